@@ -12,6 +12,14 @@
 #include <cstring>
 #include <errno.h>
 
-#define PERROR(_e) { fprintf(stderr, "[%s:%u] %s: %s\n", __FILE__, __LINE__, _e, strerror(errno)); throw errno; }
+namespace Utils {
+void log_error(char const *format, ...) __attribute__((format(printf, 1, 2)));
+}
+
+/*
+ * Report errno, to stderr or to the log function of a library caller, see
+ * Utils::log_error(), and throw it
+ */
+#define PERROR(_e) { int const _errno = errno; Utils::log_error("[%s:%u] %s: %s\n", __FILE__, __LINE__, _e, strerror(_errno)); throw _errno; }
 
 #endif /* INCLUDE_MACRO_H_ */
@@ -0,0 +1,125 @@
+/**
+ * tftrig.h
+ *
+ * C API of the heart sound classifier, libtftrig
+ *
+ * A context holds the trigger kernel and the classifier trees; it is read only
+ * after tftrig_create() and may be shared between threads. Each classification
+ * returns its own result object with the verdict and the intermediate results.
+ * The functions returning int return zero on success and an errno value on
+ * failure. The library prints nothing; tftrig_set_log() passes the progress
+ * and the errors tftrig_final prints to a function of the caller instead.
+ *
+ * Later API versions only add functions; the structs keep their layout, and
+ * the soname stays libtftrig.so.1.
+ *
+ * A multi-channel recording shares the energy signal and the events between
+ * the channels; the verdict is abnormal if any channel is abnormal. A record
+ * shorter than 3.6 s, or one whose markers fail, is TFTRIG_UNKNOWN.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INCLUDE_TFTRIG_H_
+#define INCLUDE_TFTRIG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(TFTRIG_BUILD)
+#define TFTRIG_API __attribute__((visibility("default")))
+#else
+#define TFTRIG_API
+#endif
+
+#define TFTRIG_API_VERSION 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tftrig_context tftrig_context;
+typedef struct tftrig_result tftrig_result;
+
+/* one message of progress, newline included, from the classifying thread */
+typedef void (*tftrig_log_fn)(void *arg, char const *message);
+
+struct tftrig_options {
+	char const *kernel; /* trigger convolution kernel .csv */
+	char const *params_dir; /* directory of the classifier trees, NULL for "params" */
+};
+
+enum tftrig_verdict {
+	TFTRIG_NORMAL = -3, TFTRIG_ABNORMAL = -2, TFTRIG_UNKNOWN = -1,
+};
+
+enum tftrig_event_set {
+	TFTRIG_EVENTS_TRIGGER, /* trigger events, S1 and S2 alike */
+	TFTRIG_EVENTS_CORRELATED, /* events after auto correlation */
+	TFTRIG_EVENTS_S1, /* S1 cluster, empty if not found */
+	TFTRIG_EVENTS_S2, /* S2 cluster, empty if not found */
+};
+
+struct tftrig_event {
+	size_t offset; /* samples */
+	double p; /* correlation, zero for trigger events */
+	float energy; /* nominal energy, zero for trigger events */
+};
+
+struct tftrig_marker {
+	char const *name;
+	double value;
+};
+
+struct tftrig_times {
+	double load; /* milliseconds */
+	double energy;
+	double trigger;
+	double correlate;
+	double classify;
+};
+
+TFTRIG_API int tftrig_api_version(void);
+
+TFTRIG_API int tftrig_create(tftrig_context **ctx,
+		struct tftrig_options const *options);
+TFTRIG_API void tftrig_destroy(tftrig_context *ctx);
+/* NULL to be quiet, the default; not while the context is classifying */
+TFTRIG_API void tftrig_set_log(tftrig_context *ctx, tftrig_log_fn log,
+		void *arg);
+
+/* little-endian 16 bit PCM at 2000 Hz, baseline and scale are corrected like for .wav files */
+TFTRIG_API int tftrig_classify_pcm16(tftrig_context const *ctx,
+		int16_t const *pcm, size_t len, tftrig_result **result);
+/* as above, channels recorded simultaneously; interleaved or one channel after another */
+TFTRIG_API int tftrig_classify_pcm16_channels(tftrig_context const *ctx,
+		int16_t const *pcm, size_t frames, size_t channels, int interleaved,
+		tftrig_result **result);
+/* basename.wav, or a member of a ZIP archive, eg. training-a.zip/training-a/a0001 */
+TFTRIG_API int tftrig_classify_file(tftrig_context const *ctx,
+		char const *basename, tftrig_result **result);
+TFTRIG_API void tftrig_result_free(tftrig_result *result);
+
+TFTRIG_API enum tftrig_verdict tftrig_result_verdict(
+		tftrig_result const *result);
+TFTRIG_API int tftrig_result_answer(tftrig_result const *result);
+TFTRIG_API size_t tftrig_result_channel_verdicts(tftrig_result const *result,
+		enum tftrig_verdict *verdicts, size_t max);
+TFTRIG_API float const *tftrig_result_energy(tftrig_result const *result,
+		size_t *len);
+TFTRIG_API size_t tftrig_result_events(tftrig_result const *result,
+		enum tftrig_event_set set, struct tftrig_event const **events);
+TFTRIG_API size_t tftrig_result_markers(tftrig_result const *result,
+		struct tftrig_marker const **markers);
+/* channel of the recording a marker of tftrig_result_markers() is taken from */
+TFTRIG_API unsigned tftrig_result_marker_channel(tftrig_result const *result,
+		size_t marker);
+TFTRIG_API void tftrig_result_times(tftrig_result const *result,
+		struct tftrig_times *times);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_TFTRIG_H_ */
@@ -9,6 +9,7 @@
 #define INCLUDE_TYPES_DATA_H_
 
 #include <cstdlib>
+#include <stdint.h>
 
 #ifndef ssize_t
 typedef int64_t ssize_t;
@@ -18,8 +19,24 @@ typedef int64_t ssize_t;
 typedef float cl_float;
 #endif
 
+/*
+ * Sample type of the processing pipeline. Selected at build time, see
+ * PRECISION in Makefile. Double by default, float halves the memory traffic
+ * of every stage after the ingest.
+ *
+ * The fixed point mode keeps the samples as int16 in Q12.3 format, ie. one
+ * unit of the floating point pipeline is 1 << DATA_RAW_T_Q counts.
+ */
+#if defined(DATA_RAW_T_FIXED)
+typedef int16_t data_raw_t;
+#define DATA_RAW_T_Q 3
+#elif defined(DATA_RAW_T_FLOAT)
+typedef float data_raw_t;
+#define DATA_RAW_T_Q 0
+#else
 typedef double data_raw_t;
-//typedef int16_t data_raw_t;
+#define DATA_RAW_T_Q 0
+#endif
 
 struct data_channel {
 	data_raw_t *raw;
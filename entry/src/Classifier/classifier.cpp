@@ -32,14 +32,20 @@
 #include <limits.h>
 #include <math.h>
 #include <float.h>
+#include <string>
+#include <vector>
 
 #include "markers.h"
 #include "../utils/memory_manager.h"
+#include "../utils/AssetCache.h"
+#include "../utils/log.h"
 #include "classifier.h"
 //#define VERBOSE 1
 
 namespace Classifier {
 
+static uint32_t constexpr string_tree_version = 1; // of the cached tree
+
 __attribute_used__ int free_string_tree(struct string_tree *tree) {
 	mm_free(tree->nodes);
 	tree->nodes = NULL;
@@ -47,92 +53,141 @@ __attribute_used__ int free_string_tree(struct string_tree *tree) {
 	return (0);
 }
 
-__attribute_used__ int save_string_tree(char const *filename,
-		struct string_tree const *tree) {
-	FILE *fp = fopen(filename, "w");
-	fwrite(tree, sizeof(struct string_tree), 1, fp);
-	fwrite(tree->nodes, sizeof(struct string_node), tree->n_nodes, fp);
-	fclose(fp);
-	return (0);
-}
-
-__attribute_used__ int load_string_tree(char const *filename,
+/**
+ * Load a marker tree from its text file
+ *
+ * The parsed tree is a cached asset keyed by the text, see Utils::get_asset().
+ *
+ * @param Tree filename
+ * @param Pointer to output tree, free with free_string_tree()
+ * @return Zero on success
+ */
+__attribute_used__ int load_txt_string_tree(char const *filename,
 		struct string_tree *tree) {
-	FILE *fp = fopen(filename, "r");
-	if (fp == NULL) {
-		printf("Oops, cannot open the treefile %s\n", filename);
+	std::string txt;
+	try {
+		Utils::read_source(filename, &txt);
+	} catch (int e) {
+		Utils::log_printf("Oops, cannot open the treefile %s\n", filename);
 		return (-1);
 	}
-	fread(tree, sizeof(struct string_tree), 1, fp);
-	tree->nodes = static_cast<struct string_node *>(mm_malloc(
-			tree->n_nodes * sizeof(struct string_node)));
-	if (fread(tree->nodes, sizeof(struct string_node), tree->n_nodes, fp)
-			!= tree->n_nodes) {
-		printf("Oops, treefile %s is corrupted\n", filename);
+
+	struct Utils::asset const *a = Utils::get_asset("Classifier.tree",
+			string_tree_version, txt, [&txt, filename](std::string *payload) {
+				// n_classes and n_nodes, then the nodes
+				FILE *fp = txt.size() ?
+						fmemopen(const_cast<char *>(txt.data()), txt.size(), "r") :
+						NULL;
+				int n[2] = { 0, 0 };
+				if (fp == NULL || fscanf(fp, "%d\t%d\n", &n[1], &n[0]) < 2
+						|| n[1] < 0) {
+					Utils::log_printf(
+							"Oops, treefile %s is corrupted\n", filename);
+					if (fp) {
+						fclose(fp);
+					}
+					return (-1);
+				}
+				std::vector<struct string_node> nodes(n[1]);
+				for (size_t i = 0; i < nodes.size(); i++) {
+					if (fscanf(fp, "%s\t%lf\t%d\t%d\t%d\n", nodes[i].marker_name,
+							&(nodes[i].split_value), &(nodes[i].up),
+							&(nodes[i].left), &(nodes[i].right)) < 5) {
+						Utils::log_printf(
+								"Oops, treefile %s is corrupted in line %lu\n",
+								filename, i + 1);
+						fclose(fp);
+						return (-1);
+					}
+				}
+				fclose(fp);
+				payload->assign(reinterpret_cast<char const *>(n), sizeof(n));
+				payload->append(reinterpret_cast<char const *>(nodes.data()),
+						nodes.size() * sizeof(struct string_node));
+				return (0);
+			});
+	if (a == NULL) {
 		return (-1);
 	}
-	fclose(fp);
+
+	int n[2];
+	memcpy(n, a->data, sizeof(n));
+	tree->n_classes = n[0];
+	tree->n_nodes = n[1];
+	tree->nodes = static_cast<struct string_node *>(mm_malloc(
+			tree->n_nodes * sizeof(struct string_node)));
+	memcpy(tree->nodes, static_cast<char const *>(a->data) + sizeof(n),
+			tree->n_nodes * sizeof(struct string_node));
 	return (0);
 }
 
-__attribute_used__ int load_txt_string_tree(char const *filename,
-		struct string_tree *tree) {
-	struct stat sb;
-	if (stat(filename, &sb)) {
-		printf("Oops, cannot open the treefile %s\n", filename);
+/**
+ * Compile a marker tree for evaluation
+ *
+ * The marker names are parsed and their band-pass filters designed once,
+ * see Markers::compile_marker(), and the nodes laid out in a flat array.
+ * A marker that cannot be evaluated only fails the paths through it, as
+ * when the names were parsed on the walk.
+ *
+ * @param Pointer to marker tree, see load_txt_string_tree()
+ * @param Sample frequency of the records
+ * @param Pointer to output plan, free with free_marker_plan()
+ * @return Zero on success
+ */
+__attribute_used__ int compile_tree(struct string_tree const *tree,
+		double const &sample_freq, struct marker_plan *plan) {
+	memset(plan, 0, sizeof(*plan));
+	if (tree->n_nodes <= 0) {
+		Utils::log_printf("Oops, tree has no nodes\n");
 		return (-1);
 	}
-
-	char cachefile[FILENAME_MAX];
-	sprintf(cachefile, "/tmp/Classifier.tree.%lu.dat", sb.st_ino);
-	if (stat(cachefile, &sb) == 0) {
-		return load_string_tree(cachefile, tree);
+	for (int i = 0; i < tree->n_nodes; i++) {
+		struct string_node const &n = tree->nodes[i];
+		if (n.left >= tree->n_nodes || n.right >= tree->n_nodes) {
+			Utils::log_printf("Oops, tree node %d has no child node %d\n", i,
+					n.left >= tree->n_nodes ? n.left : n.right);
+			return (-1);
+		}
 	}
 
-	FILE *fp = fopen(filename, "r");
-	size_t i;
-	if (fp == NULL) {
-		printf("Oops, cannot open the treefile %s\n", filename);
+	size_t const n_nodes = static_cast<size_t>(tree->n_nodes);
+	plan->nodes = static_cast<struct plan_node *>(mm_malloc(
+			n_nodes * sizeof(struct plan_node)));
+	plan->names = static_cast<char (*)[MAX_MARKERNAME_LEN]>(mm_malloc(
+			n_nodes * MAX_MARKERNAME_LEN));
+	if (plan->nodes == NULL || plan->names == NULL) {
+		if (plan->nodes) {
+			mm_free(plan->nodes);
+		}
+		if (plan->names) {
+			mm_free(plan->names);
+		}
+		memset(plan, 0, sizeof(*plan));
 		return (-1);
 	}
-	fscanf(fp, "%d\t%d\n", &(tree->n_nodes), &(tree->n_classes));
-	tree->nodes = static_cast<struct string_node *>(mm_malloc(
-			tree->n_nodes * sizeof(struct string_node)));
-	for (i = 0; i < tree->n_nodes; i++) {
-		if (fscanf(fp, "%s\t%lf\t%d\t%d\t%d\n", tree->nodes[i].marker_name,
-				&(tree->nodes[i].split_value), &(tree->nodes[i].up),
-				&(tree->nodes[i].left), &(tree->nodes[i].right)) < 5) {
-			printf("Oops, treefile %s is corrupted in line %lu\n", filename,
-					i + 1);
-			return (-1);
-		}
+	plan->sample_freq = sample_freq;
+	plan->n_classes = tree->n_classes;
+	for (int i = 0; i < tree->n_nodes; i++) {
+		struct string_node const &n = tree->nodes[i];
+		struct plan_node *p = &plan->nodes[i];
+		memcpy(plan->names[i], n.marker_name, MAX_MARKERNAME_LEN);
+		Markers::compile_marker(n.marker_name, sample_freq, &p->marker);
+		p->split_value = n.split_value;
+		p->left = n.left;
+		p->right = n.right;
+		plan->n_nodes = i + 1;
 	}
-	fclose(fp);
-
-	save_string_tree(cachefile, tree);
-
 	return (0);
 }
 
-__attribute_used__ int do_with_strings(struct data *data,
-		Simplified::retrig_ev const *ev1, Simplified::retrig_ev const *ev2,
-		struct string_tree *tree, int this_node) {
-	double marker_value;
-	int next_node;
-	if (Markers::create_named(tree->nodes[this_node].marker_name, data, ev1,
-			ev2, &marker_value) < 0) { // error
-		return (-tree->n_classes); // return CLASSIFIER_UNKNOWN
-	}
-	if (tree->nodes[this_node].split_value >= marker_value) { // go left?
-		next_node = tree->nodes[this_node].left;
-	} else { // go right
-		next_node = tree->nodes[this_node].right;
-	}
-	if (next_node > 0) { // continue to next node?
-		return (do_with_strings(data, ev1, ev2, tree, next_node));
-	} else { // we found the leaf
-		return (next_node); // the actual return value is coded (multipled with -1) to the negative node values
+__attribute_used__ int free_marker_plan(struct marker_plan *plan) {
+	for (int i = 0; i < plan->n_nodes; i++) {
+		Markers::free_marker(&plan->nodes[i].marker);
 	}
+	mm_free(plan->nodes);
+	mm_free(plan->names);
+	memset(plan, 0, sizeof(*plan));
+	return (0);
 }
 
 /**
@@ -149,10 +204,91 @@ enum result_e classify_this(struct data *data, Simplified::retrig_ev const *ev1,
 	struct string_tree tree = { };
 
 	load_txt_string_tree(tree_name, &tree);
-	enum result_e result = static_cast<enum result_e>(do_with_strings(data, ev1,
-			ev2, &tree, 0));
+	enum result_e result = classify_this(data, ev1, ev2, &tree);
 	free_string_tree(&tree);
 	return (result);
 }
 
+/**
+ * A dynamically created tree classifier with a preloaded tree
+ *
+ * The tree is compiled for this classification only, see compile_tree().
+ *
+ * @param Pointer to ECG legacy data structure
+ * @param Pointer to mandatory first event cluster
+ * @param Pointer to optional second event cluster
+ * @param Pointer to marker tree, see load_txt_string_tree()
+ * @param Optional pointer to output the markers on the decision path
+ * @param Channel of the data to classify
+ * @return Classifier result; normal, abnormal or unknown
+ */
+enum result_e classify_this(struct data *data, Simplified::retrig_ev const *ev1,
+		Simplified::retrig_ev const *ev2, struct string_tree const *tree,
+		marker_trace *trace, size_t const &channel) {
+	struct marker_plan plan;
+	if (tree->nodes == NULL || compile_tree(tree, data->sample_freq, &plan)) {
+		return (unknown);
+	}
+	enum result_e result = classify_this(data, ev1, ev2, &plan, trace,
+			channel);
+	free_marker_plan(&plan);
+	return (result);
+}
+
+/**
+ * A dynamically created tree classifier with a compiled tree
+ *
+ * The plan is only read, so it can be shared between threads. The channels
+ * of a record can share a marker context, see Markers::init_marker_context(),
+ * to reuse the intermediates of the markers.
+ *
+ * @param Pointer to ECG legacy data structure
+ * @param Pointer to mandatory first event cluster
+ * @param Pointer to optional second event cluster
+ * @param Pointer to compiled tree, see compile_tree()
+ * @param Optional pointer to output the markers on the decision path
+ * @param Channel of the data to classify
+ * @param Optional pointer to the marker context of the data and the events
+ * @return Classifier result; normal, abnormal or unknown
+ */
+enum result_e classify_this(struct data *data, Simplified::retrig_ev const *ev1,
+		Simplified::retrig_ev const *ev2, struct marker_plan const *plan,
+		marker_trace *trace, size_t const &channel,
+		struct Markers::marker_context *context) {
+	if (plan->n_nodes == 0) {
+		return (unknown);
+	}
+	struct Markers::marker_context local;
+	if (context == NULL) {
+		Markers::init_marker_context(&local, data, ev1, ev2);
+		context = &local;
+	}
+	for (int this_node = 0;;) {
+		struct plan_node const &node = plan->nodes[this_node];
+		double marker_value;
+		if (Markers::evaluate_marker(node.marker, plan->names[this_node],
+				plan->sample_freq, context, &marker_value, channel) < 0) { // error
+			return (unknown); // -n_classes is a class of the tree, not unknown
+		}
+		if (trace) {
+			struct marker_value m;
+			memcpy(m.marker_name, plan->names[this_node],
+					sizeof(m.marker_name));
+			m.value = marker_value;
+			m.channel = channel;
+			trace->push_back(m);
+		}
+#ifdef VERBOSE
+		Utils::log_printf("marker %s: %f (split %f)\n", plan->names[this_node],
+				marker_value, node.split_value);
+#endif
+		int const next_node =
+				node.split_value >= marker_value ? node.left : node.right; // go left?
+		if (next_node <= 0) { // we found the leaf
+			return (static_cast<enum result_e>(next_node)); // the actual return value is coded (multipled with -1) to the negative node values
+		}
+		this_node = next_node;
+	}
+}
+
 } // namespace Classifier
@@ -9,6 +9,7 @@
 #define CLASSIFIER_H_
 
 #include "../Simplified/Retrigger.h"
+#include "markers.h"
 
 namespace Classifier {
 
@@ -27,12 +28,56 @@ struct string_tree {
 	int n_nodes;
 };
 
+/*
+ * A node of a compiled tree. The marker is evaluated, its value compared to
+ * the split and the walk goes on to the left or the right child; a child
+ * that is not positive is a leaf, the negated class.
+ */
+struct plan_node {
+	struct Markers::marker_desc marker;
+	double split_value;
+	int left;
+	int right;
+};
+
+/*
+ * A marker tree compiled for evaluation, see compile_tree()
+ */
+struct marker_plan {
+	struct plan_node *nodes; // flat, in the order of the tree file
+	char (*names)[MAX_MARKERNAME_LEN]; // of the markers, for the messages and the trace
+	double sample_freq; // the filters are designed for
+	int n_classes;
+	int n_nodes;
+};
+
+struct marker_value {
+	char marker_name[MAX_MARKERNAME_LEN];
+	double value;
+	size_t channel;
+};
+
+typedef std::vector<struct marker_value> marker_trace;
+
 enum result_e {
 	normal = -3, abnormal = -2, unknown = -1,
 };
 
+int load_txt_string_tree(char const *filename, struct string_tree *tree);
+int free_string_tree(struct string_tree *tree);
+int compile_tree(struct string_tree const *tree, double const &sample_freq,
+		struct marker_plan *plan);
+int free_marker_plan(struct marker_plan *plan);
+
 enum result_e classify_this(struct data *data, Simplified::retrig_ev const *ev1,
 		Simplified::retrig_ev const *ev2, char const *tree_name);
+enum result_e classify_this(struct data *data, Simplified::retrig_ev const *ev1,
+		Simplified::retrig_ev const *ev2, struct string_tree const *tree,
+		marker_trace *trace = 0, size_t const &channel = 0);
+enum result_e classify_this(struct data *data, Simplified::retrig_ev const *ev1,
+		Simplified::retrig_ev const *ev2, struct marker_plan const *plan,
+		marker_trace *trace = 0, size_t const &channel = 0,
+		struct Markers::marker_context *context = 0);
 
 } // namespace Classifier
 
@@ -30,8 +30,11 @@
 #include <limits.h>
 #include <math.h>
 #include <float.h>
+#include <atomic>
+#include <algorithm>
 
 #include "../utils/memory_manager.h"
+#include "../utils/log.h"
 #include "../myDSP/Iir.h"
 #include "markers.h"
 #include "classifier.h"
@@ -52,12 +55,51 @@ static double constexpr conf_default_rr = 0.800;
 static double constexpr conf_default_s1s2_dur = 0.400;
 static double constexpr conf_win_len = 3.0;
 static double constexpr conf_ignore_from_start = 1.0;
+static double constexpr conf_settle_tolerance = 1e-7; // of the sparse bands
 
-struct double_array {
-	double *data;
+/*
+ * Sample arrays are templated by their sample type, so the marker routines
+ * follow the pipeline precision (data_raw_t) without conversion copies.
+ * Per event statistics are always kept in double.
+ */
+template<typename T>
+struct sample_array {
+	T *data;
 	size_t len;
+	size_t capacity; // of data, reused by the next marker
 };
 
+typedef struct sample_array<double> double_array;
+typedef struct sample_array<data_raw_t> raw_array;
+
+/*
+ * In the fixed point mode samples are Q12.3 int16 and the moving std is kept
+ * in int32 with MOVING_STD_Q more fraction bits. sample_unit() scales the
+ * values back to the units of the floating point pipeline.
+ */
+#define MOVING_STD_Q 8
+
+#ifdef DATA_RAW_T_FIXED
+typedef int32_t moving_std_t;
+#else
+typedef data_raw_t moving_std_t;
+#endif
+
+template<typename T>
+static inline double sample_unit() {
+	return 1.0;
+}
+
+template<>
+inline double sample_unit<int16_t>() {
+	return 1.0 / (1 << DATA_RAW_T_Q);
+}
+
+template<>
+inline double sample_unit<int32_t>() {
+	return 1.0 / (1 << (DATA_RAW_T_Q + MOVING_STD_Q));
+}
+
 struct markers_s1s2 {
 	double s1;
 	double s2;
@@ -76,21 +118,97 @@ struct markers_s {
 	double ss_minmax;
 };
 
-static inline void set_double_array_len(struct double_array *data, int len,
-		int uninitialized) {
-	if (uninitialized) {
-		data->data =
-				static_cast<double *>(mm_malloc(data->len * sizeof(double)));
-	} else if (data->len < len) {
-		data->data = static_cast<double *>(mm_realloc(data->data,
-				len * sizeof(double)));
+template<typename T>
+static inline void set_array_len(struct sample_array<T> *data, size_t len) {
+	if (data->capacity < len) {
+		data->data = static_cast<T *>(mm_realloc(data->data, len * sizeof(T)));
+		data->capacity = len;
 	}
 	data->len = len;
 }
 
+template<typename T>
+static inline void free_array(struct sample_array<T> *data) {
+	mm_free(data->data);
+	data->data = NULL;
+	data->len = data->capacity = 0;
+}
+
+/*
+ * Identity of a signal in the working memory, see struct marker_scratch
+ */
+struct signal_key {
+	uint64_t context; // id of the marker context, zero for none
+	size_t channel;
+	double freq1; // band, both zero for the raw signal
+	double freq2;
+};
+
+static inline bool is_same_signal(struct signal_key const &a,
+		struct signal_key const &b) {
+	return (a.context != 0 && a.context == b.context && a.channel == b.channel
+			&& a.freq1 == b.freq1 && a.freq2 == b.freq2);
+}
+
+/*
+ * Samples [start, end) of a signal
+ */
+struct span {
+	size_t start;
+	size_t end;
+};
+
+typedef struct sample_array<struct span> span_array;
+
+/*
+ * Working memory of the markers of a thread. It only grows, so evaluating
+ * the markers of a record does not allocate once the first record of that
+ * length is done. The filtered signal and the moving std are kept with the
+ * signal they are of, so the next marker of the same record can reuse them.
+ */
+struct marker_scratch {
+	raw_array filtered;
+	struct signal_key filtered_key;
+	span_array covered; // spans of the filtered signal filtered so far
+	span_array spans; // temporaries of filter_band()
+	span_array missing;
+	raw_array segment;
+	struct sample_array<float> filter; // temporary of the band-pass
+	struct sample_array<moving_std_t> std;
+	struct signal_key std_key; // of the signal the std is of
+	double_array tmp;
+	double_array min;
+	double_array max;
+	double_array minmax;
+	double_array dur; // rr and s1s2 durations
+
+	~marker_scratch() {
+		free_array(&filtered);
+		free_array(&covered);
+		free_array(&spans);
+		free_array(&missing);
+		free_array(&segment);
+		free_array(&filter);
+		free_array(&std);
+		free_array(&tmp);
+		free_array(&min);
+		free_array(&max);
+		free_array(&minmax);
+		free_array(&dur);
+	}
+};
+
+static thread_local struct marker_scratch scratch;
+
+static std::atomic<uint64_t> marker_contexts(0); // ids given
+static std::atomic<bool> sparse_bands(true); // see filter_band()
+
 static double get_kth_biggest(double a[], size_t n, size_t k) {
 	long int i, j, l, m;
 	double x, tmp;
+	if (n == 0) {
+		return (NAN); // no values, eg. no windows in a very short signal
+	}
 	l = 0;
 	m = n - 1;
 	while (l < m) {
@@ -116,20 +234,29 @@ static double get_kth_biggest(double a[], size_t n, size_t k) {
 	return a[k];
 }
 
-static double get_std(struct double_array *data, size_t start, int std_len) {
+/**
+ * Std of a window
+ *
+ * The samples are taken from the first one of the window, so an offset of
+ * the signal does not cancel the precision of the power.
+ */
+template<typename T>
+static double get_std(struct sample_array<T> *data, size_t start, int std_len) {
 	double power = 0.0;
 	double ave = 0.0;
 	size_t i;
 	if (start + std_len > data->len) {
 		std_len = data->len - start;
 		if (std_len < 3) {
-			printf("Oops, too little data for std\n");
+			Utils::log_printf("Oops, too little data for std\n");
 			return (-1.0);
 		}
 	}
+	double const offset = data->data[start];
 	for (i = start; i < start + std_len; i++) {
-		power += POW2(data->data[i]);
-		ave += data->data[i];
+		double const x = data->data[i] - offset;
+		power += POW2(x);
+		ave += x;
 	}
 	ave /= (double) (std_len);
 	power = power / (double) (std_len) - POW2(ave);
@@ -139,57 +266,227 @@ static double get_std(struct double_array *data, size_t start, int std_len) {
 	return (0.0);
 }
 
-static int define_moving_std(struct double_array *data,
-		struct double_array *std, int std_len) {
+#ifdef DATA_RAW_T_FIXED
+/**
+ * Integer square root
+ *
+ * @param Value
+ * @return floor(sqrt(value))
+ */
+static inline uint64_t isqrt(uint64_t v) {
+	uint64_t r = 0, b = 1ULL << 62;
+	while (b > v) {
+		b >>= 2;
+	}
+	while (b) {
+		if (v >= r + b) {
+			v -= r + b;
+			r = (r >> 1) + b;
+		} else {
+			r >>= 1;
+		}
+		b >>= 2;
+	}
+	return r;
+}
+
+/**
+ * Fixed point std of a window. Exact integer sums, no cancellation.
+ */
+static double get_std(struct sample_array<int16_t> *data, size_t start,
+		int std_len) {
+	int64_t power = 0;
+	int64_t ave = 0;
 	size_t i;
-	double sum, sum2;
-	double ave;
-	double inv_win_len = 1.0 / (double) (std_len);
+	if (start + std_len > data->len) {
+		std_len = data->len - start;
+		if (std_len < 3) {
+			Utils::log_printf("Oops, too little data for std\n");
+			return (-1.0);
+		}
+	}
+	for (i = start; i < start + std_len; i++) {
+		power += static_cast<int32_t>(data->data[i]) * data->data[i];
+		ave += data->data[i];
+	}
+	power = std_len * power - ave * ave; // = std_len^2 * variance
+	if (power > 0) {
+		return (sqrt(static_cast<double>(power)) / std_len
+				* sample_unit<int16_t>());
+	}
+	return (0.0);
+}
+
+/**
+ * Fixed point moving std
+ *
+ * Running int64 sums of x and x^2, integer square root. Window edges are
+ * handled as in the floating point version.
+ */
+static int define_moving_std(struct sample_array<int16_t> *data,
+		struct sample_array<int32_t> *std, int std_len) {
+	size_t i;
+	int64_t sum = 0, sum2 = 0;
 	int half_win = std_len / 2;
 
-	set_double_array_len(std, data->len, 0);
-	memset(std->data, 0, std->len * sizeof(double));
+	set_array_len(std, data->len);
+	memset(std->data, 0, std->len * sizeof(int32_t));
 
-	sum = sum2 = 0.0;
-	for (i = 0; i < std_len; i++) {
+#define FIXED_MOVING_STD(_n) { \
+		int64_t const n = (_n); \
+		uint64_t const v = n * sum2 - sum * sum; \
+		std->data[i - half_win] = (isqrt(v << (2 * MOVING_STD_Q)) + n / 2) / n; \
+	}
+
+	for (i = 0; i < static_cast<size_t>(std_len); i++) {
 		sum += data->data[i];
-		sum2 += POW2(data->data[i]);
-		ave = sum / (double) (i + 1);
-		if (i >= half_win) {
-			std->data[i - half_win] = sum2 / (double) (i + 1) - POW2(ave);
-			if (std->data[i - half_win] > 0.0) {
-				std->data[i - half_win] = sqrt(std->data[i - half_win]);
-			}
+		sum2 += static_cast<int32_t>(data->data[i]) * data->data[i];
+		if (i >= static_cast<size_t>(half_win)) {
+			FIXED_MOVING_STD(i + 1)
 		}
 	}
 	for (; i < data->len; i++) {
-		sum += data->data[i] - data->data[i - std_len];
-		sum2 += POW2(data->data[i]) - POW2(data->data[i - std_len]);
-		ave = sum * inv_win_len;
-		std->data[i - half_win] = sum2 * inv_win_len - POW2(ave);
-		if (std->data[i - half_win] > 0.0) {
-			std->data[i - half_win] = sqrt(std->data[i - half_win]);
-		}
+		int32_t const _in = data->data[i], _out = data->data[i - std_len];
+		sum += _in - _out;
+		sum2 += _in * _in - _out * _out;
+		FIXED_MOVING_STD(std_len)
 	}
 	for (; i < data->len + half_win; i++) {
-		sum -= data->data[i - std_len];
-		sum2 -= POW2(data->data[i - std_len]);
-		ave = sum / (double) (std_len - (i - data->len));
-		std->data[i - half_win] = sum2
-				/ (double) (std_len - (i - data->len))-POW2(ave);
-		if (std->data[i - half_win] > 0.0) {
-			std->data[i - half_win] = sqrt(std->data[i - half_win]);
+		int32_t const _out = data->data[i - std_len];
+		sum -= _out;
+		sum2 -= _out * _out;
+		FIXED_MOVING_STD(std_len - (i - data->len))
+	}
+#undef FIXED_MOVING_STD
+	return (0);
+}
+#endif
+
+/**
+ * Add to a running sum and its compensation
+ *
+ * The rounding error of each addition is exact (Knuth's two-sum) and kept
+ * in the compensation, so a sum of a long signal does not drift.
+ */
+static inline void add_compensated(double *sum, double *c, double const &x) {
+	double const t = *sum + x;
+	double const z = t - *sum;
+	*c += (*sum - (t - z)) + (x - z);
+	*sum = t;
+}
+
+/**
+ * Moving std of a window centered on each sample
+ *
+ * The windows are cut short at the ends of the signal. The windows at the
+ * end are divided by one sample more than they hold, as when the classifier
+ * trees were trained.
+ *
+ * The samples are taken from the mean of the signal and the running sums
+ * are compensated, so neither an offset of the signal nor the length of the
+ * record cancel the precision of the power; only the rounding differs from
+ * the plain running sums.
+ *
+ * @param Pointer to the signal
+ * @param Pointer to output std
+ * @param Window length in samples
+ * @return Zero on success
+ */
+template<typename T, typename S>
+static int define_moving_std(struct sample_array<T> *data,
+		struct sample_array<S> *std, int std_len) {
+	size_t i;
+	double sum = 0.0, sum_c = 0.0, sum2 = 0.0, sum2_c = 0.0;
+	double offset = 0.0;
+	double inv_win_len = 1.0 / (double) (std_len);
+	int half_win = std_len / 2;
+
+	set_array_len(std, data->len);
+	memset(std->data, 0, std->len * sizeof(S));
+
+	for (i = 0; i < data->len; i++) {
+		offset += data->data[i];
+	}
+	if (data->len) {
+		offset /= data->len;
+	}
+
+#define MOVING_STD(_ave, _power) { \
+		double const ave = (_ave); \
+		std->data[i - half_win] = (_power) - POW2(ave); \
+		if (std->data[i - half_win] > 0.0) { \
+			std->data[i - half_win] = sqrt(std->data[i - half_win]); \
+		} \
+	}
+
+	for (i = 0; i < static_cast<size_t>(std_len); i++) {
+		double const x = data->data[i] - offset;
+		add_compensated(&sum, &sum_c, x);
+		add_compensated(&sum2, &sum2_c, POW2(x));
+		if (i >= static_cast<size_t>(half_win)) {
+			MOVING_STD((sum + sum_c) / (double) (i + 1),
+					(sum2 + sum2_c) / (double) (i + 1))
 		}
 	}
+	for (; i < data->len; i++) {
+		double const x = data->data[i] - offset;
+		double const y = data->data[i - std_len] - offset;
+		add_compensated(&sum, &sum_c, x);
+		add_compensated(&sum, &sum_c, -y);
+		add_compensated(&sum2, &sum2_c, POW2(x));
+		add_compensated(&sum2, &sum2_c, -POW2(y));
+		MOVING_STD((sum + sum_c) * inv_win_len, (sum2 + sum2_c) * inv_win_len)
+	}
+	for (; i < data->len + half_win; i++) {
+		double const y = data->data[i - std_len] - offset;
+		add_compensated(&sum, &sum_c, -y);
+		add_compensated(&sum2, &sum2_c, -POW2(y));
+		MOVING_STD((sum + sum_c) / (double) (std_len - (i - data->len)),
+				(sum2 + sum2_c) / (double) (std_len - (i - data->len)))
+	}
+#undef MOVING_STD
 	return (0);
 }
 
-static int get_events_stds(struct double_array *data,
+/**
+ * Extremes of a window of a signal
+ *
+ * @param Pointer to the signal
+ * @param First sample of the window
+ * @param End of the window, past its last sample
+ * @param Pointer to output min
+ * @param Pointer to output max
+ */
+template<typename T>
+static inline void get_window_extremes(struct sample_array<T> const *data,
+		size_t const &start, size_t const &end, T *min, T *max) {
+	*min = *max = data->data[start];
+	for (size_t i = start + 1; i < end; i++) {
+		if (*min > data->data[i]) {
+			*min = data->data[i];
+		} else if (*max < data->data[i]) {
+			*max = data->data[i];
+		}
+	}
+}
+
+/**
+ * Stds of a window around each event
+ *
+ * @param Pointer to the signal
+ * @param Events
+ * @param Start of the window from the event
+ * @param End of the window from the event
+ * @param Pointer to output stds
+ * @return Zero on success
+ */
+static int get_events_stds(raw_array *data,
 		Simplified::retrig_ev const *events, int win_start, int win_end,
-		struct double_array *std) {
+		double_array *std) {
 	ssize_t j, n, start, end;
+	ssize_t const len = data->len;
 
-	set_double_array_len(std, events->size(), 0);
+	set_array_len(std, events->size());
 
 	for (n = 0, j = 0; j < events->size(); j++) {
 		start = (*events)[j].offset + win_start;
@@ -197,25 +494,26 @@ static int get_events_stds(struct double_array *data,
 			continue;
 		}
 		end = (*events)[j].offset + win_end;
-		if (end > data->len) {
+		if (end > len) {
 			continue;
 		}
 		std->data[n++] = get_std(data, start, end - start);
 	}
 	std->len = n;
 	if (n == 0) {
-		printf(
+		Utils::log_printf(
 				"ERROR_std: there is data with no events far enough from data bounders\n Please remove it from the list!");
 	}
 	return (0);
 }
 
-static int get_events_absmax(struct double_array *data,
+template<typename T>
+static int get_events_absmax(struct sample_array<T> *data,
 		Simplified::retrig_ev const *events, int win_start, int win_end,
-		struct double_array *absmax) {
+		double_array *absmax) {
 	ssize_t i, j, n, start, end;
 
-	set_double_array_len(absmax, events->size(), 0);
+	set_array_len(absmax, events->size());
 
 	for (n = 0, j = 0; j < events->size(); j++) {
 		start = (*events)[j].offset + win_start;
@@ -232,23 +530,26 @@ static int get_events_absmax(struct double_array *data,
 				absmax->data[n] = fabs(data->data[i]);
 			}
 		}
+		absmax->data[n] *= sample_unit<T>();
 		n++;
 	}
 	absmax->len = n;
 	if (n == 0) {
-		printf(
+		Utils::log_printf(
 				"ERROR_extreme: there is data with no events far enough from data bounders\n Please remove it from the list!");
 	}
 	return (0);
 }
 
-static int get_events_width(struct double_array *data,
+template<typename T>
+static int get_events_width(struct sample_array<T> *data,
 		Simplified::retrig_ev const *events, int win_start, int win_end,
-		double limit, struct double_array *width, double freq) {
+		double limit, double_array *width, double freq) {
 	ssize_t j, n, start, end;
 	size_t event_start, event_end;
 
-	set_double_array_len(width, events->size(), 0);
+	set_array_len(width, events->size());
+	limit /= sample_unit<T>();
 
 	for (n = 0, j = 0; j < events->size(); j++) {
 		start = (*events)[j].offset + win_start;
@@ -272,21 +573,23 @@ static int get_events_width(struct double_array *data,
 	}
 	width->len = n;
 	if (n == 0) {
-		printf(
+		Utils::log_printf(
 				"ERROR_extreme: there is data with no events far enough from data bounders\n Please remove it from the list!");
 	}
 	return (0);
 }
 
-static int get_events_extreme_values(struct double_array *data,
+template<typename T>
+static int get_events_extreme_values(struct sample_array<T> *data,
 		Simplified::retrig_ev const *events, int win_start, int win_end,
-		struct double_array *min, struct double_array *max,
-		struct double_array *min_max) {
-	ssize_t i, j, n, start, end;
+		double_array *min, double_array *max,
+		double_array *min_max) {
+	ssize_t j, n, start, end;
+	T window_min, window_max;
 
-	set_double_array_len(min, events->size(), 0);
-	set_double_array_len(max, events->size(), 0);
-	set_double_array_len(min_max, events->size(), 0);
+	set_array_len(min, events->size());
+	set_array_len(max, events->size());
+	set_array_len(min_max, events->size());
 
 	for (n = 0, j = 0; j < events->size(); j++) {
 		start = (*events)[j].offset + win_start;
@@ -297,14 +600,9 @@ static int get_events_extreme_values(struct double_array *data,
 		if (end > data->len) {
 			continue;
 		}
-		min->data[n] = max->data[n] = data->data[start];
-		for (i = start + 1; i < end; i++) {
-			if (min->data[n] > data->data[i]) {
-				min->data[n] = data->data[i];
-			} else if (max->data[n] < data->data[i]) {
-				max->data[n] = data->data[i];
-			}
-		}
+		get_window_extremes(data, start, end, &window_min, &window_max);
+		min->data[n] = window_min * sample_unit<T>();
+		max->data[n] = window_max * sample_unit<T>();
 		min_max->data[n] = max->data[n] - min->data[n];
 		n++;
 	}
@@ -312,7 +610,7 @@ static int get_events_extreme_values(struct double_array *data,
 	max->len = n;
 	min_max->len = n;
 	if (n == 0) {
-		printf(
+		Utils::log_printf(
 				"ERROR_extreme: there is data with no events far enough from data bounders\n Please remove it from the list!");
 	}
 	return (0);
@@ -377,26 +675,26 @@ int is_data_saturated(struct data *data, size_t *tot_n_saturated,
 			data->samples_per_channel));
 }
 
-static int get_repeating_extreme_values(struct double_array *data,
-		int ignore_from_start, int win_len, struct double_array *min,
-		struct double_array *max, struct double_array *min_max) {
-	size_t n_win = (data->len - ignore_from_start) / win_len;
-	size_t i, n, start;
+template<typename T>
+static int get_repeating_extreme_values(struct sample_array<T> *data,
+		int ignore_from_start, int win_len, double_array *min,
+		double_array *max, double_array *min_max) {
+	size_t n_win =
+			data->len > static_cast<size_t>(ignore_from_start) ?
+					(data->len - ignore_from_start) / win_len : 0;
+	size_t n, start;
+	T window_min, window_max;
 
-	set_double_array_len(min, n_win, 0);
-	set_double_array_len(max, n_win, 0);
-	set_double_array_len(min_max, n_win, 0);
+	set_array_len(min, n_win);
+	set_array_len(max, n_win);
+	set_array_len(min_max, n_win);
 
 	for (n = 0; n < n_win; n++) {
 		start = ignore_from_start + n * win_len;
-		min->data[n] = max->data[n] = data->data[start];
-		for (i = start + 1; i < start + win_len; i++) {
-			if (min->data[n] > data->data[i]) {
-				min->data[n] = data->data[i];
-			} else if (max->data[n] < data->data[i]) {
-				max->data[n] = data->data[i];
-			}
-		}
+		get_window_extremes(data, start, start + win_len, &window_min,
+				&window_max);
+		min->data[n] = window_min * sample_unit<T>();
+		max->data[n] = window_max * sample_unit<T>();
 		min_max->data[n] = max->data[n] - min->data[n];
 	}
 	return (0);
@@ -418,8 +716,8 @@ static inline double define_s_rr(Simplified::retrig_ev const *events,
 	size_t max_rr = 2.2 * freq;
 	size_t i, n = 0;
 	size_t this_rr;
-	double *rr = static_cast<double *>(mm_malloc(
-			events->size() * sizeof(double)));
+	set_array_len(&scratch.dur, events->size());
+	double *rr = scratch.dur.data;
 	double median_rr = -1.0;
 	for (i = 1; i < events->size(); i++) {
 		this_rr = (*events)[i].offset - (*events)[i - 1].offset;
@@ -434,7 +732,6 @@ static inline double define_s_rr(Simplified::retrig_ev const *events,
 			median_rr = get_kth_biggest(rr, n, n / 2);
 		}
 	}
-	mm_free(rr);
 	return (median_rr / freq);
 }
 
@@ -452,14 +749,17 @@ static inline double define_s1s2_dur(Simplified::retrig_ev const *s1_events,
 	size_t max_dur = 0.600 * freq;
 	size_t i, j, n = 0;
 	size_t this_dur;
-	double *dur = static_cast<double *>(mm_malloc(
-			s1_events->size() * sizeof(double)));
+	set_array_len(&scratch.dur, s1_events->size());
+	double *dur = scratch.dur.data;
 	double median_dur = -1.0;
 	for (i = 0, j = 0; i < s1_events->size(); i++) {
 		for (;
 				j < s2_events->size()
 						&& (*s2_events)[j].offset < (*s1_events)[i].offset; j++)
 			;
+		if (j == s2_events->size()) { // no S2 after this S1, nor the next ones
+			break;
+		}
 		this_dur = (*s2_events)[j].offset - (*s1_events)[i].offset;
 		if (this_dur > min_dur && this_dur < max_dur) {
 			dur[n++] = this_dur;
@@ -472,7 +772,6 @@ static inline double define_s1s2_dur(Simplified::retrig_ev const *s1_events,
 			median_dur = get_kth_biggest(dur, n, n / 2);
 		}
 	}
-	mm_free(dur);
 	return (median_dur / freq);
 }
 
@@ -485,338 +784,837 @@ static inline double get_s1s2_dur(Simplified::retrig_ev const *s1_events,
 	return (dur);
 }
 
+/**
+ * Median RR duration of a record, see get_ss()
+ */
+static inline double get_ss(struct marker_context *context) {
+	context->stats.dur.lookups++;
+	if (isnan(context->ss_dur)) {
+		context->ss_dur = get_ss(context->ev1, context->data->sample_freq);
+	} else {
+		context->stats.dur.hits++;
+	}
+	return (context->ss_dur);
+}
+
+/**
+ * Median S1S2 duration of a record, see get_s1s2_dur()
+ */
+static inline double get_s1s2_dur(struct marker_context *context) {
+	context->stats.dur.lookups++;
+	if (isnan(context->s1s2_dur)) {
+		context->s1s2_dur = get_s1s2_dur(context->ev1, context->ev2,
+				context->data->sample_freq);
+	} else {
+		context->stats.dur.hits++;
+	}
+	return (context->s1s2_dur);
+}
+
 #define MARKERS_N_WIDTH_LEVELS 5
 
-static int get_named_value(char const *where, char const *how, struct double_array *ddata,
-		double sfreq, Simplified::retrig_ev const *s1_events,
-		Simplified::retrig_ev const *s2_events, double *marker_value) {
-	static struct double_array tmp_array = { }; // set as static, so it doesn't have to be realloced again every time (TODO free).
-	static struct double_array std_array = { }; // set as static, so it doesn't have to be realloced again every time (TODO free).
-	static struct double_array min = { }; // set as static, so it doesn't have to be realloced again every time (TODO free).
-	static struct double_array max = { }; // set as static, so it doesn't have to be realloced again every time (TODO free).
-	static struct double_array minmax = { }; // set as static, so it doesn't have to be realloced again every time (TODO free).
+static char const *const marker_what_names[] = { "abs", "rel", "corr",
+		"relcorr", "norm", "dur", "width" };
+static char const *const marker_where_names[] = { "s1", "s2", "s", "s1s2",
+		"s2s1", "ss", "base", "q1", "q2", "q3", "q5", "q6", "untrigged" };
+static char const *const marker_how_names[] = { "all", "min", "max",
+		"minmax" };
+
+/**
+ * Index of a name part in its table
+ *
+ * @param Table
+ * @param Name part
+ * @return Index, or the size of the table if not found
+ */
+template<size_t N>
+static int find_part(char const *const (&names)[N], char const *part) {
+	size_t i;
+	for (i = 0; i < N; i++) {
+		if (!strcmp(names[i], part)) {
+			break;
+		}
+	}
+	return (i);
+}
+
+/**
+ * Can a value be taken from the where with the how, see get_value()
+ */
+static inline bool is_value(enum marker_where_e const where,
+		enum marker_how_e const how) {
+	if (how == MARKER_ALL) { // std around the events
+		return (where <= MARKER_Q6);
+	}
+	// median of the extremes of the moving std
+	return (how != MARKER_NOHOW
+			&& (where == MARKER_S1S2 || where == MARKER_S2S1
+					|| where == MARKER_SS || where == MARKER_UNTRIGGED));
+}
+
+/*
+ * Window around the events, in samples from each event, see
+ * get_where_windows()
+ */
+struct event_window {
+	Simplified::retrig_ev const *events;
+	int start;
+	int end;
+};
+
+/**
+ * Windows around the events a value of a where is taken from
+ *
+ * The std of s is taken from the windows of both S1 and S2, and the std at a
+ * quarter of the systole from its window and the baseline window.
+ *
+ * @param Pointer to the context of the record
+ * @param Where the value is taken
+ * @param How the value is taken
+ * @param Output windows
+ * @return Number of windows, zero if the value is not taken around the events
+ */
+static size_t get_where_windows(struct marker_context *context,
+		enum marker_where_e const where, enum marker_how_e const how,
+		struct event_window windows[2]) {
+	Simplified::retrig_ev const *s1_events = context->ev1;
+	Simplified::retrig_ev const *s2_events = context->ev2;
+	double const sfreq = context->data->sample_freq;
 	double s1s2_dur, ss_dur;
 
-	if (!strcmp(how, "all")) {
-		if (!strcmp(where, "s1")) {
-			get_events_stds(ddata, s1_events, conf_s_start * sfreq,
-					conf_s_end * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-		} else if (!strcmp(where, "s2")) {
-			get_events_stds(ddata, s2_events, conf_s_start * sfreq,
-					conf_s_end * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-		} else if (!strcmp(where, "s")) {
-			get_events_stds(ddata, s1_events, conf_s_start * sfreq,
-					conf_s_end * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-			if (s2_events != NULL) { // define ave of s1 and s2 values
-				get_events_stds(ddata, s2_events, conf_s_start * sfreq,
-						conf_s_end * sfreq, &tmp_array);
-				*marker_value = (get_kth_biggest(tmp_array.data, tmp_array.len,
-						tmp_array.len / 2) + *marker_value) / 2.0;
-			}
-		} else if (!strcmp(where, "s1s2")) {
-			s1s2_dur = get_s1s2_dur(s1_events, s2_events, sfreq);
-			get_events_stds(ddata, s1_events,
-					(conf_s_end + conf_margin) * sfreq,
-					(s1s2_dur - conf_margin) * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-		} else if (!strcmp(where, "s2s1")) {
-			s1s2_dur = get_s1s2_dur(s1_events, s2_events, sfreq);
-			ss_dur = get_ss(s1_events, sfreq);
-			get_events_stds(ddata, s2_events,
-					(-conf_margin - ss_dur + s1s2_dur) * sfreq,
-					(-conf_margin) * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-		} else if (!strcmp(where, "ss")) {
-			ss_dur = get_ss(s1_events, sfreq);
-			get_events_stds(ddata, s1_events,
-					(conf_s_end + conf_margin) * sfreq,
-					(ss_dur - conf_margin) * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-		} else if (!strcmp(where, "base")) {
-			get_events_stds(ddata, s1_events, (-0.125) * sfreq,
-					(-0.075) * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-		} else if (!strcmp(where, "q1")) {
-			get_events_stds(ddata, s1_events, -0.125 * sfreq, -0.075 * sfreq,
-					&tmp_array);
-			double base_val = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-			s1s2_dur = get_s1s2_dur(s1_events, s2_events, sfreq);
-			get_events_stds(ddata, s1_events, (s1s2_dur / 4.0 - 0.025) * sfreq,
-					(s1s2_dur / 4.0 + 0.025) * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2) - base_val;
-		} else if (!strcmp(where, "q2")) {
-			get_events_stds(ddata, s1_events, -0.125 * sfreq, -0.075 * sfreq,
-					&tmp_array);
-			double base_val = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-			s1s2_dur = get_s1s2_dur(s1_events, s2_events, sfreq);
-			get_events_stds(ddata, s1_events,
-					(2.0 * s1s2_dur / 4.0 - 0.025) * sfreq,
-					(2.0 * s1s2_dur / 4.0 + 0.025) * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2) - base_val;
-		} else if (!strcmp(where, "q3")) {
-			get_events_stds(ddata, s1_events, -0.125 * sfreq, -0.075 * sfreq,
-					&tmp_array);
-			double base_val = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-			s1s2_dur = get_s1s2_dur(s1_events, s2_events, sfreq);
-			get_events_stds(ddata, s1_events,
-					(3.0 * s1s2_dur / 4.0 - 0.025) * sfreq,
-					(3.0 * s1s2_dur / 4.0 + 0.025) * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2) - base_val;
-		} else if (!strcmp(where, "q5")) {
-			get_events_stds(ddata, s1_events, -0.125 * sfreq, -0.075 * sfreq,
-					&tmp_array);
-			double base_val = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-			s1s2_dur = get_s1s2_dur(s1_events, s2_events, sfreq);
-			get_events_stds(ddata, s2_events, (s1s2_dur / 4.0 - 0.025) * sfreq,
-					(s1s2_dur / 4.0 + 0.025) * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2) - base_val;
-		} else if (!strcmp(where, "q6")) {
-			get_events_stds(ddata, s1_events, -0.125 * sfreq, -0.075 * sfreq,
-					&tmp_array);
-			double base_val = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-			s1s2_dur = get_s1s2_dur(s1_events, s2_events, sfreq);
-			get_events_stds(ddata, s2_events,
-					(2.0 * s1s2_dur / 4.0 - 0.025) * sfreq,
-					(2.0 * s1s2_dur / 4.0 + 0.025) * sfreq, &tmp_array);
-			*marker_value = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2) - base_val;
-		}
-
-		else if (!strcmp(where, "-")) {
+	if (how != MARKER_ALL) { // the extremes of the moving std
+		switch (where) {
+		case MARKER_S1S2:
+		case MARKER_S2S1:
+		case MARKER_SS:
+			break;
+		default:
+			return (0);
+		}
+		// of the S1 events, the same windows as the std
+		s2_events = s1_events;
+	}
 
-		} else {
-			printf("Oops! Unsupported where (%s) for %s\n", where, how);
+	switch (where) {
+	case MARKER_S1:
+		windows[0] = {s1_events, static_cast<int>(conf_s_start * sfreq),
+			static_cast<int>(conf_s_end * sfreq)};
+		return (1);
+	case MARKER_S2:
+		windows[0] = {s2_events, static_cast<int>(conf_s_start * sfreq),
+			static_cast<int>(conf_s_end * sfreq)};
+		return (1);
+	case MARKER_S:
+		windows[0] = {s1_events, static_cast<int>(conf_s_start * sfreq),
+			static_cast<int>(conf_s_end * sfreq)};
+		windows[1] = {s2_events, windows[0].start, windows[0].end};
+		return (s2_events != NULL ? 2 : 1);
+	case MARKER_S1S2:
+		s1s2_dur = get_s1s2_dur(context);
+		windows[0] = {s1_events,
+			static_cast<int>((conf_s_end + conf_margin) * sfreq),
+			static_cast<int>((s1s2_dur - conf_margin) * sfreq)};
+		return (1);
+	case MARKER_S2S1:
+		s1s2_dur = get_s1s2_dur(context);
+		ss_dur = get_ss(context);
+		windows[0] = {s2_events,
+			static_cast<int>((-conf_margin - ss_dur + s1s2_dur) * sfreq),
+			static_cast<int>((-conf_margin) * sfreq)};
+		return (1);
+	case MARKER_SS:
+		ss_dur = get_ss(context);
+		windows[0] = {s1_events,
+			static_cast<int>((conf_s_end + conf_margin) * sfreq),
+			static_cast<int>((ss_dur - conf_margin) * sfreq)};
+		return (1);
+	case MARKER_BASE:
+		windows[0] = {s1_events, static_cast<int>((-0.125) * sfreq),
+			static_cast<int>((-0.075) * sfreq)};
+		return (1);
+	case MARKER_Q1:
+	case MARKER_Q2:
+	case MARKER_Q3:
+	case MARKER_Q5:
+	case MARKER_Q6: {
+		// std at a quarter of the systole, less the baseline std
+		windows[0] = {s1_events, static_cast<int>(-0.125 * sfreq),
+			static_cast<int>(-0.075 * sfreq)};
+		s1s2_dur = get_s1s2_dur(context);
+		double const q = where == MARKER_Q1 || where == MARKER_Q5 ? 1.0 :
+							where == MARKER_Q3 ? 3.0 : 2.0;
+		windows[1] = {
+			where == MARKER_Q5 || where == MARKER_Q6 ? s2_events : s1_events,
+			static_cast<int>((q * s1s2_dur / 4.0 - 0.025) * sfreq),
+			static_cast<int>((q * s1s2_dur / 4.0 + 0.025) * sfreq)};
+		return (2);
+	}
+	default:
+		return (0);
+	}
+}
+
+/**
+ * Median std of a signal around the events, see compile_marker()
+ *
+ * @param Pointer to the context of the record
+ * @param Where the value is taken
+ * @param Pointer to the signal
+ * @param Pointer to output value
+ * @return Zero on success
+ */
+static int get_std_value(struct marker_context *context,
+		enum marker_where_e const where, raw_array *ddata,
+		double *marker_value) {
+	double_array &tmp_array = scratch.tmp;
+	struct event_window windows[2];
+	double medians[2];
+	size_t const n = get_where_windows(context, where, MARKER_ALL, windows);
+
+	if (n == 0) {
+		return (-1);
+	}
+	for (size_t i = 0; i < n; i++) {
+		get_events_stds(ddata, windows[i].events, windows[i].start,
+				windows[i].end, &tmp_array);
+		medians[i] = get_kth_biggest(tmp_array.data, tmp_array.len,
+				tmp_array.len / 2);
+	}
+
+	if (n == 1) {
+		*marker_value = medians[0];
+	} else if (where == MARKER_S) { // ave of s1 and s2 values
+		*marker_value = (medians[1] + medians[0]) / 2.0;
+	} else { // less the baseline
+		*marker_value = medians[1] - medians[0];
+	}
+	return (0);
+}
+
+/**
+ * Medians of the extremes of the moving std of a signal, see compile_marker()
+ *
+ * @param Pointer to the context of the record
+ * @param Where the values are taken
+ * @param Pointer to the signal
+ * @param Signal, for the moving std kept in the working memory
+ * @param Pointer to output min, max and minmax values
+ * @return Zero on success
+ */
+static int get_extreme_values(struct marker_context *context,
+		enum marker_where_e const where, raw_array *ddata,
+		struct signal_key const &key, double values[3]) {
+	double const sfreq = context->data->sample_freq;
+	struct event_window windows[2];
+
+	if (where != MARKER_UNTRIGGED
+			&& get_where_windows(context, where, MARKER_MINMAX, windows) == 0) {
+		return (-1);
+	}
+
+	context->stats.std.lookups++;
+	if (is_same_signal(scratch.std_key, key)) {
+		context->stats.std.hits++;
+	} else {
+		define_moving_std(ddata, &scratch.std, conf_moving_std_len * sfreq);
+		scratch.std_key = key;
+	}
+
+	if (where == MARKER_UNTRIGGED) {
+		get_repeating_extreme_values(&scratch.std, conf_ignore_from_start * sfreq, conf_win_len * sfreq,
+				&scratch.min, &scratch.max, &scratch.minmax);
+	} else {
+		get_events_extreme_values(&scratch.std, windows[0].events, windows[0].start, windows[0].end,
+				&scratch.min, &scratch.max, &scratch.minmax);
+	}
+	// take the median values
+	values[0] = get_kth_biggest(scratch.min.data, scratch.min.len,
+			scratch.min.len / 2);
+	values[1] = get_kth_biggest(scratch.max.data, scratch.max.len,
+			scratch.max.len / 2);
+	values[2] = get_kth_biggest(scratch.minmax.data, scratch.minmax.len,
+			scratch.minmax.len / 2);
+	return (0);
+}
+
+/**
+ * Memoize a value of a record
+ */
+static inline void memo_value(struct marker_context *context,
+		struct signal_key const &key, enum marker_where_e const where,
+		enum marker_how_e const how, double const &value) {
+	if (context->n_values < MARKER_MEMO_VALUES) {
+		struct memo_value &m = context->values[context->n_values++];
+		m.channel = key.channel;
+		m.freq1 = key.freq1;
+		m.freq2 = key.freq2;
+		m.where = where;
+		m.how = how;
+		m.value = value;
+	}
+}
+
+/**
+ * A memoized value of a record, or NULL
+ */
+static inline struct memo_value const *find_value(
+		struct marker_context const *context, struct signal_key const &key,
+		enum marker_where_e const where, enum marker_how_e const how) {
+	for (size_t i = 0; i < context->n_values; i++) {
+		struct memo_value const &m = context->values[i];
+		if (m.where == where && m.how == how && m.channel == key.channel
+				&& m.freq1 == key.freq1 && m.freq2 == key.freq2) {
+			return (&m);
+		}
+	}
+	return (NULL);
+}
+
+/**
+ * A value of a signal around the events, see compile_marker()
+ *
+ * The values are memoized in the context. The min, max and minmax values
+ * come from the same extremes, so all three are memoized at once.
+ *
+ * @param Pointer to the context of the record
+ * @param Where the value is taken
+ * @param How the value is taken
+ * @param Pointer to the signal
+ * @param Signal, see struct signal_key
+ * @param Pointer to output value
+ * @return Zero on success
+ */
+static int get_value(struct marker_context *context,
+		enum marker_where_e const where, enum marker_how_e const how,
+		raw_array *ddata, struct signal_key const &key, double *marker_value) {
+	context->stats.value.lookups++;
+	struct memo_value const *m = find_value(context, key, where, how);
+	if (m) {
+		context->stats.value.hits++;
+		*marker_value = m->value;
+		return (0);
+	}
+
+	if (how == MARKER_ALL) { // std around the events
+		if (get_std_value(context, where, ddata, marker_value)) {
 			return (-1);
 		}
+		memo_value(context, key, where, how, *marker_value);
 		return (0);
-	} else { // how == min, max or minmax
-		define_moving_std(ddata, &std_array, conf_moving_std_len * sfreq);
-
-		if (!strcmp(where, "s1s2")) {
-			s1s2_dur = get_s1s2_dur(s1_events, s2_events, sfreq);
-			get_events_extreme_values(&std_array, s1_events,
-					(conf_s_end + conf_margin) * sfreq,
-					(s1s2_dur - conf_margin) * sfreq, &min, &max, &minmax);
-			if (!strcmp(how, "min")) {
-				*marker_value = get_kth_biggest(min.data, min.len, min.len / 2); // take the median value
-			} else if (!strcmp(how, "max")) {
-				*marker_value = get_kth_biggest(max.data, max.len, max.len / 2); // take the median value
-			} else if (!strcmp(how, "minmax")) {
-				*marker_value = get_kth_biggest(minmax.data, minmax.len,
-						minmax.len / 2); // take the median value
-			} else {
-				printf("Oops! Unsupported how (%s) for %s\n", how, where);
+	}
+
+	// median of the extremes of the moving std
+	double values[3];
+	if ((how != MARKER_MIN && how != MARKER_MAX && how != MARKER_MINMAX)
+			|| get_extreme_values(context, where, ddata, key, values)) {
+		return (-1);
+	}
+	memo_value(context, key, where, MARKER_MIN, values[0]);
+	memo_value(context, key, where, MARKER_MAX, values[1]);
+	memo_value(context, key, where, MARKER_MINMAX, values[2]);
+	*marker_value = values[how - MARKER_MIN];
+	return (0);
+}
+
+/**
+ * Compile a marker name to its parts and design its band-pass filter
+ *
+ * A marker that cannot be evaluated compiles to an invalid marker, which
+ * fails when it is evaluated, so a tree only fails on the paths through it.
+ *
+ * @param Marker name, see struct marker_desc
+ * @param Sample frequency to design the filter for
+ * @param Pointer to output, free with free_marker()
+ * @return Zero if the marker can be evaluated
+ */
+int compile_marker(char const *name, double const &sample_freq,
+		struct marker_desc *marker) {
+	char what[10], where[10], to[10], how[10];
+	memset(marker, 0, sizeof(*marker));
+	marker->what = MARKER_INVALID;
+
+	if (sscanf(name, "%9[^_]_%9[^_]_%9[^_]_%9[^_]_%lf_%lf", what, where, to,
+			how, &marker->freq1, &marker->freq2) < 6) {
+		marker->error = "Not enough name parts.";
+		return (-1);
+	}
+	marker->where = static_cast<enum marker_where_e>(find_part(
+			marker_where_names, where));
+	marker->to = static_cast<enum marker_where_e>(find_part(
+			marker_where_names, to));
+	marker->how = static_cast<enum marker_how_e>(find_part(marker_how_names,
+			how));
+
+	enum marker_what_e const w = static_cast<enum marker_what_e>(find_part(
+			marker_what_names, what));
+	switch (w) {
+	case MARKER_ABS:
+	case MARKER_CORR:
+	case MARKER_NORM:
+		if (!is_value(marker->where, marker->how)) {
+			marker->error = "Unsupported where or how.";
+			return (-1);
+		}
+		break;
+	case MARKER_REL:
+	case MARKER_RELCORR:
+		if (!is_value(marker->where, marker->how)
+				|| !is_value(marker->to, MARKER_ALL)) {
+			marker->error = "Unsupported where, to or how.";
+			return (-1);
+		}
+		break;
+	case MARKER_DUR:
+		if (marker->where != MARKER_S1S2 && marker->where != MARKER_SS) {
+			marker->error = "Dur is defined only for s1s2 or ss.";
+			return (-1);
+		}
+		break;
+	case MARKER_WIDTH:
+		if (marker->where != MARKER_S1 && marker->where != MARKER_S
+				&& marker->where != MARKER_S2) {
+			marker->error = "Width is defined only for s1,s2 and s.";
+			return (-1);
+		}
+		if (sscanf(to, "%lf", &marker->level) < 1) {
+			marker->error = "Can't read to (width lvl value).";
+			return (-1);
+		}
+		break;
+	default:
+		marker->error =
+				strcmp(what, "ext") ?
+						"Can't understand what." :
+						"External markers not defined quite yet.";
+		return (-1);
+	}
+	marker->what = w;
+
+	if (marker->freq2 > 0.0 && marker->what != MARKER_DUR) {
+		marker->band = new DSP::bandpass_design();
+		DSP::Iir iir;
+		iir.design_bandpass(marker->band, marker->freq1, marker->freq2, 0.5, 4,
+				sample_freq);
+		marker->settle = DSP::Iir::settling_len(*marker->band,
+				conf_settle_tolerance);
+	}
+	return (0);
+}
+
+void free_marker(struct marker_desc *marker) {
+	delete marker->band;
+	marker->band = NULL;
+}
+
+/**
+ * Sort and merge spans in place
+ */
+static void merge_spans(span_array *spans) {
+	std::sort(spans->data, spans->data + spans->len,
+			[](struct span const &a, struct span const &b) {
+				return a.start < b.start;
+			});
+	size_t n = 0;
+	for (size_t i = 0; i < spans->len; i++) {
+		if (n > 0 && spans->data[i].start <= spans->data[n - 1].end) {
+			if (spans->data[n - 1].end < spans->data[i].end) {
+				spans->data[n - 1].end = spans->data[i].end;
+			}
+		} else {
+			spans->data[n++] = spans->data[i];
+		}
+	}
+	spans->len = n;
+}
+
+/**
+ * Spans of its band a marker reads, see filter_band()
+ *
+ * The values memoized already are not read again. The extremes of the moving
+ * std read its window on both sides of their windows.
+ *
+ * @param Marker, see compile_marker()
+ * @param Pointer to the context of the record
+ * @param Band of the signal, see struct signal_key
+ * @param Length of the signal
+ * @param Pointer to output spans, sorted and merged
+ * @return Zero if the marker reads only around the events
+ */
+static int get_marker_spans(struct marker_desc const &marker,
+		struct marker_context *context, struct signal_key const &key,
+		size_t const &len, span_array *spans) {
+	double const sfreq = context->data->sample_freq;
+	struct event_window windows[6];
+	int reach[6];
+	size_t n = 0;
+
+	if (marker.what == MARKER_WIDTH) {
+		windows[0] = {marker.where == MARKER_S2 ? context->ev2 : context->ev1,
+			static_cast<int>((conf_s_start - conf_margin) * sfreq),
+			static_cast<int>((conf_s_end + conf_margin) * sfreq)};
+		reach[n++] = 0;
+	} else {
+		struct {
+			enum marker_where_e where;
+			enum marker_how_e how;
+		} parts[3] = { { marker.where, marker.how } };
+		size_t n_parts = 1;
+		if (marker.what == MARKER_REL || marker.what == MARKER_RELCORR) {
+			parts[n_parts++] = {marker.to, MARKER_ALL};
+		}
+		if (marker.what == MARKER_CORR || marker.what == MARKER_RELCORR) {
+			parts[n_parts++] = {MARKER_BASE, MARKER_ALL};
+		}
+		for (size_t i = 0; i < n_parts; i++) {
+			if (find_value(context, key, parts[i].where, parts[i].how)) {
+				continue;
 			}
-		} else if (!strcmp(where, "s2s1")) {
-			s1s2_dur = get_s1s2_dur(s1_events, s2_events, sfreq);
-			ss_dur = get_ss(s1_events, sfreq);
-			get_events_extreme_values(&std_array, s1_events,
-					(-conf_margin - ss_dur + s1s2_dur) * sfreq,
-					(-conf_margin) * sfreq, &min, &max, &minmax);
-			if (!strcmp(how, "min")) {
-				*marker_value = get_kth_biggest(min.data, min.len, min.len / 2); // take the median value
-			} else if (!strcmp(how, "max")) {
-				*marker_value = get_kth_biggest(max.data, max.len, max.len / 2); // take the median value
-			} else if (!strcmp(how, "minmax")) {
-				*marker_value = get_kth_biggest(minmax.data, minmax.len,
-						minmax.len / 2); // take the median value
-			} else {
-				printf("***Oops! Unsupported how (%s) for %s\n", how, where);
+			size_t const k = get_where_windows(context, parts[i].where,
+					parts[i].how, windows + n);
+			if (k == 0) {
+				return (-1);
 			}
-		} else if (!strcmp(where, "ss")) {
-			ss_dur = get_ss(s1_events, sfreq);
-			get_events_extreme_values(&std_array, s1_events,
-					(conf_s_end + conf_margin) * sfreq,
-					(ss_dur - conf_margin) * sfreq, &min, &max, &minmax);
-			if (!strcmp(how, "min")) {
-				*marker_value = get_kth_biggest(min.data, min.len, min.len / 2); // take the median value
-			} else if (!strcmp(how, "max")) {
-				*marker_value = get_kth_biggest(max.data, max.len, max.len / 2); // take the median value
-			} else if (!strcmp(how, "minmax")) {
-				*marker_value = get_kth_biggest(minmax.data, minmax.len,
-						minmax.len / 2); // take the median value
-			} else {
-				printf("Oops! Unsupported how (%s) for %s\n", how, where);
+			for (size_t j = 0; j < k; j++) {
+				reach[n++] =
+						parts[i].how == MARKER_ALL ?
+								0 : conf_moving_std_len * sfreq + 1;
 			}
-		} else if (!strcmp(where, "untrigged")) {
-			get_repeating_extreme_values(&std_array,
-					conf_ignore_from_start * sfreq, conf_win_len * sfreq, &min,
-					&max, &minmax);
-			if (!strcmp(how, "min")) {
-				*marker_value = get_kth_biggest(min.data, min.len, min.len / 2); // take the median value
-			} else if (!strcmp(how, "max")) {
-				*marker_value = get_kth_biggest(max.data, max.len, max.len / 2); // take the median value
-			} else if (!strcmp(how, "minmax")) {
-				*marker_value = get_kth_biggest(minmax.data, minmax.len,
-						minmax.len / 2); // take the median value
-			} else {
-				printf("Oops! Unsupported how (%s) for %s\n", how, where);
+		}
+	}
+
+	size_t total = 0;
+	for (size_t i = 0; i < n; i++) {
+		total += windows[i].events ? windows[i].events->size() : 0;
+	}
+	set_array_len(spans, total);
+	spans->len = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (windows[i].events == NULL) {
+			continue;
+		}
+		for (Simplified::retrig_ev_it it = windows[i].events->begin();
+				it != windows[i].events->end(); ++it) {
+			ssize_t start = it->offset + windows[i].start - reach[i];
+			ssize_t end = it->offset + windows[i].end + reach[i];
+			start = start < 0 ? 0 : start;
+			end = end > static_cast<ssize_t>(len) ? len : end;
+			if (start < end) {
+				spans->data[spans->len++] = {static_cast<size_t>(start),
+					static_cast<size_t>(end)};
 			}
 		}
+	}
+	merge_spans(spans);
+	return (0);
+}
 
-		else {
-			printf("Oops! Unsupported where (%s) for %s\n", where, how);
-			return (-1);
+/**
+ * Band-pass filter the spans of a signal a marker reads
+ *
+ * The filter runs forward and backward, so a span filtered with the settling
+ * length of the filter on both of its sides matches the whole filtered signal
+ * to conf_settle_tolerance of its peak. The spans the previous markers of the
+ * same band filtered are not filtered again, and the spans closer than twice
+ * the settling length are filtered in one run. If the runs would take as many
+ * samples as the signal, the whole signal is filtered as it was before the
+ * spans. The samples outside the spans are zero. With the spans off, see
+ * set_sparse_bands(), the whole signal is filtered always.
+ *
+ * @param Pointer to the context of the record
+ * @param Band-pass filter
+ * @param Settling length of the filter in samples
+ * @param Pointer to the signal
+ * @param Spans to filter, see get_marker_spans()
+ * @param Band of the signal, see struct signal_key
+ * @return Zero if the spans were filtered already
+ */
+static int filter_band(struct marker_context *context,
+		DSP::bandpass_design const &band, size_t const &settle,
+		raw_array const *raw, span_array const *spans,
+		struct signal_key const &key) {
+	size_t const len = raw->len;
+	span_array *covered = &scratch.covered;
+	span_array *missing = &scratch.missing;
+	size_t i, n, cost;
+
+	if (spans->len == 0) { // all memoized
+		return (0);
+	}
+	struct span whole = { 0, len };
+	span_array const all = { &whole, 1, 1 };
+	if (!sparse_bands) {
+		spans = &all; // costs the whole signal below
+	}
+	if (!is_same_signal(scratch.filtered_key, key)) {
+		covered->len = 0;
+		context->stats.band_samples += len;
+	}
+
+	// the spans not filtered yet
+	set_array_len(missing, spans->len + covered->len);
+	size_t c = 0;
+	for (n = 0, i = 0; i < spans->len; i++) {
+		size_t start = spans->data[i].start;
+		size_t const end = spans->data[i].end;
+		while (start < end) {
+			while (c < covered->len && covered->data[c].end <= start) {
+				c++;
+			}
+			if (c < covered->len && covered->data[c].start <= start) {
+				start = covered->data[c].end;
+				continue;
+			}
+			size_t const e =
+					c < covered->len && covered->data[c].start < end ?
+							covered->data[c].start : end;
+			missing->data[n++] = {start, e};
+			start = e;
 		}
+	}
+	missing->len = n;
+	if (n == 0) {
 		return (0);
 	}
-	return (0);
+
+	// runs of the missing spans, and the samples they take
+	for (cost = 0, i = 0; i < n;) {
+		size_t const start = missing->data[i].start;
+		for (i++; i < n
+				&& (missing->data[i].start - missing->data[i - 1].end) / 2
+						< settle; i++)
+			;
+		size_t const end = missing->data[i - 1].end;
+		cost += (len - end > settle ? end + settle : len)
+				- (start > settle ? start - settle : 0);
+		if (cost >= len) {
+			break;
+		}
+	}
+
+	set_array_len(&scratch.filtered, len);
+	if (cost >= len) {
+		set_array_len(&scratch.filter,
+				(DSP::Iir::bandpass_scratch(len) + sizeof(float) - 1)
+						/ sizeof(float));
+		DSP::Iir::bandpass(scratch.filtered.data, raw->data, len, band,
+				scratch.filter.data);
+		context->stats.band_filtered += len;
+		set_array_len(covered, 1);
+		covered->data[0] = {0, len};
+	} else {
+		if (covered->len == 0) {
+			memset(scratch.filtered.data, 0, len * sizeof(data_raw_t));
+		}
+		for (i = 0; i < n;) {
+			size_t const first = i;
+			for (i++; i < n
+					&& (missing->data[i].start - missing->data[i - 1].end) / 2
+							< settle; i++)
+				;
+			size_t const start =
+					missing->data[first].start > settle ?
+							missing->data[first].start - settle : 0;
+			size_t const end =
+					len - missing->data[i - 1].end > settle ?
+							missing->data[i - 1].end + settle : len;
+			set_array_len(&scratch.segment, end - start);
+			set_array_len(&scratch.filter,
+					(DSP::Iir::bandpass_scratch(end - start) + sizeof(float)
+							- 1) / sizeof(float));
+			DSP::Iir::bandpass(scratch.segment.data, raw->data + start,
+					end - start, band, scratch.filter.data);
+			for (size_t j = first; j < i; j++) {
+				struct span const &s = missing->data[j];
+				memcpy(scratch.filtered.data + s.start,
+						scratch.segment.data + s.start - start,
+						(s.end - s.start) * sizeof(data_raw_t));
+			}
+			context->stats.band_filtered += end - start;
+		}
+		size_t const n_covered = covered->len;
+		set_array_len(covered, n_covered + n);
+		memcpy(covered->data + n_covered, missing->data,
+				n * sizeof(struct span));
+		merge_spans(covered);
+	}
+	scratch.filtered_key = key;
+
+	// the moving std of the band is not of all its spans
+	if (is_same_signal(scratch.std_key, key)) {
+		scratch.std_key.context = 0;
+	}
+	return (1);
 }
 
-int create_named(char const *name, struct data *data,
-		Simplified::retrig_ev const *s1_events,
-		Simplified::retrig_ev const *s2_events, double *marker_value) {
-	char what[10], where[10], to[10], how[10];
-	double freq1, freq2;
+/**
+ * Filter only the spans of a band the markers read, the default, or always
+ * the whole signal, for comparing the two
+ *
+ * @param True for the spans
+ */
+void set_sparse_bands(bool const &sparse) {
+	sparse_bands = sparse;
+}
+
+/**
+ * Start the markers of a record
+ *
+ * @param Pointer to output context
+ * @param Pointer to ECG legacy data structure
+ * @param Pointer to the S1 events
+ * @param Pointer to the S2 events, if any
+ */
+void init_marker_context(struct marker_context *context, struct data *data,
+		Simplified::retrig_ev const *ev1, Simplified::retrig_ev const *ev2) {
+	memset(context, 0, sizeof(*context));
+	context->data = data;
+	context->ev1 = ev1;
+	context->ev2 = ev2;
+	context->id = ++marker_contexts;
+	context->ss_dur = NAN;
+	context->s1s2_dur = NAN;
+}
+
+/**
+ * Evaluate a compiled marker on a channel
+ *
+ * The band-pass filter and the statistics run on the working memory of the
+ * thread, see struct marker_scratch, and reuse what the previous markers of
+ * the record left there, see struct marker_context.
+ *
+ * @param Marker, see compile_marker()
+ * @param Marker name, for the messages
+ * @param Sample frequency the marker was compiled for
+ * @param Pointer to the context of the record, see init_marker_context()
+ * @param Pointer to output value
+ * @param Channel of the data
+ * @return Zero on success
+ */
+int evaluate_marker(struct marker_desc const &marker, char const *name,
+		double const &sample_freq, struct marker_context *context,
+		double *marker_value, size_t const &channel) {
+	struct data *data = context->data;
+	Simplified::retrig_ev const *s1_events = context->ev1;
+	Simplified::retrig_ev const *s2_events = context->ev2;
 	double help_val;
-	struct double_array filtered = { 0 };
-	static struct double_array tmp_array = { 0 }; // set as static, so it doesn't have to be realloced again every time (TODO free).
+	size_t const len = data->samples_per_channel;
+	raw_array raw = { data->ch[channel].raw, len, 0 };
+	raw_array *filtered = &raw;
+	struct signal_key const raw_key = { context->id, channel, 0.0, 0.0 };
+	struct signal_key key = raw_key;
 
-	if (sscanf(name, "%[^_]_%[^_]_%[^_]_%[^_]_%lf_%lf", what, where, to, how,
-			&freq1, &freq2) < 6) {
-		printf("Unknown marker %s. Not enough name parts.\n", name);
+	if (marker.what == MARKER_INVALID) {
+		Utils::log_printf("Unknown marker %s. %s\n", name, marker.error);
 		return (-1);
 	}
 
-	filtered.len = 0;
-	filtered.data = NULL;
-	if (freq2 <= 0.0) { // no filtering
-		set_double_array_len(&filtered, data->samples_per_channel, 0);
-		memcpy(filtered.data, data->ch[0].raw,
-				data->samples_per_channel * sizeof(double));
-	} else {
-		DSP::Iir iir;
-		iir.bandpass(&(filtered.data), data->ch[0].raw,
-				data->samples_per_channel, freq1, freq2, 0.5, 4,
-				data->sample_freq);
-		filtered.len = data->samples_per_channel;
+	if (marker.freq2 > 0.0 && marker.what != MARKER_DUR) {
+		key.freq1 = marker.freq1;
+		key.freq2 = marker.freq2;
+		DSP::bandpass_design const *band = marker.band;
+		size_t settle = marker.settle;
+		DSP::bandpass_design other;
+		if (!band || data->sample_freq != sample_freq) { // a record of another sample frequency
+			DSP::Iir iir;
+			iir.design_bandpass(&other, marker.freq1, marker.freq2, 0.5, 4,
+					data->sample_freq);
+			band = &other;
+			settle = DSP::Iir::settling_len(other, conf_settle_tolerance);
+		}
+		if (get_marker_spans(marker, context, key, len, &scratch.spans)) {
+			set_array_len(&scratch.spans, 1);
+			scratch.spans.data[0] = {0, len};
+		}
+		context->stats.band.lookups++;
+		if (!filter_band(context, *band, settle, &raw, &scratch.spans, key)) {
+			context->stats.band.hits++;
+		}
+		filtered = &scratch.filtered;
 	}
 
-	if (!strcmp(what, "abs")) {
-		get_named_value(where, how, &filtered, data->sample_freq, s1_events,
-				s2_events, marker_value);
-	} else if (!strcmp(what, "rel")) {
-		get_named_value(where, how, &filtered, data->sample_freq, s1_events,
-				s2_events, marker_value);
-		get_named_value(to, "all", &filtered, data->sample_freq, s1_events,
-				s2_events, &help_val);
+	switch (marker.what) {
+	case MARKER_ABS:
+		get_value(context, marker.where, marker.how, filtered, key,
+				marker_value);
+		break;
+	case MARKER_REL:
+		get_value(context, marker.where, marker.how, filtered, key,
+				marker_value);
+		get_value(context, marker.to, MARKER_ALL, filtered, key, &help_val);
 		if (help_val != 0.0) {
 			(*marker_value) /= help_val;
 		} else {
-			printf("Oops! Trying to divide by zero when defining %s\n", name);
+			Utils::log_printf(
+					"Oops! Trying to divide by zero when defining %s\n", name);
 			(*marker_value) *= 10000000000.0;
 		}
-	} else if (!strcmp(what, "corr")) {
-		get_named_value(where, how, &filtered, data->sample_freq, s1_events,
-				s2_events, marker_value);
-		get_named_value("base", "all", &filtered, data->sample_freq, s1_events,
-				s2_events, &help_val);
+		break;
+	case MARKER_CORR:
+		get_value(context, marker.where, marker.how, filtered, key,
+				marker_value);
+		get_value(context, MARKER_BASE, MARKER_ALL, filtered, key,
+				&help_val);
 		(*marker_value) -= help_val;
-	} else if (!strcmp(what, "relcorr")) {
-		get_named_value(where, how, &filtered, data->sample_freq, s1_events,
-				s2_events, marker_value);
-		get_named_value("base", "all", &filtered, data->sample_freq, s1_events,
-				s2_events, &help_val);
+		break;
+	case MARKER_RELCORR:
+		get_value(context, marker.where, marker.how, filtered, key,
+				marker_value);
+		get_value(context, MARKER_BASE, MARKER_ALL, filtered, key,
+				&help_val);
 		(*marker_value) -= help_val;
-		get_named_value(to, "all", &filtered, data->sample_freq, s1_events,
-				s2_events, &help_val);
+		get_value(context, marker.to, MARKER_ALL, filtered, key, &help_val);
 		if (help_val != 0.0) {
 			(*marker_value) /= help_val;
 		} else {
-			printf("Oops! Trying to divide by zero when defining %s\n", name);
+			Utils::log_printf(
+					"Oops! Trying to divide by zero when defining %s\n", name);
 			(*marker_value) *= 10000000000.0;
 		}
-	} else if (!strcmp(what, "norm")) {
-		get_named_value(where, how, &filtered, data->sample_freq, s1_events,
-				s2_events, marker_value);
-		memcpy(filtered.data, data->ch[0].raw,
-				data->samples_per_channel * sizeof(double)); // create not filtered for creating all band normalization reference to bandpassed marker
-		get_named_value(where, how, &filtered, data->sample_freq, s1_events,
-				s2_events, &help_val);
+		break;
+	case MARKER_NORM:
+		get_value(context, marker.where, marker.how, filtered, key,
+				marker_value);
+		// not filtered, the all band normalization reference to the bandpassed marker
+		get_value(context, marker.where, marker.how, &raw, raw_key,
+				&help_val);
 		if (help_val != 0.0) {
 			(*marker_value) /= help_val;
 		} else {
-			printf("Oops! Trying to divide by zero when defining %s\n", name);
+			Utils::log_printf(
+					"Oops! Trying to divide by zero when defining %s\n", name);
 			(*marker_value) *= 10000000000.0;
 		}
-	} else if (!strcmp(what, "dur")) {
-		if (!strcmp(where, "s1s2")) {
-			(*marker_value) = get_s1s2_dur(s1_events, s2_events,
-					data->sample_freq);
-		} else if (!strcmp(where, "ss")) {
-			(*marker_value) = get_ss(s1_events, data->sample_freq);
-		} else {
-			printf("Unknown marker %s. Dur us defined only for s1s2 or ss.\n",
-					name);
-		}
-	} else if (!strcmp(what, "width")) {
-		double perc_lvl;
-		if (!strcmp(where, "s1") || !strcmp(where, "s")) {
-			get_events_absmax(&filtered, s1_events,
-					conf_s_start * data->sample_freq,
-					conf_s_end * data->sample_freq, &tmp_array);
-			help_val = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2); // define absmax value
-			if (sscanf(to, "%lf", &perc_lvl) < 1) {
-				printf("Unknown marker %s. Can't read to (width lvl value).\n",
-						name);
-				return (-1);
-			}
-			get_events_width(&filtered, s1_events,
-					(conf_s_start - conf_margin) * data->sample_freq,
-					(conf_s_end + conf_margin) * data->sample_freq,
-					perc_lvl / 100.0 * help_val, &tmp_array, data->sample_freq);
-			(*marker_value) = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
-		} else if (!strcmp(where, "s2")) {
-			get_events_absmax(&filtered, s2_events,
-					conf_s_start * data->sample_freq,
-					conf_s_end * data->sample_freq, &tmp_array);
-			help_val = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2); // define absmax value
-			if (sscanf(to, "%lf", &perc_lvl) < 1) {
-				printf("Unknown marker %s. Can't read to (width lvl value).\n",
-						name);
-				return (-1);
-			}
-			get_events_width(&filtered, s2_events,
-					(conf_s_start - conf_margin) * data->sample_freq,
-					(conf_s_end + conf_margin) * data->sample_freq,
-					perc_lvl / 100.0 * help_val, &tmp_array, data->sample_freq);
-			(*marker_value) = get_kth_biggest(tmp_array.data, tmp_array.len,
-					tmp_array.len / 2);
+		break;
+	case MARKER_DUR:
+		if (marker.where == MARKER_S1S2) {
+			(*marker_value) = get_s1s2_dur(context);
 		} else {
-			printf(
-					"Unknown marker %s. Width is defined only for s1,s2 and s.\n",
-					name);
-			return (-1);
+			(*marker_value) = get_ss(context);
 		}
-	} else if (!strcmp(what, "ext")) {
-		printf("Oops! External markers not defined quite yet..\n"); // TODO: ...
-	} else {
-		printf("Unknown marker %s. Can't understand what.\n", name);
+		break;
+	case MARKER_WIDTH: {
+		Simplified::retrig_ev const *events =
+				marker.where == MARKER_S2 ? s2_events : s1_events;
+		get_events_absmax(filtered, events, conf_s_start * data->sample_freq,
+				conf_s_end * data->sample_freq, &scratch.tmp);
+		help_val = get_kth_biggest(scratch.tmp.data, scratch.tmp.len,
+				scratch.tmp.len / 2); // define absmax value
+		get_events_width(filtered, events,
+				(conf_s_start - conf_margin) * data->sample_freq,
+				(conf_s_end + conf_margin) * data->sample_freq,
+				marker.level / 100.0 * help_val, &scratch.tmp,
+				data->sample_freq);
+		(*marker_value) = get_kth_biggest(scratch.tmp.data, scratch.tmp.len,
+				scratch.tmp.len / 2);
+		break;
+	}
+	default:
+		return (-1);
+	}
+	if (isnan(*marker_value)) {
+		Utils::log_printf("Oops! No values for marker %s\n", name);
 		return (-1);
 	}
-	mm_free(filtered.data);
 	return (0);
 }
 
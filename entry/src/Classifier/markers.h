@@ -8,7 +8,10 @@
 #ifndef MARKERS_H_
 #define MARKERS_H_
 
+#include <stdint.h>
+
 #include "../Simplified/Retrigger.h"
+#include "../myDSP/Iir.h"
 
 #define MARKERS_S1S2 1
 #define MARKERS_EVENTS 2
@@ -16,9 +19,97 @@
 
 namespace Classifier {
 namespace Markers {
-int create_named(char const *name, struct data *data,
-		Simplified::retrig_ev const *ev1, Simplified::retrig_ev const *ev2,
-		double *marker_value);
+
+enum marker_what_e {
+	MARKER_ABS, MARKER_REL, MARKER_CORR, MARKER_RELCORR, MARKER_NORM,
+	MARKER_DUR, MARKER_WIDTH, MARKER_INVALID,
+};
+
+enum marker_where_e {
+	MARKER_S1, MARKER_S2, MARKER_S, MARKER_S1S2, MARKER_S2S1, MARKER_SS,
+	MARKER_BASE, MARKER_Q1, MARKER_Q2, MARKER_Q3, MARKER_Q5, MARKER_Q6,
+	MARKER_UNTRIGGED, MARKER_NOWHERE,
+};
+
+enum marker_how_e {
+	MARKER_ALL, MARKER_MIN, MARKER_MAX, MARKER_MINMAX, MARKER_NOHOW,
+};
+
+/*
+ * A marker name compiled to its parts, see compile_marker()
+ *
+ *   what_where_to_how_freq1_freq2, eg. rel_s2s1_s1_minmax_400.0_600.0
+ */
+struct marker_desc {
+	enum marker_what_e what;
+	enum marker_where_e where;
+	enum marker_where_e to; // reference of rel and relcorr
+	enum marker_how_e how;
+	double level; // of width, in percents of the median absolute maximum
+	double freq1; // band, not filtered if freq2 <= 0
+	double freq2;
+	DSP::bandpass_design *band; // designed for the sample frequency, or NULL
+	size_t settle; // samples for the band to settle, see filter_band()
+	char const *error; // why an invalid marker cannot be evaluated
+};
+
+struct memo_count {
+	size_t lookups;
+	size_t hits;
+};
+
+/*
+ * How often the intermediates of the markers were reused
+ */
+struct marker_memo_stats {
+	struct memo_count band; // band-pass filtered signals
+	struct memo_count std; // moving stds of the signals
+	struct memo_count value; // values of a where and how, eg. the to of a rel
+	struct memo_count dur; // median RR and S1S2 durations
+	size_t band_samples; // of the signals band-pass filtered
+	size_t band_filtered; // samples run through the filters for them
+};
+
+#define MARKER_MEMO_VALUES 64
+
+struct memo_value {
+	size_t channel;
+	double freq1; // band of the signal, both zero for the raw signal
+	double freq2;
+	enum marker_where_e where;
+	enum marker_how_e how;
+	double value;
+};
+
+/*
+ * The markers of a record, see init_marker_context()
+ *
+ * The values, the durations and the keys of the signals kept in the working
+ * memory of the thread are memoized, so the markers of the walks through the
+ * channels of the record share what they have in common. Once full, the
+ * values are no longer memoized.
+ */
+struct marker_context {
+	struct data *data;
+	Simplified::retrig_ev const *ev1; // S1 events
+	Simplified::retrig_ev const *ev2; // S2 events, if any
+	uint64_t id; // of the context, unique in the process
+	double ss_dur; // NAN until defined
+	double s1s2_dur;
+	struct memo_value values[MARKER_MEMO_VALUES];
+	size_t n_values;
+	struct marker_memo_stats stats;
+};
+
+int compile_marker(char const *name, double const &sample_freq,
+		struct marker_desc *marker);
+void free_marker(struct marker_desc *marker);
+void set_sparse_bands(bool const &sparse);
+void init_marker_context(struct marker_context *context, struct data *data,
+		Simplified::retrig_ev const *ev1, Simplified::retrig_ev const *ev2);
+int evaluate_marker(struct marker_desc const &marker, char const *name,
+		double const &sample_freq, struct marker_context *context,
+		double *marker_value, size_t const &channel = 0);
 } // namespace Markers
 } // namespace Classifier
 
@@ -0,0 +1,498 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Clusters.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <math.h>
+#include <algorithm>
+
+#include "macro.h"
+#include "../utils/memory_manager.h"
+
+#include "Clusters.h"
+
+namespace Simplified {
+
+/**
+ * Incremental S1/S2 clustering
+ *
+ * Keeps averaged templates of the current clusters. Each new event is
+ * correlated only against the templates near its reference offset and
+ * assigned to the best matching cluster, so the cost of an event does not
+ * depend on the length of the recording. Full clustering with
+ * calc_correlations() is run over the last history seconds of signal when
+ * there are no templates yet or when the average of the best correlations of
+ * the last quality_len events drops below the correlation limit, but at most
+ * once per half history. Without templates it is retried every second once
+ * there are min_events events.
+ *
+ * The correlation and lookaround windows and the convolution kernel must be
+ * set before the first push. The events of the clusters are kept for the
+ * event history, at least as long as the signal history.
+ *
+ * @param Energy function window length in fraction of sample time (seconds)
+ * @param Cut-off correlation limit
+ * @param Length of the signal history for full clustering in seconds
+ * @param Length of the event history in seconds
+ */
+Clusters::Clusters(double const &window_length_in_fractions_of_sample_time,
+		double const &correlation_limit, double const &history,
+		double const &event_history) :
+		Retrigger(window_length_in_fractions_of_sample_time), correlation_limit(
+				correlation_limit), history_len(history * sample_freq), event_history_len(
+				std::max(history, event_history) * sample_freq), recluster_interval(
+				history_len / 2), hist(0), hist_energy(0), hist_size(0), origin(
+				0), total(0), total_energy(0), n_clusters(0), recluster_at(0), reclustering(
+				true), reclusters(0) {
+	for (size_t i = 0; i < 2; ++i) {
+		clusters[i].n = 0;
+		clusters[i].p_sum = 0.0;
+	}
+}
+
+Clusters::~Clusters() {
+	mm_free(hist);
+	mm_free(hist_energy);
+}
+
+/**
+ * Drop the history older than history_len and the events older than
+ * event_history_len
+ */
+void Clusters::trim() {
+	size_t const keep_ev = total > event_history_len ?
+			total - event_history_len : 0;
+	for (size_t k = 0; k < 2; ++k) {
+		struct cluster &c = clusters[k];
+		retrig_ev::iterator it = c.ev.begin();
+		for (; it != c.ev.end() && it->offset < keep_ev; ++it) {
+			c.p_sum -= it->correlation.p;
+		}
+		c.ev.erase(c.ev.begin(), it);
+	}
+
+	size_t const keep = total > history_len ? total - history_len : 0;
+	if (keep <= origin || keep > total_energy) {
+		return;
+	}
+
+	size_t const n = keep - origin;
+	memmove(hist, hist + n, (total - keep) * sizeof(data_raw_t));
+	memmove(hist_energy, hist_energy + n,
+			(total_energy - keep) * sizeof(cl_float));
+	origin = keep;
+
+	ref_ev::iterator it = recent.begin();
+	while (it != recent.end() && it->offset < origin) {
+		++it;
+	}
+	recent.erase(recent.begin(), it);
+}
+
+/**
+ * Reserve history for len more samples
+ *
+ * @param Number of samples to add
+ */
+static void reserve(data_raw_t **hist, cl_float **hist_energy,
+		size_t *hist_size, size_t const &need) {
+	if (need <= *hist_size) {
+		return;
+	}
+
+	*hist_size = 2 * need;
+	*hist = static_cast<data_raw_t *>(mm_realloc(*hist,
+			*hist_size * sizeof(data_raw_t)));
+	*hist_energy = static_cast<cl_float *>(mm_realloc(*hist_energy,
+			*hist_size * sizeof(cl_float)));
+	if (*hist == 0 || *hist_energy == 0) {
+		PERROR("realloc");
+	}
+}
+
+/**
+ * Push a chunk of signal
+ *
+ * @param Pointer to data
+ * @param Length of data in samples
+ */
+void Clusters::push(data_raw_t const *raw, size_t const &len) {
+	trim();
+	reserve(&hist, &hist_energy, &hist_size, total + len - origin);
+	memcpy(hist + (total - origin), raw, len * sizeof(data_raw_t));
+	total += len;
+	process();
+}
+
+/**
+ * Push a chunk of the energy signal of the data
+ *
+ * @param Pointer to energy signal
+ * @param Length of energy signal in samples
+ */
+void Clusters::push_energy(cl_float const *energy, size_t const &len) {
+	reserve(&hist, &hist_energy, &hist_size, total_energy + len - origin);
+	memcpy(hist_energy + (total_energy - origin), energy,
+			len * sizeof(cl_float));
+	total_energy += len;
+	process();
+}
+
+/**
+ * Add new reference events
+ *
+ * @param Vector of reference events in increasing offset order
+ * @return Number of events processed, older events included
+ */
+size_t Clusters::add(ref_ev const &ev) {
+	pending.insert(pending.end(), ev.begin(), ev.end());
+	return process();
+}
+
+/**
+ * Allow or defer full clustering
+ *
+ * Deferred clustering runs at the first event after it is allowed again.
+ *
+ * @param False to defer full clustering
+ */
+void Clusters::set_reclustering(bool const &enabled) {
+	reclustering = enabled;
+}
+
+/**
+ * Process the pending events that have enough signal around them
+ *
+ * @return Number of events processed
+ */
+size_t Clusters::process() {
+	size_t const need = lookaround_window.len + correlation_window.len
+			+ halo();
+	size_t n = 0;
+
+	for (; n < pending.size(); ++n) {
+		struct ref_event const &e = pending[n];
+		if (e.offset + need > total || e.offset >= total_energy) {
+			break;
+		}
+		if (e.offset < origin + need) {
+			continue; // too close to the beginning of the signal
+		}
+
+		recent.push_back(e);
+
+		if (n_clusters) {
+			assign(e);
+		}
+
+		if (reclustering && e.offset >= recluster_at
+				&& recent.size() >= min_events
+				&& (n_clusters == 0 || get_quality() < correlation_limit)) {
+			recluster(e.offset);
+		}
+	}
+
+	pending.erase(pending.begin(), pending.begin() + n);
+	return n;
+}
+
+/**
+ * A custom correlation value
+ *
+ * Divider is set as the greatest variance, see retrig_correlation_program.
+ *
+ * @param Pointer to the template
+ * @param Pointer to the signal window
+ * @param Length of the window in samples
+ * @return Correlation value
+ */
+static double correlation(cl_float const *b, retrig_in_t const *a,
+		size_t const &len) {
+	double avg_a = 0.0, avg_b = 0.0;
+	for (size_t i = 0; i < len; ++i) {
+		avg_a += a[i];
+		avg_b += b[i];
+	}
+	avg_a /= len;
+	avg_b /= len;
+
+	double conv = 0.0, var_a = 0.0, var_b = 0.0;
+	for (size_t i = 0; i < len; ++i) {
+		double const _a = a[i] - avg_a;
+		double const _b = b[i] - avg_b;
+		conv += _a * _b;
+		var_a += _a * _a;
+		var_b += _b * _b;
+	}
+
+	double const var = var_a > var_b ? var_a : var_b;
+	return var > 0.0 ? conv / var : 0.0;
+}
+
+/**
+ * Correlate an event against the templates and assign it to the best match
+ *
+ * @param Reference event with enough signal around it
+ */
+void Clusters::assign(struct ref_event const &e) {
+	size_t const set = e.offset - lookaround_window.offset
+			- correlation_window.offset - halo();
+	size_t const end = e.offset - lookaround_window.offset
+			+ lookaround_window.len + correlation_window.len + halo();
+
+	set_prefiltered_data(hist + (set - origin), end - set);
+
+	double best_p = 0.0;
+	size_t best_at = 0;
+	struct cluster *best = 0;
+	for (size_t k = 0; k < n_clusters; ++k) {
+		struct cluster &c = clusters[k];
+		for (size_t i = e.offset - lookaround_window.offset, _len = i
+				+ lookaround_window.len; i < _len; ++i) {
+			double const p = correlation(&c.signal[0],
+					in + (i - set - correlation_window.offset),
+					correlation_window.len);
+			if (p > best_p) {
+				best_p = p;
+				best_at = i;
+				best = &c;
+			}
+		}
+	}
+
+	quality.push_back(best_p);
+	if (quality.size() > quality_len) {
+		quality.erase(quality.begin());
+	}
+
+	if (best == 0 || best_p < correlation_limit) {
+		return;
+	}
+
+	struct retrig_event _e = { best_at, best_p, hist_energy[best_at - origin] };
+	best->ev.push_back(_e);
+	best->p.push_back(best_p);
+	if (best->p.size() > quality_len) {
+		best->p.erase(best->p.begin());
+	}
+	best->p_sum += best_p;
+
+	// running average, the weight of a new event is limited so that the template can follow
+	if (best->n < template_weight_limit) {
+		++best->n;
+	}
+	retrig_in_t const *a = in + (best_at - set - correlation_window.offset);
+	for (size_t i = 0; i < correlation_window.len; ++i) {
+		best->signal[i] += (a[i] - best->signal[i]) / best->n;
+	}
+}
+
+/**
+ * Average the windows of events into a template
+ *
+ * Expects the data of the events to be set.
+ *
+ * @param Cluster to set
+ * @param Events relative to the set data
+ */
+void Clusters::set_template(struct cluster &c, retrig_ev const &ev) {
+	c.signal.assign(correlation_window.len, 0.0);
+	c.n = 0;
+	c.p.clear();
+	for (retrig_ev_it it = ev.begin(); it != ev.end(); ++it) {
+		if (it->offset < static_cast<size_t>(correlation_window.offset)
+				|| it->offset - correlation_window.offset
+						+ correlation_window.len > len) {
+			continue;
+		}
+
+		retrig_in_t const *a = in + (it->offset - correlation_window.offset);
+		for (size_t i = 0; i < correlation_window.len; ++i) {
+			c.signal[i] += a[i];
+		}
+		++c.n;
+
+		c.p.push_back(it->correlation.p);
+		if (c.p.size() > quality_len) {
+			c.p.erase(c.p.begin());
+		}
+	}
+
+	if (c.n) {
+		for (size_t i = 0; i < correlation_window.len; ++i) {
+			c.signal[i] /= c.n;
+		}
+	}
+	if (c.n > template_weight_limit) {
+		c.n = template_weight_limit;
+	}
+}
+
+/**
+ * Full clustering over the history
+ *
+ * Replaces the events of the clusters within the history and the templates.
+ *
+ * @param Offset of the event that started the clustering
+ */
+void Clusters::recluster(size_t const &at) {
+	size_t const _len = total_energy < total ? total_energy : total;
+
+	recluster_at = at + recluster_interval;
+	++reclusters;
+
+	ref_ev ev;
+	for (ref_ev_it it = recent.begin(); it != recent.end(); ++it) {
+		struct ref_event const e = { it->offset - origin };
+		ev.push_back(e);
+	}
+
+	set_data(hist, hist_energy, _len - origin);
+	set_ref_ev(ev);
+	calc_correlations(correlation_limit);
+
+	retrig_ev const *_ev[2] = { 0, 0 };
+	size_t n = 0;
+	try {
+		_ev[0] = &Retrigger::get_s1_events();
+		_ev[1] = &Retrigger::get_s2_events();
+		n = 2;
+	} catch (int e) {
+		if (Retrigger::get_events().size()) {
+			_ev[0] = &Retrigger::get_events();
+			n = 1;
+		}
+	}
+
+	if (n == 0) {
+		if (n_clusters == 0) {
+			recluster_at = at + sample_freq; // retry soon while there are no templates
+		}
+		return; // keep the current templates
+	}
+
+	if (n != n_clusters) {
+		for (size_t k = 0; k < 2; ++k) {
+			clusters[k].ev.clear();
+			clusters[k].p_sum = 0.0;
+		}
+	}
+	n_clusters = n;
+
+	for (size_t k = 0; k < n; ++k) {
+		struct cluster &c = clusters[k];
+
+		retrig_ev::iterator it = c.ev.begin();
+		while (it != c.ev.end() && it->offset < origin) {
+			++it;
+		}
+		for (retrig_ev::iterator it2 = it; it2 != c.ev.end(); ++it2) {
+			c.p_sum -= it2->correlation.p;
+		}
+		c.ev.erase(it, c.ev.end());
+
+		for (retrig_ev_it it2 = _ev[k]->begin(); it2 != _ev[k]->end(); ++it2) {
+			struct retrig_event e = *it2;
+			e.offset += origin;
+			c.ev.push_back(e);
+			c.p_sum += e.correlation.p;
+		}
+
+		set_template(c, *_ev[k]);
+	}
+
+	quality.clear();
+}
+
+/**
+ * Getter for events
+ *
+ * @return Events in EV cluster, empty if S1 and S2 clusters are found
+ */
+retrig_ev const &Clusters::get_events() const {
+	return n_clusters == 1 ? clusters[0].ev : none;
+}
+
+/**
+ * Getter for events
+ *
+ * @return Events in S1 cluster
+ */
+retrig_ev const &Clusters::get_s1_events() const {
+	if (n_clusters < 2) {
+		throw EINVAL;
+	}
+	return clusters[0].ev;
+}
+
+/**
+ * Getter for events
+ *
+ * @return Events in S2 cluster
+ */
+retrig_ev const &Clusters::get_s2_events() const {
+	if (n_clusters < 2) {
+		throw EINVAL;
+	}
+	return clusters[1].ev;
+}
+
+/**
+ * Template quality
+ *
+ * @return Average of the best template correlations of the last events
+ */
+double Clusters::get_quality() const {
+	if (quality.size() == 0) {
+		return 1.0;
+	}
+
+	double p = 0.0;
+	for (size_t i = 0; i < quality.size(); ++i) {
+		p += quality[i];
+	}
+	return p / quality.size();
+}
+
+/**
+ * Cluster statistics
+ *
+ * @param Cluster index; 0 for S1 or EV, 1 for S2
+ * @return Average correlation of the events of the cluster within the event
+ *         history
+ */
+double Clusters::get_p(size_t const &i) const {
+	if (i >= n_clusters || clusters[i].ev.size() == 0) {
+		return 0.0;
+	}
+	return clusters[i].p_sum / clusters[i].ev.size();
+}
+
+/**
+ * Getter for the number of full clusterings
+ *
+ * @return Number of full clusterings run so far
+ */
+size_t const &Clusters::get_reclusters() const {
+	return reclusters;
+}
+
+} /* namespace Simplified */
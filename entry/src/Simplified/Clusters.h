@@ -0,0 +1,81 @@
+/**
+ * Clusters.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_SIMPLIFIED_CLUSTERS_H_
+#define SRC_SIMPLIFIED_CLUSTERS_H_
+
+#include <vector>
+#include "Retrigger.h"
+
+namespace Simplified {
+
+struct cluster {
+	std::vector<cl_float> signal; // averaged template, centered on the event
+	size_t n; // events averaged into the template
+	std::vector<double> p; // correlations of the last assigned events
+	double p_sum; // sum of the correlations of ev
+	retrig_ev ev; // assigned events within the event history
+};
+
+class Clusters: public Retrigger {
+public:
+	static size_t constexpr quality_len = 8;
+	static size_t constexpr template_weight_limit = 32;
+	static size_t constexpr min_events = 6;
+
+	Clusters(double const &window_length_in_fractions_of_sample_time,
+			double const &correlation_limit = 0.8,
+			double const &history = 20.0, double const &event_history = 30.0);
+	virtual ~Clusters();
+
+	void push(data_raw_t const *raw, size_t const &len);
+	void push_energy(cl_float const *energy, size_t const &len);
+	size_t add(ref_ev const &ev);
+	void set_reclustering(bool const &enabled);
+
+	retrig_ev const &get_events() const;
+	retrig_ev const &get_s1_events() const;
+	retrig_ev const &get_s2_events() const;
+
+	double get_quality() const;
+	double get_p(size_t const &i) const;
+	size_t const &get_reclusters() const;
+private:
+	double const correlation_limit;
+	size_t const history_len;
+	size_t const event_history_len;
+	size_t const recluster_interval;
+
+	data_raw_t *hist; // hist[0] and hist_energy[0] are the samples at origin
+	cl_float *hist_energy;
+	size_t hist_size;
+	size_t origin;
+	size_t total; // samples received
+	size_t total_energy; // energy samples received
+
+	ref_ev pending; // events waiting for signal
+	ref_ev recent; // events within the history
+
+	struct cluster clusters[2];
+	size_t n_clusters; // 0: none, 1: EV, 2: S1 and S2
+	retrig_ev none; // empty result
+
+	std::vector<double> quality; // best correlation of the last events
+	size_t recluster_at; // earliest offset for the next full clustering
+	bool reclustering;
+	size_t reclusters;
+
+	size_t process();
+	void assign(struct ref_event const &e);
+	void recluster(size_t const &at);
+	void set_template(struct cluster &c, retrig_ev const &ev);
+	void trim();
+};
+
+} /* namespace Simplified */
+
+#endif /* SRC_SIMPLIFIED_CLUSTERS_H_ */
@@ -0,0 +1,416 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Corpus.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include <zlib.h>
+
+#include "macro.h"
+
+#include "Corpus.h"
+
+namespace Signal {
+
+size_t constexpr Corpus::corpus_align;
+size_t constexpr Corpus::npos;
+
+static char const corpus_magic[8] = "TFTRIGC";
+static uint32_t constexpr corpus_version = 1;
+static uint32_t constexpr corpus_byte_order = 0x01020304;
+static size_t constexpr corpus_header_len = 4096; // the samples start page aligned
+
+/**
+ * CRC-32 of a buffer of any length, zlib counts in uInt
+ */
+static uint32_t crc(uint32_t crc, void const *buf, size_t len) {
+	Bytef const *p = static_cast<Bytef const *>(buf);
+	for (size_t const chunk = 1u << 30; len; ) {
+		size_t const n = len < chunk ? len : chunk;
+		crc = crc32(crc, p, n);
+		p += n;
+		len -= n;
+	}
+	return crc;
+}
+
+/**
+ * @return Sample type of this build, see corpus_sample_e
+ */
+uint32_t Corpus::sample_type() {
+#if defined(DATA_RAW_T_FIXED)
+	return CORPUS_FIXED;
+#elif defined(DATA_RAW_T_FLOAT)
+	return CORPUS_FLOAT;
+#else
+	return CORPUS_DOUBLE;
+#endif
+}
+
+/**
+ * Map a corpus and check its header and index
+ *
+ * @param Corpus filename
+ */
+Corpus::Corpus(char const *filename) :
+		map(0), map_len(0), header(0), entries(0), names(0) {
+	int const fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		PERROR("open");
+	}
+
+	struct stat sb;
+	if (fstat(fd, &sb)) {
+		close(fd);
+		PERROR("fstat");
+	}
+
+	map_len = sb.st_size;
+	if (map_len) {
+		map = mmap(0, map_len, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (map_len == 0 || map == MAP_FAILED) {
+		map = 0;
+		if (map_len == 0) {
+			errno = EINVAL;
+		}
+		PERROR("mmap");
+	}
+
+	try {
+		parse();
+	} catch (int e) {
+		munmap(map, map_len);
+		throw;
+	}
+}
+
+Corpus::~Corpus() {
+	munmap(map, map_len);
+}
+
+void Corpus::parse() {
+	uint8_t const *buf = static_cast<uint8_t const *>(map);
+	header = reinterpret_cast<struct corpus_header const *>(buf);
+
+	if (map_len < corpus_header_len
+			|| memcmp(header->magic, corpus_magic, sizeof(corpus_magic))
+			|| header->byte_order != corpus_byte_order
+			|| header->version != corpus_version
+			|| header->header_crc
+					!= crc(0, header, offsetof(struct corpus_header, header_crc))) {
+		errno = EINVAL;
+		PERROR("not a corpus");
+	}
+	if (header->sample_type != sample_type()
+			|| header->sample_q != DATA_RAW_T_Q) {
+		errno = EINVAL;
+		PERROR("corpus packed for another PRECISION");
+	}
+
+	size_t const index_len = header->records * sizeof(struct corpus_entry);
+	if (header->index_offset > map_len
+			|| header->records > map_len / sizeof(struct corpus_entry)
+			|| index_len > map_len - header->index_offset
+			|| header->names_offset != header->index_offset + index_len
+			|| header->names_len > map_len - header->names_offset
+			|| header->index_offset % alignof(struct corpus_entry)) {
+		errno = EINVAL;
+		PERROR("corrupted corpus index");
+	}
+	if (header->index_crc
+			!= crc(0, buf + header->index_offset, index_len + header->names_len)) {
+		errno = EINVAL;
+		PERROR("corpus index CRC mismatch");
+	}
+
+	entries = reinterpret_cast<struct corpus_entry const *>(buf
+			+ header->index_offset);
+	names = reinterpret_cast<char const *>(buf + header->names_offset);
+
+	index.reserve(header->records);
+	std::vector<std::atomic<bool> >(header->records).swap(verified);
+	for (size_t i = 0; i < header->records; ++i) {
+		struct corpus_entry const &e = entries[i];
+		size_t const len = e.channels ?
+				(e.channels - 1) * e.stride + e.samples * sizeof(data_raw_t) : 0;
+		if (e.name >= header->names_len
+				|| memchr(names + e.name, 0, header->names_len - e.name) == 0
+				|| e.offset % corpus_align || e.stride % corpus_align
+				|| e.samples > map_len / sizeof(data_raw_t)
+				|| e.stride < e.samples * sizeof(data_raw_t)
+				|| e.channels > map_len / (e.stride ? e.stride : 1)
+				|| e.offset > map_len || len > map_len - e.offset) {
+			errno = EINVAL;
+			PERROR("corrupted corpus entry");
+		}
+		// by the name and by the bare record name, eg. a0001
+		index.emplace(names + e.name, i);
+		char const *slash = strrchr(names + e.name, '/');
+		if (slash) {
+			index.emplace(slash + 1, i);
+		}
+	}
+}
+
+/**
+ * @return Number of records
+ */
+size_t Corpus::size() const {
+	return header->records;
+}
+
+/**
+ * Look up a record
+ *
+ * @param Record name as packed, eg. training-a/a0001, or the bare record name
+ * @return Index of the record, npos if not found
+ */
+size_t Corpus::find(char const *name) const {
+	std::unordered_map<std::string, size_t>::const_iterator const i =
+			index.find(name);
+	return i == index.end() ? npos : i->second;
+}
+
+/**
+ * @param Index of the record
+ * @return Record name, valid until the corpus is destroyed
+ */
+char const *Corpus::get_name(size_t const &record) const {
+	return names + get_entry(record).name;
+}
+
+/**
+ * @param Index of the record
+ * @return Index entry of the record
+ */
+struct corpus_entry const &Corpus::get_entry(size_t const &record) const {
+	if (record >= header->records) {
+		errno = EINVAL;
+		PERROR("no such record");
+	}
+	return entries[record];
+}
+
+/**
+ * Samples of a channel in place
+ *
+ * @param Index of the record
+ * @param Channel, from zero
+ * @return Pointer to samples, valid until the corpus is destroyed
+ */
+data_raw_t const *Corpus::get_samples(size_t const &record,
+		size_t const &channel) const {
+	struct corpus_entry const &e = get_entry(record);
+	if (channel >= e.channels) {
+		errno = EINVAL;
+		PERROR("no such channel");
+	}
+	return reinterpret_cast<data_raw_t const *>(static_cast<uint8_t const *>(map)
+			+ e.offset + channel * e.stride);
+}
+
+/**
+ * Check the CRC of a record
+ *
+ * This is the one pass over the pages of the record before the pipeline; the
+ * pages are read ahead first. A record is checked once per Corpus object.
+ *
+ * @param Index of the record
+ */
+void Corpus::verify(size_t const &record) const {
+	struct corpus_entry const &e = get_entry(record);
+	if (verified[record].load(std::memory_order_acquire)) {
+		return;
+	}
+	uint8_t const *p = static_cast<uint8_t const *>(map) + e.offset;
+
+	// madvise wants a page aligned start
+	size_t const page = sysconf(_SC_PAGESIZE);
+	size_t const start = e.offset / page * page;
+	madvise(static_cast<uint8_t *>(map) + start,
+			e.offset - start + e.channels * e.stride, MADV_WILLNEED);
+
+	uint32_t c = crc32(0, Z_NULL, 0);
+	for (size_t ch = 0; ch < e.channels; ++ch) {
+		c = crc(c, p + ch * e.stride, e.samples * sizeof(data_raw_t));
+	}
+	if (c != e.crc) {
+		errno = EINVAL;
+		PERROR("corpus record CRC mismatch");
+	}
+	verified[record].store(true, std::memory_order_release);
+}
+
+/**
+ * Split a record path into a corpus and a record, eg.
+ * train.tfc/training-a/a0001 into train.tfc and training-a/a0001
+ *
+ * @param Record path
+ * @param Pointer to output corpus filename
+ * @param Pointer to output record name
+ * @return True if the path is inside a .tfc corpus
+ */
+bool Corpus::split(char const *path, std::string *corpus,
+		std::string *record) {
+	char const *tfc = strstr(path, ".tfc/");
+	if (tfc == 0) {
+		return false;
+	}
+	corpus->assign(path, tfc + 4);
+	record->assign(tfc + 5);
+	return true;
+}
+
+/**
+ * Start a corpus
+ *
+ * @param Corpus filename
+ */
+CorpusWriter::CorpusWriter(char const *filename) :
+		filename(filename), f(0), offset(0) {
+	char tmp[FILENAME_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.%d.%lu", filename, getpid(),
+			static_cast<unsigned long>(pthread_self()));
+	tmpfile = tmp;
+
+	f = fopen(tmpfile.c_str(), "w");
+	if (f == 0) {
+		PERROR("fopen");
+	}
+
+	// the header is written by finish()
+	static uint8_t const zero[corpus_header_len] = { };
+	write(zero, sizeof(zero));
+}
+
+/**
+ * An unfinished corpus is removed
+ */
+CorpusWriter::~CorpusWriter() {
+	if (f) {
+		fclose(f);
+		unlink(tmpfile.c_str());
+	}
+}
+
+void CorpusWriter::write(void const *buf, size_t const &len) {
+	if (len && fwrite(buf, len, 1, f) != 1) {
+		PERROR("fwrite");
+	}
+	offset += len;
+}
+
+/**
+ * Pad the file to corpus_align
+ */
+void CorpusWriter::pad() {
+	static uint8_t const zero[Corpus::corpus_align] = { };
+	write(zero, (Corpus::corpus_align - offset % Corpus::corpus_align)
+			% Corpus::corpus_align);
+}
+
+/**
+ * Append a baseline and scale corrected record
+ *
+ * @param Record name
+ * @param Signals, one per channel
+ * @param Number of channels
+ * @param Number of samples per channel
+ */
+void CorpusWriter::append(char const *name, data_raw_t const *const *channels,
+		size_t const &n_channels, size_t const &samples) {
+	size_t const len = samples * sizeof(data_raw_t);
+
+	struct corpus_entry e;
+	memset(&e, 0, sizeof(e));
+	pad();
+	e.name = names.size();
+	e.offset = offset;
+	e.stride = (len + Corpus::corpus_align - 1) / Corpus::corpus_align
+			* Corpus::corpus_align;
+	e.samples = samples;
+	e.channels = n_channels;
+	e.crc = crc32(0, Z_NULL, 0);
+	for (size_t c = 0; c < n_channels; ++c) {
+		write(channels[c], len);
+		e.crc = crc(e.crc, channels[c], len);
+		if (c + 1 < n_channels) {
+			pad();
+		}
+	}
+
+	entries.push_back(e);
+	names.append(name);
+	names.push_back(0);
+}
+
+/**
+ * Write the index and the header, and rename the corpus in place
+ */
+void CorpusWriter::finish() {
+	struct corpus_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, corpus_magic, sizeof(h.magic));
+	h.version = corpus_version;
+	h.byte_order = corpus_byte_order;
+	h.sample_type = Corpus::sample_type();
+	h.sample_q = DATA_RAW_T_Q;
+	h.sample_freq = 2000; // Hz, see PhysionetChallenge2016::sample_freq
+	h.records = entries.size();
+
+	pad();
+	h.index_offset = offset;
+	size_t const index_len = entries.size() * sizeof(struct corpus_entry);
+	write(entries.data(), index_len);
+	h.names_offset = offset;
+	h.names_len = names.size();
+	write(names.data(), names.size());
+
+	h.index_crc = crc(crc(0, entries.data(), index_len), names.data(),
+			names.size());
+	h.header_crc = crc(0, &h, offsetof(struct corpus_header, header_crc));
+
+	if (fseek(f, 0, SEEK_SET) || fwrite(&h, sizeof(h), 1, f) != 1) {
+		PERROR("fwrite");
+	}
+	if (fflush(f) || fsync(fileno(f))) {
+		PERROR("fsync");
+	}
+	fclose(f);
+	f = 0;
+	if (rename(tmpfile.c_str(), filename.c_str())) {
+		unlink(tmpfile.c_str());
+		PERROR("rename");
+	}
+}
+
+} /* namespace Signal */
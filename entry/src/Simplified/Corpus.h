@@ -0,0 +1,130 @@
+/**
+ * Corpus.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef ENTRY_SRC_SIMPLIFIED_CORPUS_H_
+#define ENTRY_SRC_SIMPLIFIED_CORPUS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+
+#include "types.data.h"
+
+namespace Signal {
+
+/*
+ * Packed corpus file, see tftrig_pack
+ *
+ *   header, one page
+ *   per record: channel sample arrays, each aligned to corpus_align bytes
+ *   index of corpus_entry, then the record names separated by NUL
+ *
+ * The samples are baseline and scale corrected data_raw_t of the packing
+ * build, so a corpus is read by a build of the same PRECISION only. All the
+ * fields are in host byte order, see byte_order.
+ */
+enum corpus_sample_e {
+	CORPUS_DOUBLE = 1, CORPUS_FLOAT = 2, CORPUS_FIXED = 3,
+};
+
+struct corpus_header {
+	char magic[8]; // "TFTRIGC\0"
+	uint32_t version;
+	uint32_t byte_order; // 0x01020304 as written
+	uint32_t sample_type; // corpus_sample_e
+	uint32_t sample_q; // DATA_RAW_T_Q of fixed point samples
+	uint64_t sample_freq;
+	uint64_t records;
+	uint64_t index_offset;
+	uint64_t names_offset;
+	uint64_t names_len;
+	uint32_t index_crc; // of the index and the names
+	uint32_t header_crc; // of the header up to this field
+};
+
+struct corpus_entry {
+	uint64_t name; // offset in the names
+	uint64_t offset; // of the first channel
+	uint64_t stride; // bytes from one channel to the next
+	uint64_t samples; // per channel
+	uint32_t channels;
+	uint32_t crc; // of the sample arrays, without the padding
+};
+
+/*
+ * Read only view of a packed corpus
+ *
+ * The file is mapped once; the samples are used in place, see
+ * PhysionetChallenge2016. The object is read only after construction, apart
+ * from the records already verified, so it can be shared between threads.
+ */
+class Corpus {
+public:
+	static size_t constexpr corpus_align = 64; // bytes, a cache line
+	static size_t constexpr npos = static_cast<size_t>(-1);
+
+	explicit Corpus(char const *filename);
+	virtual ~Corpus();
+
+	size_t size() const;
+	size_t find(char const *name) const;
+	char const *get_name(size_t const &record) const;
+	struct corpus_entry const &get_entry(size_t const &record) const;
+	data_raw_t const *get_samples(size_t const &record,
+			size_t const &channel) const;
+	void verify(size_t const &record) const;
+
+	static bool split(char const *path, std::string *corpus,
+			std::string *record);
+	static uint32_t sample_type();
+private:
+	void *map;
+	size_t map_len;
+
+	struct corpus_header const *header;
+	struct corpus_entry const *entries;
+	char const *names;
+	std::unordered_map<std::string, size_t> index;
+	mutable std::vector<std::atomic<bool> > verified; // records of a good CRC
+
+	void parse();
+};
+
+/*
+ * Writer of a packed corpus
+ *
+ * The corpus is written to a private file and renamed in place by finish(),
+ * so a reader never sees a partial corpus.
+ */
+class CorpusWriter {
+public:
+	explicit CorpusWriter(char const *filename);
+	virtual ~CorpusWriter();
+
+	void append(char const *name, data_raw_t const *const *channels,
+			size_t const &n_channels, size_t const &samples);
+	void finish();
+private:
+	std::string filename;
+	std::string tmpfile;
+	FILE *f;
+	uint64_t offset;
+
+	std::vector<struct corpus_entry> entries;
+	std::string names;
+
+	void write(void const *buf, size_t const &len);
+	void pad();
+};
+
+} /* namespace Signal */
+
+#endif /* ENTRY_SRC_SIMPLIFIED_CORPUS_H_ */
@@ -0,0 +1,167 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * EnergyStream.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <math.h>
+
+#include "macro.h"
+#include "../utils/memory_manager.h"
+
+#include "EnergyStream.h"
+
+namespace Simplified {
+
+/**
+ * A push based energy signal
+ *
+ * Takes the signal in chunks of any size and produces the same energy signal
+ * as Retrigger::set_data in blocks. Each block is calculated from a segment
+ * that extends a halo over both ends: the settle time of the forward-backward
+ * IIR prefilter plus half of the convolution kernel and of the energy window.
+ * The convolution kernel must be set before the first push.
+ *
+ * @param Energy function window length in fraction of sample time (seconds)
+ * @param Block length in seconds
+ */
+EnergyStream::EnergyStream(
+		double const &window_length_in_fractions_of_sample_time,
+		double const &block_length) :
+		Retrigger(window_length_in_fractions_of_sample_time), hist(0), hist_origin(
+				0), hist_len(0), hist_size(0), total(0), done(0), block_len(
+				block_length * sample_freq > 1 ?
+						block_length * sample_freq : 1), block(0), block_offset(
+				0), block_n(0), block_size(0) {
+}
+
+EnergyStream::~EnergyStream() {
+	mm_free(hist);
+	mm_free(block);
+}
+
+/**
+ * Calculate the energy up to end and append it to the current block
+ *
+ * @param End of the energy to calculate in samples
+ */
+void EnergyStream::emit(size_t const &end) {
+	size_t const set = done > halo() ? done - halo() : 0;
+	size_t const seg_end = end + halo() < total ? end + halo() : total;
+
+	Retrigger::set_data(hist + (set - hist_origin), seg_end - set);
+
+	if (block_n + end - done > block_size) {
+		block_size = block_n + end - done;
+		block = static_cast<cl_float *>(mm_realloc(block,
+				block_size * sizeof(cl_float)));
+		if (block == 0) {
+			PERROR("realloc");
+		}
+	}
+
+	memcpy(block + block_n, energy + (done - set),
+			(end - done) * sizeof(cl_float));
+	block_n += end - done;
+	done = end;
+}
+
+/**
+ * Push a chunk of signal
+ *
+ * @param Pointer to data
+ * @param Length of data in samples
+ * @return Number of new energy samples, see get_block()
+ */
+size_t EnergyStream::push(data_raw_t const *raw, size_t const &len) {
+	block_offset = done;
+	block_n = 0;
+
+	// drop the history no block needs anymore
+	size_t const keep = done > halo() ? done - halo() : 0;
+	if (keep > hist_origin) {
+		hist_len -= keep - hist_origin;
+		memmove(hist, hist + (keep - hist_origin),
+				hist_len * sizeof(data_raw_t));
+		hist_origin = keep;
+	}
+
+	if (hist_len + len > hist_size) {
+		hist_size = 2 * (hist_len + len);
+		hist = static_cast<data_raw_t *>(mm_realloc(hist,
+				hist_size * sizeof(data_raw_t)));
+		if (hist == 0) {
+			PERROR("realloc");
+		}
+	}
+
+	memcpy(hist + hist_len, raw, len * sizeof(data_raw_t));
+	hist_len += len;
+	total += len;
+
+	while (done + block_len + halo() <= total) {
+		emit(done + block_len);
+	}
+	return block_n;
+}
+
+/**
+ * Calculate the rest of the energy at the end of the signal
+ *
+ * @return Number of new energy samples, see get_block()
+ */
+size_t EnergyStream::flush() {
+	block_offset = done;
+	block_n = 0;
+
+	if (done < total) {
+		emit(total);
+	}
+	return block_n;
+}
+
+/**
+ * Getter for the energy samples produced by the last push() or flush()
+ *
+ * @return Pointer to energy samples, valid until the next push() or flush()
+ */
+cl_float const *EnergyStream::get_block() const {
+	return block;
+}
+
+/**
+ * Getter for the offset of the last block
+ *
+ * @return Offset of the first sample of get_block() in samples
+ */
+size_t const &EnergyStream::get_block_offset() const {
+	return block_offset;
+}
+
+/**
+ * Latency of the energy signal in steady state
+ *
+ * @return Number of samples pushed after a sample before its energy is emitted
+ */
+size_t EnergyStream::get_latency() const {
+	return block_len + halo();
+}
+
+} /* namespace Simplified */
@@ -0,0 +1,47 @@
+/**
+ * EnergyStream.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_SIMPLIFIED_ENERGYSTREAM_H_
+#define SRC_SIMPLIFIED_ENERGYSTREAM_H_
+
+#include "Retrigger.h"
+
+namespace Simplified {
+
+class EnergyStream: public Retrigger {
+public:
+	EnergyStream(double const &window_length_in_fractions_of_sample_time,
+			double const &block_length = 0.5);
+	virtual ~EnergyStream();
+
+	size_t push(data_raw_t const *raw, size_t const &len);
+	size_t flush();
+
+	cl_float const *get_block() const;
+	size_t const &get_block_offset() const;
+	size_t get_latency() const;
+private:
+	data_raw_t *hist; // hist[0] is the sample at hist_origin
+	size_t hist_origin;
+	size_t hist_len;
+	size_t hist_size;
+
+	size_t total; // samples received
+	size_t done; // energy samples emitted
+
+	size_t const block_len;
+	cl_float *block;
+	size_t block_offset;
+	size_t block_n;
+	size_t block_size;
+
+	void emit(size_t const &end);
+};
+
+} /* namespace Simplified */
+
+#endif /* SRC_SIMPLIFIED_ENERGYSTREAM_H_ */
@@ -0,0 +1,188 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * PcmStream.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <errno.h>
+#include <math.h>
+
+#include <unistd.h>
+
+#include "macro.h"
+#include "../utils/memory_manager.h"
+
+#include "PcmStream.h"
+
+namespace Signal {
+
+size_t constexpr PcmStream::calibration_len;
+
+/**
+ * Read raw PCM from a pipe, FIFO or file descriptor in blocks
+ *
+ * The data is little-endian 16bit PCM, one channel at 2000 Hz. The baseline
+ * and amplitude scale are corrected like PhysionetChallenge2016 does, but the
+ * statistics are taken from the first calibration_len samples only.
+ *
+ * @param File descriptor to read from
+ * @param Block length in samples
+ */
+PcmStream::PcmStream(int const &fd, size_t const &block_len) :
+		fd(fd), block_len(block_len), total(0), ave(0.0), scale(1.0) {
+	size_t const n =
+			block_len > calibration_len ? block_len : calibration_len;
+	buffer = static_cast<int16_t *>(mm_malloc(n * sizeof(int16_t)));
+	block = static_cast<data_raw_t *>(mm_malloc(n * sizeof(data_raw_t)));
+	if (buffer == 0 || block == 0) {
+		PERROR("malloc");
+	}
+}
+
+PcmStream::~PcmStream() {
+	mm_free(buffer);
+	mm_free(block);
+}
+
+/**
+ * Read up to len samples to the buffer, blocking until they are available
+ *
+ * @param Number of samples to read
+ * @return Number of samples read, less than len only at the end of stream
+ */
+size_t PcmStream::fill(size_t const &len) {
+	size_t const len_in_bytes = len * sizeof(int16_t);
+	size_t n = 0;
+	while (n < len_in_bytes) {
+		ssize_t const r = ::read(fd, reinterpret_cast<char *>(buffer) + n,
+				len_in_bytes - n);
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			PERROR("read");
+		}
+		if (r == 0) {
+			break;
+		}
+		n += r;
+	}
+	return n / sizeof(int16_t);
+}
+
+/**
+ * Baseline and amplitude scale from the first samples of the stream
+ *
+ * @param Number of samples in the buffer
+ */
+void PcmStream::calibrate(size_t const &n) {
+	size_t const start = n > 4000 ? 1000 : 0;
+
+	int64_t sum = 0;
+	for (size_t i = start; i < n; i++) {
+		sum += buffer[i];
+	}
+	ave = n > start ? static_cast<double>(sum) / (n - start) : 0.0;
+
+	size_t set, end;
+	if (n < 4000) {
+		set = 0;
+		end = n;
+	} else if (n < 10000) {
+		set = 1000;
+		end = n - 1000;
+	} else {
+		set = 2000;
+		end = 9000;
+	}
+
+	int16_t min = buffer[set], max = buffer[set];
+	for (size_t i = set; i < end; i++) {
+		if (min > buffer[i]) {
+			min = buffer[i];
+		}
+		if (max < buffer[i]) {
+			max = buffer[i];
+		}
+	}
+	scale = max > min ? 2000.0 / (max - min) : 1.0;
+}
+
+/**
+ * Convert samples from the buffer to the block
+ *
+ * @param Number of samples to convert
+ */
+void PcmStream::convert(size_t const &len) {
+	for (size_t i = 0; i < len; i++) {
+#ifdef DATA_RAW_T_FIXED
+		long const d = lrint(
+				(buffer[i] - ave) * scale * (1 << DATA_RAW_T_Q));
+		block[i] = d > INT16_MAX ? INT16_MAX : d < INT16_MIN ? INT16_MIN : d;
+#else
+		data_raw_t d = buffer[i];
+		d -= ave;
+		d *= scale;
+		block[i] = d;
+#endif
+	}
+}
+
+/**
+ * Read the next block
+ *
+ * The first block holds the calibration samples and may be longer than the
+ * block length.
+ *
+ * @return Number of samples in the block, zero at the end of stream
+ */
+size_t PcmStream::read() {
+	size_t n;
+	if (total == 0) {
+		n = fill(calibration_len);
+		if (n == 0) {
+			return 0;
+		}
+		calibrate(n);
+	} else {
+		n = fill(block_len);
+	}
+
+	convert(n);
+	total += n;
+	return n;
+}
+
+/**
+ * @return Pointer to the samples of the last block
+ */
+data_raw_t const *PcmStream::get_block() const {
+	return block;
+}
+
+/**
+ * @return Number of samples read so far
+ */
+size_t const &PcmStream::size() const {
+	return total;
+}
+
+} /* namespace Signal */
@@ -0,0 +1,44 @@
+/**
+ * PcmStream.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef ENTRY_SRC_SIMPLIFIED_PCMSTREAM_H_
+#define ENTRY_SRC_SIMPLIFIED_PCMSTREAM_H_
+
+#include "types.data.h"
+
+namespace Signal {
+
+class PcmStream {
+public:
+	static size_t constexpr calibration_len = 10000;
+
+	PcmStream(int const &fd, size_t const &block_len);
+	virtual ~PcmStream();
+
+	size_t read();
+
+	data_raw_t const *get_block() const;
+	size_t const &size() const;
+private:
+	int const fd;
+	size_t const block_len;
+
+	int16_t *buffer;
+	data_raw_t *block;
+	size_t total;
+
+	double ave;
+	double scale;
+
+	size_t fill(size_t const &len);
+	void calibrate(size_t const &len);
+	void convert(size_t const &len);
+};
+
+} /* namespace Signal */
+
+#endif /* ENTRY_SRC_SIMPLIFIED_PCMSTREAM_H_ */
@@ -23,7 +23,10 @@
  */
 
 #include <cstdio>
+#include <cstring>
+#include <string>
 #include <errno.h>
+#include <math.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -32,131 +35,553 @@
 #include "macro.h"
 #include "../utils/memory_manager.h"
 
+#include "../myDSP/Resampler.h"
+#include "WavFile.h"
+#include "ZipArchive.h"
+#include "WfdbRecord.h"
+#include "Corpus.h"
 #include "PhysionetChallenge2016.h"
 
 namespace Signal {
 
+size_t constexpr PhysionetChallenge2016::sample_freq;
+
+static void normalise_in_place(data_raw_t *raw, size_t const n);
+
 /**
  * Read PhysioNet / CinC 2016 Wav file to buffer
  *
- * Corrects corrupted data baseline and amplitude scale on demand
+ * The file is mapped and mono 16 bit PCM at 2000 Hz is converted straight from
+ * the mapped pages, see WavFile. Other sample formats and the channels of
+ * multi-channel files are decoded one channel at a time, other sample rates
+ * are resampled to 2000 Hz, see DSP::Resampler. Corrects corrupted data
+ * baseline and amplitude scale on demand, for each channel separately.
+ *
+ * A record without a .wav file is read from its WFDB header and signal
+ * files, see WfdbRecord.
  *
  * @param Input filename
  */
-PhysionetChallenge2016::PhysionetChallenge2016(char const *basename) {
+PhysionetChallenge2016::PhysionetChallenge2016(char const *basename) :
+		borrowed(false) {
 	char filename[FILENAME_MAX];
-	sprintf(filename, "%s.wav", basename);
+	snprintf(filename, sizeof(filename), "%s.wav", basename);
 
-	struct stat sb;
-	if (stat(filename, &sb)) {
-		PERROR("stat");
-		throw errno;
+	if (access(filename, F_OK)) {
+		char header[FILENAME_MAX];
+		snprintf(header, sizeof(header), "%s.hea", basename);
+		if (access(header, F_OK) == 0) {
+			WfdbRecord record(basename);
+			load(record);
+			return;
+		}
+	}
+
+	WavFile wav(filename);
+	load(wav);
+}
+
+/**
+ * Read a parsed Wav file, eg. one read ahead into memory, see Prefetch
+ *
+ * The samples are converted, so the file can go away afterwards. Otherwise as
+ * for the Wav files by name.
+ *
+ * @param Wav file
+ */
+PhysionetChallenge2016::PhysionetChallenge2016(WavFile const &wav) :
+		borrowed(false) {
+	load(wav);
+}
+
+/**
+ * Read a record from a ZIP archive without extracting it
+ *
+ * A stored member is parsed in place in the mapped archive. A deflated one in
+ * the native format is inflated straight into its channel, see
+ * load_inflated(). Other formats are decoded, and maybe resampled, a channel
+ * at a time from anywhere in the image, so such a member is inflated whole
+ * into a scratch buffer first. Otherwise as for the Wav files.
+ *
+ * @param Archive, see ZipArchive
+ * @param Index of the member, see ZipArchive::find()
+ */
+PhysionetChallenge2016::PhysionetChallenge2016(ZipArchive const &zip,
+		size_t const &member) :
+		borrowed(false) {
+	struct zip_member const &m = zip.get_members().at(member);
+	if (m.method == ZIP_STORED) {
+		WavFile wav(zip.get_stored(member), m.size);
+		load(wav);
+		return;
+	}
+	if (load_inflated(zip, member)) {
+		return;
 	}
 
-	FILE *f = fopen(filename, "rb");
-	if (f == NULL) {
-		PERROR("fopen");
-		throw errno;
+	// the size was checked against the compressed data by load_inflated()
+	void *image = mm_malloc(m.size ? m.size : 1);
+	try {
+		zip.inflate(member, image);
+		WavFile wav(image, m.size);
+		load(wav);
+	} catch (...) {
+		mm_free(image);
+		throw;
 	}
+	mm_free(image);
+}
 
- 	// FIXME: supports only one channel little-endian 16bit PCM data
-	dat.sample_freq = 2000.0;
-	dat.samples_per_channel = (sb.st_size - 44) / sizeof(int16_t);
-	dat.number_of_channels = 1;
-	dat.ch = static_cast<struct data_channel *>(mm_malloc(
-			sizeof(struct data_channel)));
+/**
+ * Inflate a member in the native format straight into its channel
+ *
+ * The header is gathered from the first pieces of the stream. The samples of
+ * 16 bit mono PCM at 2000 Hz are then inflated into the channel buffer and
+ * normalised there, see normalise_in_place(), so the record is never held
+ * twice. The output is the same as parsing the inflated image.
+ *
+ * @param Archive
+ * @param Index of a deflated member
+ * @return False if the member is not in the native format, nothing is loaded then
+ */
+bool PhysionetChallenge2016::load_inflated(ZipArchive const &zip,
+		size_t const &member) {
+	struct zip_member const &m = zip.get_members().at(member);
+	std::string header;
+	uint8_t *samples = 0;
+	size_t data_len = 0, filled = 0;
+
+	try {
+		zip.inflate(member,
+				[&](uint8_t const *data, size_t const &len) {
+					size_t n = len;
+					if (samples == 0) {
+						header.append(reinterpret_cast<char const *>(data), len);
+						size_t const offset = WavFile::find_data(header.data(),
+								header.size(), &data_len);
+						if (offset == 0) {
+							return true;
+						}
+						if (offset > header.size()) { // not a Wav image
+							return false;
+						}
+						WavFile const wav(header.data(), offset);
+						struct wav_format const &format = wav.get_format();
+						if (format.channels != 1
+								|| format.format_tag != WAV_FORMAT_PCM
+								|| format.bits_per_sample != 16
+								|| format.sample_rate != sample_freq) {
+							return false;
+						}
 
-	// read and convert
-	int16_t *data_buffer = static_cast<int16_t *>(mm_malloc(
-			dat.samples_per_channel * sizeof(int16_t)));
-	fseek(f, 44, SEEK_SET);
-	size_t nread = fread(data_buffer, sizeof(int16_t), dat.samples_per_channel,
-			f);
-	fclose(f);
-
-	if (nread < dat.samples_per_channel) {
-		errno = EIO;
-		throw errno;
-	}
-
-	dat.ch->raw = static_cast<data_raw_t *>(mm_malloc(
-			dat.samples_per_channel * sizeof(data_raw_t)));
-	dat.ch->samples_per_mv = 1000;
-	{
-		data_raw_t *a = dat.ch->raw;
-		int16_t *b = data_buffer;
-		for (size_t i = 0; i < dat.samples_per_channel; ++i) {
-			*a++ = *b++;
+						// cut to the whole samples of the member, as parse() does
+						if (data_len > m.size - offset) {
+							data_len = m.size - offset;
+						}
+						data_len -= data_len % sizeof(int16_t);
+						allocate_channels(1, data_len / sizeof(int16_t));
+						dat.ch[0].raw = static_cast<data_raw_t *>(mm_malloc(
+								(dat.samples_per_channel ?
+										dat.samples_per_channel : 1)
+										* sizeof(data_raw_t)));
+						dat.ch[0].samples_per_mv = 1000;
+						samples = reinterpret_cast<uint8_t *>(dat.ch[0].raw);
+
+						data = reinterpret_cast<uint8_t const *>(header.data())
+								+ offset;
+						n = header.size() - offset;
+					}
+					if (n > data_len - filled) {
+						n = data_len - filled;
+					}
+					memcpy(samples + filled, data, n);
+					filled += n;
+					return true;
+				});
+	} catch (...) {
+		if (samples) {
+			free_channels();
 		}
+		throw;
+	}
+	if (samples == 0) {
+		return false;
 	}
-	mm_free(data_buffer);
+	if (dat.samples_per_channel) {
+		normalise_in_place(dat.ch[0].raw, dat.samples_per_channel);
+	}
+	return true;
+}
 
-	// correct average
-	if (1) {
-		double ave = 0.0;
-		size_t start;
-		if (dat.samples_per_channel > 4000) {
-			start = 1000;
-		}
+/**
+ * Use a record of a packed corpus in place
+ *
+ * The samples were corrected when packed, see CorpusWriter, so they are only
+ * checked against their CRC. The signals point into the mapped corpus, which
+ * must outlive the object; the pipeline only reads them.
+ *
+ * @param Corpus
+ * @param Index of the record, see Corpus::find()
+ */
+PhysionetChallenge2016::PhysionetChallenge2016(Corpus const &corpus,
+		size_t const &record) :
+		borrowed(true) {
+	struct corpus_entry const &e = corpus.get_entry(record);
+	corpus.verify(record);
 
-		data_raw_t *a = dat.ch->raw;
-		for (size_t i = start; i < dat.samples_per_channel; i++) {
-			ave += *a++;
-		}
-		ave /= (double) (dat.samples_per_channel - start);
+	allocate_channels(e.channels, e.samples);
+	for (size_t c = 0; c < e.channels; ++c) {
+		dat.ch[c].raw = const_cast<data_raw_t *>(corpus.get_samples(record, c));
+		dat.ch[c].samples_per_mv = 1000;
+	}
+}
 
-		a = dat.ch->raw;
-		for (size_t i = 0; i < dat.samples_per_channel; i++) {
-			*(a + i) -= ave;
-		}
+/**
+ * Convert the channels of a parsed Wav image
+ *
+ * @param Wav image
+ */
+void PhysionetChallenge2016::load(WavFile const &wav) {
+	struct wav_format const &format = wav.get_format();
+	allocate_channels(format.channels, wav.size());
+
+	// the native format is converted straight from the mapped pages, unless
+	// an archive member left the samples at an odd address
+	if (format.channels == 1 && format.format_tag == WAV_FORMAT_PCM
+			&& format.bits_per_sample == 16
+			&& format.sample_rate == sample_freq
+			&& reinterpret_cast<uintptr_t>(wav.get_data()) % sizeof(int16_t)
+					== 0) {
+		convert(static_cast<int16_t const *>(wav.get_data()), 0);
+		return;
+	}
+
+	load_decoded(wav, format.sample_rate, format.channels);
+}
+
+/**
+ * Convert the channels of a WFDB record
+ *
+ * Formats 16 and 212 at 2000 Hz are unpacked to 16 bit samples and converted
+ * like the Wav files, the others are decoded and resampled.
+ *
+ * @param WFDB record
+ */
+void PhysionetChallenge2016::load(WfdbRecord const &record) {
+	size_t const channels = record.get_channels();
+	allocate_channels(channels, record.size());
+
+	bool native = record.get_sample_rate() == sample_freq;
+	for (size_t c = 0; c < channels; ++c) {
+		native = native && record.get_format(c) != WFDB_FORMAT_24;
+	}
+	if (!native) {
+		load_decoded(record, record.get_sample_rate(), channels);
+		return;
 	}
 
-	// correct amplitude scale
-	if (1) {
-		size_t start, end;
-		double min, max, scale;
-		double max_range = 2000.0;
-		if (dat.samples_per_channel < 4000) {
-			start = 0;
-			end = dat.samples_per_channel;
-		} else if (dat.samples_per_channel < 10000) {
-			start = 1000;
-			end = dat.samples_per_channel - 1000;
-		} else {
-			start = 2000;
-			end = 9000;
+	int16_t *pcm = static_cast<int16_t *>(mm_malloc(
+			(record.size() ? record.size() : 1) * sizeof(int16_t)));
+	try {
+		for (size_t c = 0; c < channels; ++c) {
+			record.decode(pcm, c);
+			convert(pcm, c);
 		}
-		min = max = dat.ch->raw[start];
-		for (size_t i = start; i < end; i++) {
-			data_raw_t &d = *(dat.ch->raw + i);
+	} catch (int e) {
+		mm_free(pcm);
+		free_channels();
+		throw;
+	}
+	mm_free(pcm);
+}
 
-			if (min > d) {
-				min = d;
-			}
-			if (max < d) {
-				max = d;
+/**
+ * Allocate the channel table
+ *
+ * @param Number of channels
+ * @param Number of samples per channel
+ */
+void PhysionetChallenge2016::allocate_channels(size_t const &channels,
+		size_t const &len) {
+	dat.sample_freq = sample_freq;
+	dat.number_of_channels = channels;
+	dat.samples_per_channel = len;
+	dat.ch = static_cast<struct data_channel *>(mm_calloc(channels,
+			sizeof(struct data_channel)));
+}
+
+/**
+ * Decode, resample and convert the channels one at a time
+ *
+ * @param Record with size() and decode(float *, channel), eg. WavFile
+ * @param Sample rate of the record
+ * @param Number of channels
+ */
+template<class Record>
+void PhysionetChallenge2016::load_decoded(Record const &record,
+		size_t const &rate, size_t const &channels) {
+	DSP::Resampler const *resampler = 0;
+	dat.samples_per_channel = record.size();
+	if (rate != sample_freq) {
+		resampler = new DSP::Resampler(rate, sample_freq);
+		dat.samples_per_channel = resampler->output_size(record.size());
+	}
+
+	float *decoded = static_cast<float *>(mm_malloc(
+			(record.size() ? record.size() : 1) * sizeof(float)));
+	float *resampled = resampler ? static_cast<float *>(mm_malloc(
+			(dat.samples_per_channel ? dat.samples_per_channel : 1)
+					* sizeof(float))) : 0;
+	try {
+		for (size_t c = 0; c < channels; ++c) {
+			record.decode(decoded, c);
+			if (resampler) {
+				resampler->process(resampled, decoded, record.size());
 			}
+			convert(resampler ? resampled : decoded, c);
 		}
-		scale = max_range / (max - min);
-		data_raw_t *a = dat.ch->raw;
-		for (size_t i = 0; i < dat.samples_per_channel; i++) {
-			*(a + i) *= scale;
+	} catch (int e) {
+		mm_free(decoded);
+		mm_free(resampled);
+		delete resampler;
+		free_channels();
+		throw;
+	}
+
+	mm_free(decoded);
+	mm_free(resampled);
+	delete resampler;
+}
+
+/**
+ * Wrap 16 bit PCM already in memory, eg. received from a socket
+ *
+ * Same baseline and amplitude scale correction as for the Wav files, for each
+ * channel separately.
+ *
+ * @param Little-endian 16bit PCM at 2000 Hz
+ * @param Number of samples per channel
+ * @param Number of channels
+ * @param Are the channels interleaved (frames of one sample per channel) or planar (one channel after the other)
+ */
+PhysionetChallenge2016::PhysionetChallenge2016(int16_t const *pcm,
+		size_t const &len, size_t const &channels, bool const &interleaved) :
+		borrowed(false) {
+	dat.sample_freq = sample_freq;
+	dat.samples_per_channel = len;
+	dat.number_of_channels = channels;
+	dat.ch = static_cast<struct data_channel *>(mm_calloc(channels,
+			sizeof(struct data_channel)));
+
+	if (channels == 1 || !interleaved) {
+		for (size_t c = 0; c < channels; ++c) {
+			convert(pcm + c * len, c);
 		}
+		return;
 	}
+
+	int16_t *planar = static_cast<int16_t *>(mm_malloc(
+			(len ? len : 1) * sizeof(int16_t)));
+	for (size_t c = 0; c < channels; ++c) {
+		for (size_t i = 0; i < len; ++i) {
+			planar[i] = pcm[i * channels + c];
+		}
+		convert(planar, c);
+	}
+	mm_free(planar);
 }
 
 PhysionetChallenge2016::~PhysionetChallenge2016() {
-	mm_free(dat.ch->raw);
+	free_channels();
+}
+
+void PhysionetChallenge2016::free_channels() {
+	for (size_t c = 0; c < dat.number_of_channels && !borrowed; ++c) {
+		if (dat.ch[c].raw) {
+			mm_free(dat.ch[c].raw);
+		}
+	}
+	mm_free(dat.ch);
+	dat.ch = 0;
+	dat.number_of_channels = 0;
+}
+
+/**
+ * Baseline and amplitude statistics of a record
+ *
+ * The baseline is the average of the first n - 1000 samples, or of all
+ * samples in records of at most 4000 samples. The amplitude range is taken
+ * from samples 2000 to 9000, from 1000 to n - 1000 in records of 4000 to
+ * 10000 samples, or from the whole record. Both loops run over the source
+ * type, so they vectorize without conversion.
+ *
+ * @param Pointer to samples
+ * @param Number of samples, at least one
+ * @param Pointer to output average
+ * @param Pointer to output minimum
+ * @param Pointer to output maximum
+ */
+template<typename T, typename S>
+static void pcm_statistics(T const *pcm, size_t const n, double *ave, T *min,
+		T *max) {
+	size_t const start = n > 4000 ? 1000 : 0;
+	S sum = 0;
+	for (size_t i = 0; i < n - start; i++) {
+		sum += pcm[i];
+	}
+	*ave = static_cast<double>(sum) / (n - start);
+
+	size_t set, end;
+	if (n < 4000) {
+		set = 0;
+		end = n;
+	} else if (n < 10000) {
+		set = 1000;
+		end = n - 1000;
+	} else {
+		set = 2000;
+		end = 9000;
+	}
+	T _min = pcm[set], _max = pcm[set];
+	for (size_t i = set; i < end; i++) {
+		_min = pcm[i] < _min ? pcm[i] : _min;
+		_max = pcm[i] > _max ? pcm[i] : _max;
+	}
+	*min = _min;
+	*max = _max;
 }
 
 /**
+ * Baseline and scale correction of a record, see normalise()
+ *
+ * @param Pointer to samples
+ * @param Number of samples, at least one
+ * @param Pointer to output average
+ * @return Scale
+ */
+template<typename T, typename S>
+static double normal_scale(T const *pcm, size_t const n, double *ave) {
+	T min, max;
+	pcm_statistics<T, S>(pcm, n, ave, &min, &max);
+
+#ifdef DATA_RAW_T_FIXED
+	return (1 << DATA_RAW_T_Q) * (max > min ? 2000.0 / (max - min) : 1.0);
+#else
+	// the range of the baseline corrected samples, rounded as they would be
+	data_raw_t const _min = min - *ave, _max = max - *ave;
+	return _max > _min ? 2000.0 / (_max - _min) : 1.0;
+#endif
+}
+
+/**
+ * Correct the baseline and scale of a sample
+ */
+template<typename T>
+static inline data_raw_t normal_sample(T const &pcm, double const &ave,
+		double const &scale) {
+#ifdef DATA_RAW_T_FIXED
+	// fixed point; one rounding
+	long const d = lrint((pcm - ave) * scale);
+	return d > INT16_MAX ? INT16_MAX : d < INT16_MIN ? INT16_MIN : d;
+#else
+	data_raw_t const d = pcm - ave;
+	return d * scale;
+#endif
+}
+
+/**
+ * Correct the baseline and scale of a record
+ *
+ * Two passes over the source; the statistics, see pcm_statistics(), and a
+ * fused write of (pcm - average) * scale. The rounding of each step is the
+ * same as converting, subtracting and scaling in place, so the output is bit
+ * identical to doing that in separate passes. A flat record is left unscaled.
+ *
+ * @param Pointer to samples
+ * @param Number of samples, at least one
+ * @param Pointer to output
+ */
+template<typename T, typename S>
+static void normalise(T const *pcm, size_t const n,
+		data_raw_t *__restrict__ raw) {
+	double ave;
+	double const scale = normal_scale<T, S>(pcm, n, &ave);
+	for (size_t i = 0; i < n; i++) {
+		raw[i] = normal_sample(pcm[i], ave, scale);
+	}
+}
+
+/**
+ * Correct the baseline and scale of 16 bit PCM at the start of its output
+ *
+ * As normalise(), but written backwards over the samples. An output is at
+ * least as wide as a sample, so output i only covers samples from i on, which
+ * are read already.
+ *
+ * @param Pointer to output, with the samples in its first 2 * n bytes
+ * @param Number of samples, at least one
+ */
+static void normalise_in_place(data_raw_t *raw, size_t const n) {
+	int16_t const *pcm = reinterpret_cast<int16_t const *>(raw);
+	double ave;
+	double const scale = normal_scale<int16_t, int64_t>(pcm, n, &ave);
+	for (size_t i = n; i-- > 0;) {
+		int16_t const sample = pcm[i];
+		raw[i] = normal_sample(sample, ave, scale);
+	}
+}
+
+/**
+ * Convert 16 bit PCM to data_raw_t and correct the baseline and scale
+ *
+ * @param PCM buffer of samples_per_channel samples
+ * @param Channel to set
+ */
+void PhysionetChallenge2016::convert(int16_t const *data_buffer,
+		size_t const &channel) {
+	size_t const n = dat.samples_per_channel;
+	struct data_channel &ch = dat.ch[channel];
+	ch.raw = static_cast<data_raw_t *>(mm_malloc((n ? n : 1) * sizeof(data_raw_t)));
+	ch.samples_per_mv = 1000;
+	if (n) {
+		normalise<int16_t, int64_t>(data_buffer, n, ch.raw);
+	}
+}
+
+/**
+ * Convert decoded samples to data_raw_t and correct the baseline and scale
+ *
+ * @param Buffer of samples_per_channel samples, any full scale
+ * @param Channel to set
+ */
+void PhysionetChallenge2016::convert(float const *data_buffer,
+		size_t const &channel) {
+	size_t const n = dat.samples_per_channel;
+	struct data_channel &ch = dat.ch[channel];
+	ch.raw = static_cast<data_raw_t *>(mm_malloc((n ? n : 1) * sizeof(data_raw_t)));
+	ch.samples_per_mv = 1000;
+	if (n) {
+		normalise<float, double>(data_buffer, n, ch.raw);
+	}
+}
+
+/**
+ * @param Channel, from zero
  * @return Pointer to struct data_raw_t
  */
-data_raw_t *PhysionetChallenge2016::get_signal() const {
-	return dat.ch->raw;
+data_raw_t *PhysionetChallenge2016::get_signal(size_t const &channel) const {
+	return dat.ch[channel].raw;
+}
+
+/**
+ * @return Number of channels
+ */
+size_t const &PhysionetChallenge2016::get_channels() const {
+	return dat.number_of_channels;
 }
+
 /**
- * @return Number of samples in data
+ * @return Number of samples in data, per channel
  */
 size_t const &PhysionetChallenge2016::size() const {
 	return dat.samples_per_channel;
@@ -8,19 +8,45 @@
 #ifndef ENTRY_SRC_SIMPLIFIED_PHYSIONETCHALLENGE2016_H_
 #define ENTRY_SRC_SIMPLIFIED_PHYSIONETCHALLENGE2016_H_
 
+#include <stdint.h>
 #include "types.data.h"
 
 namespace Signal {
 
+class Corpus;
+class WavFile;
+class WfdbRecord;
+class ZipArchive;
+
 class PhysionetChallenge2016 {
 public:
+	static size_t constexpr sample_freq = 2000; // Hz, of the signal
+
 	explicit PhysionetChallenge2016(char const *basename);
+	explicit PhysionetChallenge2016(WavFile const &wav);
+	PhysionetChallenge2016(ZipArchive const &zip, size_t const &member);
+	PhysionetChallenge2016(Corpus const &corpus, size_t const &record);
+	PhysionetChallenge2016(int16_t const *pcm, size_t const &len,
+			size_t const &channels = 1, bool const &interleaved = true);
 	virtual ~PhysionetChallenge2016();
 
-	data_raw_t *get_signal() const;
+	data_raw_t *get_signal(size_t const &channel = 0) const;
 	size_t const &size() const;
+	size_t const &get_channels() const;
 private:
 	struct data dat;
+	bool borrowed; // the samples belong to a corpus
+
+	void load(WavFile const &wav);
+	void load(WfdbRecord const &record);
+	bool load_inflated(ZipArchive const &zip, size_t const &member);
+	void allocate_channels(size_t const &channels, size_t const &len);
+	template<class Record>
+	void load_decoded(Record const &record, size_t const &rate,
+			size_t const &channels);
+	void convert(int16_t const *data_buffer, size_t const &channel);
+	void convert(float const *data_buffer, size_t const &channel);
+	void free_channels();
 };
 
 } /* namespace Signal */
@@ -0,0 +1,597 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Prefetch.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "macro.h"
+
+#include "Prefetch.h"
+
+namespace Signal {
+
+static size_t constexpr prefetch_align = 4096; // a page
+static size_t constexpr prefetch_readers = 4; // threads of the fallback
+static size_t constexpr prefetch_chunk = 1u << 30; // bytes per read
+
+/*
+ * io_uring submission and completion rings, see io_uring_setup(2)
+ */
+struct prefetch_ring {
+	int fd;
+	unsigned entries; // of the submission queue
+	size_t inflight; // reads submitted or queued, not completed
+	unsigned pending; // queued, not submitted
+
+	void *sq_map;
+	size_t sq_len;
+	void *cq_map;
+	size_t cq_len;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+static double prefetch_clock() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Open a file for reading and get its size
+ *
+ * @param Pointer to the file
+ * @return Zero or errno
+ */
+static int open_file(struct prefetch_file *f) {
+	f->fd = open(f->name.c_str(), O_RDONLY | O_CLOEXEC);
+	if (f->fd < 0) {
+		return errno;
+	}
+	struct stat sb;
+	if (fstat(f->fd, &sb)) {
+		return errno;
+	}
+	f->size = sb.st_size;
+	return 0;
+}
+
+/**
+ * Start reading the files ahead
+ *
+ * @param Filenames in the read ahead order
+ * @param Number of files read ahead and not released, at least one
+ * @param I/O backend, see prefetch_backend_e
+ */
+Prefetch::Prefetch(std::vector<std::string> const &names, size_t const &window,
+		enum prefetch_backend_e const &backend) :
+		window(window ? window : 1), backend(backend), ring(0), next(0),
+		held(0), stop(false), stats() {
+	files.resize(names.size());
+	for (size_t i = 0; i < names.size(); ++i) {
+		struct prefetch_file &f = files[i];
+		f.name = names[i];
+		f.state = PREFETCH_IDLE;
+		f.error = 0;
+		f.buf = 0;
+		f.capacity = 0;
+		f.len = 0;
+		f.fd = -1;
+		f.size = 0;
+	}
+
+	if (this->backend != PREFETCH_THREADS) {
+		size_t entries = 1;
+		while (entries < this->window && entries < 4096) {
+			entries <<= 1;
+		}
+		if (setup_ring(entries)) {
+			this->backend = PREFETCH_IO_URING;
+		} else if (this->backend == PREFETCH_IO_URING) {
+			PERROR("io_uring_setup");
+		} else {
+			this->backend = PREFETCH_THREADS;
+		}
+	}
+
+	if (this->backend == PREFETCH_IO_URING) {
+		threads.push_back(std::thread(&Prefetch::run_ring, this));
+	} else {
+		size_t const n =
+				this->window < prefetch_readers ?
+						this->window : prefetch_readers;
+		for (size_t i = 0; i < n; ++i) {
+			threads.push_back(std::thread(&Prefetch::run_threads, this));
+		}
+	}
+}
+
+/**
+ * Stop reading ahead; the reads in flight are completed first
+ */
+Prefetch::~Prefetch() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+		wakeup.notify_all();
+	}
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+	free_ring();
+
+	for (size_t i = 0; i < stranded.size(); ++i) {
+		free(stranded[i]);
+	}
+	for (size_t i = 0; i < files.size(); ++i) {
+		free(files[i].buf);
+	}
+	for (size_t i = 0; i < pool.size(); ++i) {
+		free(pool[i].buf);
+	}
+}
+
+/**
+ * Wait for a file to be read
+ *
+ * A file that is not read yet is read next. The buffer stays valid until
+ * release().
+ *
+ * @param Index of the file
+ * @param Pointer to output the file contents
+ * @param Pointer to output the file length
+ * @param Pointer to output the seconds waited for the read, or NULL
+ * @return Zero or errno of the failed read; release() the file either way
+ */
+int Prefetch::acquire(size_t const &file, void const **buf, size_t *len,
+		double *wait) {
+	std::unique_lock<std::mutex> lock(mutex);
+	struct prefetch_file &f = files.at(file);
+	if (f.state == PREFETCH_TAKEN || f.state == PREFETCH_RELEASED) {
+		return EINVAL;
+	}
+	if (f.state == PREFETCH_IDLE) {
+		urgent.push_back(file);
+		wakeup.notify_all();
+	}
+
+	double waited = 0.0;
+	if (f.state == PREFETCH_READY || f.state == PREFETCH_FAILED) {
+		++stats.hits;
+	} else {
+		double const t0 = prefetch_clock();
+		ready.wait(lock, [&f] {
+			return f.state == PREFETCH_READY || f.state == PREFETCH_FAILED;
+		});
+		waited = prefetch_clock() - t0;
+		stats.io_wait += waited;
+	}
+	if (wait) {
+		*wait = waited;
+	}
+
+	if (f.state == PREFETCH_FAILED) {
+		return f.error;
+	}
+	f.state = PREFETCH_TAKEN;
+	*buf = f.buf;
+	*len = f.len;
+	return 0;
+}
+
+/**
+ * Return the buffer of a file to the pool and read further ahead
+ *
+ * @param Index of the file
+ */
+void Prefetch::release(size_t const &file) {
+	std::lock_guard<std::mutex> lock(mutex);
+	struct prefetch_file &f = files.at(file);
+	if (f.state != PREFETCH_TAKEN && f.state != PREFETCH_FAILED
+			&& f.state != PREFETCH_READY) {
+		return;
+	}
+	if (f.buf) {
+		struct prefetch_buffer const b = { f.buf, f.capacity };
+		pool.push_back(b);
+		f.buf = 0;
+		f.capacity = 0;
+	}
+	f.state = PREFETCH_RELEASED;
+	--held;
+	wakeup.notify_all();
+}
+
+/**
+ * @return I/O backend in use
+ */
+enum prefetch_backend_e const &Prefetch::get_backend() const {
+	return backend;
+}
+
+/**
+ * @return Counters so far
+ */
+struct prefetch_stats Prefetch::get_stats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+/**
+ * Pick the next file to read, the mutex held
+ *
+ * @param Pointer to output the index of the file
+ * @return False if there is nothing to read now
+ */
+bool Prefetch::next_file(size_t *file) {
+	while (urgent.size()) {
+		size_t const i = urgent.front();
+		urgent.pop_front();
+		if (files[i].state == PREFETCH_IDLE) {
+			files[i].state = PREFETCH_QUEUED;
+			++held;
+			*file = i;
+			return true;
+		}
+	}
+	while (next < files.size() && held < window) {
+		size_t const i = next++;
+		if (files[i].state == PREFETCH_IDLE) {
+			files[i].state = PREFETCH_QUEUED;
+			++held;
+			*file = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Take a buffer for the size of the file from the pool, the mutex held
+ *
+ * The smallest pooled buffer that fits is used; if none fits, the largest
+ * one is dropped and a new one allocated, so the pool never outgrows the
+ * window.
+ *
+ * @param Pointer to the file, its size set
+ * @return Zero or errno
+ */
+int Prefetch::get_buffer(struct prefetch_file *f) {
+	size_t const need = (f->size + prefetch_align - 1) / prefetch_align
+			* prefetch_align + prefetch_align * (f->size == 0);
+	size_t best = pool.size(), largest = pool.size();
+	for (size_t i = 0; i < pool.size(); ++i) {
+		if (pool[i].capacity >= need
+				&& (best == pool.size() || pool[i].capacity < pool[best].capacity)) {
+			best = i;
+		}
+		if (largest == pool.size() || pool[i].capacity > pool[largest].capacity) {
+			largest = i;
+		}
+	}
+	if (best == pool.size() && largest < pool.size()) {
+		free(pool[largest].buf);
+		pool[largest] = pool.back();
+		pool.pop_back();
+	}
+	if (best < pool.size()) {
+		f->buf = pool[best].buf;
+		f->capacity = pool[best].capacity;
+		pool[best] = pool.back();
+		pool.pop_back();
+		return 0;
+	}
+	if (posix_memalign(&f->buf, prefetch_align, need)) {
+		f->buf = 0;
+		return ENOMEM;
+	}
+	f->capacity = need;
+	return 0;
+}
+
+/**
+ * Mark a file read or failed and wake up the consumers, the mutex held
+ *
+ * @param Pointer to the file
+ * @param Zero or errno
+ */
+void Prefetch::finish(struct prefetch_file *f, int const &error) {
+	if (f->fd >= 0) {
+		close(f->fd);
+		f->fd = -1;
+	}
+	if (error) {
+		if (f->buf) {
+			struct prefetch_buffer const b = { f->buf, f->capacity };
+			pool.push_back(b);
+			f->buf = 0;
+			f->capacity = 0;
+		}
+		f->state = PREFETCH_FAILED;
+		f->error = error;
+	} else {
+		f->state = PREFETCH_READY;
+		++stats.files;
+		stats.bytes += f->len;
+	}
+	ready.notify_all();
+}
+
+/**
+ * Fallback reader thread, reads whole files with pread()
+ */
+void Prefetch::run_threads() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for (size_t i;;) {
+		while (!stop && !next_file(&i)) {
+			wakeup.wait(lock);
+		}
+		if (stop) {
+			return;
+		}
+
+		// the file is ours until finished
+		struct prefetch_file *f = &files[i];
+		lock.unlock();
+		int error = open_file(f);
+		lock.lock();
+		if (error == 0) {
+			error = get_buffer(f);
+		}
+		lock.unlock();
+		while (error == 0 && f->len < f->size) {
+			size_t const n = f->size - f->len;
+			ssize_t const r = pread(f->fd, static_cast<uint8_t *>(f->buf) + f->len,
+					n < prefetch_chunk ? n : prefetch_chunk, f->len);
+			if (r < 0 && errno != EINTR) {
+				error = errno;
+			} else if (r == 0) {
+				break; // the file was truncated
+			} else if (r > 0) {
+				f->len += r;
+			}
+		}
+		lock.lock();
+		finish(f, error);
+	}
+}
+
+/**
+ * io_uring reader thread
+ *
+ * Opens the files and queues one read per file, up to the ring size, then
+ * submits and waits for a completion in a single io_uring_enter() call. A
+ * short read is continued with another read. If the ring breaks, the files
+ * queued in it fail and the thread goes on as a pread() reader.
+ */
+void Prefetch::run_ring() {
+	std::unique_lock<std::mutex> lock(mutex);
+	auto queue_read = [this](size_t const &i) {
+		struct prefetch_file const &f = files[i];
+		size_t const n = f.size - f.len;
+		unsigned const tail = *ring->sq_tail;
+		unsigned const idx = tail & *ring->sq_mask;
+		struct io_uring_sqe *sqe = &ring->sqes[idx];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = f.fd;
+		sqe->addr = reinterpret_cast<uintptr_t>(static_cast<uint8_t *>(f.buf)
+				+ f.len);
+		sqe->len = n < prefetch_chunk ? n : prefetch_chunk;
+		sqe->off = f.len;
+		sqe->user_data = i;
+		ring->sq_array[idx] = idx;
+		__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+		++ring->pending;
+	};
+
+	for (;;) {
+		size_t i;
+		while (ring->inflight < ring->entries && !stop && next_file(&i)) {
+			struct prefetch_file *f = &files[i];
+			lock.unlock();
+			int error = open_file(f);
+			lock.lock();
+			if (error == 0) {
+				error = get_buffer(f);
+			}
+			if (error || f->size == 0) {
+				finish(f, error);
+				continue;
+			}
+			queue_read(i);
+			++ring->inflight;
+		}
+		if (ring->inflight == 0) {
+			if (stop) {
+				return;
+			}
+			wakeup.wait(lock);
+			continue;
+		}
+
+		// entries the kernel did not take stay queued for the next call
+		unsigned const to_submit = ring->pending;
+		lock.unlock();
+		long const r = syscall(__NR_io_uring_enter, ring->fd, to_submit, 1,
+				IORING_ENTER_GETEVENTS, 0, 0);
+		int const error = r < 0 ? errno : 0;
+		lock.lock();
+		if (r > 0) {
+			ring->pending -= r;
+		} else if (r < 0 && error != EINTR && error != EAGAIN
+				&& error != EBUSY) {
+			// a broken ring, the reads queued in it would never complete;
+			// the kernel may still write to their buffers until it is freed
+			Utils::log_error("[%s:%u] io_uring_enter: %s\n", __FILE__,
+					__LINE__, strerror(error));
+			for (size_t j = 0; j < files.size(); ++j) {
+				struct prefetch_file *f = &files[j];
+				if (f->state == PREFETCH_QUEUED) {
+					stranded.push_back(f->buf);
+					f->buf = 0;
+					f->capacity = 0;
+					finish(f, error);
+				}
+			}
+			ring->inflight = ring->pending = 0;
+			lock.unlock();
+			run_threads();
+			return;
+		}
+
+		unsigned head = *ring->cq_head;
+		for (unsigned const tail = __atomic_load_n(ring->cq_tail,
+				__ATOMIC_ACQUIRE); head != tail; ++head) {
+			struct io_uring_cqe const &cqe = ring->cqes[head & *ring->cq_mask];
+			struct prefetch_file *f = &files[cqe.user_data];
+			if (cqe.res < 0) {
+				--ring->inflight;
+				finish(f, -cqe.res);
+			} else if (cqe.res == 0 || (f->len += cqe.res) == f->size) {
+				--ring->inflight; // done, or the file was truncated
+				finish(f, 0);
+			} else {
+				queue_read(cqe.user_data);
+			}
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+/**
+ * Set up the rings, see io_uring_setup(2)
+ *
+ * @param Number of submission queue entries, a power of two
+ * @return False if io_uring or its read operation is not available
+ */
+bool Prefetch::setup_ring(size_t const &entries) {
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_register)
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int const fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (fd < 0) {
+		return false;
+	}
+
+	ring = new prefetch_ring();
+	ring->fd = fd;
+	ring->entries = p.sq_entries;
+	ring->sq_map = ring->cq_map = MAP_FAILED;
+	ring->sqes = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+
+	// IORING_OP_READ is from Linux 5.6, as is the probe
+	size_t const probe_len = sizeof(struct io_uring_probe)
+			+ 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = static_cast<struct io_uring_probe *>(calloc(
+			1, probe_len));
+	bool const read_op = probe
+			&& syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+					256) == 0 && probe->last_op >= IORING_OP_READ
+			&& (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	if (!read_op) {
+		free_ring();
+		return false;
+	}
+
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_len > ring->sq_len) {
+			ring->sq_len = ring->cq_len;
+		}
+		ring->cq_len = 0;
+	}
+	ring->sq_map = mmap(0, ring->sq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ring->sq_map != MAP_FAILED) {
+		ring->cq_map = ring->cq_len ?
+				mmap(0, ring->cq_len, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING) :
+				ring->sq_map;
+	}
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	if (ring->cq_map != MAP_FAILED) {
+		ring->sqes = static_cast<struct io_uring_sqe *>(mmap(0, ring->sqes_len,
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+				IORING_OFF_SQES));
+	}
+	if (ring->sqes == MAP_FAILED) {
+		free_ring();
+		return false;
+	}
+
+	uint8_t *sq = static_cast<uint8_t *>(ring->sq_map);
+	uint8_t *cq = static_cast<uint8_t *>(ring->cq_map);
+	ring->sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+	ring->sq_mask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+	ring->sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+	ring->cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+	ring->cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+	ring->cq_mask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+	ring->cqes = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Prefetch::free_ring() {
+	if (ring == 0) {
+		return;
+	}
+	if (ring->sqes != MAP_FAILED) {
+		munmap(ring->sqes, ring->sqes_len);
+	}
+	if (ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map) {
+		munmap(ring->cq_map, ring->cq_len);
+	}
+	if (ring->sq_map != MAP_FAILED) {
+		munmap(ring->sq_map, ring->sq_len);
+	}
+	close(ring->fd);
+	delete ring;
+	ring = 0;
+}
+
+} /* namespace Signal */
@@ -0,0 +1,113 @@
+/**
+ * Prefetch.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#ifndef ENTRY_SRC_SIMPLIFIED_PREFETCH_H_
+#define ENTRY_SRC_SIMPLIFIED_PREFETCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace Signal {
+
+enum prefetch_backend_e {
+	PREFETCH_AUTO, // io_uring if the kernel allows it, threads otherwise
+	PREFETCH_IO_URING,
+	PREFETCH_THREADS,
+};
+
+enum prefetch_state_e {
+	PREFETCH_IDLE, PREFETCH_QUEUED, PREFETCH_READY, PREFETCH_FAILED,
+	PREFETCH_TAKEN, PREFETCH_RELEASED,
+};
+
+struct prefetch_file {
+	std::string name;
+	enum prefetch_state_e state;
+	int error; // errno of a failed read
+	void *buf; // see Prefetch::get_buffer()
+	size_t capacity;
+	size_t len; // bytes read
+	int fd; // while read by io_uring
+	size_t size; // of the file, when opened
+};
+
+struct prefetch_buffer {
+	void *buf;
+	size_t capacity;
+};
+
+struct prefetch_stats {
+	size_t files; // read
+	size_t bytes;
+	size_t hits; // files ready when acquired
+	double io_wait; // seconds the consumers waited, summed over the threads
+};
+
+struct prefetch_ring;
+
+/*
+ * Read ahead of whole files, eg. the .wav files of a batch run
+ *
+ * The files are read in the given order into pooled page aligned buffers,
+ * keeping at most window files read but not yet released. A file that is
+ * acquired before its turn is read next, past the window. The reads go
+ * through io_uring with a single submitting thread, or through a pool of
+ * pread() threads if io_uring is not available, eg. it is disabled by a
+ * seccomp policy. If the ring breaks, the files queued in it fail with its
+ * errno and the rest are read with pread().
+ *
+ * acquire() and release() can be called from any thread; each file is
+ * acquired once.
+ */
+class Prefetch {
+public:
+	Prefetch(std::vector<std::string> const &files, size_t const &window,
+			enum prefetch_backend_e const &backend = PREFETCH_AUTO);
+	virtual ~Prefetch();
+
+	int acquire(size_t const &file, void const **buf, size_t *len,
+			double *wait = 0);
+	void release(size_t const &file);
+
+	enum prefetch_backend_e const &get_backend() const;
+	struct prefetch_stats get_stats();
+private:
+	std::vector<struct prefetch_file> files;
+	size_t window;
+	enum prefetch_backend_e backend;
+	struct prefetch_ring *ring; // io_uring backend only
+
+	std::mutex mutex; // guards all below and the file states
+	std::condition_variable ready; // a file was read
+	std::condition_variable wakeup; // a file was released or asked for
+	std::deque<size_t> urgent; // files acquired before their turn
+	size_t next; // in the read ahead order
+	size_t held; // files read or being read, not released
+	bool stop;
+	std::vector<struct prefetch_buffer> pool;
+	std::vector<void *> stranded; // buffers of a broken ring, freed after it
+	struct prefetch_stats stats;
+	std::vector<std::thread> threads;
+
+	bool next_file(size_t *file);
+	int get_buffer(struct prefetch_file *f);
+	void finish(struct prefetch_file *f, int const &error);
+	void run_threads();
+	void run_ring();
+	bool setup_ring(size_t const &entries);
+	void free_ring();
+};
+
+} /* namespace Signal */
+
+#endif /* ENTRY_SRC_SIMPLIFIED_PREFETCH_H_ */
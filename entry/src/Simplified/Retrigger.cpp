@@ -25,7 +25,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <map>
+#include <string>
+#include <vector>
 #include <algorithm>    // std::sort
 #include <limits> // std::numeric
 #include <time.h> // clock
@@ -33,22 +34,31 @@
 #include "macro.h"
 #include "../utils/memory_manager.h"
 #include "../myDSP/Iir.h"
+#include "../utils/AssetCache.h"
+#include "../utils/log.h"
 
 #include "Retrigger.h"
 
 namespace Simplified {
 
+static uint32_t constexpr blackman_window_version = 1; // of the cached window
+
 /**
  * Setup routines for retigger
  *
- * Uses cached Blackman window (/tmp/Retrigger.blackman,window.dat). Must be manually deleted
- * if window langht or sample rate is altered.
+ * The Blackman window is a cached asset keyed by its length, see
+ * Utils::get_asset().
  *
  * @param Energy function window length in fraction of sample time (seconds)
  */
 Retrigger::Retrigger(double const &window_length_in_fractions_of_sample_time) :
-		raw(0), len(0), len_in_bytes(0), in(0), energy(0), blackman_window(0), retrig_convolution_kernel(
-				0), evx_offset(0) {
+		raw(0), len(0), len_in_bytes(0), in(0), energy(0), reference_channel(
+				0), blackman_window(0), retrig_convolution_kernel(0),
+#ifdef DATA_RAW_T_FIXED
+		blackman_window_q(0), retrig_convolution_kernel_q(0), retrig_convolution_kernel_shift(
+				0),
+#endif
+		evx_offset(0) {
 	energy_window.len = window_length_in_fractions_of_sample_time * sample_freq;
 	energy_window.offset = 0;
 	energy_window.len_in_bytes = energy_window.len * sizeof(cl_float);
@@ -69,47 +79,37 @@ Retrigger::Retrigger(double const &window_length_in_fractions_of_sample_time) :
 	blackman_window = static_cast<cl_float *>(mm_malloc(
 			energy_window.len_in_bytes));
 
-	{
-		struct stat sb;
-		char cachefilename[FILENAME_MAX];
-		sprintf(cachefilename, "/tmp/Retrigger.blackman window.dat");
-		if (stat(cachefilename, &sb) == 0) {
-			FILE *f = fopen(cachefilename, "r");
-			if (f == 0) {
-				PERROR("fopen");
-				throw errno;
-			}
-
-			if (fread(blackman_window, sizeof(cl_float), energy_window.len, f)
-					!= energy_window.len) {
-				PERROR("fread");
-				throw errno;
-			}
-
-			fclose(f);
-		} else {
-			cl_float const twopiperm = 2 * M_PI / (energy_window.len - 1);
-			for (size_t i = 0; i < energy_window.len; ++i) {
-				// strict blackman
-				blackman_window[i] = 0.42 - 0.5 * cos(i * twopiperm)
-						+ 0.08 * cos(2 * i * twopiperm);
-			}
-
-			FILE *f = fopen(cachefilename, "w");
-			if (f == 0) {
-				PERROR("fopen");
-				throw errno;
-			}
-
-			if (fwrite(blackman_window, sizeof(cl_float), energy_window.len, f)
-					!= energy_window.len) {
-				PERROR("fwrite");
-				throw errno;
-			}
-
-			fclose(f);
-		}
+	// a cached asset keyed by the window length
+	size_t const window_len = energy_window.len;
+	struct Utils::asset const *window = Utils::get_asset("Retrigger.blackman",
+			blackman_window_version,
+			std::string(reinterpret_cast<char const *>(&window_len),
+					sizeof(window_len)), [window_len](std::string *payload) {
+				std::vector<cl_float> w(window_len);
+				cl_float const twopiperm = 2 * M_PI / (window_len - 1);
+				for (size_t i = 0; i < window_len; ++i) {
+					// strict blackman
+					w[i] = 0.42 - 0.5 * cos(i * twopiperm)
+							+ 0.08 * cos(2 * i * twopiperm);
+				}
+				payload->assign(reinterpret_cast<char const *>(w.data()),
+						window_len * sizeof(cl_float));
+				return 0;
+			});
+	if (window == 0) {
+		errno = ENOMEM;
+		PERROR("Retrigger");
+	}
+	memcpy(blackman_window, window->data, energy_window.len_in_bytes);
+
+#ifdef DATA_RAW_T_FIXED
+	// Q15 copy of the window for the fixed point energy
+	blackman_window_q = static_cast<int16_t *>(mm_malloc(
+			energy_window.len * sizeof(int16_t)));
+	for (size_t i = 0; i < energy_window.len; ++i) {
+		blackman_window_q[i] = lrint(blackman_window[i] * INT16_MAX);
 	}
+#endif
 }
 
 Retrigger::~Retrigger() {
@@ -121,10 +121,72 @@ Retrigger::~Retrigger() {
 		mm_free(retrig_convolution_kernel);
 	}
 
+#ifdef DATA_RAW_T_FIXED
+	if (blackman_window_q) {
+		mm_free(blackman_window_q);
+	}
+
+	if (retrig_convolution_kernel_q) {
+		mm_free(retrig_convolution_kernel_q);
+	}
+#endif
+
 	mm_free(in);
 	mm_free(energy);
 }
 
+#ifndef DATA_RAW_T_FIXED
+/**
+ * Retrigger prefilter for single precision data. Filters straight from the source.
+ *
+ * @param Pointer to pointer to output memory. The memory is allocated internally.
+ * @param Pointer to data
+ * @param Length of data in samples
+ * @param Sample frequency
+ */
+static void retrig_prefilter(cl_float **out, float const *raw,
+		size_t const &len, double const &sample_freq) {
+	DSP::Iir iir;
+	iir.bandpass(out, raw, len, 10.0, 500.0, 0.5, 4, sample_freq);
+}
+
+#ifndef DATA_RAW_T_FLOAT
+/**
+ * Retrigger prefilter for double precision data. Narrows to single precision first.
+ *
+ * @param Pointer to pointer to output memory. The memory is allocated internally.
+ * @param Pointer to data
+ * @param Length of data in samples
+ * @param Sample frequency
+ */
+static void retrig_prefilter(cl_float **out, double const *raw,
+		size_t const &len, double const &sample_freq) {
+	float *tmp = static_cast<float *>(mm_malloc(len * sizeof(float)));
+	for (size_t i = 0; i < len; ++i) {
+		*(tmp + i) = *(raw + i);
+	}
+
+	retrig_prefilter(out, tmp, len, sample_freq);
+	mm_free(tmp);
+}
+#endif
+
+#else
+/**
+ * Retrigger prefilter for fixed point data
+ *
+ * @param Pointer to pointer to output memory. The memory is allocated internally.
+ * @param Pointer to data
+ * @param Length of data in samples
+ * @param Sample frequency
+ */
+static void retrig_prefilter(int16_t **out, int16_t const *raw,
+		size_t const &len, double const &sample_freq) {
+	DSP::Iir iir;
+	iir.bandpass(out, raw, len, 10.0, 500.0, 0.5, 4, sample_freq);
+}
+#endif
+
 /**
  * Set data and generates the energy norm
  *
@@ -137,6 +199,40 @@ Retrigger::~Retrigger() {
  *  @param Length of data in samples
  */
 void Retrigger::set_data(data_raw_t const *raw, size_t const &len) {
+	set_prefiltered_data(raw, len);
+	calculate_energy();
+}
+
+/**
+ * Set data with a precalculated energy signal
+ *
+ *  @param Pointer to data
+ *  @param Pointer to energy signal of the data
+ *  @param Length of data in samples
+ */
+void Retrigger::set_data(data_raw_t const *raw, cl_float const *energy,
+		size_t const &len) {
+	set_prefiltered_data(raw, len);
+
+	if (this->energy) {
+		mm_free(this->energy);
+	}
+
+	this->energy = static_cast<cl_float *>(mm_malloc(len * sizeof(cl_float)));
+	if (this->energy == 0) {
+		PERROR("malloc");
+	}
+	memcpy(this->energy, energy, len * sizeof(cl_float));
+}
+
+/**
+ * Set data and generate only the IIR bandpass filtered signal
+ *
+ *  @param Pointer to data
+ *  @param Length of data in samples
+ */
+void Retrigger::set_prefiltered_data(data_raw_t const *raw,
+		size_t const &len) {
 	this->raw = raw;
 	this->len = len;
 
@@ -145,16 +241,19 @@ void Retrigger::set_data(data_raw_t const *raw, size_t const &len) {
 		in = 0;
 	}
 
-	DSP::Iir iir;
-	float *tmp = static_cast<float *>(mm_malloc(len * sizeof(float)));
-	for (size_t i = 0; i < len; ++i) {
-		*(tmp + i) = *(raw + i);
-	}
-
-	iir.bandpass(&in, tmp, len, 10.0, 500.0, 0.5, 4, sample_freq);
-	mm_free(tmp);
+	retrig_prefilter(&in, raw, len, sample_freq);
+}
 
-	calculate_energy();
+/**
+ * Margin needed around a part of a signal for its energy to match the energy
+ * of the whole signal: the settle time of the forward-backward IIR prefilter
+ * plus half of the convolution kernel and of the energy window.
+ *
+ * @return Halo length in samples
+ */
+size_t Retrigger::halo() const {
+	return iir_settle_time * sample_freq + convolution_window.len / 2
+			+ energy_window.len / 2 + 1;
 }
 
 /**
@@ -179,66 +278,231 @@ void Retrigger::set_convolution_kernel(cl_float const *kernel,
 			convolution_window.len_in_bytes));
 
 	memcpy(retrig_convolution_kernel, kernel, convolution_window.len_in_bytes);
+
+#ifdef DATA_RAW_T_FIXED
+	// block scaled int16 copy of the kernel; largest power of two scale that fits
+	cl_float max = 0.0;
+	for (size_t i = 0; i < len; ++i) {
+		if (fabs(kernel[i]) > max) {
+			max = fabs(kernel[i]);
+		}
+	}
+
+	retrig_convolution_kernel_shift = 0;
+	while (retrig_convolution_kernel_shift < 30
+			&& max * (2 << retrig_convolution_kernel_shift) <= INT16_MAX) {
+		++retrig_convolution_kernel_shift;
+	}
+
+	if (retrig_convolution_kernel_q) {
+		mm_free(retrig_convolution_kernel_q);
+	}
+
+	retrig_convolution_kernel_q = static_cast<int16_t *>(mm_malloc(
+			len * sizeof(int16_t)));
+	for (size_t i = 0; i < len; ++i) {
+		retrig_convolution_kernel_q[i] = lrint(
+				ldexp(kernel[i], retrig_convolution_kernel_shift));
+	}
+#endif
 }
 
 #define POW2(_a) ((_a) * (_a))
 
+static ulong constexpr retrig_block_len = 512; // outputs per block, all channels
+
+#ifndef DATA_RAW_T_FIXED
 /**
- * A convolution routine.
+ * A convolution routine for channel interleaved data
  *
  * See retrig.cl
  *
+ * The outputs of all the channels are contiguous in the interleaved layout,
+ * so they are calculated a block at a time with the window taps in the outer
+ * loop; the block is in the vector lanes and stays in the L1 cache. Each
+ * output is summed over the taps in order, so the result does not depend on
+ * the number of channels.
+ *
+ * @param Pointer to output memory space. Must be properly allocated.
+ * @param Pointer to longer convolution component (channel interleaved stream)
+ * @param Length of longer convolution component in samples per channel
+ * @param Number of channels
+ * @param Pointer to shorter convolution component (window)
+ * @param Length of shorter convolution component
+ */
+static void retrig_convolution_program(cl_float *out, cl_float const *a,
+		ulong const a_len, ulong const channels, cl_float const *b,
+		ulong const b_len) {
+	ulong const len = b_len / 2;
+	ulong const n = channels;
+
+	memset(out, -0.0, len * n * sizeof(cl_float));
+	memset(out + (a_len - len - 1) * n, -0.0, len * n * sizeof(cl_float));
+
+	for (ulong set = len * n, end = (a_len - len) * n; set < end; set +=
+			retrig_block_len) {
+		ulong const m = end - set < retrig_block_len ? end - set : retrig_block_len;
+		cl_float *__restrict__ d = out + set;
+		for (ulong k = 0; k < m; ++k) {
+			d[k] = 0.0;
+		}
+		for (ulong i = 0; i < b_len; ++i) {
+			cl_float const *__restrict__ p = a + set - len * n + i * n;
+			cl_float const _b = b[i];
+			for (ulong k = 0; k < m; ++k) {
+				d[k] += p[k] * _b;
+			}
+		}
+		for (ulong k = 0; k < m; ++k) {
+			d[k] /= b_len;
+		}
+	}
+}
+
+/**
+ * An energy norm routine for channel interleaved data
+ *
+ * See retrig.cl and the convolution routine above.
+ *
+ * @param Pointer to output memory space. Must be properly allocated.
+ * @param Pointer to data (channel interleaved stream)
+ * @param Length of data in samples per channel
+ * @param Number of channels
+ * @param Pointer to window function memory space
+ * @param Length of window function in samples
+ */
+static void retrig_energy_program(cl_float *out, cl_float const *a,
+		ulong const a_len, ulong const channels, cl_float const *b,
+		ulong const b_len) {
+	ulong const len = b_len / 2;
+	ulong const n = channels;
+
+	memset(out, -0.0, len * n * sizeof(cl_float));
+	memset(out + (a_len - len - 1) * n, -0.0, len * n * sizeof(cl_float));
+
+	for (ulong set = len * n, end = (a_len - len) * n; set < end; set +=
+			retrig_block_len) {
+		ulong const m = end - set < retrig_block_len ? end - set : retrig_block_len;
+		cl_float *__restrict__ d = out + set;
+		for (ulong k = 0; k < m; ++k) {
+			d[k] = 0.0;
+		}
+		for (ulong i = 0; i < b_len; ++i) {
+			cl_float const *__restrict__ p = a + set - len * n + i * n;
+			cl_float const _b = b[i];
+			for (ulong k = 0; k < m; ++k) {
+				d[k] += POW2(p[k] * _b);
+			}
+		}
+	}
+}
+
+#endif
+
+#ifdef DATA_RAW_T_FIXED
+/**
+ * A fixed point convolution routine.
+ *
+ * int16 x int16 products accumulated in int64, scaled back by the kernel scale.
+ *
  * @param Pointer to output memory space. Must be properly allocated.
  * @param Pointer to longer convolution component (stream)
  * @param Length of longer convolution component
  * @param Pointer to shorter convolution component (window)
  * @param Length of shorter convolution component
+ * @param Fraction bits of the shorter convolution component
  */
-static void retrig_convolution_program(cl_float *out, cl_float *a,
-		ulong const a_len, cl_float *b, ulong const b_len) {
+static void retrig_convolution_program(int32_t *out, int16_t const *a,
+		ulong const a_len, int16_t const *b, ulong const b_len,
+		int const shift) {
 	ulong const len = b_len / 2;
 
-	memset(out, -0.0, len * sizeof(cl_float));
-	memset(out + a_len - len - 1, -0.0, len * sizeof(cl_float));
-
 	for (ulong id = len, _len = a_len - len; id < _len; ++id) {
-		cl_float const *p = a + id - len;
-		register cl_float d = 0.0;
+		int16_t const *p = a + id - len;
+		int64_t d = 0;
 		for (ulong i = 0; i < b_len; ++i) {
-			d += *(p + i) * *(b + i);
+			d += static_cast<int32_t>(*(p + i)) * *(b + i);
 		}
-		out[id] = d / b_len;
+		out[id] = d >> shift;
 	}
 }
 
 /**
- * An energy norm routine
+ * A fixed point energy norm routine
  *
- * See retrig.cl
+ * Block scales the stream to int16 before windowing. The scale is restored in
+ * the output, so that energies of separately processed blocks are comparable.
  *
  * @param Pointer to output memory space. Must be properly allocated.
  * @param Pointer to data (stream)
  * @param Length of data in samples
- * @param Pointer to window function memory space
- * @param Length of window function in bytes
+ * @param Pointer to Q15 window function memory space
+ * @param Length of window function in samples
  */
-static void retrig_energy_program(cl_float *out, cl_float *a, ulong const a_len,
-		cl_float *b, ulong const b_len) {
+static void retrig_energy_program(cl_float *out, int32_t *a, ulong const a_len,
+		int16_t const *b, ulong const b_len) {
 	ulong const len = b_len / 2;
 
-	memset(out, -0.0, len * sizeof(cl_float));
-	memset(out + a_len - len - 1, -0.0, len * sizeof(cl_float));
+	int32_t max = 0;
+	for (ulong i = 0; i < a_len; ++i) {
+		if (abs(a[i]) > max) {
+			max = abs(a[i]);
+		}
+	}
+
+	int shift = 0;
+	while ((max >> shift) > INT16_MAX) {
+		++shift;
+	}
+
+	for (ulong i = 0; i < a_len; ++i) {
+		a[i] >>= shift;
+	}
 
 	for (ulong id = len, _len = a_len - len; id < _len; ++id) {
-		cl_float const *p = a + id - len;
-		register cl_float d = 0.0;
+		int32_t const *p = a + id - len;
+		int64_t d = 0;
 		for (ulong i = 0; i < b_len; ++i) {
-			d += POW2(*(p + i) * *(b + i));
+			int32_t const _d = (*(p + i) * *(b + i)) >> 15;
+			d += _d * _d;
 		}
-		out[id] = d;
+		out[id] = ldexp(static_cast<double>(d), 2 * shift);
 	}
 }
 
+/**
+ * Calculate the internal energy signal from internally set data signal
+ */
+void Retrigger::calculate_energy() {
+	if (energy) {
+		mm_free(energy);
+	}
+
+	int32_t *tmp = static_cast<int32_t *>(mm_calloc(len, sizeof(int32_t)));
+	if (tmp == 0) {
+		PERROR("calloc");
+		throw errno;
+	}
+
+	// first pass
+	// convolve with the convolution kernel
+	retrig_convolution_program(tmp, in, len, retrig_convolution_kernel_q,
+			convolution_window.len, retrig_convolution_kernel_shift);
+
+	energy = static_cast<cl_float *>(mm_calloc(len, sizeof(cl_float)));
+	if (energy == 0) {
+		PERROR("calloc");
+		throw errno;
+	}
+
+	// second pass
+	// calculate energy
+	retrig_energy_program(energy, tmp, len, blackman_window_q,
+			energy_window.len);
+
+	mm_free(tmp);
+}
+#else
 /**
  * Calculate the internal energy signal from internally set data signal
  */
@@ -255,7 +519,7 @@ void Retrigger::calculate_energy() {
 
 	// first pass
 	// convolve with the convolution kernel
-	retrig_convolution_program(tmp, in, len, retrig_convolution_kernel,
+	retrig_convolution_program(tmp, in, len, 1, retrig_convolution_kernel,
 			convolution_window.len);
 
 	energy = static_cast<cl_float *>(mm_calloc(len, sizeof(cl_float)));
@@ -266,10 +530,135 @@ void Retrigger::calculate_energy() {
 
 	// second pass
 	// calculate energy
-	retrig_energy_program(energy, tmp, len, blackman_window, energy_window.len);
+	retrig_energy_program(energy, tmp, len, 1, blackman_window,
+			energy_window.len);
 
 	mm_free(tmp);
 }
+#endif
+
+/**
+ * Set multi-channel data and generate one shared energy signal
+ *
+ * The shared energy is the average of the channel energies, so a single
+ * trigger and a single clustering serve all the channels. The correlations
+ * are calculated from the prefiltered signal of the channel with the most
+ * energy, see get_reference_channel(). In floating point the channels are
+ * prefiltered and convolved side by side, channel interleaved.
+ *
+ *  @param Pointers to data, one per channel
+ *  @param Number of channels
+ *  @param Length of data in samples per channel
+ */
+#ifndef DATA_RAW_T_FIXED
+void Retrigger::set_data(data_raw_t const *const *raw, size_t const &channels,
+		size_t const &len) {
+	reference_channel = 0;
+	if (channels == 1) {
+		set_data(raw[0], len);
+		return;
+	}
+
+	size_t const n = channels;
+	this->len = len;
+
+	// channel interleaved, narrowed to single precision like retrig_prefilter()
+	float *x = static_cast<float *>(mm_malloc(len * n * sizeof(float)));
+	for (size_t i = 0; i < len; ++i) {
+		for (size_t c = 0; c < n; ++c) {
+			x[i * n + c] = raw[c][i];
+		}
+	}
+
+	cl_float *filtered = 0;
+	DSP::Iir iir;
+	iir.bandpass(&filtered, x, len, n, 10.0, 500.0, 0.5, 4, sample_freq);
+	mm_free(x);
+
+	cl_float *tmp = static_cast<cl_float *>(mm_calloc(len * n,
+			sizeof(cl_float)));
+	cl_float *e = static_cast<cl_float *>(mm_calloc(len * n, sizeof(cl_float)));
+	if (tmp == 0 || e == 0) {
+		PERROR("calloc");
+	}
+	retrig_convolution_program(tmp, filtered, len, n, retrig_convolution_kernel,
+			convolution_window.len);
+	retrig_energy_program(e, tmp, len, n, blackman_window, energy_window.len);
+	mm_free(tmp);
+
+	if (energy) {
+		mm_free(energy);
+	}
+	energy = static_cast<cl_float *>(mm_malloc(len * sizeof(cl_float)));
+	std::vector<double> total(n, 0.0);
+	for (size_t i = 0; i < len; ++i) {
+		cl_float sum = 0.0;
+		for (size_t c = 0; c < n; ++c) {
+			sum += e[i * n + c];
+			total[c] += e[i * n + c];
+		}
+		energy[i] = sum / n;
+	}
+	mm_free(e);
+
+	for (size_t c = 1; c < n; ++c) {
+		if (total[c] > total[reference_channel]) {
+			reference_channel = c;
+		}
+	}
+
+	if (in) {
+		mm_free(in);
+	}
+	in = static_cast<retrig_in_t *>(mm_malloc(len * sizeof(retrig_in_t)));
+	for (size_t i = 0; i < len; ++i) {
+		in[i] = filtered[i * n + reference_channel];
+	}
+	mm_free(filtered);
+
+	this->raw = raw[reference_channel];
+}
+#else
+void Retrigger::set_data(data_raw_t const *const *raw, size_t const &channels,
+		size_t const &len) {
+	reference_channel = 0;
+	if (channels == 1) {
+		set_data(raw[0], len);
+		return;
+	}
+
+	// fixed point; one channel after the other
+	cl_float *sum = static_cast<cl_float *>(mm_calloc(len, sizeof(cl_float)));
+	std::vector<double> total(channels, 0.0);
+	retrig_in_t *reference_in = 0;
+	for (size_t c = 0; c < channels; ++c) {
+		set_data(raw[c], len);
+		for (size_t i = 0; i < len; ++i) {
+			sum[i] += energy[i];
+			total[c] += energy[i];
+		}
+		if (c == 0 || total[c] > total[reference_channel]) {
+			reference_channel = c;
+			if (reference_in) {
+				mm_free(reference_in);
+			}
+			reference_in = in;
+			in = 0;
+		}
+	}
+	for (size_t i = 0; i < len; ++i) {
+		sum[i] /= channels;
+	}
+
+	if (in) {
+		mm_free(in);
+	}
+	in = reference_in;
+	mm_free(energy);
+	energy = sum;
+	this->raw = raw[reference_channel];
+}
+#endif
 
 /**
  * Find local energy maxima near reference events and set locally stored temporary events accordingly
@@ -283,7 +672,7 @@ void Retrigger::calc(struct ref_event const &e, off_t const &_offset) {
 	if (offset < lookaround_window.offset
 			|| offset - lookaround_window.offset + lookaround_window.len
 					> len) {
-		fprintf(stderr, "[%s:%u] partial window.\n", __FILE__,
+		Utils::log_error("[%s:%u] partial window.\n", __FILE__,
 		__LINE__);
 		return;
 	}
@@ -304,10 +693,12 @@ void Retrigger::calc(struct ref_event const &e, off_t const &_offset) {
 	evx.push_back(_e);
 
 #ifdef DEBUG
-	printf("max at %lu, change: %li\n", max_at, (int64_t) max_at - offset);
+	Utils::log_printf(
+			"max at %lu, change: %li\n", max_at, (int64_t) max_at - offset);
 #endif
 }
 
+#ifndef DATA_RAW_T_FIXED
 /**
  * Calculate average
  *
@@ -360,6 +751,56 @@ static void retrig_correlation_program(cl_float *out, cl_float *a,
 	}
 }
 
+#else
+/**
+ * A fixed point custom correlation signal routine
+ *
+ * Same as the floating point version, but the sums are expanded so that the
+ * inner loop is a plain int16 x int16 dot product and the stream sums slide.
+ *
+ * @param Pointer to output memory space. Must be properly allocated.
+ * @param Pointer to longer correlation component (stream)
+ * @param Length of longer correlation component
+ * @param Pointer to shorter correlation component (window)
+ * @param Length of shorter correlation component
+ * @param Precalculated sum of the shorter correlation component (window)
+ * @param Precalculated n * sum(b^2) - sum(b)^2 of the shorter correlation component (window)
+ */
+static void retrig_correlation_program(cl_float *out, int16_t const *a,
+		ulong const &a_len, int16_t const *b, ulong const &b_len,
+		int64_t const &sum_b, int64_t const &var_b) {
+	ulong const len = b_len / 2;
+	int64_t const n = b_len;
+	int64_t sum_a = 0, sum2_a = 0;
+
+	for (ulong id = 0; id < a_len; ++id) {
+		int16_t const *p = a + id - len;
+
+		if (id == 0) {
+			for (ulong i = 0; i < b_len; ++i) {
+				sum_a += *(p + i);
+				sum2_a += static_cast<int32_t>(*(p + i)) * *(p + i);
+			}
+		} else {
+			int32_t const _in = *(p + b_len - 1), _out = *(p - 1);
+			sum_a += _in - _out;
+			sum2_a += _in * _in - _out * _out;
+		}
+
+		int64_t ab = 0;
+		for (ulong i = 0; i < b_len; ++i) {
+			ab += static_cast<int32_t>(*(p + i)) * *(b + i);
+		}
+
+		int64_t const conv = n * ab - sum_a * sum_b;
+		int64_t const var_a = n * sum2_a - sum_a * sum_a;
+
+		out[id] = static_cast<cl_float>(conv)
+				/ static_cast<cl_float>(var_a > var_b ? var_a : var_b);
+	}
+}
+#endif
+
 struct range {
 	off_t set;
 	off_t end;
@@ -400,6 +841,18 @@ void Retrigger::calculate_correlations() {
 			throw errno;
 		}
 
+#ifdef DATA_RAW_T_FIXED
+		int64_t sum_b = 0, sum2_b = 0;
+		for (ulong i = 0; i < correlation_window.len; ++i) {
+			int32_t const _b = *(in + it->offset - correlation_window.offset
+					+ i);
+			sum_b += _b;
+			sum2_b += _b * _b;
+		}
+		int64_t const stdev_b = static_cast<int64_t>(correlation_window.len)
+				* sum2_b - sum_b * sum_b;
+		int64_t const &avg_b = sum_b;
+#else
 		cl_float avg_b = avg(in + it->offset - correlation_window.offset,
 				correlation_window.len);
 		cl_float stdev_b = 0.0;
@@ -408,6 +861,7 @@ void Retrigger::calculate_correlations() {
 					+ i) - avg_b;
 			stdev_b += POW2(_b);
 		}
+#endif
 
 		// calculate correlation signal locally for each event
 		for (std::vector<struct range>::const_iterator it2 = ranges.begin();
@@ -434,7 +888,7 @@ retrig_ev Retrigger::form_cluster(
 	for (double _d = 0.95; ev.size() < 3; _d -= 0.025) {
 		if (_d < 0.8) {
 			errno = ENOSYS;
-			fprintf(stderr,
+			Utils::log_error(
 					"[%s:%u] failed to get good enough template events. Refusing to continue.\n",
 					__FILE__, __LINE__);
 			throw errno;
@@ -469,7 +923,8 @@ retrig_ev Retrigger::form_cluster(
 
 			offset -= ref_offset;
 #ifdef DEBUG
-			printf("template event at %lu, p-value: %f, template offset: %li\n",
+			Utils::log_printf(
+					"template event at %lu, p-value: %f, template offset: %li\n",
 					(*it)->offset, dd, offset);
 #endif
 			(*it)->correlation.offset = offset;
@@ -529,7 +984,7 @@ retrig_ev Retrigger::form_cluster(
 			ev.push_back(e);
 
 #ifdef DEBUG
-			printf("retriggered event at %lu, p = %.03f\n", e.offset,
+			Utils::log_printf("retriggered event at %lu, p = %.03f\n", e.offset,
 					e.correlation.p);
 #endif
 		}
@@ -570,11 +1025,16 @@ bool corr_p_sort(ref_ev_ext_it i, ref_ev_ext_it j) {
  * @param Cut-off correlation limit
  */
 void Retrigger::calc_correlations(double const &correlation_limit) {
+	ev.clear();
+	evs.clear();
+	s1.clear();
+	s2.clear();
+
 	{
 		clock_t ref = clock();
 		calculate_correlations();
 		clock_t t = clock();
-		printf("calculated correlations in %.3f s\n",
+		Utils::log_printf("calculated correlations in %.3f s\n",
 				static_cast<double>(t - ref) / CLOCKS_PER_SEC);
 	}
 
@@ -621,6 +1081,7 @@ void Retrigger::calc_correlations(double const &correlation_limit) {
 	}
 
 	if (corr_map.size() == 0) {
+		release_correlations();
 		return;
 	}
 
@@ -639,7 +1100,8 @@ void Retrigger::calc_correlations(double const &correlation_limit) {
 			continue;
 		}
 
-		printf("template event at %lu, p-value: %f, cluster size: %lu\n",
+		Utils::log_printf(
+				"template event at %lu, p-value: %f, cluster size: %lu\n",
 				(*it)->offset, (*it)->correlation.p,
 				(*it)->cluster.stack.size());
 		try {
@@ -667,7 +1129,7 @@ void Retrigger::calc_correlations(double const &correlation_limit) {
 				}
 			}
 
-			printf("smallest distance: %.3f s\n",
+			Utils::log_printf("smallest distance: %.3f s\n",
 					static_cast<double>(distance) / sample_freq);
 
 			// calculate rr estimate
@@ -681,13 +1143,14 @@ void Retrigger::calc_correlations(double const &correlation_limit) {
 				prev = it;
 			}
 
-			printf("best cluster rr: %lu (%.03f s)\n", rr, rr / sample_freq);
+			Utils::log_printf(
+					"best cluster rr: %lu (%.03f s)\n", rr, rr / sample_freq);
 
 			if (labs(distance) < static_cast<off_t>(sample_freq * 0.2)) {
-				puts("too close to existing, skip");
+				Utils::log_printf("too close to existing, skip\n");
 			} else if (labs(distance) > static_cast<off_t>(sample_freq * 0.5)
 					|| labs(distance) > 0.8 * rr) {
-				puts("too far to existing, skip");
+				Utils::log_printf("too far to existing, skip\n");
 			} else {
 				evs.push_back(_ev);
 
@@ -699,7 +1162,7 @@ void Retrigger::calc_correlations(double const &correlation_limit) {
 						s1 = _ev;
 						s2 = *(evs.begin());
 					}
-					puts("s1 and s2 models found.");
+					Utils::log_printf("s1 and s2 models found.\n");
 
 					// verify that s1 doesn't contain s2 triggers
 					if (labs(distance) < sample_freq) {
@@ -714,7 +1177,8 @@ void Retrigger::calc_correlations(double const &correlation_limit) {
 							prev = it;
 
 							if (rr < 1.25 * distance) {
-								printf("bad s1 at %lu, rr = %lu\n", it->offset,
+								Utils::log_printf(
+										"bad s1 at %lu, rr = %lu\n", it->offset,
 										rr);
 								it = s1.erase(it);
 								if (it == s1.end()) {
@@ -732,6 +1196,13 @@ void Retrigger::calc_correlations(double const &correlation_limit) {
 		}
 	}
 
+	release_correlations();
+}
+
+/**
+ * Free the temporary correlation state of calc_correlations()
+ */
+void Retrigger::release_correlations() {
 	for (ref_ev_ext_it it = evx.begin(); it != evx.end(); ++it) {
 		mm_free(it->correlation.signal);
 	}
@@ -780,6 +1251,13 @@ const cl_float *Retrigger::get_energy() const {
 	return energy;
 }
 
+/**
+ * @return Channel the correlations are calculated from, see set_data()
+ */
+size_t const &Retrigger::get_reference_channel() const {
+	return reference_channel;
+}
+
 /**
  * A sort function
  *
@@ -813,7 +1291,7 @@ void Retrigger::set_ref_ev(ref_ev const &ev) {
 		return;
 	}
 
-	printf("limiting count to %lu\n", ref_ev_limit);
+	Utils::log_printf("limiting count to %lu\n", ref_ev_limit);
 	evx.reserve(ref_ev_limit);
 
 	off_t center = ev.size() / 2;
@@ -43,15 +43,24 @@ typedef ref_ev_ext::iterator ref_ev_ext_it;
 typedef std::vector<struct retrig_event> retrig_ev;
 typedef retrig_ev::const_iterator retrig_ev_it;
 
+#ifdef DATA_RAW_T_FIXED
+typedef int16_t retrig_in_t;
+#else
+typedef cl_float retrig_in_t;
+#endif
+
 class Retrigger {
 public:
 	static double constexpr sample_freq = 2000.0;
 	static size_t constexpr ref_ev_limit = 100;
+	static double constexpr iir_settle_time = 0.5;
 
 	Retrigger(double const &window_length_in_fractions_of_sample_time);
 	virtual ~Retrigger();
 
 	virtual void set_data(data_raw_t const *raw, size_t const &len);
+	void set_data(data_raw_t const *const *raw, size_t const &channels,
+			size_t const &len);
 	virtual void set_convolution_kernel(cl_float const *kernel,
 			size_t const &len);
 	virtual void set_ref_ev(ref_ev const &ev);
@@ -70,26 +79,39 @@ public:
 	retrig_ev const &get_s2_events() const;
 
 	cl_float const *get_energy() const;
+	size_t const &get_reference_channel() const;
 
 protected:
 	data_raw_t const *raw;
 	size_t len;
 	size_t len_in_bytes;
 
-	cl_float *in;
+	retrig_in_t *in;
 	cl_float *energy;
+	size_t reference_channel;
 
-	void calculate_energy();
-	void calculate_correlations();
-
-private:
 	struct window energy_window;
 	struct window convolution_window;
 	struct window lookaround_window;
 	struct window correlation_window;
 
+	void set_prefiltered_data(data_raw_t const *raw, size_t const &len);
+	void set_data(data_raw_t const *raw, cl_float const *energy,
+			size_t const &len);
+	size_t halo() const;
+
+	void calculate_energy();
+	void calculate_correlations();
+
+private:
+
 	cl_float *blackman_window;
 	cl_float *retrig_convolution_kernel;
+#ifdef DATA_RAW_T_FIXED
+	int16_t *blackman_window_q;
+	int16_t *retrig_convolution_kernel_q;
+	int retrig_convolution_kernel_shift;
+#endif
 
 	ref_ev_ext evx; // temporary resource, lifespan from calc() to calc_correlations()
 	off_t evx_offset; // average offset to ref_event offset
@@ -101,6 +123,7 @@ private:
 	retrig_ev s2;
 
 	retrig_ev form_cluster(std::vector<ref_ev_ext_it>::iterator &trunk_it);
+	void release_correlations();
 };
 
 } /* namespace OpenCL */
@@ -0,0 +1,346 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ShmRing.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "macro.h"
+
+#include "ShmRing.h"
+
+namespace Signal {
+
+uint32_t constexpr ShmRing::magic;
+
+static size_t const page_size = 4096;
+
+static size_t slots_offset() {
+	return (sizeof(struct shm_ring_header) + 63) & ~static_cast<size_t>(63);
+}
+
+static size_t data_offset(size_t const &slots) {
+	return (slots_offset() + slots * sizeof(struct shm_ring_slot) + page_size
+			- 1) & ~(page_size - 1);
+}
+
+/**
+ * Wait until the futex word differs from the expected value
+ *
+ * The word is shared between processes, so the private futex operations can
+ * not be used.
+ *
+ * @param Futex word
+ * @param Expected value
+ * @param Timeout in seconds
+ */
+static void futex_wait(uint32_t *word, uint32_t const &expected,
+		double const &timeout) {
+	struct timespec ts;
+	ts.tv_sec = static_cast<time_t>(timeout);
+	ts.tv_nsec = static_cast<long>((timeout - ts.tv_sec) * 1e9);
+	syscall(SYS_futex, word, FUTEX_WAIT, expected, &ts, 0, 0);
+}
+
+static void futex_wake(uint32_t *word) {
+	syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, 0, 0, 0);
+}
+
+/**
+ * Create a single producer ring of PCM records in POSIX shared memory
+ *
+ * The consumer creates the ring and removes it when done. A capture process
+ * opens it by name, writes each record straight to a slot and publishes it;
+ * the consumer converts the samples from the shared pages with no file and
+ * no intermediate copy. The head and tail counters double as futex doorbells.
+ *
+ * @param Shared memory object name, eg. /tftrig
+ * @param Number of slots
+ * @param Slot capacity in samples, rounded up to whole pages
+ */
+ShmRing::ShmRing(char const *name, size_t const &slots,
+		size_t const &slot_samples) :
+		owner(true), slots(slots) {
+	snprintf(this->name, sizeof(this->name), "%s", name);
+
+	size_t const samples_per_page = page_size / sizeof(int16_t);
+	this->slot_samples = (slot_samples + samples_per_page - 1)
+			/ samples_per_page * samples_per_page;
+	if (slots < 1 || this->slot_samples < 1) {
+		errno = EINVAL;
+		PERROR("ShmRing");
+	}
+
+	// replace a stale ring of a previous consumer
+	shm_unlink(name);
+	int const fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		PERROR("shm_open");
+	}
+
+	map_len = data_offset(slots)
+			+ slots * this->slot_samples * sizeof(int16_t);
+	if (ftruncate(fd, map_len)) {
+		::close(fd);
+		shm_unlink(name);
+		PERROR("ftruncate");
+	}
+
+	map(fd);
+
+	header->slots = slots;
+	header->slot_samples = this->slot_samples;
+	header->closed = 0;
+	header->head = 0;
+	header->tail = 0;
+	__atomic_store_n(&header->magic, magic, __ATOMIC_RELEASE);
+}
+
+/**
+ * Open an existing ring, see the above
+ *
+ * @param Shared memory object name
+ */
+ShmRing::ShmRing(char const *name) :
+		owner(false), slots(0), slot_samples(0) {
+	snprintf(this->name, sizeof(this->name), "%s", name);
+
+	int const fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) {
+		PERROR("shm_open");
+	}
+
+	struct stat sb;
+	if (fstat(fd, &sb)) {
+		::close(fd);
+		PERROR("fstat");
+	}
+	map_len = sb.st_size;
+	if (map_len < data_offset(0)) {
+		::close(fd);
+		errno = EINVAL;
+		PERROR("ShmRing");
+	}
+
+	map(fd);
+
+	// slots and slot_samples are checked before they size or divide anything
+	size_t const n_slots = header->slots;
+	size_t const n_samples = header->slot_samples;
+	if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != magic
+			|| n_slots == 0 || n_samples == 0
+			|| n_slots > (map_len - data_offset(0)) / sizeof(struct shm_ring_slot)
+			|| map_len < data_offset(n_slots)
+			|| n_samples > (map_len - data_offset(n_slots)) / sizeof(int16_t)
+					/ n_slots) {
+		munmap(header, map_len);
+		errno = EINVAL;
+		PERROR("ShmRing");
+	}
+	slots = n_slots;
+	slot_samples = n_samples;
+	data = reinterpret_cast<int16_t *>(reinterpret_cast<char *>(header)
+			+ data_offset(slots));
+}
+
+ShmRing::~ShmRing() {
+	munmap(header, map_len);
+	if (owner) {
+		shm_unlink(name);
+	}
+}
+
+void ShmRing::map(int const &fd) {
+	void *p = mmap(0, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		if (owner) {
+			shm_unlink(name);
+		}
+		PERROR("mmap");
+	}
+
+	header = static_cast<struct shm_ring_header *>(p);
+	slot = reinterpret_cast<struct shm_ring_slot *>(static_cast<char *>(p)
+			+ slots_offset());
+	data = reinterpret_cast<int16_t *>(static_cast<char *>(p)
+			+ data_offset(slots));
+}
+
+/**
+ * Wait until the slot of a record is free to be written
+ *
+ * @param Record sequence number
+ * @param Timeout in seconds
+ * @return True if the slot is free
+ */
+bool ShmRing::wait_free(uint32_t const &seq, double const &timeout) {
+	uint32_t tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+	if (seq - tail < slots) {
+		return true;
+	}
+	futex_wait(&header->tail, tail, timeout);
+	tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+	return seq - tail < slots;
+}
+
+/**
+ * @param Record sequence number
+ * @return Pointer to the slot_samples long slot of the record
+ */
+int16_t *ShmRing::get_slot(uint32_t const &seq) {
+	return data + (seq % slots) * slot_samples;
+}
+
+/**
+ * Publish a record written to its slot and ring the doorbell
+ *
+ * The records must be published in sequence.
+ *
+ * @param Record sequence number
+ * @param Number of samples in the slot
+ * @param Record name, eg. a0123
+ */
+void ShmRing::publish(uint32_t const &seq, size_t const &len,
+		char const *name) {
+	struct shm_ring_slot &s = slot[seq % slots];
+	s.len = len < slot_samples ? len : slot_samples;
+	s.answer = 0;
+	snprintf(s.name, sizeof(s.name), "%s", name);
+
+	__atomic_store_n(&header->head, seq + 1, __ATOMIC_RELEASE);
+	futex_wake(&header->head);
+}
+
+/**
+ * Tell the consumer there will be no more records
+ */
+void ShmRing::close() {
+	__atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+	futex_wake(&header->head);
+}
+
+/**
+ * Wait until a record is published
+ *
+ * @param Record sequence number
+ * @param Timeout in seconds
+ * @return True if the record is available
+ */
+bool ShmRing::wait_published(uint32_t const &seq, double const &timeout) {
+	uint32_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+	if (static_cast<int32_t>(head - seq) > 0) {
+		return true;
+	}
+	if (is_closed()) {
+		return false;
+	}
+	futex_wait(&header->head, head, timeout);
+	head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+	return static_cast<int32_t>(head - seq) > 0;
+}
+
+bool ShmRing::is_closed() const {
+	return __atomic_load_n(&header->closed, __ATOMIC_ACQUIRE);
+}
+
+int16_t const *ShmRing::get_pcm(uint32_t const &seq) const {
+	return data + (seq % slots) * slot_samples;
+}
+
+/**
+ * Number of samples of a record, as the producer wrote it
+ *
+ * The producer is another process; a length over get_slot_samples() is not
+ * a record.
+ *
+ * @param Record sequence number
+ * @return Number of samples
+ */
+size_t ShmRing::get_len(uint32_t const &seq) const {
+	return __atomic_load_n(&slot[seq % slots].len, __ATOMIC_RELAXED);
+}
+
+/**
+ * Copy the name of a record, NUL terminated whatever the producer wrote
+ *
+ * @param Record sequence number
+ * @param Pointer to output name
+ * @param Size of the output, at least one
+ * @return Pointer to the name
+ */
+char const *ShmRing::get_name(uint32_t const &seq, char *name,
+		size_t const &size) const {
+	char const *s = slot[seq % slots].name;
+	size_t const len = strnlen(s, std::min(size - 1, sizeof(slot->name)));
+	memcpy(name, s, len);
+	name[len] = 0;
+	return name;
+}
+
+/**
+ * Release a record and its slot back to the producer
+ *
+ * The records must be released in sequence. The answer stays readable from
+ * get_answer() until the producer reuses the slot.
+ *
+ * @param Record sequence number
+ * @param Answer code
+ */
+void ShmRing::release(uint32_t const &seq, int const &answer) {
+	slot[seq % slots].answer = answer;
+	__atomic_store_n(&header->tail, seq + 1, __ATOMIC_RELEASE);
+	futex_wake(&header->tail);
+}
+
+int ShmRing::get_answer(uint32_t const &seq) const {
+	return slot[seq % slots].answer;
+}
+
+uint32_t ShmRing::get_head() const {
+	return __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+}
+
+uint32_t ShmRing::get_tail() const {
+	return __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+}
+
+size_t const &ShmRing::get_slot_samples() const {
+	return slot_samples;
+}
+
+size_t const &ShmRing::get_slots() const {
+	return slots;
+}
+
+} /* namespace Signal */
@@ -0,0 +1,80 @@
+/**
+ * ShmRing.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef ENTRY_SRC_SIMPLIFIED_SHMRING_H_
+#define ENTRY_SRC_SIMPLIFIED_SHMRING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Signal {
+
+/*
+ * Shared memory layout; the header, the slot descriptors and the page aligned
+ * slots of slot_samples 16 bit PCM samples each.
+ */
+struct shm_ring_header {
+	uint32_t magic;
+	uint32_t slots;
+	uint32_t slot_samples;
+	uint32_t closed; // set by the producer after the last record
+	uint32_t head; // number of published records, futex word
+	uint32_t tail; // number of released records, futex word
+};
+
+struct shm_ring_slot {
+	uint32_t len; // samples
+	int32_t answer; // valid once the record is released
+	char name[248];
+};
+
+class ShmRing {
+public:
+	static uint32_t constexpr magic = 0x54465231; // "TFR1"
+
+	ShmRing(char const *name, size_t const &slots, size_t const &slot_samples);
+	explicit ShmRing(char const *name);
+	virtual ~ShmRing();
+
+	// producer
+	bool wait_free(uint32_t const &seq, double const &timeout);
+	int16_t *get_slot(uint32_t const &seq);
+	void publish(uint32_t const &seq, size_t const &len, char const *name);
+	void close();
+
+	// consumer
+	bool wait_published(uint32_t const &seq, double const &timeout);
+	bool is_closed() const;
+	int16_t const *get_pcm(uint32_t const &seq) const;
+	size_t get_len(uint32_t const &seq) const;
+	char const *get_name(uint32_t const &seq, char *name,
+			size_t const &size) const;
+	void release(uint32_t const &seq, int const &answer);
+
+	int get_answer(uint32_t const &seq) const;
+	uint32_t get_head() const;
+	uint32_t get_tail() const;
+	size_t const &get_slot_samples() const;
+	size_t const &get_slots() const;
+private:
+	char name[248];
+	bool owner;
+
+	size_t slots;
+	size_t slot_samples;
+	size_t map_len;
+
+	struct shm_ring_header *header;
+	struct shm_ring_slot *slot;
+	int16_t *data;
+
+	void map(int const &fd);
+};
+
+} /* namespace Signal */
+
+#endif /* ENTRY_SRC_SIMPLIFIED_SHMRING_H_ */
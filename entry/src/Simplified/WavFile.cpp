@@ -0,0 +1,297 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * WavFile.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "macro.h"
+
+#include "WavFile.h"
+
+namespace Signal {
+
+static uint16_t le16(uint8_t const *p) {
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(uint8_t const *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+/**
+ * Map a RIFF/WAVE file
+ *
+ * The samples are left in the mapped pages, see get_data().
+ *
+ * @param Input filename
+ */
+WavFile::WavFile(char const *filename) :
+		map(0), map_len(0), data(0), frames(0) {
+	int const fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		PERROR("open");
+	}
+
+	struct stat sb;
+	if (fstat(fd, &sb)) {
+		close(fd);
+		PERROR("fstat");
+	}
+
+	map_len = sb.st_size;
+	if (map_len) {
+		map = mmap(0, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map_len == 0 || map == MAP_FAILED) {
+		map = 0;
+		if (map_len == 0) {
+			errno = EINVAL;
+		}
+		PERROR("mmap");
+	}
+	madvise(map, map_len, MADV_SEQUENTIAL);
+
+	try {
+		parse(static_cast<uint8_t const *>(map), map_len);
+	} catch (int e) {
+		munmap(map, map_len);
+		throw;
+	}
+}
+
+/**
+ * Parse a RIFF/WAVE image in memory, eg. a stored archive member
+ *
+ * The buffer must outlive the object.
+ *
+ * @param Pointer to the image
+ * @param Length of the image in bytes
+ */
+WavFile::WavFile(void const *buf, size_t const &len) :
+		map(0), map_len(0), data(0), frames(0) {
+	parse(static_cast<uint8_t const *>(buf), len);
+}
+
+WavFile::~WavFile() {
+	if (map) {
+		munmap(map, map_len);
+	}
+}
+
+/**
+ * Walk the RIFF chunks
+ *
+ * Unknown chunks (LIST, fact, cue, ..) are skipped, chunks are padded to even
+ * length. The fmt chunk must precede the data chunk. A data chunk running past
+ * the end of the image, as left by an interrupted recorder, is cut to the
+ * whole frames available.
+ *
+ * @param Pointer to the image
+ * @param Length of the image in bytes
+ */
+void WavFile::parse(uint8_t const *buf, size_t const &len) {
+	if (len < 12 || memcmp(buf, "RIFF", 4) || memcmp(buf + 8, "WAVE", 4)) {
+		errno = EINVAL;
+		PERROR("not a RIFF/WAVE file");
+	}
+
+	bool has_format = false;
+	for (size_t offset = 12; offset + 8 <= len;) {
+		uint8_t const *chunk = buf + offset;
+		size_t const chunk_len = le32(chunk + 4);
+		size_t const available = len - offset - 8;
+
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			if (chunk_len < 16 || chunk_len > available) {
+				errno = EINVAL;
+				PERROR("truncated fmt chunk");
+			}
+			format.format_tag = le16(chunk + 8);
+			format.channels = le16(chunk + 10);
+			format.sample_rate = le32(chunk + 12);
+			format.block_align = le16(chunk + 20);
+			format.bits_per_sample = le16(chunk + 22);
+
+			// WAVEFORMATEXTENSIBLE; the subformat GUID starts with the format tag
+			if (format.format_tag == WAV_FORMAT_EXTENSIBLE) {
+				if (chunk_len < 40) {
+					errno = EINVAL;
+					PERROR("truncated extensible fmt chunk");
+				}
+				format.format_tag = le16(chunk + 8 + 24);
+			}
+
+			if ((format.format_tag != WAV_FORMAT_PCM
+					&& format.format_tag != WAV_FORMAT_IEEE_FLOAT)
+					|| format.channels < 1 || format.sample_rate < 1
+					|| format.bits_per_sample < 8
+					|| format.bits_per_sample % 8
+					|| format.block_align
+							!= format.channels * format.bits_per_sample / 8) {
+				errno = EINVAL;
+				PERROR("unsupported wav format");
+			}
+			has_format = true;
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			if (!has_format) {
+				errno = EINVAL;
+				PERROR("data chunk before fmt chunk");
+			}
+			size_t const n = chunk_len < available ? chunk_len : available;
+			data = chunk + 8;
+			frames = n / format.block_align;
+			return;
+		}
+
+		offset += 8 + chunk_len + (chunk_len & 1);
+	}
+
+	errno = EINVAL;
+	PERROR("no data chunk");
+}
+
+/**
+ * Find the samples in the start of a RIFF/WAVE image, eg. one being inflated
+ *
+ * The chunks are only walked, as in parse(); the image up to the samples is
+ * parsed once it is all there.
+ *
+ * @param Pointer to the start of the image
+ * @param Length of the start in bytes
+ * @param Pointer to output length of the data chunk, as it claims
+ * @return Offset of the samples, zero if more of the image is needed, SIZE_MAX if not RIFF/WAVE
+ */
+size_t WavFile::find_data(void const *buf, size_t const &len,
+		size_t *data_len) {
+	uint8_t const *b = static_cast<uint8_t const *>(buf);
+	if (len < 12) {
+		return 0;
+	}
+	if (memcmp(b, "RIFF", 4) || memcmp(b + 8, "WAVE", 4)) {
+		return SIZE_MAX;
+	}
+	for (size_t offset = 12; offset + 8 <= len;) {
+		size_t const chunk_len = le32(b + offset + 4);
+		if (memcmp(b + offset, "data", 4) == 0) {
+			*data_len = chunk_len;
+			return offset + 8;
+		}
+		offset += 8 + chunk_len + (chunk_len & 1);
+	}
+	return 0;
+}
+
+/**
+ * Decode one channel to float at full scale 1.0
+ *
+ * Integer PCM of 8 (unsigned), 16, 24 and 32 bits and IEEE float of 32 and
+ * 64 bits. The mapped samples need not be aligned.
+ *
+ * @param Pointer to output, size() samples
+ * @param Channel, from zero
+ */
+void WavFile::decode(float *out, uint16_t const &channel) const {
+	if (channel >= format.channels) {
+		errno = EINVAL;
+		PERROR("no such channel");
+	}
+	size_t const stride = format.block_align;
+	uint8_t const *p = static_cast<uint8_t const *>(data)
+			+ channel * format.bits_per_sample / 8;
+
+	if (format.format_tag == WAV_FORMAT_IEEE_FLOAT) {
+		switch (format.bits_per_sample) {
+		case 32:
+			for (size_t i = 0; i < frames; ++i, p += stride) {
+				memcpy(out + i, p, sizeof(float));
+			}
+			return;
+		case 64:
+			for (size_t i = 0; i < frames; ++i, p += stride) {
+				double d;
+				memcpy(&d, p, sizeof(double));
+				out[i] = d;
+			}
+			return;
+		}
+	} else {
+		switch (format.bits_per_sample) {
+		case 8:
+			for (size_t i = 0; i < frames; ++i, p += stride) {
+				out[i] = (p[0] - 128) * (1.0f / 128);
+			}
+			return;
+		case 16:
+			for (size_t i = 0; i < frames; ++i, p += stride) {
+				out[i] = static_cast<int16_t>(le16(p)) * (1.0f / 32768);
+			}
+			return;
+		case 24:
+			for (size_t i = 0; i < frames; ++i, p += stride) {
+				// sign extend from the top byte
+				int32_t const d = static_cast<int32_t>(p[0] << 8 | p[1] << 16
+						| static_cast<uint32_t>(p[2]) << 24) >> 8;
+				out[i] = d * (1.0f / 8388608);
+			}
+			return;
+		case 32:
+			for (size_t i = 0; i < frames; ++i, p += stride) {
+				out[i] = static_cast<int32_t>(le32(p)) * (1.0f / 2147483648.0f);
+			}
+			return;
+		}
+	}
+
+	errno = EINVAL;
+	PERROR("unsupported sample size");
+}
+
+/**
+ * @return Format of the samples
+ */
+struct wav_format const &WavFile::get_format() const {
+	return format;
+}
+
+/**
+ * @return Pointer to the interleaved little-endian samples
+ */
+void const *WavFile::get_data() const {
+	return data;
+}
+
+/**
+ * @return Number of frames, ie. samples per channel
+ */
+size_t const &WavFile::size() const {
+	return frames;
+}
+
+} /* namespace Signal */
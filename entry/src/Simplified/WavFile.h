@@ -0,0 +1,56 @@
+/**
+ * WavFile.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef ENTRY_SRC_SIMPLIFIED_WAVFILE_H_
+#define ENTRY_SRC_SIMPLIFIED_WAVFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Signal {
+
+enum wav_format_tag_e {
+	WAV_FORMAT_PCM = 0x0001,
+	WAV_FORMAT_IEEE_FLOAT = 0x0003,
+	WAV_FORMAT_EXTENSIBLE = 0xfffe,
+};
+
+struct wav_format {
+	uint16_t format_tag; // PCM or IEEE float, resolved from the extensible subformat
+	uint16_t channels;
+	uint32_t sample_rate;
+	uint16_t block_align; // bytes per frame
+	uint16_t bits_per_sample;
+};
+
+class WavFile {
+public:
+	explicit WavFile(char const *filename);
+	WavFile(void const *buf, size_t const &len);
+	virtual ~WavFile();
+
+	struct wav_format const &get_format() const;
+	void const *get_data() const;
+	void decode(float *out, uint16_t const &channel = 0) const;
+	size_t const &size() const;
+
+	static size_t find_data(void const *buf, size_t const &len,
+			size_t *data_len);
+private:
+	void *map;
+	size_t map_len;
+
+	struct wav_format format;
+	void const *data;
+	size_t frames;
+
+	void parse(uint8_t const *buf, size_t const &len);
+};
+
+} /* namespace Signal */
+
+#endif /* ENTRY_SRC_SIMPLIFIED_WAVFILE_H_ */
@@ -0,0 +1,401 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * WfdbRecord.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <math.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "macro.h"
+#include "../utils/memory_manager.h"
+
+#include "WfdbRecord.h"
+
+namespace Signal {
+
+static size_t constexpr block_frames = 4096; // even, so that 212 blocks start on a pair
+
+/**
+ * Unpack format 212; two 12 bit samples in three bytes, the high nibbles of
+ * both in the middle byte. Plain loops over the pairs, which vectorize.
+ *
+ * @param Pointer to output
+ * @param Pointer to the first byte of a pair
+ * @param Number of samples
+ */
+static void unpack212(int16_t *__restrict__ out, uint8_t const *__restrict__ p,
+		size_t const n) {
+	size_t const pairs = n / 2;
+	for (size_t k = 0; k < pairs; ++k) {
+		uint8_t const b0 = p[3 * k], b1 = p[3 * k + 1], b2 = p[3 * k + 2];
+		// sign extend from bit 11
+		out[2 * k] = static_cast<int16_t>((b0 | (b1 & 0x0f) << 8) << 4) >> 4;
+		out[2 * k + 1] = static_cast<int16_t>((b2 | (b1 & 0xf0) << 4) << 4) >> 4;
+	}
+	if (n & 1) {
+		uint8_t const b0 = p[3 * pairs], b1 = p[3 * pairs + 1];
+		out[n - 1] = static_cast<int16_t>((b0 | (b1 & 0x0f) << 8) << 4) >> 4;
+	}
+}
+
+/**
+ * Read a WFDB header and map its signal files
+ *
+ * @param Record name, eg. a0123 for a0123.hea
+ */
+WfdbRecord::WfdbRecord(char const *basename) :
+		channels(0), sample_rate(0), frames(0) {
+	char header[FILENAME_MAX];
+	snprintf(header, sizeof(header), "%s.hea", basename);
+
+	// the signal files are relative to the header
+	std::string dir(basename);
+	size_t const slash = dir.rfind('/');
+	dir.erase(slash == std::string::npos ? 0 : slash + 1);
+
+	parse(header, dir);
+	try {
+		map_files(dir, frames == 0);
+	} catch (int e) {
+		unmap_files();
+		throw;
+	}
+}
+
+WfdbRecord::~WfdbRecord() {
+	unmap_files();
+}
+
+/**
+ * Parse the record line and the signal lines
+ *
+ *   record nsig [fs[/counter freq[(base)]] [nsamp ..]]
+ *   file format[xspf][:skew][+offset] [gain(baseline)/units ..] ..
+ *
+ * Comment lines start with #. The gain, baseline and ADC fields are not
+ * needed, as the baseline and scale are corrected after loading. Signals
+ * sharing a file are on consecutive lines.
+ *
+ * @param Header filename
+ * @param Directory of the signal files
+ */
+void WfdbRecord::parse(char const *header, std::string const &dir) {
+	FILE *f = fopen(header, "r");
+	if (f == 0) {
+		PERROR("fopen");
+	}
+
+	char line[4096];
+	size_t nsig = 0;
+	bool has_record = false;
+	while (signals.size() < nsig || !has_record) {
+		if (fgets(line, sizeof(line), f) == 0) {
+			fclose(f);
+			errno = EINVAL;
+			PERROR("truncated WFDB header");
+		}
+		char *p = line + strspn(line, " \t\r\n");
+		if (*p == 0 || *p == '#') {
+			continue;
+		}
+
+		char name[FILENAME_MAX], spec[64];
+		if (!has_record) {
+			char fs[64] = "250";
+			unsigned long nsamp = 0;
+			if (sscanf(p, "%4095s %lu %63s %lu", name, &nsig, fs, &nsamp) < 2) {
+				fclose(f);
+				errno = EINVAL;
+				PERROR("corrupted WFDB record line");
+			}
+			if (strchr(name, '/')) {
+				fclose(f);
+				errno = ENOTSUP;
+				PERROR("multi-segment WFDB records are not supported");
+			}
+			double const rate = strtod(fs, 0);
+			if (!(rate >= 1) || rate != floor(rate)) {
+				fclose(f);
+				errno = ENOTSUP;
+				PERROR("WFDB sampling frequency is not a whole number of Hz");
+			}
+			sample_rate = rate;
+			frames = nsamp;
+			has_record = true;
+			continue;
+		}
+
+		if (sscanf(p, "%4095s %63s", name, spec) < 2) {
+			fclose(f);
+			errno = EINVAL;
+			PERROR("corrupted WFDB signal line");
+		}
+		char *s = spec;
+		unsigned long const format = strtoul(s, &s, 10);
+		unsigned long spf = 1, offset = 0;
+		long skew = 0;
+		for (; *s; ) {
+			char const c = *s++;
+			if (c == 'x') {
+				spf = strtoul(s, &s, 10);
+			} else if (c == ':') {
+				skew = strtol(s, &s, 10);
+			} else if (c == '+') {
+				offset = strtoul(s, &s, 10);
+			} else {
+				break;
+			}
+		}
+		if ((format != WFDB_FORMAT_16 && format != WFDB_FORMAT_24
+				&& format != WFDB_FORMAT_212) || spf != 1 || skew
+				|| strcmp(name, "-") == 0) {
+			fclose(f);
+			errno = ENOTSUP;
+			PERROR("unsupported WFDB signal format");
+		}
+
+		if (files.size() && files.back().name == name) {
+			if (files.back().format != format || files.back().offset != offset) {
+				fclose(f);
+				errno = EINVAL;
+				PERROR("mixed formats in a WFDB signal file");
+			}
+		} else {
+			struct wfdb_file file = { name, static_cast<uint16_t>(format),
+					offset, 0, 0, 0 };
+			files.push_back(file);
+		}
+		struct wfdb_signal const signal = { files.size() - 1,
+				files.back().signals++ };
+		signals.push_back(signal);
+	}
+	fclose(f);
+
+	if (nsig == 0) {
+		errno = EINVAL;
+		PERROR("WFDB record has no signals");
+	}
+	channels = nsig;
+}
+
+/**
+ * Map the signal files
+ *
+ * A file shorter than the header says, eg. of an interrupted recording, cuts
+ * the record to the whole frames available.
+ *
+ * @param Directory of the signal files
+ * @param Take the number of frames from the file sizes
+ */
+void WfdbRecord::map_files(std::string const &dir, bool const &count_frames) {
+	size_t available = static_cast<size_t>(-1);
+	for (size_t i = 0; i < files.size(); ++i) {
+		struct wfdb_file &file = files[i];
+		std::string const filename = dir + file.name;
+
+		int const fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			PERROR("open");
+		}
+		struct stat sb;
+		if (fstat(fd, &sb)) {
+			close(fd);
+			PERROR("fstat");
+		}
+		file.map_len = sb.st_size;
+		if (file.map_len) {
+			file.map = mmap(0, file.map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+		if (file.map_len == 0 || file.map == MAP_FAILED) {
+			file.map = 0;
+			if (file.map_len == 0) {
+				errno = EINVAL;
+			}
+			PERROR("mmap");
+		}
+		madvise(file.map, file.map_len, MADV_SEQUENTIAL);
+
+		size_t const bytes =
+				file.map_len > file.offset ? file.map_len - file.offset : 0;
+		size_t samples;
+		switch (file.format) {
+		case WFDB_FORMAT_16:
+			samples = bytes / 2;
+			break;
+		case WFDB_FORMAT_24:
+			samples = bytes / 3;
+			break;
+		default: // 212; a lone last sample takes two bytes
+			samples = bytes / 3 * 2 + (bytes % 3 == 2);
+			break;
+		}
+		if (samples / file.signals < available) {
+			available = samples / file.signals;
+		}
+	}
+
+	if (count_frames || frames > available) {
+		frames = available;
+	}
+}
+
+void WfdbRecord::unmap_files() {
+	for (size_t i = 0; i < files.size(); ++i) {
+		if (files[i].map) {
+			munmap(files[i].map, files[i].map_len);
+			files[i].map = 0;
+		}
+	}
+}
+
+/**
+ * @param Channel, from zero
+ * @return Pointer to the first sample of the file of the channel
+ */
+uint8_t const *WfdbRecord::get_samples(size_t const &channel) const {
+	if (channel >= signals.size()) {
+		errno = EINVAL;
+		PERROR("no such channel");
+	}
+	struct wfdb_file const &file = files[signals[channel].file];
+	return static_cast<uint8_t const *>(file.map) + file.offset;
+}
+
+/**
+ * Decode one channel of format 16 or 212 to 16 bit samples, unscaled
+ *
+ * The samples of a file of several signals are unpacked a block of frames at
+ * a time and the channel is picked from the frames.
+ *
+ * @param Pointer to output, size() samples
+ * @param Channel, from zero
+ */
+void WfdbRecord::decode(int16_t *out, size_t const &channel) const {
+	uint8_t const *p = get_samples(channel);
+	struct wfdb_file const &file = files[signals[channel].file];
+	size_t const stride = file.signals, index = signals[channel].index;
+
+	if (file.format == WFDB_FORMAT_16) {
+		p += 2 * index;
+		for (size_t i = 0; i < frames; ++i) {
+			out[i] = static_cast<int16_t>(p[2 * i * stride]
+					| p[2 * i * stride + 1] << 8);
+		}
+		return;
+	}
+	if (file.format != WFDB_FORMAT_212) {
+		errno = EINVAL;
+		PERROR("WFDB format does not fit 16 bits");
+	}
+
+	if (stride == 1) {
+		unpack212(out, p, frames);
+		return;
+	}
+	int16_t *block = static_cast<int16_t *>(mm_malloc(
+			block_frames * stride * sizeof(int16_t)));
+	for (size_t set = 0; set < frames; set += block_frames) {
+		size_t const n = frames - set < block_frames ? frames - set : block_frames;
+		unpack212(block, p + set * stride / 2 * 3, n * stride);
+		for (size_t i = 0; i < n; ++i) {
+			out[set + i] = block[i * stride + index];
+		}
+	}
+	mm_free(block);
+}
+
+/**
+ * Decode one channel to float at full scale 1.0
+ *
+ * @param Pointer to output, size() samples
+ * @param Channel, from zero
+ */
+void WfdbRecord::decode(float *out, size_t const &channel) const {
+	uint8_t const *p = get_samples(channel);
+	struct wfdb_file const &file = files[signals[channel].file];
+	size_t const stride = file.signals, index = signals[channel].index;
+
+	if (file.format == WFDB_FORMAT_24) {
+		p += 3 * index;
+		for (size_t i = 0; i < frames; ++i) {
+			uint8_t const *q = p + 3 * i * stride;
+			// sign extend from the top byte
+			int32_t const d = static_cast<int32_t>(q[0] << 8 | q[1] << 16
+					| static_cast<uint32_t>(q[2]) << 24) >> 8;
+			out[i] = d * (1.0f / 8388608);
+		}
+		return;
+	}
+
+	int16_t *pcm = static_cast<int16_t *>(mm_malloc(
+			(frames ? frames : 1) * sizeof(int16_t)));
+	try {
+		decode(pcm, channel);
+	} catch (int e) {
+		mm_free(pcm);
+		throw;
+	}
+	float const scale = file.format == WFDB_FORMAT_16 ? 1.0f / 32768 : 1.0f / 2048;
+	for (size_t i = 0; i < frames; ++i) {
+		out[i] = pcm[i] * scale;
+	}
+	mm_free(pcm);
+}
+
+/**
+ * @return Number of signals
+ */
+size_t const &WfdbRecord::get_channels() const {
+	return channels;
+}
+
+/**
+ * @return Samples per second
+ */
+size_t const &WfdbRecord::get_sample_rate() const {
+	return sample_rate;
+}
+
+/**
+ * @param Channel, from zero
+ * @return Signal format, see wfdb_format_e
+ */
+uint16_t const &WfdbRecord::get_format(size_t const &channel) const {
+	return files[signals.at(channel).file].format;
+}
+
+/**
+ * @return Number of frames, ie. samples per channel
+ */
+size_t const &WfdbRecord::size() const {
+	return frames;
+}
+
+} /* namespace Signal */
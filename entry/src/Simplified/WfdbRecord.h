@@ -0,0 +1,71 @@
+/**
+ * WfdbRecord.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef ENTRY_SRC_SIMPLIFIED_WFDBRECORD_H_
+#define ENTRY_SRC_SIMPLIFIED_WFDBRECORD_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace Signal {
+
+enum wfdb_format_e {
+	WFDB_FORMAT_16 = 16, // 16 bit two's complement, little-endian
+	WFDB_FORMAT_24 = 24, // 24 bit two's complement, little-endian
+	WFDB_FORMAT_212 = 212, // pairs of 12 bit samples packed in 3 bytes
+};
+
+struct wfdb_file {
+	std::string name;
+	uint16_t format;
+	size_t offset; // bytes before the first sample
+	size_t signals; // in a frame of the file
+	void *map;
+	size_t map_len;
+};
+
+struct wfdb_signal {
+	size_t file; // see wfdb_file
+	size_t index; // in the frame of the file
+};
+
+/*
+ * PhysioNet WFDB record, a .hea header and its signal files
+ *
+ * Single segment records of format 16, 24 and 212 with one sample per frame
+ * and no skew. The signal files are mapped; several signals may share a file.
+ */
+class WfdbRecord {
+public:
+	explicit WfdbRecord(char const *basename);
+	virtual ~WfdbRecord();
+
+	size_t const &get_channels() const;
+	size_t const &get_sample_rate() const;
+	uint16_t const &get_format(size_t const &channel) const;
+	size_t const &size() const;
+
+	void decode(int16_t *out, size_t const &channel) const;
+	void decode(float *out, size_t const &channel) const;
+private:
+	std::vector<struct wfdb_file> files;
+	std::vector<struct wfdb_signal> signals;
+	size_t channels;
+	size_t sample_rate;
+	size_t frames;
+
+	void parse(char const *header, std::string const &dir);
+	void map_files(std::string const &dir, bool const &count_frames);
+	void unmap_files();
+	uint8_t const *get_samples(size_t const &channel) const;
+};
+
+} /* namespace Signal */
+
+#endif /* ENTRY_SRC_SIMPLIFIED_WFDBRECORD_H_ */
@@ -0,0 +1,456 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ZipArchive.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "macro.h"
+#include "../utils/memory_manager.h"
+
+#include "ZipArchive.h"
+
+namespace Signal {
+
+size_t constexpr ZipArchive::npos;
+
+// inflated bytes given to a sink at a time
+#define ZIP_SINK_CHUNK (64 * 1024)
+
+// deflate expands its input at most 1032 times
+#define ZIP_DEFLATE_MAX_RATIO 1032
+
+static uint16_t le16(uint8_t const *p) {
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(uint8_t const *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+static uint64_t le64(uint8_t const *p) {
+	return le32(p) | static_cast<uint64_t>(le32(p + 4)) << 32;
+}
+
+/**
+ * Update a CRC-32 with a buffer of any length; zlib counts in uInt
+ *
+ * @param CRC so far
+ * @param Pointer to data
+ * @param Length of data in bytes
+ * @return Updated CRC
+ */
+static uLong crc32_long(uLong crc, uint8_t const *data, size_t len) {
+	uInt constexpr chunk = 1u << 30;
+	for (; len > chunk; data += chunk, len -= chunk) {
+		crc = crc32(crc, data, chunk);
+	}
+	return crc32(crc, data, len);
+}
+
+/**
+ * Map an archive and index its central directory
+ *
+ * @param Archive filename
+ */
+ZipArchive::ZipArchive(char const *filename) :
+		map(0), map_len(0) {
+	int const fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		PERROR("open");
+	}
+
+	struct stat sb;
+	if (fstat(fd, &sb)) {
+		close(fd);
+		PERROR("fstat");
+	}
+
+	map_len = sb.st_size;
+	if (map_len) {
+		map = mmap(0, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map_len == 0 || map == MAP_FAILED) {
+		map = 0;
+		if (map_len == 0) {
+			errno = EINVAL;
+		}
+		PERROR("mmap");
+	}
+
+	try {
+		parse();
+	} catch (...) {
+		munmap(map, map_len);
+		throw;
+	}
+}
+
+ZipArchive::~ZipArchive() {
+	munmap(map, map_len);
+}
+
+/**
+ * Read the central directory
+ *
+ * The end of central directory record is searched backwards over the
+ * archive comment. ZIP64 sizes and offsets are taken from the extra fields.
+ * Directories are skipped; a member is indexed by its path, by the path
+ * without the .wav suffix and by the bare record name, eg. a0001, unless
+ * another member already has that key.
+ */
+void ZipArchive::parse() {
+	uint8_t const *buf = static_cast<uint8_t const *>(map);
+
+	size_t eocd = npos;
+	if (map_len >= 22) {
+		size_t const floor = map_len - 22 > 0xffff ? map_len - 22 - 0xffff : 0;
+		for (size_t i = map_len - 22 + 1; i-- > floor;) {
+			if (le32(buf + i) == 0x06054b50) {
+				eocd = i;
+				break;
+			}
+		}
+	}
+	if (eocd == npos) {
+		errno = EINVAL;
+		PERROR("not a zip archive");
+	}
+
+	uint64_t entries = le16(buf + eocd + 10);
+	uint64_t cd_len = le32(buf + eocd + 12);
+	uint64_t cd_offset = le32(buf + eocd + 16);
+
+	// ZIP64 end of central directory, through its locator
+	if (eocd >= 20 && le32(buf + eocd - 20) == 0x07064b50) {
+		uint64_t const zip64 = le64(buf + eocd - 20 + 8);
+		if (zip64 > map_len || map_len - zip64 < 56
+				|| le32(buf + zip64) != 0x06064b50) {
+			errno = EINVAL;
+			PERROR("corrupted zip64 end of central directory");
+		}
+		entries = le64(buf + zip64 + 32);
+		cd_len = le64(buf + zip64 + 40);
+		cd_offset = le64(buf + zip64 + 48);
+	}
+	if (cd_offset > map_len || cd_len > map_len - cd_offset) {
+		errno = EINVAL;
+		PERROR("corrupted central directory");
+	}
+	if (entries > cd_len / 46) { // a record takes at least 46 bytes
+		errno = EINVAL;
+		PERROR("corrupted central directory");
+	}
+
+	members.reserve(entries);
+	uint8_t const *p = buf + cd_offset, *const end = p + cd_len;
+	for (uint64_t i = 0; i < entries; ++i) {
+		if (end - p < 46 || le32(p) != 0x02014b50) {
+			errno = EINVAL;
+			PERROR("corrupted central directory");
+		}
+		size_t const name_len = le16(p + 28);
+		size_t const extra_len = le16(p + 30);
+		size_t const comment_len = le16(p + 32);
+		if (static_cast<size_t>(end - p) < 46 + name_len + extra_len + comment_len) {
+			errno = EINVAL;
+			PERROR("corrupted central directory");
+		}
+
+		struct zip_member m;
+		m.name.assign(reinterpret_cast<char const *>(p + 46), name_len);
+		m.method = le16(p + 10);
+		m.crc = le32(p + 16);
+		m.compressed_size = le32(p + 20);
+		m.size = le32(p + 24);
+		m.offset = le32(p + 42);
+
+		// ZIP64 extended information; only the saturated fields are present
+		for (uint8_t const *e = p + 46 + name_len, *const e_end = e + extra_len;
+				e_end - e >= 4;) {
+			size_t const id = le16(e), len = le16(e + 2);
+			if (static_cast<size_t>(e_end - e - 4) < len) {
+				break;
+			}
+			if (id == 0x0001) {
+				uint8_t const *f = e + 4, *const f_end = f + len;
+				if (m.size == 0xffffffff && f_end - f >= 8) {
+					m.size = le64(f);
+					f += 8;
+				}
+				if (m.compressed_size == 0xffffffff && f_end - f >= 8) {
+					m.compressed_size = le64(f);
+					f += 8;
+				}
+				if (m.offset == 0xffffffff && f_end - f >= 8) {
+					m.offset = le64(f);
+				}
+			}
+			e += 4 + len;
+		}
+
+		uint16_t const flags = le16(p + 8);
+		p += 46 + name_len + extra_len + comment_len;
+
+		if (name_len && m.name[name_len - 1] == '/') {
+			continue;
+		}
+		if (flags & 0x0001) { // encrypted, cannot be read
+			continue;
+		}
+
+		size_t const member = members.size();
+		members.push_back(m);
+		index.emplace(m.name, member);
+
+		std::string record(m.name);
+		if (record.size() > 4
+				&& record.compare(record.size() - 4, 4, ".wav") == 0) {
+			record.erase(record.size() - 4);
+			index.emplace(record, member);
+		}
+		size_t const slash = record.rfind('/');
+		if (slash != std::string::npos) {
+			index.emplace(record.substr(slash + 1), member);
+		}
+	}
+}
+
+/**
+ * @return Members of the archive in central directory order, without directories
+ */
+std::vector<struct zip_member> const &ZipArchive::get_members() const {
+	return members;
+}
+
+/**
+ * Look up a member
+ *
+ * @param Path in the archive, the path without .wav or the record name
+ * @return Index of the member, npos if not found
+ */
+size_t ZipArchive::find(char const *name) const {
+	std::unordered_map<std::string, size_t>::const_iterator const i =
+			index.find(name);
+	return i == index.end() ? npos : i->second;
+}
+
+/**
+ * Locate the compressed data after the local header
+ *
+ * The local header has its own extra field, which need not match the one in
+ * the central directory. The sizes of the central directory are checked
+ * against the data, so a member never claims more than its data can give.
+ *
+ * @param Index of the member
+ * @return Pointer to the compressed data in the mapped archive
+ */
+uint8_t const *ZipArchive::get_compressed(size_t const &member) const {
+	if (member >= members.size()) {
+		errno = EINVAL;
+		PERROR("no such member");
+	}
+	struct zip_member const &m = members[member];
+	uint8_t const *buf = static_cast<uint8_t const *>(map);
+
+	if (m.offset > map_len || map_len - m.offset < 30
+			|| le32(buf + m.offset) != 0x04034b50) {
+		errno = EINVAL;
+		PERROR("corrupted local header");
+	}
+	size_t const data = m.offset + 30 + le16(buf + m.offset + 26)
+			+ le16(buf + m.offset + 28);
+	if (data > map_len || m.compressed_size > map_len - data) {
+		errno = EINVAL;
+		PERROR("truncated member");
+	}
+	if ((m.method == ZIP_STORED && m.size != m.compressed_size)
+			|| m.size / ZIP_DEFLATE_MAX_RATIO > m.compressed_size) {
+		errno = EINVAL;
+		PERROR("corrupted member size");
+	}
+	return buf + data;
+}
+
+/**
+ * Stored member in place
+ *
+ * The pages are read straight from the mapped archive, nothing is copied.
+ * The CRC is verified first.
+ *
+ * @param Index of the member
+ * @return Pointer to size bytes of the member, valid until the archive is destroyed
+ */
+void const *ZipArchive::get_stored(size_t const &member) const {
+	uint8_t const *data = get_compressed(member);
+	if (members[member].method != ZIP_STORED) {
+		errno = EINVAL;
+		PERROR("member is not stored");
+	}
+	if (crc32_long(crc32(0, Z_NULL, 0), data, members[member].size)
+			!= members[member].crc) {
+		errno = EINVAL;
+		PERROR("zip member CRC mismatch");
+	}
+	return data;
+}
+
+/**
+ * Inflate a deflated member, or copy a stored one
+ *
+ * @param Index of the member
+ * @param Pointer to output, size bytes
+ */
+void ZipArchive::inflate(size_t const &member, void *out) const {
+	uint8_t *o = static_cast<uint8_t *>(out);
+	inflate(member, [&o](uint8_t const *data, size_t const &len) {
+		memcpy(o, data, len);
+		o += len;
+		return true;
+	});
+}
+
+/**
+ * Inflate a deflated member, or read a stored one, a piece at a time
+ *
+ * The compressed data is read straight from the mapped archive and inflated
+ * in one pass, ZIP_SINK_CHUNK bytes at a time, so the member is never held
+ * whole. The sink never gets more than the size of the member. Once the
+ * sink has all of it, the CRC is verified, unless the sink stopped early.
+ *
+ * @param Index of the member
+ * @param Sink of the bytes, see zip_sink
+ */
+void ZipArchive::inflate(size_t const &member, zip_sink const &sink) const {
+	uint8_t const *data = get_compressed(member);
+	struct zip_member const &m = members[member];
+
+	if (m.method == ZIP_STORED) {
+		uLong crc = crc32(0, Z_NULL, 0);
+		for (size_t i = 0; i < m.size; i += ZIP_SINK_CHUNK) {
+			size_t const n =
+					m.size - i < ZIP_SINK_CHUNK ? m.size - i : ZIP_SINK_CHUNK;
+			crc = crc32(crc, data + i, n);
+			if (!sink(data + i, n)) {
+				return;
+			}
+		}
+		if (crc != m.crc) {
+			errno = EINVAL;
+			PERROR("zip member CRC mismatch");
+		}
+		return;
+	}
+	if (m.method != ZIP_DEFLATED) {
+		errno = ENOTSUP;
+		PERROR("unsupported zip compression method");
+	}
+
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, -MAX_WBITS) != Z_OK) { // raw deflate, no zlib header
+		errno = ENOMEM;
+		PERROR("inflateInit2");
+	}
+	uint8_t *buf = static_cast<uint8_t *>(mm_malloc(ZIP_SINK_CHUNK));
+
+	// zlib counts in uInt, so feed the stream in pieces of at most 1 GB
+	uInt constexpr chunk = 1u << 30;
+	size_t in_left = m.compressed_size, written = 0;
+	uLong crc = crc32(0, Z_NULL, 0);
+	z.next_in = const_cast<Bytef *>(data);
+	int status = Z_OK;
+	bool more = true;
+	try {
+		while (status == Z_OK && more) {
+			if (z.avail_in == 0) {
+				z.avail_in = in_left < chunk ? in_left : chunk;
+				in_left -= z.avail_in;
+			}
+			z.next_out = buf;
+			z.avail_out = ZIP_SINK_CHUNK;
+			status = ::inflate(&z, Z_NO_FLUSH);
+			if (status == Z_BUF_ERROR && (z.avail_in || in_left)) {
+				status = Z_OK;
+			}
+			size_t const n = ZIP_SINK_CHUNK - z.avail_out;
+			if (n > m.size - written) { // more than the central directory says
+				status = Z_DATA_ERROR;
+				break;
+			}
+			crc = crc32(crc, buf, n);
+			written += n;
+			if (n) {
+				more = sink(buf, n);
+			}
+		}
+	} catch (...) {
+		inflateEnd(&z);
+		mm_free(buf);
+		throw;
+	}
+	inflateEnd(&z);
+	mm_free(buf);
+
+	if (!more) {
+		return;
+	}
+	if (status != Z_STREAM_END || written != m.size) {
+		errno = EINVAL;
+		PERROR("corrupted deflate stream");
+	}
+	if (crc != m.crc) {
+		errno = EINVAL;
+		PERROR("zip member CRC mismatch");
+	}
+}
+
+/**
+ * Split a record path into an archive and a member, eg.
+ * training-a.zip/training-a/a0001 into training-a.zip and training-a/a0001
+ *
+ * @param Record path
+ * @param Pointer to output archive filename
+ * @param Pointer to output member name
+ * @return True if the path is inside a .zip archive
+ */
+bool ZipArchive::split(char const *path, std::string *archive,
+		std::string *member) {
+	char const *zip = strstr(path, ".zip/");
+	if (zip == 0) {
+		return false;
+	}
+	archive->assign(path, zip + 4);
+	member->assign(zip + 5);
+	return true;
+}
+
+} /* namespace Signal */
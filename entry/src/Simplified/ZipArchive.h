@@ -0,0 +1,75 @@
+/**
+ * ZipArchive.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef ENTRY_SRC_SIMPLIFIED_ZIPARCHIVE_H_
+#define ENTRY_SRC_SIMPLIFIED_ZIPARCHIVE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+namespace Signal {
+
+enum zip_method_e {
+	ZIP_STORED = 0, ZIP_DEFLATED = 8,
+};
+
+struct zip_member {
+	std::string name; // path in the archive, eg. training-a/a0001.wav
+	uint16_t method; // stored or deflated
+	uint32_t crc;
+	size_t compressed_size;
+	size_t size; // uncompressed
+	size_t offset; // of the local header
+};
+
+/*
+ * Takes the bytes of a member in order, see ZipArchive::inflate(). Returns
+ * false to stop reading.
+ */
+typedef std::function<bool(uint8_t const *data, size_t const &len)> zip_sink;
+
+/*
+ * Read only ZIP archive, eg. the PhysioNet training-?.zip bundles
+ *
+ * The archive is mapped and the central directory is indexed once; ZIP64 is
+ * supported. The object is read only after construction, so it can be shared
+ * between threads.
+ */
+class ZipArchive {
+public:
+	explicit ZipArchive(char const *filename);
+	virtual ~ZipArchive();
+
+	std::vector<struct zip_member> const &get_members() const;
+	size_t find(char const *name) const;
+
+	void const *get_stored(size_t const &member) const;
+	void inflate(size_t const &member, void *out) const;
+	void inflate(size_t const &member, zip_sink const &sink) const;
+
+	static bool split(char const *path, std::string *archive,
+			std::string *member);
+
+	static size_t constexpr npos = static_cast<size_t>(-1);
+private:
+	void *map;
+	size_t map_len;
+
+	std::vector<struct zip_member> members;
+	std::unordered_map<std::string, size_t> index;
+
+	void parse();
+	uint8_t const *get_compressed(size_t const &member) const;
+};
+
+} /* namespace Signal */
+
+#endif /* ENTRY_SRC_SIMPLIFIED_ZIPARCHIVE_H_ */
@@ -21,124 +21,62 @@
  *      Author: jtmakela
  */
 
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <libgen.h>
-#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <errno.h>
+#include <string>
+#include <vector>
+
 #include "macro.h"
 #include "types.event.h"
-#include "../utils/memory_manager.h"
+#include "../utils/AssetCache.h"
 
 #include "Csv2kernel.h"
 
 namespace Trigger {
 
+static uint32_t constexpr csv2kernel_version = 1; // of the cached kernel
+
 /**
  * Convolution kernel loader. Converts from CSV to binary format
  *
- * Caches binary format file in /tmp/
+ * The binary kernel is a cached asset keyed by the CSV contents, see
+ * Utils::get_asset(), and used in place.
  *
  * @param Kernel filename
  */
 Csv2kernel::Csv2kernel(char const *filename) :
 		kernel(0), kernel_len(0) {
-	struct stat sb;
-
-	if (stat(filename, &sb)) {
-		PERROR("stat");
-		throw errno;
-	}
-
-	char cachefilename[FILENAME_MAX];
-	sprintf(cachefilename, "/tmp/Csv2kernel.%lu.dat", sb.st_ino);
-	if (stat(cachefilename, &sb) == 0) {
-		kernel_len = sb.st_size / sizeof(cl_float);
-		kernel = static_cast<cl_float *>(mm_malloc(
-				kernel_len * sizeof(cl_float)));
-
-		FILE *f = fopen(cachefilename, "r");
-		if (f == 0) {
-			PERROR("fopen");
-			throw errno;
-		}
-
-		if (fread(kernel, sizeof(cl_float), kernel_len, f) != kernel_len) {
-			PERROR("fread");
-			throw errno;
-		}
-
-		fclose(f);
-		return;
-	}
-
-	char *c = (char *) mm_malloc(sb.st_size);
-	if (c == 0) {
-		PERROR("malloc");
-		throw errno;
-	}
-
-	FILE *f = fopen(filename, "r");
-	if (f == 0) {
-		PERROR("fopen");
-		throw errno;
-	}
-
-	try {
-		// count lines;
-		for (;; ++kernel_len) {
-			if (fgets(c, sb.st_size, f) == 0) {
-				if (feof(f)) {
-					break;
+	std::string csv;
+	Utils::read_source(filename, &csv);
+
+	struct Utils::asset const *a = Utils::get_asset("Csv2kernel",
+			csv2kernel_version, csv, [&csv](std::string *payload) {
+				// one value per line
+				std::vector<cl_float> values;
+				for (size_t i = 0; i < csv.size();) {
+					size_t end = csv.find('\n', i);
+					if (end == std::string::npos) {
+						end = csv.size();
+					}
+					values.push_back(atof(csv.substr(i, end - i).c_str()));
+					i = end + 1;
 				}
-				PERROR("fgets");
-				throw errno;
-			}
-		}
-
-		kernel = static_cast<cl_float *>(mm_calloc(kernel_len,
-				sizeof(cl_float)));
-
-		fseek(f, 0, SEEK_SET);
-
-		for (cl_float *p = kernel;; ++p) {
-			if (fgets(c, sb.st_size, f) == 0) {
-				if (feof(f)) {
-					break;
-				}
-				PERROR("fgets");
-				throw errno;
-			}
-
-			*p = atof(c);
-		}
-	} catch (int e) {
-		fclose(f);
-		mm_free(c);
-		throw e;
+				payload->assign(reinterpret_cast<char const *>(values.data()),
+						values.size() * sizeof(cl_float));
+				return 0;
+			});
+
+	if (a == 0) {
+		errno = ENOMEM;
+		PERROR("Csv2kernel");
 	}
-
-	fclose(f);
-	mm_free(c);
-
-	f = fopen(cachefilename, "w");
-	if (f == 0) {
-		PERROR("fopen");
-		throw errno;
-	}
-
-	if (fwrite(kernel, sizeof(cl_float), kernel_len, f) != kernel_len) {
-		PERROR("fwrite");
-		throw errno;
-	}
-
-	fclose(f);
+	kernel = static_cast<cl_float const *>(a->data);
+	kernel_len = a->len / sizeof(cl_float);
 }
 
 Csv2kernel::~Csv2kernel() {
-	if (kernel) {
-		mm_free(kernel);
-	}
 }
 
 /**
@@ -21,7 +21,7 @@ public:
 	size_t const &size() const;
 
 private:
-	cl_float *kernel;
+	cl_float const *kernel; // a cached asset, see Utils::get_asset()
 	size_t kernel_len;
 };
 
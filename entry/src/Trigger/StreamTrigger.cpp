@@ -0,0 +1,170 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * StreamTrigger.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <float.h>
+
+#include "macro.h"
+#include "../utils/memory_manager.h"
+#include "types.event.h"
+
+#include "StreamTrigger.h"
+
+namespace Accbpm {
+
+/**
+ * A push based version of the energy slope trigger.
+ *
+ * Takes the energy signal in chunks of any size and emits the same events as
+ * Trigger would, except that the threshold adapts: it is re-estimated from the
+ * last history 3 s segments whenever a segment completes. Testing starts once
+ * the first segment is complete. After that a sample is tested as soon as the
+ * 0.5 s tail skip of the batch trigger has passed it, so events are final when
+ * emitted and lag the energy signal by get_latency() samples.
+ *
+ * @param Sample rate in time domain (eq. samples per second)
+ * @param Number of 3 s segments the threshold is estimated from
+ */
+StreamTrigger::StreamTrigger(double const &sample_freq, size_t const &history) :
+		sample_freq(sample_freq), skip_offset(0.5 * sample_freq), base_len(
+				0.100 * sample_freq), max_rr(3.0 * sample_freq), history(
+				history < 1 ? 1 : history), origin(0), len(0), cursor(
+				skip_offset), n_segments(0), limit(0.0) {
+	state.min = FLT_MAX;
+	state.low_limit = 0.0;
+	state.k = 0;
+
+	peak.reserve(this->history);
+	base.reserve(this->history);
+	deque = static_cast<size_t *>(mm_malloc(base_len * sizeof(size_t)));
+	if (deque == 0) {
+		PERROR("malloc");
+	}
+}
+
+StreamTrigger::~StreamTrigger() {
+	mm_free(deque);
+}
+
+/**
+ * Estimate all the threshold segments completed so far and update the limit
+ */
+void StreamTrigger::estimate_segments() {
+	size_t set = skip_offset + n_segments * max_rr;
+	bool updated = false;
+
+	for (; set + max_rr + base_len <= len; set += max_rr, ++n_segments) {
+		cl_float _peak, _base;
+		Trigger::segment_estimate(&energy[set - origin], max_rr, base_len,
+				deque, &_peak, &_base);
+		if (peak.size() < history) {
+			peak.push_back(_peak);
+			base.push_back(_base);
+		} else {
+			peak[n_segments % history] = _peak;
+			base[n_segments % history] = _base;
+		}
+		updated = true;
+	}
+
+	if (updated) {
+		std::vector<cl_float> _peak(peak), _base(base);
+		limit = Trigger::threshold_estimate(&_peak[0], &_base[0],
+				_peak.size());
+	}
+}
+
+/**
+ * Drop the samples that are no longer needed by the segments nor the trigger
+ */
+void StreamTrigger::trim() {
+	size_t keep = skip_offset + n_segments * max_rr;
+	if (cursor - 1 < keep) {
+		keep = cursor - 1;
+	}
+
+	if (keep - origin > max_rr) {
+		energy.erase(energy.begin(), energy.begin() + (keep - origin));
+		origin = keep;
+	}
+}
+
+/**
+ * Push a chunk of energy signal
+ *
+ * @param Pointer to energy signal
+ * @param Length of the chunk in samples
+ * @return Number of new events, see get_events()
+ */
+size_t StreamTrigger::push(cl_float const *_energy, size_t const &_len) {
+	ev.clear();
+
+	energy.insert(energy.end(), _energy, _energy + _len);
+	len += _len;
+
+	estimate_segments();
+	if (n_segments == 0) {
+		return 0;
+	}
+
+	for (struct ref_event e; cursor + skip_offset < len; ++cursor) {
+		if (Trigger::trig_step(&energy[0], origin, cursor, len, limit,
+				sample_freq, state, &e)) {
+			ev.push_back(e);
+		}
+	}
+
+	trim();
+	return ev.size();
+}
+
+/**
+ * Getter for trigged events
+ *
+ * @return Reference to vector of the events trigged by the last push
+ */
+ref_ev const &StreamTrigger::get_events() const {
+	return ev;
+}
+
+/**
+ * Getter for the current trigger threshold
+ *
+ * @return Threshold estimated from the last segments, zero before the first
+ */
+double const &StreamTrigger::get_limit() const {
+	return limit;
+}
+
+/**
+ * Latency of the trigger decisions in steady state
+ *
+ * @return Number of samples a sample waits before it is tested
+ */
+size_t StreamTrigger::get_latency() const {
+	return skip_offset;
+}
+
+} /* namespace Accbpm */
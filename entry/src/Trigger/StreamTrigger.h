@@ -0,0 +1,55 @@
+/**
+ * StreamTrigger.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_TRIGGER_STREAMTRIGGER_H_
+#define SRC_TRIGGER_STREAMTRIGGER_H_
+
+#include <vector>
+#include "types.data.h"
+#include "types.event.h"
+#include "Trigger.h"
+
+namespace Accbpm {
+
+class StreamTrigger {
+public:
+	StreamTrigger(double const &sample_freq, size_t const &history = 10);
+	virtual ~StreamTrigger();
+
+	size_t push(cl_float const *energy, size_t const &len);
+
+	ref_ev const &get_events() const;
+	double const &get_limit() const;
+	size_t get_latency() const;
+private:
+	double const sample_freq;
+	size_t const skip_offset;
+	size_t const base_len;
+	size_t const max_rr;
+	size_t const history;
+
+	std::vector<cl_float> energy; // energy[0] is the sample at origin
+	size_t origin;
+	size_t len; // samples received
+	size_t cursor; // next sample to test
+
+	std::vector<cl_float> peak; // estimates of the last history segments
+	std::vector<cl_float> base;
+	size_t n_segments;
+	size_t *deque;
+
+	double limit;
+	struct trig_state state;
+	ref_ev ev; // of the last push
+
+	void estimate_segments();
+	void trim();
+};
+
+} /* namespace Accbpm */
+
+#endif /* SRC_TRIGGER_STREAMTRIGGER_H_ */
@@ -25,7 +25,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cmath>
 #include <float.h>
+#include <algorithm>
 
 #include "../utils/memory_manager.h"
 #include "types.event.h"
@@ -37,6 +39,9 @@ namespace Accbpm {
 /**
  * A rough energy slope trigger. Derived from the Accbpm project.
  *
+ * An energy signal shorter than min_len() has no threshold and triggers no
+ * events.
+ *
  * @param Pointer to energy signal
  * @param Length of energy signal in samples
  * @param Sample rate in time domain (eq. samples per second)
@@ -45,7 +50,9 @@ Trigger::Trigger(cl_float const *energy, size_t const &len,
 		double const &sample_freq) :
 		sample_freq(sample_freq), energy(energy), len(len) {
 	skip_offset = 0.5 * sample_freq; // There is often some noise in the beginning of the data we want to skip..
-	define_threshold_value(energy, len, skip_offset, sample_freq, &limit);
+	if (define_threshold_value(energy, len, skip_offset, sample_freq, &limit)) {
+		limit = HUGE_VAL; // too short data
+	}
 	ev.clear();
 	trig_do();
 }
@@ -54,172 +61,222 @@ Trigger::~Trigger() {
 }
 
 /**
- * Fast implementation for finding kth smallest element in array.
+ * Shortest energy signal with a trigger threshold; the skipped beginning, a
+ * base window and one 3 s segment, see define_threshold_value()
  *
- * FIXME: This could be replaced with std::nth_element
+ * @param Sample rate in time domain (eq. samples per second)
+ * @return Length in samples
+ */
+size_t Trigger::min_len(double const &sample_freq) {
+	size_t const skip_offset = 0.5 * sample_freq;
+	size_t const base_len = sample_freq * 0.100;
+	size_t const max_rr = sample_freq * 3.0;
+	return skip_offset + base_len + max_rr;
+}
+
+/**
+ * Value of the kth smallest element in array.
  *
- * @param An array of values to sort. Notice that this implementation modifies the array.
+ * @param An array of values. Notice that the elements are reordered.
  * @param Length of array
  * @param kth smallest value to extract from the array
- * @return Value fo the kth smallest item in array
+ * @return Value of the kth smallest item in array
  */
-__attribute__((deprecated)) double Trigger::kth_smallest(cl_float a[], ssize_t const n, ssize_t const k) {
-	cl_float const &x = a[k];
-	for (ssize_t l = 0, m = n - 1; l < m;) {
-		ssize_t i = l;
-		ssize_t j = m;
-		do {
-			while (a[i] < x) {
-				++i;
-			}
-			while (x < a[j]) {
-				--j;
-			}
-			if (i <= j) {
-				double tmp = a[i]; // swap
-				a[i++] = a[j];
-				a[j--] = tmp;
-			}
-		} while (i <= j);
+static cl_float nth_smallest(cl_float *a, size_t const n, size_t const k) {
+	std::nth_element(a, a + k, a + n);
+	return a[k];
+}
+
+/**
+ * Peak and base estimates of a single threshold segment
+ *
+ * The peak is the segment maximum and the base is the smallest base_len long
+ * sliding maximum starting within the segment. The sliding maximum is kept in a
+ * monotonic deque of sample indices, so the cost is linear in segment length.
+ *
+ * @param Pointer to the first sample of the segment
+ * @param Length of the segment in samples. base_len - 1 samples past the end must be readable.
+ * @param Length of the sliding maximum window in samples
+ * @param Pointer to scratch memory of base_len indices
+ * @param Pointer to peak output
+ * @param Pointer to base output
+ */
+void Trigger::segment_estimate(cl_float const *energy, size_t const len,
+		size_t const base_len, size_t *deque, cl_float *peak, cl_float *base) {
+	size_t head = 0, tail = 0, end = 0;
 
-		if (j < k) {
-			l = i;
+	// deque[head..tail) holds indices of decreasing energy within the window [i, end)
+	*peak = energy[0];
+	for (size_t i = 0; i < len; i++) {
+		if (tail > head && deque[head % base_len] < i) {
+			head++;
 		}
-		if (k < i) {
-			m = j;
+		for (; end < i + base_len; end++) {
+			while (tail > head
+					&& energy[deque[(tail - 1) % base_len]] <= energy[end]) {
+				tail--;
+			}
+			deque[tail++ % base_len] = end;
+		}
+		if (energy[i] > *peak) {
+			*peak = energy[i];
+		}
+		cl_float const &base_max = energy[deque[head % base_len]];
+		if (i == 0 || base_max < *base) {
+			*base = base_max;
 		}
 	}
-	return x;
 }
 
 /**
- * Define trigger threshold value by energy minmaxminmax..
+ * Trigger threshold from segment estimates
  *
- * A bit too complex threshold function for simple algorithm -- a copy from ECG trig algorithm
+ * @param Segment peak estimates. Notice that the elements are reordered.
+ * @param Segment base estimates. Notice that the elements are reordered.
+ * @param Number of segments
+ * @return Threshold value
+ */
+double Trigger::threshold_estimate(cl_float *peak, cl_float *base,
+		size_t const n) {
+	cl_float const peak_estimate = nth_smallest(peak, n, 0.1 * n);
+	cl_float const base_estimate = nth_smallest(base, n, 0.9 * n);
+	return base_estimate + 0.125 * (peak_estimate - base_estimate);
+}
+
+/**
+ * Define trigger threshold value by energy minmaxminmax..
  *
- * TODO more suitable
+ * The signal is split in 3 s segments, see segment_estimate().
  *
  * @param Pointer to the source signal
  * @param Lenght of source signal in samples
  * @param Number of samples to skip from the beginning of source signal
  * @param Sample rate of the source signal in time domain (eq. samples per second)
  * @param Pointer to output
- * @return Always returns zero
+ * @return Zero on success, -1 if the signal is too short
  */
-int Trigger::define_threshold_value(cl_float const *energy, int len,
-		int skip_offset, double freq, double *threshold) {
-	int base_len = freq * 0.100;
-	int max_rr = freq * 3.0;
-	int n_step = (len - skip_offset - base_len) / max_rr;
-	cl_float *max, *base, base_max;
-	ssize_t n, i, j, set;
-	cl_float peak_estimate, base_estimate;
+int Trigger::define_threshold_value(cl_float const *energy, size_t const len,
+		size_t const skip_offset, double const freq, double *threshold) {
+	size_t const base_len = freq * 0.100;
+	size_t const max_rr = freq * 3.0;
+	size_t n_step;
+	cl_float *max, *base;
+	size_t *deque;
 
+	if (base_len < 1 || max_rr < 1 || len < skip_offset + base_len) {
+		return (-1); // too short data
+	}
+	n_step = (len - skip_offset - base_len) / max_rr;
 	if (n_step < 1) {
 		return (-1); // too short data
 	}
 	max = static_cast<cl_float *>(mm_malloc(n_step * sizeof(cl_float)));
 	base = static_cast<cl_float *>(mm_malloc(n_step * sizeof(cl_float)));
+	deque = static_cast<size_t *>(mm_malloc(base_len * sizeof(size_t)));
 
-	for (n = 0; n < n_step; n++) {
-		set = skip_offset + n * max_rr;
-		max[n] = energy[set];
-		for (i = set; i < set + max_rr; i++) {
-			if (energy[i] > max[n]) {
-				max[n] = energy[i];
-			}
-			base_max = energy[i];
-			for (j = i + 1; j < i + base_len && j < len; j++) {
-				if (energy[j] > base_max) {
-					base_max = energy[j];
-				}
-			}
-			if (i == set || base_max < base[n]) {
-				base[n] = base_max;
-			}
-		}
+	for (size_t n = 0; n < n_step; n++) {
+		segment_estimate(energy + skip_offset + n * max_rr, max_rr, base_len,
+				deque, max + n, base + n);
 	}
-	peak_estimate = kth_smallest(max, n_step, 0.1 * n_step);
-	base_estimate = kth_smallest(base, n_step, 0.9 * n_step);
-	*threshold = base_estimate + 0.125 * (peak_estimate - base_estimate);
+	*threshold = threshold_estimate(max, base, n_step);
 
+	mm_free(deque);
 	mm_free(max);
 	mm_free(base);
 	return (0);
 }
 
 /**
- * The actual trigger
+ * A single step of the trigger
  *
  * Trig on energy signal above limit. Expect the signal to remain above limit for 400ms
  * tolerating 60ms continuous sinking below limit. Skips 200ms after each trig.
  *
- * @return Always returns zero
+ * Sample indices are absolute; energy[0] is the sample at origin. The samples
+ * from i - 1 to min(i + 400ms, len) must be available.
+ *
+ * @param Pointer to energy signal
+ * @param Absolute index of the first sample in energy
+ * @param Absolute index of the sample to test
+ * @param Absolute end of the energy signal in samples
+ * @param Trigger threshold
+ * @param Sample rate in time domain (eq. samples per second)
+ * @param Trigger state carried from step to step
+ * @param Pointer to output event
+ * @return True if an event was trigged
  */
-int Trigger::trig_do() {
-	int const max_tolerance = 0.060 * sample_freq, max_above_len = 0.400
+bool Trigger::trig_step(cl_float const *energy, size_t const origin,
+		size_t const i, size_t const len, double const limit,
+		double const sample_freq, struct trig_state &s, struct ref_event *e) {
+	size_t const max_tolerance = 0.060 * sample_freq, max_above_len = 0.400
 			* sample_freq;
-	int const dead_time = 0.200 * sample_freq; // 0.250
-	cl_float max;
-	size_t max_i;
-	size_t below_limit;
+	size_t const dead_time = 0.200 * sample_freq; // 0.250
+	cl_float const low_limit_factor = 0.1;
 
-	cl_float low_limit_factor = 0.1;
-	cl_float low_limit = 0.0;
+	if (energy[i - origin] < s.min) {
+		s.min = energy[i - origin];
+	}
 
-	cl_float min = FLT_MAX;
-	size_t k = 0;
+	// has energy been below the low limit
+	if (energy[i - origin] < s.low_limit) {
+		return false;
+	}
 
-	ev.reserve(512);
+	if (energy[i - origin] < energy[i - 1 - origin]) {
+		return false;
+	}
 
-	for (size_t i = skip_offset, _len = len - skip_offset; i < _len; i++) {
-		if (energy[i] < min) {
-			min = energy[i];
-		}
+	if (energy[i - origin] - s.min < 0.2 * limit) {
+		return false;
+	}
 
-		// has energy been below the low limit
-		if (energy[i] < low_limit) {
-			continue;
-		}
+	if (i < s.k) {
+		return false;
+	}
 
-		if (energy[i] < energy[i - 1]) {
-			continue;
+	if (energy[i - origin] > limit) {
+		size_t max_i = i;
+		cl_float max = energy[i - origin];
+		size_t below_limit = 0;
+		for (size_t j = i + 1; j < len && j < i + max_above_len; j++) {
+			if (energy[j - origin] < limit) {
+				below_limit++;
+				if (below_limit > max_tolerance) {
+					break;
+				}
+			} else {
+				below_limit = 0;
+				if (energy[j - origin] > max) {
+					max = energy[j - origin];
+					max_i = j;
+				}
+			}
 		}
 
-		if (energy[i] - min < 0.2 * limit) {
-			continue;
-		}
+		s.min = max;
+		s.k = max_i + dead_time;
+		s.low_limit = low_limit_factor * max;
 
-		if (i < k) {
-			continue;
-		}
+		e->offset = max_i;
+		return true;
+	}
+	return false;
+}
 
-		if (energy[i] > limit) {
-			max_i = i;
-			max = energy[i];
-			below_limit = 0;
-			for (size_t j = i + 1; j < len && j < i + max_above_len; j++) {
-				if (energy[j] < limit) {
-					below_limit++;
-					if (below_limit > max_tolerance) {
-						break;
-					}
-				} else {
-					below_limit = 0;
-					if (energy[j] > max) {
-						max = energy[j];
-						max_i = j;
-					}
-				}
-			}
+/**
+ * The actual trigger
+ *
+ * @return Always returns zero
+ */
+int Trigger::trig_do() {
+	struct trig_state s = { FLT_MAX, 0.0, 0 };
+	struct ref_event e;
 
-			min = max;
+	ev.reserve(512);
 
-			struct ref_event e = { max_i };
+	for (size_t i = skip_offset; i + skip_offset < len; i++) {
+		if (trig_step(energy, 0, i, len, limit, sample_freq, s, &e)) {
 			ev.push_back(e);
-
-			k = max_i + dead_time;
-			low_limit = low_limit_factor * max;
 		}
 	}
 	return (0);
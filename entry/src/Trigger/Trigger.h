@@ -13,12 +13,30 @@
 
 namespace Accbpm {
 
+struct trig_state {
+	cl_float min;
+	cl_float low_limit;
+	size_t k; // dead time end
+};
+
 class Trigger {
 public:
 	Trigger(cl_float const *energy, size_t const &len, double const &sample_freq);
 	virtual ~Trigger();
 
 	ref_ev const &get_events() const;
+
+	static size_t min_len(double const &sample_freq);
+
+	static void segment_estimate(cl_float const *energy, size_t const len,
+			size_t const base_len, size_t *deque, cl_float *peak,
+			cl_float *base);
+	static double threshold_estimate(cl_float *peak, cl_float *base,
+			size_t const n);
+	static bool trig_step(cl_float const *energy, size_t const origin,
+			size_t const i, size_t const len, double const limit,
+			double const sample_freq, struct trig_state &s,
+			struct ref_event *e);
 private:
 	size_t skip_offset;
 	double limit;
@@ -30,9 +48,8 @@ private:
 
 	int trig_do();
 
-	double kth_smallest(cl_float a[], ssize_t const n, ssize_t const k);
-	int define_threshold_value(cl_float const *energy, int len, int skip_offset,
-			double freq, double *threshold);
+	int define_threshold_value(cl_float const *energy, size_t const len,
+			size_t const skip_offset, double const freq, double *threshold);
 };
 
 } /* namespace Accbpm */
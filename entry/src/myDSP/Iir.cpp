@@ -25,8 +25,14 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <math.h>
+#include <cstring>
+#include <pthread.h>
+#include <string>
+#include <vector>
 #include "macro.h"
 #include "../utils/memory_manager.h"
+#include "../utils/AssetCache.h"
+#include "../utils/log.h"
 
 #include "Iir.h"
 
@@ -36,6 +42,8 @@
 
 namespace DSP {
 
+static uint32_t constexpr chebyshev_version = 1; // of the cached coefficients
+
 Iir::Iir() {
 }
 
@@ -145,7 +153,7 @@ void Iir::init_coefficients(enum iir_mode_e const mode) {
 
 	case LOW_PASS_4_POLE_0_01F:
 #ifdef VERBOSE
-		fprintf(stdout, "*** unstable filter ***\n");
+		Utils::log_printf("*** unstable filter ***\n");
 #endif
 		coeff.a[0] = 4.149425E-07;
 		coeff.a[1] = 1.659770E-06;
@@ -366,7 +374,7 @@ void Iir::init_coefficients(enum iir_mode_e const mode) {
 
 	case HIGH_PASS_4_POLE_0_01F:
 #ifdef VERBOSE
-		fprintf(stdout, "*** unstable filter ***\n");
+		Utils::log_printf("*** unstable filter ***\n");
 #endif
 		coeff.a[0] = 9.121579E-01;
 		coeff.a[1] = -3.648632E+00;
@@ -503,26 +511,18 @@ void Iir::init_coefficients(enum iir_mode_e const mode) {
 }
 
 /**
- * The actual IIR calculator
+ * Forward and backward pass of a filter on caller memory
  *
- * @param Pointer to pointer to output memory. The memory is allocated internally. Preallocated memory is freed.
+ * @param Coefficients
+ * @param Pointer to output, may be the input
  * @param Pointer to input data
  * @param length of input in samples
- * @return libc errno
+ * @param Pointer to a temporary of len samples
  */
-int Iir::calc(float **out, float const *in, size_t const &len) {
+static void iir_pass(struct coefficients const &coeff, float *d2,
+		float const *in, size_t const &len, float *d1) {
 	off_t const padding = coeff.a.size();
 
-	float *d1 = static_cast<float *>(mm_malloc(len * sizeof(float)));
-	if (d1 == NULL) {
-		PERROR("malloc");
-		return errno;
-	}
-
-#ifdef VERBOSE
-	fprintf(stdout, "  Calculating frequency response..\n");
-#endif
-
 	// first pass
 	for (off_t i = 0; i < padding; ++i) {
 		register float _d = coeff.a[0] * in[i];
@@ -547,13 +547,7 @@ int Iir::calc(float **out, float const *in, size_t const &len) {
 		d1[i] = _d;
 	}
 
-	// second pass
-	float *d2 = static_cast<float *>(mm_malloc(len * sizeof(float)));
-	if (d2 == NULL) {
-		PERROR("malloc");
-		return errno;
-	}
-
+	// second pass, the input is no longer read
 	for (off_t i = len - 1; i >= len - 1 - padding; --i) {
 		register float _d = coeff.a[0] * d1[i];
 		for (off_t j = 1, ___len = coeff.a.size(); j < ___len; ++j) {
@@ -576,6 +570,145 @@ int Iir::calc(float **out, float const *in, size_t const &len) {
 		}
 		d2[i] = _d;
 	}
+}
+
+/**
+ * The actual IIR calculator
+ *
+ * @param Pointer to pointer to output memory. The memory is allocated internally. Preallocated memory is freed.
+ * @param Pointer to input data
+ * @param length of input in samples
+ * @return libc errno
+ */
+int Iir::calc(float **out, float const *in, size_t const &len) {
+#ifdef VERBOSE
+	Utils::log_printf("  Calculating frequency response..\n");
+#endif
+
+	float *d1 = static_cast<float *>(mm_malloc(len * sizeof(float)));
+	if (d1 == NULL) {
+		PERROR("malloc");
+		return errno;
+	}
+	float *d2 = static_cast<float *>(mm_malloc(len * sizeof(float)));
+	if (d2 == NULL) {
+		PERROR("malloc");
+		return errno;
+	}
+
+	iir_pass(coeff, d2, in, len, d1);
+	mm_free(d1);
+
+	if (*out) {
+		mm_free(*out);
+	}
+
+	*out = d2;
+
+	return 0;
+}
+
+/**
+ * The IIR calculator for channel interleaved data
+ *
+ * Same recursion as the single channel calc(), with the channels in the
+ * innermost loop so that they are filtered side by side in the vector lanes.
+ * Each channel sees the same operations in the same order as when filtered
+ * alone, so the output is bit identical.
+ *
+ * @param Pointer to pointer to output memory. The memory is allocated internally. Preallocated memory is freed.
+ * @param Pointer to channel interleaved input data
+ * @param length of input in samples per channel
+ * @param Number of channels
+ * @return libc errno
+ */
+int Iir::calc(float **out, float const *in, size_t const &len,
+		size_t const &channels) {
+	off_t const padding = coeff.a.size();
+	off_t const samples = len;
+	size_t const n = channels;
+
+	float *d1 = static_cast<float *>(mm_malloc(len * n * sizeof(float)));
+	if (d1 == NULL) {
+		PERROR("malloc");
+		return errno;
+	}
+
+	// first pass
+	for (off_t i = 0; i < padding; ++i) {
+		float *_d = d1 + i * n;
+		for (size_t c = 0; c < n; ++c) {
+			_d[c] = coeff.a[0] * in[i * n + c];
+		}
+		for (off_t j = 1, ___len = coeff.a.size(); j < ___len; ++j) {
+			if (i < j) {
+				for (size_t c = 0; c < n; ++c) {
+					_d[c] += coeff.a[j] * in[c];
+				}
+			} else {
+				for (size_t c = 0; c < n; ++c) {
+					_d[c] += coeff.a[j] * in[(i - j) * n + c];
+					_d[c] += coeff.b[j] * d1[(i - j) * n + c];
+				}
+			}
+		}
+	}
+
+	for (off_t i = padding; i < samples; ++i) {
+		float *__restrict__ _d = d1 + i * n;
+		for (size_t c = 0; c < n; ++c) {
+			_d[c] = coeff.a[0] * in[i * n + c];
+		}
+		for (off_t j = 1, ___len = coeff.a.size(); j < ___len; ++j) {
+			float const a = coeff.a[j], b = coeff.b[j];
+			float const *x = in + (i - j) * n, *y = d1 + (i - j) * n;
+			for (size_t c = 0; c < n; ++c) {
+				_d[c] += a * x[c];
+				_d[c] += b * y[c];
+			}
+		}
+	}
+
+	// second pass
+	float *d2 = static_cast<float *>(mm_malloc(len * n * sizeof(float)));
+	if (d2 == NULL) {
+		PERROR("malloc");
+		return errno;
+	}
+
+	for (off_t i = samples - 1; i >= samples - 1 - padding; --i) {
+		float *_d = d2 + i * n;
+		for (size_t c = 0; c < n; ++c) {
+			_d[c] = coeff.a[0] * d1[i * n + c];
+		}
+		for (off_t j = 1, ___len = coeff.a.size(); j < ___len; ++j) {
+			if (i + j >= samples) {
+				for (size_t c = 0; c < n; ++c) {
+					_d[c] += coeff.a[j] * d1[(len - 1) * n + c];
+				}
+			} else {
+				for (size_t c = 0; c < n; ++c) {
+					_d[c] += coeff.a[j] * d1[(i + j) * n + c];
+					_d[c] += coeff.b[j] * d2[(i + j) * n + c];
+				}
+			}
+		}
+	}
+
+	for (off_t i = samples - 1 - padding; i >= 0; --i) {
+		float *__restrict__ _d = d2 + i * n;
+		for (size_t c = 0; c < n; ++c) {
+			_d[c] = coeff.a[0] * d1[i * n + c];
+		}
+		for (off_t j = 1, ___len = coeff.a.size(); j < ___len; ++j) {
+			float const a = coeff.a[j], b = coeff.b[j];
+			float const *x = d1 + (i + j) * n, *y = d2 + (i + j) * n;
+			for (size_t c = 0; c < n; ++c) {
+				_d[c] += a * x[c];
+				_d[c] += b * y[c];
+			}
+		}
+	}
 	mm_free(d1);
 
 	if (*out) {
@@ -599,7 +732,7 @@ int Iir::calc(float **out, float const *in, size_t const &len) {
 int Iir::filter(float **out, float const *in, size_t const &len,
 		enum iir_mode_e const &mode) {
 #ifdef VERBOSE
-	fprintf(stdout, "  Initializing coefficients..\n");
+	Utils::log_printf("  Initializing coefficients..\n");
 #endif
 	init_coefficients(mode);
 	return calc(out, in, len);
@@ -820,6 +953,48 @@ int Iir::bandpass(float **out, const float *in, const size_t len,
 	return 0;
 }
 
+/**
+ * Nth order Chebyshev bandpass filter for channel interleaved data
+ *
+ * @param Pointer to pointer to output memory. The memory is allocated internally. Preallocated memory is freed.
+ * @param Pointer to channel interleaved input data
+ * @param length of input in samples per channel
+ * @param Number of channels
+ * @param Cutoff low frequency
+ * @param Cutoff high frequency
+ * @param Allowed ripple percentage
+ * @parma Number of poles
+ * @param Sample frequency
+ * @return libc errno
+ */
+int Iir::bandpass(float **out, float const *in, size_t const &len,
+		size_t const &channels, float const low_freq, float const high_freq,
+		float const ripple_percent, size_t const number_of_poles,
+		float const sample_freq) {
+	if (low_freq == 0) {
+		calc_chebyshev_coefficients(high_freq, false, ripple_percent,
+				number_of_poles, sample_freq);
+		return calc(out, in, len, channels);
+	}
+
+	if (high_freq > 0.5 * sample_freq) {
+		calc_chebyshev_coefficients(low_freq, true, ripple_percent,
+				number_of_poles, sample_freq);
+		return calc(out, in, len, channels);
+	}
+
+	float *d = 0;
+	calc_chebyshev_coefficients(high_freq, false, ripple_percent,
+			number_of_poles, sample_freq);
+	calc(&d, in, len, channels);
+	calc_chebyshev_coefficients(low_freq, true, ripple_percent,
+			number_of_poles, sample_freq);
+	calc(out, d, len, channels);
+	mm_free(d);
+
+	return 0;
+}
+
 /**
  * Nth order Chebyshev bandpass filter
  *
@@ -862,6 +1037,308 @@ int Iir::bandpass(double **out, const double *in, const size_t len,
 	return 0;
 }
 
+/**
+ * Nth order Chebyshev bandpass filter in fixed point
+ *
+ * A cascade of Q2.29 second order sections run forward and backward like the
+ * floating point version. The signal is carried in int32 with 8 extra fraction
+ * bits between the sections, products are accumulated in int64. Output is
+ * rounded and saturated back to int16.
+ *
+ * @param Pointer to pointer to output memory. The memory is allocated internally. Preallocated memory is freed.
+ * @param Pointer to input data
+ * @param length of input in samples
+ * @param Cutoff low frequency
+ * @param Cutoff high frequency
+ * @param Allowed ripple percentage
+ * @parma Number of poles
+ * @param Sample frequency
+ * @return libc errno
+ */
+int Iir::bandpass(int16_t **out, const int16_t *in, const size_t len,
+		const float low_freq, const float high_freq, float const ripple_percent,
+		const size_t number_of_poles, const float sample_freq) {
+	sections.clear();
+
+	if (low_freq == 0) {
+		calc_chebyshev_sections(high_freq, false, ripple_percent,
+				number_of_poles, sample_freq);
+	} else if (high_freq > 0.5 * sample_freq) {
+		calc_chebyshev_sections(low_freq, true, ripple_percent,
+				number_of_poles, sample_freq);
+	} else {
+		calc_chebyshev_sections(high_freq, false, ripple_percent,
+				number_of_poles, sample_freq);
+		calc_chebyshev_sections(low_freq, true, ripple_percent,
+				number_of_poles, sample_freq);
+	}
+
+	return calc_q(out, in, len);
+}
+
+#define BIQUAD_Q_FRAC 29
+#define SIGNAL_Q_FRAC 8
+
+/**
+ * Run one fixed point second order section in place
+ *
+ * History is initialized as in Iir::calc; input history to the first sample, output history to zero.
+ *
+ * @param Pointer to data
+ * @param length of data in samples
+ * @param Second order section
+ * @param Run backwards
+ */
+static void biquad_q_pass(int32_t *d, size_t const &len,
+		struct biquad_q const &s, bool const reverse) {
+	ssize_t const step = reverse ? -1 : 1;
+	int32_t *p = reverse ? d + len - 1 : d;
+
+	int32_t x1 = *p, x2 = *p, y1 = 0, y2 = 0;
+	for (size_t i = 0; i < len; ++i, p += step) {
+		int32_t const x0 = *p;
+		int64_t acc = static_cast<int64_t>(s.a[0]) * x0
+				+ static_cast<int64_t>(s.a[1]) * x1
+				+ static_cast<int64_t>(s.a[2]) * x2
+				+ static_cast<int64_t>(s.b[1]) * y1
+				+ static_cast<int64_t>(s.b[2]) * y2;
+		int32_t const y0 = (acc + (1LL << (BIQUAD_Q_FRAC - 1))) >> BIQUAD_Q_FRAC;
+
+		x2 = x1, x1 = x0;
+		y2 = y1, y1 = y0;
+		*p = y0;
+	}
+}
+
+/**
+ * Fixed point forward and backward passes on caller memory
+ *
+ * @param Second order sections
+ * @param Pointer to output, may be the input
+ * @param Pointer to input data
+ * @param length of input in samples
+ * @param Pointer to a temporary of len samples
+ */
+static void iir_pass_q(std::vector<struct biquad_q> const &sections,
+		int16_t *o, int16_t const *in, size_t const &len, int32_t *d) {
+	for (size_t i = 0; i < len; ++i) {
+		d[i] = static_cast<int32_t>(in[i]) * (1 << SIGNAL_Q_FRAC);
+	}
+
+	// first pass
+	for (std::vector<struct biquad_q>::const_iterator it = sections.begin();
+			it != sections.end(); ++it) {
+		biquad_q_pass(d, len, *it, false);
+	}
+
+	// second pass
+	for (std::vector<struct biquad_q>::const_iterator it = sections.begin();
+			it != sections.end(); ++it) {
+		biquad_q_pass(d, len, *it, true);
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		int32_t const v = (d[i] + (1 << (SIGNAL_Q_FRAC - 1))) >> SIGNAL_Q_FRAC;
+		o[i] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+	}
+}
+
+/**
+ * The actual fixed point IIR calculator
+ *
+ * @param Pointer to pointer to output memory. The memory is allocated internally. Preallocated memory is freed.
+ * @param Pointer to input data
+ * @param length of input in samples
+ * @return libc errno
+ */
+int Iir::calc_q(int16_t **out, int16_t const *in, size_t const &len) {
+	int32_t *d = static_cast<int32_t *>(mm_malloc(len * sizeof(int32_t)));
+	if (d == NULL) {
+		PERROR("malloc");
+		return errno;
+	}
+	int16_t *o = static_cast<int16_t *>(mm_malloc(len * sizeof(int16_t)));
+	if (o == NULL) {
+		PERROR("malloc");
+		return errno;
+	}
+
+	iir_pass_q(sections, o, in, len, d);
+	mm_free(d);
+
+	if (*out) {
+		mm_free(*out);
+	}
+
+	*out = o;
+
+	return 0;
+}
+
+/**
+ * Design a Chebyshev bandpass filter once, to be run on caller memory
+ *
+ * Takes the same stages as bandpass(): a low-pass only if the low cut-off
+ * is zero, a high-pass only if the high cut-off is above the Nyquist
+ * frequency, and both otherwise. Both the floating point coefficients and
+ * the fixed point sections are designed.
+ *
+ * @param Pointer to output design
+ * @param Cutoff low frequency
+ * @param Cutoff high frequency
+ * @param Allowed ripple percentage
+ * @parma Number of poles
+ * @param Sample frequency
+ */
+void Iir::design_bandpass(struct bandpass_design *design,
+		float const low_freq, float const high_freq,
+		float const ripple_percent, size_t const number_of_poles,
+		float const sample_freq) {
+	design->low_pass.a.clear();
+	design->low_pass.b.clear();
+	design->high_pass.a.clear();
+	design->high_pass.b.clear();
+	sections.clear();
+
+	if (low_freq == 0 || high_freq <= 0.5 * sample_freq) {
+		calc_chebyshev_coefficients(high_freq, false, ripple_percent,
+				number_of_poles, sample_freq);
+		design->low_pass = coeff;
+		calc_chebyshev_sections(high_freq, false, ripple_percent,
+				number_of_poles, sample_freq);
+	}
+	if (low_freq != 0) {
+		calc_chebyshev_coefficients(low_freq, true, ripple_percent,
+				number_of_poles, sample_freq);
+		design->high_pass = coeff;
+		calc_chebyshev_sections(low_freq, true, ripple_percent,
+				number_of_poles, sample_freq);
+	}
+	design->sections = sections;
+}
+
+/**
+ * Size of the temporary memory of the bandpass() on a design
+ *
+ * @param length of input in samples
+ * @return Bytes
+ */
+size_t Iir::bandpass_scratch(size_t const &len) {
+	return 2 * len * sizeof(float);
+}
+
+/**
+ * Samples for the response of a design to decay below a tolerance
+ *
+ * Taken from the slowest pole of the sections. A stretch of a signal filtered
+ * with this many extra samples on both sides matches the same stretch of the
+ * whole filtered signal to about the tolerance, relative to the signal peak,
+ * as the filter runs both forward and backward.
+ *
+ * @param Filter, see design_bandpass()
+ * @param Tolerance, eg. 1e-7
+ * @return Samples
+ */
+size_t Iir::settling_len(struct bandpass_design const &design,
+		double const &tolerance) {
+	double r = 0.0;
+	for (std::vector<struct biquad_q>::const_iterator it =
+			design.sections.begin(); it != design.sections.end(); ++it) {
+		// poles of z^2 - b1 z - b2
+		double const b1 = it->b[1] / static_cast<double>(1 << BIQUAD_Q_FRAC);
+		double const b2 = it->b[2] / static_cast<double>(1 << BIQUAD_Q_FRAC);
+		double const disc = b1 * b1 + 4.0 * b2;
+		double const pole =
+				disc < 0.0 ?
+						sqrt(-b2) : (fabs(b1) + sqrt(disc)) / 2.0;
+		if (r < pole) {
+			r = pole;
+		}
+	}
+	if (r <= 0.0) {
+		return (0);
+	}
+	if (r >= 1.0) { // not stable, never settles
+		return (SIZE_MAX);
+	}
+	return (ceil(log(tolerance) / log(r)));
+}
+
+/**
+ * Nth order Chebyshev bandpass filter without allocations
+ *
+ * @param Pointer to output, may be the input
+ * @param Pointer to input data
+ * @param length of input in samples
+ * @param Filter, see design_bandpass()
+ * @param Pointer to temporary memory, see bandpass_scratch()
+ */
+void Iir::bandpass(float *out, float const *in, size_t const &len,
+		struct bandpass_design const &design, void *scratch) {
+	float *tmp = static_cast<float *>(scratch);
+	if (design.low_pass.a.size()) {
+		iir_pass(design.low_pass, out, in, len, tmp);
+		in = out;
+	}
+	if (design.high_pass.a.size()) {
+		iir_pass(design.high_pass, out, in, len, tmp);
+	}
+}
+
+void Iir::bandpass(double *out, double const *in, size_t const &len,
+		struct bandpass_design const &design, void *scratch) {
+	// single precision like the allocating version
+	float *x = static_cast<float *>(scratch);
+	for (size_t i = 0; i < len; ++i) {
+		x[i] = in[i];
+	}
+	bandpass(x, x, len, design, x + len);
+	for (size_t i = 0; i < len; ++i) {
+		out[i] = x[i];
+	}
+}
+
+void Iir::bandpass(int16_t *out, int16_t const *in, size_t const &len,
+		struct bandpass_design const &design, void *scratch) {
+	iir_pass_q(design.sections, out, in, len, static_cast<int32_t *>(scratch));
+}
+
+/**
+ * Chebyshev second order section calculator for the fixed point filters
+ *
+ * Appends number_of_poles / 2 sections, each normalized to unity gain in the pass band.
+ *
+ * @param Cut-off frequency. Must be in range 0 to 0.5 times the sampling frequency.
+ * @param Are the desired coefficients for high-pass (or low pass) filter
+ * @param Desired ripple percentage in range 0 to 29
+ * @param Number of poles, an event integer in berween 2 and 20
+ * @oaram Desired sampling frequency domain
+ */
+void Iir::calc_chebyshev_sections(float const cutoff_freq,
+		bool const is_high_pass, float const ripple_percent,
+		const int number_of_poles, const float sample_freq) {
+	for (int i = 0, _len = number_of_poles / 2; i < _len; ++i) {
+		struct coefficients tmp;
+		chebyshev_coefficient_iterator(cutoff_freq / sample_freq, is_high_pass,
+				ripple_percent, number_of_poles, i, tmp);
+
+		// normalize gain
+		double const sign = is_high_pass ? -1.0 : 1.0;
+		double const gain = (tmp.a[0] + sign * tmp.a[1] + tmp.a[2])
+				/ (1.0 - sign * tmp.b[1] - tmp.b[2]);
+
+		struct biquad_q q;
+		for (int j = 0; j < 3; ++j) {
+			q.a[j] = lrint(tmp.a[j] / gain * (1 << BIQUAD_Q_FRAC));
+		}
+		q.b[0] = 0;
+		q.b[1] = lrint(tmp.b[1] * (1 << BIQUAD_Q_FRAC));
+		q.b[2] = lrint(tmp.b[2] * (1 << BIQUAD_Q_FRAC));
+
+		sections.push_back(q);
+	}
+}
+
 /**
  * Narrow-pass coefficient calculator
  *
@@ -871,7 +1348,7 @@ int Iir::bandpass(double **out, const double *in, const size_t len,
 void Iir::calc_narrow_pass_coefficients(const float bandwidth,
 		const float center_freq) {
 #ifdef VERBOSE
-	fprintf(stdout, "  Calculating coefficients..\n");
+	Utils::log_printf("  Calculating coefficients..\n");
 #endif
 
 	float cosw = cos(2 * M_PI * center_freq);
@@ -916,6 +1393,10 @@ void Iir::calc_simple_coefficients(float const cutoff_freq,
 }
 
 /**
+ * Chebyshev coefficient calculator
+ *
+ * The coefficients are a cached asset keyed by the parameters, see
+ * Utils::get_asset().
  *
  * @param Cut-off frequency. Must be in range 0 to 0.5 times the sampling frequency.
  * @param Are the desired coefficients for high-pass (or low pass) filter
@@ -928,146 +1409,103 @@ void Iir::calc_chebyshev_coefficients(float const cutoff_freq,
 		const int number_of_poles, const float sample_freq) {
 	float const _cutoff_freq = cutoff_freq / sample_freq;
 
-	char cachefilename[FILENAME_MAX];
-	sprintf(cachefilename, "/tmp/Iir.chebyshev_coefficients.%f_%u_%f_%i.dat",
-			_cutoff_freq, is_high_pass, ripple_percent, number_of_poles);
-	{
-		struct stat sb;
-		if (stat(cachefilename, &sb) == 0) {
-			FILE *f = fopen(cachefilename, "r");
-			if (f == 0) {
-				PERROR("fopen");
-				throw errno;
-			}
+	// a cached asset keyed by the parameters, shared by all the filters
+	struct {
+		float cutoff_freq;
+		int is_high_pass;
+		float ripple_percent;
+		int number_of_poles;
+	} const key = { _cutoff_freq, is_high_pass, ripple_percent, number_of_poles };
+	struct Utils::asset const *a = Utils::get_asset("Iir.chebyshev",
+			chebyshev_version,
+			std::string(reinterpret_cast<char const *>(&key), sizeof(key)),
+			[&](std::string *payload) {
+				int n = 1 + number_of_poles + 2;
+
+				coeff.a.clear();
+				coeff.b.clear();
+
+				coeff.a.resize(n);
+				coeff.b.resize(n);
+
+				coeff.a[2] = 1, coeff.b[2] = 1;
+
+				{
+					struct coefficients tmp;
+					tmp.a.resize(n);
+					tmp.b.resize(n);
+
+					for (size_t i = 0, _len = number_of_poles / 2; i < _len; ++i) {
+						struct coefficients tmp2;
+						tmp2.a.clear();
+						tmp2.b.clear();
+
+						chebyshev_coefficient_iterator(_cutoff_freq, is_high_pass,
+								ripple_percent, number_of_poles, i, tmp2);
+
+						for (int i = 0; i < n; ++i) {
+							tmp.a[i] = coeff.a[i], tmp.b[i] = coeff.b[i];
+						}
+
+						for (int i = 2; i < n; ++i) {
+							coeff.a[i] = tmp2.a[0] * tmp.a[i] + tmp2.a[1] * tmp.a[i - 1]
+									+ tmp2.a[2] * tmp.a[i - 2];
+							coeff.b[i] = tmp.b[i] - tmp2.b[1] * tmp.b[i - 1]
+									- tmp2.b[2] * tmp.b[i - 2];
+						}
+					}
+				}
 
-			int n = 0;
-			if (fread(&n, sizeof(int), 1, f) != 1) {
-				PERROR("fread");
-				throw errno;
-			}
+				coeff.b[2] = 0;
 
-			coeff.a.resize(n);
-			coeff.b.resize(n);
+				n = 1 + number_of_poles;
 
-			for (std::vector<float>::iterator it = coeff.a.begin();
-					it != coeff.a.end(); ++it) {
-				if (fread(&(*it), sizeof(float), 1, f) != 1) {
-					PERROR("fread");
-					throw errno;
+				for (int i = 0; i < n; ++i) {
+					coeff.a[i] = coeff.a[i + 2];
+					coeff.b[i] = -coeff.b[i + 2];
 				}
-			}
 
-			for (std::vector<float>::iterator it = coeff.b.begin();
-					it != coeff.b.end(); ++it) {
-				if (fread(&(*it), sizeof(float), 1, f) != 1) {
-					PERROR("fread");
-					throw errno;
+				// normalize gain
+				float sa = 0, sb = 0;
+				if (is_high_pass) {
+					for (int i = 0; i < n; ++i) {
+						sa += coeff.a[i] * pow(-1, i);
+						sb += coeff.b[i] * pow(-1, i);
+					}
+				} else {
+					for (int i = 0; i < n; ++i) {
+						sa += coeff.a[i];
+						sb += coeff.b[i];
+					}
 				}
-			}
 
-			fclose(f);
-
-			return;
-		}
-	}
-
-	int n = 1 + number_of_poles + 2;
-
-	coeff.a.clear();
-	coeff.b.clear();
-
-	coeff.a.resize(n);
-	coeff.b.resize(n);
-
-	coeff.a[2] = 1, coeff.b[2] = 1;
-
-	{
-		struct coefficients tmp;
-		tmp.a.resize(n);
-		tmp.b.resize(n);
-
-		for (size_t i = 0, _len = number_of_poles / 2; i < _len; ++i) {
-			struct coefficients tmp2;
-			tmp2.a.clear();
-			tmp2.b.clear();
-
-			chebyshev_coefficient_iterator(_cutoff_freq, is_high_pass,
-					ripple_percent, number_of_poles, i, tmp2);
-
-			for (int i = 0; i < n; ++i) {
-				tmp.a[i] = coeff.a[i], tmp.b[i] = coeff.b[i];
-			}
-
-			for (int i = 2; i < n; ++i) {
-				coeff.a[i] = tmp2.a[0] * tmp.a[i] + tmp2.a[1] * tmp.a[i - 1]
-						+ tmp2.a[2] * tmp.a[i - 2];
-				coeff.b[i] = tmp.b[i] - tmp2.b[1] * tmp.b[i - 1]
-						- tmp2.b[2] * tmp.b[i - 2];
-			}
-		}
-	}
-
-	coeff.b[2] = 0;
-
-	n = 1 + number_of_poles;
-
-	for (int i = 0; i < n; ++i) {
-		coeff.a[i] = coeff.a[i + 2];
-		coeff.b[i] = -coeff.b[i + 2];
-	}
-
-	// normalize gain
-	float sa = 0, sb = 0;
-	if (is_high_pass) {
-		for (int i = 0; i < n; ++i) {
-			sa += coeff.a[i] * pow(-1, i);
-			sb += coeff.b[i] * pow(-1, i);
-		}
-	} else {
-		for (int i = 0; i < n; ++i) {
-			sa += coeff.a[i];
-			sb += coeff.b[i];
-		}
-	}
-
-	float gain = sa / (1 - sb);
-	for (int i = 0; i < n; ++i) {
-		coeff.a[i] /= gain;
-	}
-
-	coeff.a.resize(n);
-	coeff.b.resize(n);
-
-	FILE *f = fopen(cachefilename, "w");
-	if (f == 0) {
-		PERROR("fopen");
-		throw errno;
-	}
-
-	if (fwrite(&n, sizeof(int), 1, f) != 1) {
-		PERROR("fwrite");
-		throw errno;
-	}
-
-	for (std::vector<float>::const_iterator it = coeff.a.begin();
-			it != coeff.a.end(); ++it) {
-		if (fwrite(&(*it), sizeof(float), 1, f) != 1) {
-			PERROR("fwrite");
-			throw errno;
-		}
-	}
+				float gain = sa / (1 - sb);
+				for (int i = 0; i < n; ++i) {
+					coeff.a[i] /= gain;
+				}
 
-	for (std::vector<float>::const_iterator it = coeff.b.begin();
-			it != coeff.b.end(); ++it) {
-		if (fwrite(&(*it), sizeof(float), 1, f) != 1) {
-			PERROR("fwrite");
-			throw errno;
-		}
+				coeff.a.resize(n);
+				coeff.b.resize(n);
+
+				// n, then the a and the b coefficients
+				payload->assign(reinterpret_cast<char const *>(&n), sizeof(n));
+				payload->append(reinterpret_cast<char const *>(coeff.a.data()),
+						n * sizeof(float));
+				payload->append(reinterpret_cast<char const *>(coeff.b.data()),
+						n * sizeof(float));
+				return 0;
+			});
+	if (a == 0) {
+		errno = ENOMEM;
+		PERROR("Iir");
 	}
 
-	fclose(f);
-
-	return;
+	int n;
+	memcpy(&n, a->data, sizeof(n));
+	float const *c = reinterpret_cast<float const *>(
+			static_cast<char const *>(a->data) + sizeof(n));
+	coeff.a.assign(c, c + n);
+	coeff.b.assign(c + n, c + 2 * n);
 }
 
 /**
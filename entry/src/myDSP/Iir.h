@@ -9,6 +9,7 @@
 #define SRC_MYDSP_IIR_H_
 
 #include <vector>
+#include <stdint.h>
 
 namespace DSP {
 
@@ -71,6 +72,24 @@ struct coefficients {
 	std::vector<float> b;
 };
 
+/*
+ * Fixed point second order section. Coefficients in Q2.29, b[0] unused.
+ */
+struct biquad_q {
+	int32_t a[3];
+	int32_t b[3];
+};
+
+/*
+ * Chebyshev bandpass filter designed once and run without allocations, see
+ * Iir::design_bandpass()
+ */
+struct bandpass_design {
+	struct coefficients low_pass; // empty if the stage is not used
+	struct coefficients high_pass;
+	std::vector<struct biquad_q> sections; // fixed point, both stages
+};
+
 class Iir {
 public:
 	Iir();
@@ -78,6 +97,8 @@ public:
 
 	void init_coefficients(enum iir_mode_e const mode);
 	int calc(float **out, float const *in, size_t const &len);
+	int calc(float **out, float const *in, size_t const &len,
+			size_t const &channels);
 
 	int filter(float **out, float const *in, size_t const &len,
 			enum iir_mode_e const &mode);
@@ -109,13 +130,43 @@ public:
 			float const ripple_percent, const size_t number_of_poles,
 			const float sample_freq);
 
+	int bandpass(float **out, float const *in, size_t const &len,
+			size_t const &channels, float const low_freq,
+			float const high_freq, float const ripple_percent,
+			size_t const number_of_poles, float const sample_freq);
+
 	int bandpass(double **out, const double *in, const size_t len,
 			const float low_freq, const float high_freq,
 			float const ripple_percent, const size_t number_of_poles,
 			const float sample_freq);
 
+	int bandpass(int16_t **out, const int16_t *in, const size_t len,
+			const float low_freq, const float high_freq,
+			float const ripple_percent, const size_t number_of_poles,
+			const float sample_freq);
+
+	void design_bandpass(struct bandpass_design *design,
+			float const low_freq, float const high_freq,
+			float const ripple_percent, size_t const number_of_poles,
+			float const sample_freq);
+	static size_t bandpass_scratch(size_t const &len);
+	static size_t settling_len(struct bandpass_design const &design,
+			double const &tolerance);
+	static void bandpass(float *out, float const *in, size_t const &len,
+			struct bandpass_design const &design, void *scratch);
+	static void bandpass(double *out, double const *in, size_t const &len,
+			struct bandpass_design const &design, void *scratch);
+	static void bandpass(int16_t *out, int16_t const *in, size_t const &len,
+			struct bandpass_design const &design, void *scratch);
+
 private:
 	struct coefficients coeff;
+	std::vector<struct biquad_q> sections;
+
+	int calc_q(int16_t **out, int16_t const *in, size_t const &len);
+	void calc_chebyshev_sections(float const cutoff_freq,
+			bool const is_high_pass, float const ripple_percent,
+			const int number_of_poles, const float sample_freq);
 
 	void calc_narrow_pass_coefficients(const float bandwidth,
 			const float center_freq);
@@ -0,0 +1,192 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Resampler.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstring>
+#include <errno.h>
+#include <math.h>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "macro.h"
+#include "../utils/memory_manager.h"
+
+#include "Resampler.h"
+
+#ifndef M_PI
+#define M_PI		3.14159265358979323846
+#endif
+
+namespace DSP {
+
+static size_t gcd(size_t a, size_t b) {
+	while (b) {
+		size_t const t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/**
+ * Design the polyphase filter bank
+ *
+ * The prototype low pass runs at up times the input rate and has 2 * half * up
+ * + 1 taps centered on the output sample. Phase p takes the taps p + k * up;
+ * they are stored in input order so that each output sample is one contiguous
+ * dot product, zero padded to taps. The gain is up to make up for the inserted
+ * zeros.
+ *
+ * @param Pointer to output, up * taps coefficients
+ * @param Upsampling factor
+ * @param Downsampling factor
+ * @param Input samples each side of the output sample
+ * @param Coefficients per phase
+ */
+static void design(std::vector<float> &coefficients, size_t const &up,
+		size_t const &down, size_t const &half, size_t const &taps) {
+	size_t const len = 2 * half * up + 1; // prototype length
+	double const center = half * up;
+	double const cutoff = Resampler::passband * 0.5 / (up > down ? up : down); // cycles per upsampled sample
+
+	coefficients.assign(up * taps, 0.0f);
+	for (size_t p = 0; p < up; ++p) {
+		for (size_t k = 0; k <= 2 * half; ++k) {
+			size_t const j = p + k * up;
+			if (j >= len) {
+				continue;
+			}
+			double const x = j - center;
+			double const sinc =
+					x == 0.0 ?
+							2 * cutoff :
+							sin(2 * M_PI * cutoff * x) / (M_PI * x);
+			// strict blackman
+			double const window = 0.42 - 0.5 * cos(2 * M_PI * j / (len - 1))
+					+ 0.08 * cos(4 * M_PI * j / (len - 1));
+			coefficients[p * taps + 2 * half - k] = up * sinc * window;
+		}
+	}
+}
+
+/**
+ * Resampler from in_rate to out_rate
+ *
+ * The filter bank of each rate pair is designed once per process and shared.
+ *
+ * @param Input sample rate, Hz
+ * @param Output sample rate, Hz
+ */
+Resampler::Resampler(size_t const &in_rate, size_t const &out_rate) {
+	if (in_rate == 0 || out_rate == 0) {
+		errno = EINVAL;
+		PERROR("Resampler");
+	}
+	size_t const g = gcd(in_rate, out_rate);
+	up = out_rate / g;
+	down = in_rate / g;
+	half = (zero_crossings * (up > down ? up : down) + up - 1) / up;
+	taps = (2 * half + lanes) / lanes * lanes;
+
+	static std::mutex filter_bank_mutex;
+	static std::map<std::pair<size_t, size_t>, std::vector<float> > filter_banks;
+	{
+		std::lock_guard<std::mutex> lock(filter_bank_mutex);
+
+		std::vector<float> &bank = filter_banks[std::make_pair(up, down)];
+		if (bank.empty()) {
+			design(bank, up, down, half, taps);
+		}
+		coefficients = &bank[0];
+	}
+}
+
+Resampler::~Resampler() {
+}
+
+/**
+ * @param Number of input samples
+ * @return Number of output samples
+ */
+size_t Resampler::output_size(size_t const &len) const {
+	return (len * up + down - 1) / down;
+}
+
+/**
+ * Resample a whole signal
+ *
+ * The signal is zero padded on both sides, so the output is aligned with the
+ * input and has no group delay.
+ *
+ * @param Pointer to output, output_size() samples
+ * @param Pointer to input
+ * @param Number of input samples
+ * @return Number of output samples
+ */
+size_t Resampler::process(float *out, float const *in,
+		size_t const &len) const {
+	size_t const out_len = output_size(len);
+	float *padded = static_cast<float *>(mm_malloc(
+			(len + taps - 1) * sizeof(float)));
+	memset(padded, 0, half * sizeof(float));
+	memcpy(padded + half, in, len * sizeof(float));
+	memset(padded + half + len, 0, (taps - half - 1) * sizeof(float));
+
+	// output sample m is at input position m * down / up
+	size_t offset = 0, phase = 0;
+	for (size_t m = 0; m < out_len; ++m) {
+		float const *x = padded + offset;
+		float const *c = coefficients + phase * taps;
+		// independent partial sums, so that the dot product vectorizes
+		float y[lanes] = { };
+		for (size_t k = 0; k < taps; k += lanes) {
+			for (size_t l = 0; l < lanes; ++l) {
+				y[l] += c[k + l] * x[k + l];
+			}
+		}
+		float sum = 0.0f;
+		for (size_t l = 0; l < lanes; ++l) {
+			sum += y[l];
+		}
+		out[m] = sum;
+
+		phase += down;
+		offset += phase / up;
+		phase %= up;
+	}
+
+	mm_free(padded);
+	return out_len;
+}
+
+size_t const &Resampler::get_up() const {
+	return up;
+}
+
+size_t const &Resampler::get_down() const {
+	return down;
+}
+
+} /* namespace DSP */
@@ -0,0 +1,43 @@
+/**
+ * Resampler.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_MYDSP_RESAMPLER_H_
+#define SRC_MYDSP_RESAMPLER_H_
+
+#include <stddef.h>
+
+namespace DSP {
+
+/*
+ * Rational polyphase resampler with a Blackman windowed sinc low pass
+ */
+class Resampler {
+public:
+	static size_t constexpr zero_crossings = 16; // of the sinc, each side
+	static double constexpr passband = 0.9; // cutoff relative to the lower Nyquist frequency
+	static size_t constexpr lanes = 16; // partial sums of the dot product
+
+	Resampler(size_t const &in_rate, size_t const &out_rate);
+	virtual ~Resampler();
+
+	size_t output_size(size_t const &len) const;
+	size_t process(float *out, float const *in, size_t const &len) const;
+
+	size_t const &get_up() const;
+	size_t const &get_down() const;
+private:
+	size_t up;
+	size_t down;
+	size_t half; // input samples each side of the output sample
+	size_t taps; // per phase, 2 * half + 1 rounded up to lanes
+
+	float const *coefficients; // up phases of taps, in input order
+};
+
+} /* namespace DSP */
+
+#endif /* SRC_MYDSP_RESAMPLER_H_ */
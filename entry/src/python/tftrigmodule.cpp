@@ -0,0 +1,449 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrigmodule.cpp
+ *
+ * Python binding of the C API, see include/tftrig.h
+ *
+ *   import tftrig, numpy as np
+ *   ctx = tftrig.Context("final.convolution.kernel.csv", "params")
+ *   r = ctx.classify(pcm)              # any int16 buffer, eg. np.int16 array
+ *   r = ctx.classify(frames)           # frames x channels, r.channels are the verdicts
+ *   energy = np.asarray(r.energy())    # float32 view, no copy
+ *   s1 = np.asarray(r.events("s1"))    # (offset, p, energy) records, no copy
+ *
+ * The input buffer is used in place and the GIL is released during the
+ * classification, so a Python thread pool runs records in parallel.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include <cstring>
+#include <vector>
+#include <errno.h>
+
+#include "tftrig.h"
+
+/*
+ * Context
+ */
+struct ContextObject {
+	PyObject_HEAD
+	tftrig_context *ctx;
+};
+
+/*
+ * Result, owns the tftrig_result the views point to
+ */
+struct ResultObject {
+	PyObject_HEAD
+	tftrig_result *result;
+};
+
+/*
+ * A one dimensional buffer within a result, keeps the result alive
+ */
+struct ViewObject {
+	PyObject_HEAD
+	PyObject *owner;
+	void *buf;
+	Py_ssize_t len;
+	Py_ssize_t itemsize;
+	char const *format;
+};
+
+static PyTypeObject ContextType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject ResultType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject ViewType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+// struct tftrig_event; size_t offset, double p, float energy and padding
+static char const event_format[] = "Qdf4x";
+
+static PyObject *set_errno(int const e) {
+	errno = e;
+	return PyErr_SetFromErrno(e == EINVAL ? PyExc_ValueError : PyExc_OSError);
+}
+
+/*
+ * View
+ */
+static void View_dealloc(ViewObject *self) {
+	Py_XDECREF(self->owner);
+	Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+}
+
+static int View_getbuffer(ViewObject *self, Py_buffer *view, int flags) {
+	if (flags & PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError, "read only buffer");
+		view->obj = NULL;
+		return -1;
+	}
+	view->obj = reinterpret_cast<PyObject *>(self);
+	Py_INCREF(view->obj);
+	view->buf = self->buf;
+	view->len = self->len * self->itemsize;
+	view->readonly = 1;
+	view->itemsize = self->itemsize;
+	view->format =
+			(flags & PyBUF_FORMAT) ? const_cast<char *>(self->format) : NULL;
+	view->ndim = 1;
+	view->shape = (flags & PyBUF_ND) ? &self->len : NULL;
+	view->strides = (flags & PyBUF_STRIDES) ? &self->itemsize : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+static PyBufferProcs View_as_buffer = {
+		reinterpret_cast<getbufferproc>(View_getbuffer), NULL };
+
+static PyObject *new_view(PyObject *owner, void const *buf, size_t const &len,
+		size_t const &itemsize, char const *format) {
+	ViewObject *v = PyObject_New(ViewObject, &ViewType);
+	if (v == NULL) {
+		return NULL;
+	}
+	Py_INCREF(owner);
+	v->owner = owner;
+	v->buf = const_cast<void *>(buf);
+	v->len = len;
+	v->itemsize = itemsize;
+	v->format = format;
+
+	PyObject *m = PyMemoryView_FromObject(reinterpret_cast<PyObject *>(v));
+	Py_DECREF(v);
+	return m;
+}
+
+/*
+ * Result
+ */
+static void Result_dealloc(ResultObject *self) {
+	tftrig_result_free(self->result);
+	Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+}
+
+static PyObject *verdict_name(enum tftrig_verdict const &verdict) {
+	switch (verdict) {
+	case TFTRIG_NORMAL:
+		return PyUnicode_FromString("normal");
+	case TFTRIG_ABNORMAL:
+		return PyUnicode_FromString("abnormal");
+	default:
+		return PyUnicode_FromString("unknown");
+	}
+}
+
+static PyObject *Result_get_verdict(ResultObject *self, void *) {
+	return verdict_name(tftrig_result_verdict(self->result));
+}
+
+static PyObject *Result_get_answer(ResultObject *self, void *) {
+	return PyLong_FromLong(tftrig_result_answer(self->result));
+}
+
+static PyObject *Result_get_markers(ResultObject *self, void *) {
+	struct tftrig_marker const *markers;
+	size_t const n = tftrig_result_markers(self->result, &markers);
+	PyObject *list = PyList_New(n);
+	if (list == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		PyObject *t = Py_BuildValue("(sdI)", markers[i].name, markers[i].value,
+				tftrig_result_marker_channel(self->result, i));
+		if (t == NULL) {
+			Py_DECREF(list);
+			return NULL;
+		}
+		PyList_SET_ITEM(list, i, t);
+	}
+	return list;
+}
+
+static PyObject *Result_get_channels(ResultObject *self, void *) {
+	size_t const n = tftrig_result_channel_verdicts(self->result, NULL, 0);
+	std::vector<enum tftrig_verdict> verdicts(n);
+	tftrig_result_channel_verdicts(self->result, verdicts.data(), n);
+	PyObject *list = PyList_New(n);
+	if (list == NULL) {
+		return NULL;
+	}
+	for (size_t c = 0; c < n; ++c) {
+		PyObject *v = verdict_name(verdicts[c]);
+		if (v == NULL) {
+			Py_DECREF(list);
+			return NULL;
+		}
+		PyList_SET_ITEM(list, c, v);
+	}
+	return list;
+}
+
+static PyObject *Result_get_times(ResultObject *self, void *) {
+	struct tftrig_times t;
+	tftrig_result_times(self->result, &t);
+	return Py_BuildValue("{sdsdsdsdsd}", "load", t.load, "energy", t.energy,
+			"trigger", t.trigger, "correlate", t.correlate, "classify",
+			t.classify);
+}
+
+static PyObject *Result_energy(ResultObject *self, PyObject *) {
+	size_t len;
+	float const *energy = tftrig_result_energy(self->result, &len);
+	return new_view(reinterpret_cast<PyObject *>(self), energy, len,
+			sizeof(float), "f");
+}
+
+static PyObject *Result_events(ResultObject *self, PyObject *args) {
+	static char const *names[] = { "trigger", "correlated", "s1", "s2" };
+	char const *name = "correlated";
+	if (!PyArg_ParseTuple(args, "|s", &name)) {
+		return NULL;
+	}
+
+	for (int set = TFTRIG_EVENTS_TRIGGER; set <= TFTRIG_EVENTS_S2; ++set) {
+		if (strcmp(name, names[set]) == 0) {
+			struct tftrig_event const *events;
+			size_t const n = tftrig_result_events(self->result,
+					static_cast<enum tftrig_event_set>(set), &events);
+			return new_view(reinterpret_cast<PyObject *>(self), events, n,
+					sizeof(struct tftrig_event), event_format);
+		}
+	}
+	PyErr_Format(PyExc_ValueError,
+			"unknown event set %s, expected trigger, correlated, s1 or s2",
+			name);
+	return NULL;
+}
+
+static PyGetSetDef Result_getset[] = {
+		{ const_cast<char *>("verdict"),
+				reinterpret_cast<getter>(Result_get_verdict), NULL,
+				const_cast<char *>("normal, abnormal or unknown"), NULL },
+		{ const_cast<char *>("answer"),
+				reinterpret_cast<getter>(Result_get_answer), NULL,
+				const_cast<char *>("1 abnormal, -1 normal, 0 unsure"), NULL },
+		{ const_cast<char *>("markers"),
+				reinterpret_cast<getter>(Result_get_markers), NULL,
+				const_cast<char *>("[(name, value, channel)] on the decision path"),
+				NULL },
+		{ const_cast<char *>("channels"),
+				reinterpret_cast<getter>(Result_get_channels), NULL,
+				const_cast<char *>("verdict of each channel"), NULL },
+		{ const_cast<char *>("times"),
+				reinterpret_cast<getter>(Result_get_times), NULL,
+				const_cast<char *>("stage wall clock times in ms"), NULL },
+		{ NULL } };
+
+static PyMethodDef Result_methods[] = {
+		{ "energy", reinterpret_cast<PyCFunction>(Result_energy), METH_NOARGS,
+				"energy() -> float32 memoryview of the energy signal" },
+		{ "events", reinterpret_cast<PyCFunction>(Result_events), METH_VARARGS,
+				"events(set='correlated') -> memoryview of (offset, p, energy) records; set is trigger, correlated, s1 or s2" },
+		{ NULL } };
+
+/*
+ * Context
+ */
+static int Context_init(ContextObject *self, PyObject *args, PyObject *kwds) {
+	static char const *kwlist[] = { "kernel", "params_dir", NULL };
+	struct tftrig_options options = { NULL, NULL };
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|z",
+			const_cast<char **>(kwlist), &options.kernel,
+			&options.params_dir)) {
+		return -1;
+	}
+
+	// another thread may be classifying with the context, the GIL released
+	if (self->ctx) {
+		PyErr_SetString(PyExc_RuntimeError, "context already initialized");
+		return -1;
+	}
+
+	tftrig_context *ctx = NULL;
+	int e;
+	Py_BEGIN_ALLOW_THREADS
+	e = tftrig_create(&ctx, &options);
+	Py_END_ALLOW_THREADS
+	if (e) {
+		set_errno(e);
+		return -1;
+	}
+	if (self->ctx) { // initialized by another thread meanwhile
+		tftrig_destroy(ctx);
+		PyErr_SetString(PyExc_RuntimeError, "context already initialized");
+		return -1;
+	}
+	self->ctx = ctx;
+	return 0;
+}
+
+static void Context_dealloc(ContextObject *self) {
+	tftrig_destroy(self->ctx);
+	Py_TYPE(self)->tp_free(reinterpret_cast<PyObject *>(self));
+}
+
+static PyObject *new_result(tftrig_result *result) {
+	ResultObject *r = PyObject_New(ResultObject, &ResultType);
+	if (r == NULL) {
+		tftrig_result_free(result);
+		return NULL;
+	}
+	r->result = result;
+	return reinterpret_cast<PyObject *>(r);
+}
+
+static PyObject *Context_classify(ContextObject *self, PyObject *args,
+		PyObject *kwds) {
+	static char const *kwlist[] = { "pcm", "channels", "interleaved", NULL };
+	PyObject *obj;
+	Py_ssize_t channels = 0;
+	int interleaved = 1;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|np",
+			const_cast<char **>(kwlist), &obj, &channels, &interleaved)) {
+		return NULL;
+	}
+	if (self->ctx == NULL) {
+		PyErr_SetString(PyExc_RuntimeError, "context not initialized");
+		return NULL;
+	}
+
+	Py_buffer view;
+	if (PyObject_GetBuffer(obj, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT)) {
+		return NULL;
+	}
+	char const *format = view.format ? view.format : "B";
+	if (*format == '@' || *format == '=' || *format == '<') {
+		++format;
+	}
+	if (view.itemsize != sizeof(int16_t) || strcmp(format, "h")) {
+		PyBuffer_Release(&view);
+		PyErr_SetString(PyExc_TypeError,
+				"expected a contiguous int16 buffer of 2000 Hz PCM");
+		return NULL;
+	}
+
+	if (channels <= 0) { // frames x channels array, or a single channel
+		channels = view.ndim == 2 ? view.shape[1] : 1;
+	}
+	size_t const samples = view.len / sizeof(int16_t);
+	if (channels <= 0 || samples % channels) {
+		PyBuffer_Release(&view);
+		PyErr_SetString(PyExc_ValueError,
+				"the buffer is not a whole number of frames");
+		return NULL;
+	}
+
+	tftrig_result *result;
+	int e;
+	Py_BEGIN_ALLOW_THREADS
+	e = tftrig_classify_pcm16_channels(self->ctx,
+			static_cast<int16_t *>(view.buf), samples / channels, channels,
+			interleaved, &result);
+	Py_END_ALLOW_THREADS
+	PyBuffer_Release(&view);
+
+	if (e) {
+		return set_errno(e);
+	}
+	return new_result(result);
+}
+
+static PyObject *Context_classify_file(ContextObject *self, PyObject *args) {
+	char const *basename;
+	if (!PyArg_ParseTuple(args, "s", &basename)) {
+		return NULL;
+	}
+	if (self->ctx == NULL) {
+		PyErr_SetString(PyExc_RuntimeError, "context not initialized");
+		return NULL;
+	}
+
+	tftrig_result *result;
+	int e;
+	Py_BEGIN_ALLOW_THREADS
+	e = tftrig_classify_file(self->ctx, basename, &result);
+	Py_END_ALLOW_THREADS
+
+	if (e) {
+		return set_errno(e);
+	}
+	return new_result(result);
+}
+
+static PyMethodDef Context_methods[] = {
+		{ "classify", reinterpret_cast<PyCFunction>(Context_classify),
+				METH_VARARGS | METH_KEYWORDS,
+				"classify(pcm, channels=None, interleaved=True) -> Result; pcm is a contiguous int16 buffer of 2000 Hz samples, used in place; a 2-D buffer is frames x channels" },
+		{ "classify_file", reinterpret_cast<PyCFunction>(Context_classify_file),
+				METH_VARARGS,
+				"classify_file(basename) -> Result; reads basename.wav" },
+		{ NULL } };
+
+static struct PyModuleDef tftrig_module = { PyModuleDef_HEAD_INIT, "tftrig",
+		"Heart sound classifier, see include/tftrig.h", -1, NULL };
+
+PyMODINIT_FUNC PyInit_tftrig(void) {
+	ContextType.tp_name = "tftrig.Context";
+	ContextType.tp_basicsize = sizeof(ContextObject);
+	ContextType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ContextType.tp_doc = "Context(kernel, params_dir=None); kernel and classifier trees loaded once";
+	ContextType.tp_new = PyType_GenericNew;
+	ContextType.tp_init = reinterpret_cast<initproc>(Context_init);
+	ContextType.tp_dealloc = reinterpret_cast<destructor>(Context_dealloc);
+	ContextType.tp_methods = Context_methods;
+
+	ResultType.tp_name = "tftrig.Result";
+	ResultType.tp_basicsize = sizeof(ResultObject);
+	ResultType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ResultType.tp_doc = "Classification result";
+	ResultType.tp_dealloc = reinterpret_cast<destructor>(Result_dealloc);
+	ResultType.tp_methods = Result_methods;
+	ResultType.tp_getset = Result_getset;
+
+	ViewType.tp_name = "tftrig._View";
+	ViewType.tp_basicsize = sizeof(ViewObject);
+	ViewType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ViewType.tp_dealloc = reinterpret_cast<destructor>(View_dealloc);
+	ViewType.tp_as_buffer = &View_as_buffer;
+
+	if (PyType_Ready(&ContextType) < 0 || PyType_Ready(&ResultType) < 0
+			|| PyType_Ready(&ViewType) < 0) {
+		return NULL;
+	}
+
+	PyObject *m = PyModule_Create(&tftrig_module);
+	if (m == NULL) {
+		return NULL;
+	}
+
+	Py_INCREF(&ContextType);
+	if (PyModule_AddObject(m, "Context",
+			reinterpret_cast<PyObject *>(&ContextType)) < 0) {
+		Py_DECREF(&ContextType);
+		Py_DECREF(m);
+		return NULL;
+	}
+	PyModule_AddIntConstant(m, "API_VERSION", tftrig_api_version());
+	return m;
+}
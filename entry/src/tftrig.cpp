@@ -0,0 +1,386 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrig.cpp
+ *
+ * C API, see include/tftrig.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <errno.h>
+
+#include "tftrig.h"
+
+#include "Trigger/Csv2kernel.h"
+#include "Simplified/PhysionetChallenge2016.h"
+#include "Simplified/ZipArchive.h"
+#include "Classifier/classifier.h"
+#include "utils/log.h"
+
+#include "tftrig_classify.h"
+
+struct tftrig_context {
+	Trigger::Csv2kernel *kernel;
+	struct classifier_trees trees;
+	tftrig_log_fn log;
+	void *log_arg;
+};
+
+struct tftrig_result {
+	Classifier::result_e verdict;
+	struct stage_times times;
+	struct classify_trace trace;
+
+	std::vector<struct tftrig_event> events[TFTRIG_EVENTS_S2 + 1];
+	std::vector<struct tftrig_marker> markers;
+	std::vector<unsigned> marker_channels;
+};
+
+int tftrig_api_version(void) {
+	return TFTRIG_API_VERSION;
+}
+
+/**
+ * Map the exception being handled to an errno value, call from a catch block
+ *
+ * @return errno value
+ */
+static int current_error() {
+	try {
+		throw;
+	} catch (int e) {
+		return e;
+	} catch (std::bad_alloc const &) {
+		return ENOMEM;
+	} catch (std::logic_error const &) {
+		return EINVAL;
+	} catch (std::exception const &) {
+		return EIO;
+	} catch (...) {
+		return EIO;
+	}
+}
+
+/**
+ * Load the kernel and the classifier trees
+ *
+ * @param Pointer to output context
+ * @param Options
+ * @return Zero on success, errno value otherwise
+ */
+int tftrig_create(tftrig_context **ctx, struct tftrig_options const *options) {
+	if (ctx == 0 || options == 0 || options->kernel == 0) {
+		return EINVAL;
+	}
+
+	tftrig_context *c = new (std::nothrow) tftrig_context();
+	if (c == 0) {
+		return ENOMEM;
+	}
+
+	try {
+		c->kernel = new Trigger::Csv2kernel(options->kernel);
+		if (load_classifier_trees(&c->trees,
+				options->params_dir ? options->params_dir : "params")) {
+			throw ENOENT;
+		}
+	} catch (...) {
+		free_classifier_trees(&c->trees);
+		delete c->kernel;
+		delete c;
+		return current_error();
+	}
+
+	*ctx = c;
+	return 0;
+}
+
+/**
+ * Pass the progress of the classifications on the context to a function
+ *
+ * @param Context, not in use by other threads
+ * @param Log function, NULL to be quiet
+ * @param Argument of the log function
+ */
+void tftrig_set_log(tftrig_context *ctx, tftrig_log_fn log, void *arg) {
+	ctx->log = log;
+	ctx->log_arg = arg;
+}
+
+void tftrig_destroy(tftrig_context *ctx) {
+	if (ctx) {
+		free_classifier_trees(&ctx->trees);
+		delete ctx->kernel;
+		delete ctx;
+	}
+}
+
+static void copy_events(Simplified::retrig_ev const &ev,
+		std::vector<struct tftrig_event> &out) {
+	out.resize(ev.size());
+	for (size_t i = 0; i < ev.size(); ++i) {
+		out[i].offset = ev[i].offset;
+		out[i].p = ev[i].correlation.p;
+		out[i].energy = ev[i].nominal_energy;
+	}
+}
+
+/**
+ * Convert the trace to the C view of the result
+ */
+static void finish(tftrig_result *r) {
+	ref_ev const &trigger = r->trace.trigger;
+	std::vector<struct tftrig_event> &t = r->events[TFTRIG_EVENTS_TRIGGER];
+	t.resize(trigger.size());
+	for (size_t i = 0; i < trigger.size(); ++i) {
+		t[i].offset = trigger[i].offset;
+		t[i].p = 0.0;
+		t[i].energy = 0.0f;
+	}
+	copy_events(r->trace.events, r->events[TFTRIG_EVENTS_CORRELATED]);
+	copy_events(r->trace.s1, r->events[TFTRIG_EVENTS_S1]);
+	copy_events(r->trace.s2, r->events[TFTRIG_EVENTS_S2]);
+
+	Classifier::marker_trace const &m = r->trace.markers;
+	r->markers.resize(m.size());
+	r->marker_channels.resize(m.size());
+	for (size_t i = 0; i < m.size(); ++i) {
+		r->markers[i].name = m[i].marker_name;
+		r->markers[i].value = m[i].value;
+		r->marker_channels[i] = m[i].channel;
+	}
+}
+
+/**
+ * Classify all the channels of a loaded record
+ */
+static Classifier::result_e classify(tftrig_context const *ctx,
+		Signal::PhysionetChallenge2016 const &dat, tftrig_result *r) {
+	std::vector<data_raw_t *> signals(dat.get_channels());
+	for (size_t c = 0; c < signals.size(); ++c) {
+		signals[c] = dat.get_signal(c);
+	}
+	return classify_signal(&signals[0], signals.size(), dat.size(),
+			*ctx->kernel, ctx->trees, &r->times, &r->trace);
+}
+
+/**
+ * Classify 16 bit PCM in memory
+ *
+ * @param Context
+ * @param Little-endian 16 bit PCM at 2000 Hz
+ * @param Number of samples
+ * @param Pointer to output result, free with tftrig_result_free()
+ * @return Zero on success, errno value otherwise
+ */
+int tftrig_classify_pcm16(tftrig_context const *ctx, int16_t const *pcm,
+		size_t len, tftrig_result **result) {
+	return tftrig_classify_pcm16_channels(ctx, pcm, len, 1, 1, result);
+}
+
+/**
+ * Classify multi-channel 16 bit PCM in memory
+ *
+ * @param Context
+ * @param Little-endian 16 bit PCM at 2000 Hz
+ * @param Number of samples per channel
+ * @param Number of channels
+ * @param Nonzero if the channels are interleaved, zero if one after another
+ * @param Pointer to output result, free with tftrig_result_free()
+ * @return Zero on success, errno value otherwise
+ */
+int tftrig_classify_pcm16_channels(tftrig_context const *ctx,
+		int16_t const *pcm, size_t frames, size_t channels, int interleaved,
+		tftrig_result **result) {
+	if (ctx == 0 || pcm == 0 || result == 0 || channels == 0) {
+		return EINVAL;
+	}
+	if (frames < ctx->kernel->size()) {
+		return EINVAL;
+	}
+
+	tftrig_result *r = new (std::nothrow) tftrig_result();
+	if (r == 0) {
+		return ENOMEM;
+	}
+
+	Utils::log_scope log(ctx->log, ctx->log_arg);
+	try {
+		double const t0 = stage_clock();
+		Signal::PhysionetChallenge2016 dat(pcm, frames, channels,
+				interleaved != 0);
+		r->times.load = stage_clock() - t0;
+
+		r->verdict = classify(ctx, dat, r);
+		finish(r);
+	} catch (...) {
+		delete r;
+		return current_error();
+	}
+
+	*result = r;
+	return 0;
+}
+
+/**
+ * Classify a .wav record
+ *
+ * @param Context
+ * @param Record name, eg. a0123 for a0123.wav, or training-a.zip/a0123 in an archive
+ * @param Pointer to output result, free with tftrig_result_free()
+ * @return Zero on success, errno value otherwise
+ */
+int tftrig_classify_file(tftrig_context const *ctx, char const *basename,
+		tftrig_result **result) {
+	if (ctx == 0 || basename == 0 || result == 0) {
+		return EINVAL;
+	}
+
+	tftrig_result *r = new (std::nothrow) tftrig_result();
+	if (r == 0) {
+		return ENOMEM;
+	}
+
+	Utils::log_scope log(ctx->log, ctx->log_arg);
+	try {
+		std::string archive, member;
+		if (Signal::ZipArchive::split(basename, &archive, &member)) {
+			double const t0 = stage_clock();
+			Signal::ZipArchive zip(archive.c_str());
+			size_t const m = zip.find(member.c_str());
+			if (m == Signal::ZipArchive::npos) {
+				throw ENOENT;
+			}
+			Signal::PhysionetChallenge2016 dat(zip, m);
+			r->times.load = stage_clock() - t0;
+
+			r->verdict = classify(ctx, dat, r);
+		} else {
+			double const t0 = stage_clock();
+			Signal::PhysionetChallenge2016 dat(basename);
+			r->times.load = stage_clock() - t0;
+
+			r->verdict = classify(ctx, dat, r);
+		}
+		finish(r);
+	} catch (...) {
+		delete r;
+		return current_error();
+	}
+
+	*result = r;
+	return 0;
+}
+
+void tftrig_result_free(tftrig_result *result) {
+	delete result;
+}
+
+enum tftrig_verdict tftrig_result_verdict(tftrig_result const *result) {
+	return static_cast<enum tftrig_verdict>(result->verdict);
+}
+
+/**
+ * @return 1 for abnormal, -1 for normal and 0 if unsure, as in answers.txt
+ */
+int tftrig_result_answer(tftrig_result const *result) {
+	return answer(result->verdict);
+}
+
+/**
+ * @param Result
+ * @param Pointer to output verdicts of the channels
+ * @param Size of the output
+ * @return Number of channels, may be more than max
+ */
+size_t tftrig_result_channel_verdicts(tftrig_result const *result,
+		enum tftrig_verdict *verdicts, size_t max) {
+	std::vector<Classifier::result_e> const &v = result->trace.channels;
+	for (size_t c = 0; c < v.size() && c < max; ++c) {
+		verdicts[c] = static_cast<enum tftrig_verdict>(v[c]);
+	}
+	return v.size();
+}
+
+/**
+ * @param Result
+ * @param Pointer to output length in samples
+ * @return Energy signal, valid until the result is freed
+ */
+float const *tftrig_result_energy(tftrig_result const *result, size_t *len) {
+	if (len) {
+		*len = result->trace.energy.size();
+	}
+	return result->trace.energy.size() ? &result->trace.energy[0] : 0;
+}
+
+/**
+ * @param Result
+ * @param Event set
+ * @param Pointer to output events, valid until the result is freed
+ * @return Number of events
+ */
+size_t tftrig_result_events(tftrig_result const *result,
+		enum tftrig_event_set set, struct tftrig_event const **events) {
+	if (set < TFTRIG_EVENTS_TRIGGER || set > TFTRIG_EVENTS_S2) {
+		*events = 0;
+		return 0;
+	}
+	std::vector<struct tftrig_event> const &ev = result->events[set];
+	*events = ev.size() ? &ev[0] : 0;
+	return ev.size();
+}
+
+/**
+ * @param Result
+ * @param Pointer to output markers on the decision path, valid until the result is freed
+ * @return Number of markers
+ */
+size_t tftrig_result_markers(tftrig_result const *result,
+		struct tftrig_marker const **markers) {
+	*markers = result->markers.size() ? &result->markers[0] : 0;
+	return result->markers.size();
+}
+
+/**
+ * @param Result
+ * @param Index of the marker in tftrig_result_markers()
+ * @return Channel of the recording the marker is taken from, 0 if no such marker
+ */
+unsigned tftrig_result_marker_channel(tftrig_result const *result,
+		size_t marker) {
+	return marker < result->marker_channels.size() ?
+			result->marker_channels[marker] : 0;
+}
+
+void tftrig_result_times(tftrig_result const *result,
+		struct tftrig_times *times) {
+	times->load = result->times.load;
+	times->energy = result->times.energy;
+	times->trigger = result->times.trigger;
+	times->correlate = result->times.correlate;
+	times->classify = result->times.classify;
+}
@@ -0,0 +1,481 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrig_batch.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "macro.h"
+
+#include "Simplified/Retrigger.h"
+#include "Simplified/WfdbRecord.h"
+#include "Simplified/Corpus.h"
+#include "Simplified/Prefetch.h"
+
+#include "tftrig_batch.h"
+
+struct batch_queue {
+	std::mutex mutex;
+	std::deque<size_t> jobs;
+};
+
+/**
+ * Estimate the memory of a record
+ *
+ * @param Pointer to the job, the samples set
+ */
+static void estimate_memory(struct batch_job *job) {
+	// signal buffers plus one correlation signal per reference event
+	size_t events = job->samples / 800 + 1;
+	if (events > Simplified::Retrigger::ref_ev_limit) {
+		events = Simplified::Retrigger::ref_ev_limit;
+	}
+	job->memory = job->samples
+			* (sizeof(int16_t) + 3 * sizeof(data_raw_t) + 4 * sizeof(cl_float)
+					+ events * sizeof(cl_float));
+}
+
+/**
+ * Read the record names from a list file (one per line), a directory (*.wav
+ * and WFDB *.hea), a ZIP archive (*.wav members, see Signal::ZipArchive) or a
+ * packed corpus (*.tfc, see Signal::Corpus)
+ *
+ * @param List filename, directory, archive or corpus
+ * @param Pointer to output
+ * @param Pointer to output archive or corpus, free with free_record_source()
+ * @return Zero on success
+ */
+int read_record_list(char const *list, std::vector<batch_job> *jobs,
+		struct record_source *source) {
+	memset(source, 0, sizeof(*source));
+
+	struct stat sb;
+	if (stat(list, &sb)) {
+		PERROR("stat");
+	}
+
+	size_t const list_len = strlen(list);
+	if (S_ISREG(sb.st_mode) && list_len > 4
+			&& strcmp(list + list_len - 4, ".tfc") == 0) {
+		Signal::Corpus const *corpus = source->corpus = new Signal::Corpus(list);
+		for (size_t i = 0; i < corpus->size(); ++i) {
+			struct Signal::corpus_entry const &e = corpus->get_entry(i);
+			struct batch_job job = { std::string(list) + "/"
+					+ corpus->get_name(i), i, e.samples * e.channels, 0, false,
+					false, 0 };
+			estimate_memory(&job);
+			jobs->push_back(job);
+		}
+		return (0);
+	}
+	if (S_ISREG(sb.st_mode) && list_len > 4
+			&& strcmp(list + list_len - 4, ".zip") == 0) {
+		Signal::ZipArchive const *zip = source->zip = new Signal::ZipArchive(
+				list);
+		std::vector<struct Signal::zip_member> const &members =
+				zip->get_members();
+		for (size_t i = 0; i < members.size(); ++i) {
+			std::string const &name = members[i].name;
+			if (name.size() <= 4
+					|| name.compare(name.size() - 4, 4, ".wav")) {
+				continue;
+			}
+			struct batch_job job = { std::string(list) + "/"
+					+ name.substr(0, name.size() - 4), i, 0, 0, false, false,
+					0 };
+			if (members[i].size > 44) {
+				job.samples = (members[i].size - 44) / sizeof(int16_t);
+			}
+			estimate_memory(&job);
+			jobs->push_back(job);
+		}
+		return (0);
+	}
+
+	std::vector<std::string> names;
+	if (S_ISDIR(sb.st_mode)) {
+		std::string dir(list);
+		while (dir.size() > 1 && dir[dir.size() - 1] == '/') {
+			dir.erase(dir.size() - 1);
+		}
+
+		DIR *d = opendir(list);
+		if (d == 0) {
+			PERROR("opendir");
+		}
+		for (struct dirent *e; (e = readdir(d));) {
+			size_t const n = strlen(e->d_name);
+			if (n > 4 && (strcmp(e->d_name + n - 4, ".wav") == 0
+					|| strcmp(e->d_name + n - 4, ".hea") == 0)) {
+				names.push_back(dir + "/" + std::string(e->d_name, n - 4));
+			}
+		}
+		closedir(d);
+		// a WFDB header next to its .wav names the same record
+		std::sort(names.begin(), names.end());
+		names.erase(std::unique(names.begin(), names.end()), names.end());
+	} else {
+		FILE *f = fopen(list, "r");
+		if (f == 0) {
+			PERROR("fopen");
+		}
+		char line[FILENAME_MAX];
+		while (fgets(line, sizeof(line), f)) {
+			size_t n = strlen(line);
+			while (n && (line[n - 1] == '\n' || line[n - 1] == '\r'
+					|| line[n - 1] == ' ' || line[n - 1] == '\t')) {
+				line[--n] = 0;
+			}
+			if (n) {
+				names.push_back(line);
+			}
+		}
+		fclose(f);
+	}
+
+	for (size_t i = 0; i < names.size(); ++i) {
+		struct batch_job job = { names[i], 0, 0, 0, false, false, 0 };
+
+		std::string const filename = names[i] + ".wav";
+		if (stat(filename.c_str(), &sb) == 0) {
+			if (sb.st_size > 44) {
+				job.samples = (sb.st_size - 44) / sizeof(int16_t);
+			}
+		} else {
+			try {
+				Signal::WfdbRecord const record(names[i].c_str());
+				job.samples = record.size() * record.get_channels();
+			} catch (int e) {
+				// not a WFDB record either, fails when classified
+			}
+		}
+		estimate_memory(&job);
+
+		jobs->push_back(job);
+	}
+	return (0);
+}
+
+void free_record_source(struct record_source *source) {
+	delete source->zip;
+	delete source->corpus;
+	source->zip = 0;
+	source->corpus = 0;
+}
+
+static size_t constexpr no_prefetch = static_cast<size_t>(-1);
+
+/**
+ * Add up the marker memo counts of the records
+ *
+ * @param Pointer to the sums
+ * @param Counts of a record
+ */
+static void add_memo_stats(struct Classifier::Markers::marker_memo_stats *sum,
+		struct Classifier::Markers::marker_memo_stats const &stats) {
+	auto add = [](struct Classifier::Markers::memo_count *s,
+			struct Classifier::Markers::memo_count const &a) {
+		s->lookups += a.lookups;
+		s->hits += a.hits;
+	};
+	add(&sum->band, stats.band);
+	add(&sum->std, stats.std);
+	add(&sum->value, stats.value);
+	add(&sum->dur, stats.dur);
+	sum->band_samples += stats.band_samples;
+	sum->band_filtered += stats.band_filtered;
+}
+
+/**
+ * Hit rate of a memoized intermediate in percents
+ */
+static double memo_hit_rate(struct Classifier::Markers::memo_count const &c) {
+	return c.lookups ? 100.0 * c.hits / c.lookups : 0.0;
+}
+
+/**
+ * Classify a record of the list
+ *
+ * A record read ahead is classified from memory. If the read ahead failed,
+ * the record is read again by name, to fail with the usual error.
+ *
+ * @param Job, see read_record_list()
+ * @param Archive or corpus of the records, if any
+ * @param Read ahead of the Wav files, if any
+ * @param Index of the Wav file of the job in the read ahead, or no_prefetch
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @param Pointer to the per stage wall clock times
+ * @param Pointer to output the milliseconds waited for the read ahead
+ * @return Classifier result; normal, abnormal or unknown
+ */
+static Classifier::result_e classify_job(struct batch_job const &job,
+		struct record_source const &source, Signal::Prefetch *prefetch,
+		size_t const &file, Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees, struct stage_times *times,
+		double *io_wait) {
+	*io_wait = 0.0;
+	if (source.corpus) {
+		return classify_record(*source.corpus, job.member, kernel, trees, times);
+	}
+	if (source.zip) {
+		return classify_record(*source.zip, job.member, kernel, trees, times);
+	}
+	if (prefetch && file != no_prefetch) {
+		void const *image;
+		size_t len;
+		double wait;
+		int const e = prefetch->acquire(file, &image, &len, &wait);
+		*io_wait = wait * 1000;
+		if (e == 0) {
+			Classifier::result_e result;
+			try {
+				result = classify_record(job.name.c_str(), image, len, kernel,
+						trees, times);
+			} catch (int e) {
+				prefetch->release(file);
+				throw;
+			}
+			prefetch->release(file);
+			return result;
+		}
+		prefetch->release(file);
+	}
+	return classify_record(job.name.c_str(), kernel, trees, times);
+}
+
+/**
+ * Classify records on a work-stealing thread pool
+ *
+ * The kernel and the classification trees are loaded once. The records are
+ * scheduled longest first: they are dealt in decreasing length to the worker
+ * queues and an idle worker steals the longest job left in another queue.
+ * A job starts only when its memory estimate fits in the budget, or when
+ * nothing else is running. The answers are appended to answers.txt in input
+ * order as soon as all preceding records are done, in the same format as the
+ * single record mode; a record that fails gets no line there either.
+ *
+ * The Wav files of a record list or directory are read ahead in the same
+ * order, see Signal::Prefetch, so the workers rarely wait for a read. The
+ * time spent waiting for the reads, loading the records and classifying them
+ * is reported at the end, summed over the workers.
+ *
+ * @param Convolution kernel filename
+ * @param List filename (one record per line), directory, ZIP archive or corpus of records
+ * @param Number of worker threads, zero for the number of cores
+ * @param Memory budget in bytes
+ * @param Number of Wav files to read ahead, zero to read them on demand
+ * @return Zero if all records were classified
+ */
+int batch(char const *convolution_kernel, char const *list,
+		size_t const &_threads, size_t const &memory_budget,
+		size_t const &prefetch_window) {
+	std::vector<batch_job> jobs;
+	struct record_source source;
+	read_record_list(list, &jobs, &source);
+
+	size_t threads = _threads ? _threads : std::thread::hardware_concurrency();
+	if (threads < 1) {
+		threads = 1;
+	}
+	if (threads > jobs.size() && jobs.size()) {
+		threads = jobs.size();
+	}
+
+	Trigger::Csv2kernel kernel(convolution_kernel);
+	struct classifier_trees trees;
+	if (load_classifier_trees(&trees)) {
+		free_classifier_trees(&trees);
+		free_record_source(&source);
+		return (EXIT_FAILURE);
+	}
+
+	FILE *f = fopen("answers.txt", "a");
+	if (f == 0) {
+		PERROR("fopen");
+	}
+
+	// longest first
+	std::vector<size_t> order(jobs.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(),
+			[&jobs](size_t const &a, size_t const &b) {
+				return jobs[a].samples > jobs[b].samples;
+			});
+
+	// read the Wav files ahead in about the order the workers take them
+	Signal::Prefetch *prefetch = 0;
+	std::vector<size_t> prefetch_file(jobs.size(), no_prefetch);
+	if (prefetch_window && source.zip == 0 && source.corpus == 0) {
+		std::vector<std::string> files;
+		for (size_t i = 0; i < order.size(); ++i) {
+			std::string const filename = jobs[order[i]].name + ".wav";
+			if (access(filename.c_str(), R_OK) == 0) {
+				prefetch_file[order[i]] = files.size();
+				files.push_back(filename);
+			}
+		}
+		if (files.size()) {
+			prefetch = new Signal::Prefetch(files, prefetch_window);
+		}
+	}
+
+	std::vector<batch_queue> queues(threads);
+	for (size_t i = 0; i < order.size(); ++i) {
+		queues[i % threads].jobs.push_back(order[i]);
+	}
+
+	std::mutex mutex; // guards jobs, memory and the answers
+	std::condition_variable memory_freed;
+	size_t memory_used = 0, running = 0, written = 0;
+	int failed = 0;
+	double load_time = 0, compute_time = 0; // ms
+	struct Classifier::Markers::marker_memo_stats memo = { };
+
+	auto next_job = [&queues, &jobs](size_t const &self, size_t *job) {
+		{
+			std::lock_guard<std::mutex> lock(queues[self].mutex);
+			if (queues[self].jobs.size()) {
+				*job = queues[self].jobs.front();
+				queues[self].jobs.pop_front();
+				return true;
+			}
+		}
+
+		// steal the longest job left
+		for (size_t i = 1; i < queues.size(); ++i) {
+			batch_queue &victim = queues[(self + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (victim.jobs.size()) {
+				*job = victim.jobs.front();
+				victim.jobs.pop_front();
+				return true;
+			}
+		}
+		return false;
+	};
+
+	auto worker = [&](size_t const self) {
+		for (size_t j; next_job(self, &j);) {
+			batch_job &job = jobs[j];
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				memory_freed.wait(lock, [&] {
+					return running == 0 || memory_used + job.memory <= memory_budget;
+				});
+				memory_used += job.memory;
+				++running;
+			}
+
+			bool ok = true;
+			Classifier::result_e result = Classifier::unknown;
+			struct stage_times times = { };
+			double io_wait = 0.0;
+			double const t0 = stage_clock();
+			try {
+				result = classify_job(job, source, prefetch, prefetch_file[j],
+						kernel, trees, &times, &io_wait);
+			} catch (int e) {
+				fprintf(stderr, "[%s:%u] %s: failed (%s)\n", __FILE__, __LINE__,
+						job.name.c_str(), strerror(e));
+				ok = false;
+			}
+
+			double const t1 = stage_clock();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			load_time += times.load;
+			compute_time += t1 - t0 - io_wait - times.load;
+			add_memo_stats(&memo, times.memo);
+			memory_used -= job.memory;
+			--running;
+			memory_freed.notify_all();
+
+			job.ok = ok;
+			job.answer = answer(result);
+			job.done = true;
+			if (!ok) {
+				++failed;
+			}
+
+			// commit the answers in input order
+			for (; written < jobs.size() && jobs[written].done; ++written) {
+				if (jobs[written].ok) {
+					fprintf(f, "%s,%i\n", jobs[written].name.c_str(),
+							jobs[written].answer);
+				}
+			}
+			fflush(f);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (size_t i = 0; i < threads; ++i) {
+		pool.push_back(std::thread(worker, i));
+	}
+	for (size_t i = 0; i < pool.size(); ++i) {
+		pool[i].join();
+	}
+
+	fclose(f);
+	free_classifier_trees(&trees);
+	free_record_source(&source);
+
+	printf("batch: %lu records, %lu failed, %lu threads\n", jobs.size(),
+			static_cast<size_t>(failed), threads);
+	if (prefetch) {
+		struct Signal::prefetch_stats const stats = prefetch->get_stats();
+		printf("batch: I/O wait %.3f s, load %.3f s, compute %.3f s;"
+				" %s read ahead of %lu records, %lu ready when needed\n",
+				stats.io_wait, load_time / 1000, compute_time / 1000,
+				prefetch->get_backend() == Signal::PREFETCH_IO_URING ?
+						"io_uring" : "thread", stats.files, stats.hits);
+		delete prefetch;
+	} else {
+		printf("batch: load %.3f s, compute %.3f s\n", load_time / 1000,
+				compute_time / 1000);
+	}
+	printf("batch: marker memo hits: values %.1f %% of %lu, bands %.1f %% of %lu,"
+			" moving stds %.1f %% of %lu, durations %.1f %% of %lu\n",
+			memo_hit_rate(memo.value), memo.value.lookups,
+			memo_hit_rate(memo.band), memo.band.lookups,
+			memo_hit_rate(memo.std), memo.std.lookups, memo_hit_rate(memo.dur),
+			memo.dur.lookups);
+	printf("batch: band-pass filters ran over %.1f %% of the samples of their"
+			" signals\n", memo.band_samples ?
+					100.0 * memo.band_filtered / memo.band_samples : 0.0);
+	return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,39 @@
+/**
+ * tftrig_batch.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_TFTRIG_BATCH_H_
+#define SRC_TFTRIG_BATCH_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "tftrig_classify.h"
+
+struct batch_job {
+	std::string name;
+	size_t member; // in the archive or the corpus, if the records are in one
+	size_t samples;
+	size_t memory;
+	bool done;
+	bool ok;
+	int answer;
+};
+
+struct record_source {
+	Signal::ZipArchive *zip; // if the records are in an archive
+	Signal::Corpus *corpus; // if the records are in a packed corpus
+};
+
+int read_record_list(char const *list, std::vector<batch_job> *jobs,
+		struct record_source *source);
+void free_record_source(struct record_source *source);
+int batch(char const *convolution_kernel, char const *list,
+		size_t const &threads, size_t const &memory_budget,
+		size_t const &prefetch_window);
+
+#endif /* SRC_TFTRIG_BATCH_H_ */
@@ -0,0 +1,702 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrig_check.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ * Compare the marker values of the band-pass filtered spans to those of the
+ * whole filtered signals, see Classifier::Markers::set_sparse_bands(), and
+ * read well formed and broken ZIP archives, see Signal::ZipArchive, and
+ * compare the verdicts and the marker values of a float or fixed point build
+ * to those written by the double build, see make check
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "macro.h"
+
+#include "Trigger/Csv2kernel.h"
+#include "Simplified/PhysionetChallenge2016.h"
+#include "Simplified/ZipArchive.h"
+#include "Classifier/classifier.h"
+#include "utils/log.h"
+#include "tftrig_classify.h"
+
+/*
+ * The filters run in single precision, so a span differs from the whole
+ * filtered signal by their rounding, up to 1e-4 of its peak, whatever the
+ * margins. A marker value may move as much relative to itself.
+ */
+static double constexpr check_tolerance = 1e-4;
+
+/*
+ * A marker value of a float or fixed point build may differ from the double
+ * build by its filters, most on the low band norm markers: 0.4 % in float
+ * and 5 % in fixed point on the synthetic records, see the error budget in
+ * README.md. The verdicts must match.
+ */
+#if defined(DATA_RAW_T_FIXED)
+static double constexpr precision_tolerance = 0.1;
+static char const *const precision = "fixed";
+#elif defined(DATA_RAW_T_FLOAT)
+static double constexpr precision_tolerance = 0.01;
+static char const *const precision = "float";
+#else
+static double constexpr precision_tolerance = 0.0;
+static char const *const precision = "double";
+#endif
+
+/*
+ * The verdict and the markers of a record, see write_verdicts()
+ */
+struct check_verdict {
+	std::string label;
+	int answer;
+	Classifier::marker_trace markers;
+};
+
+/*
+ * A synthetic record, for when no records are given
+ */
+struct check_record {
+	char const *name;
+	unsigned seed;
+	double duration; // s
+	bool murmur; // between S2 and the next S1
+};
+
+static struct check_record const check_records[] = {
+	{ "synthetic-30s", 1, 30.0, false },
+	{ "synthetic-20s-murmur", 2, 20.0, true },
+	{ "synthetic-35s-murmur", 3, 35.0, true },
+	{ "synthetic-8s", 4, 8.0, false },
+};
+
+/**
+ * Synthesize heart sounds; noise and a beat every 0.8-0.9 s with S1 at 60-70
+ * Hz and S2 at 90-100 Hz 0.3 s later
+ *
+ * @param Record
+ * @param Pointer to output PCM at PhysionetChallenge2016::sample_freq
+ */
+static void synthesize(struct check_record const &record,
+		std::vector<int16_t> *pcm) {
+	double const fs = Signal::PhysionetChallenge2016::sample_freq;
+	size_t const n = record.duration * fs;
+	std::mt19937 rng(record.seed);
+	std::normal_distribution<double> noise(0.0, 30.0);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<double> x(n);
+
+	for (size_t i = 0; i < n; i++) {
+		x[i] = noise(rng);
+	}
+
+	auto burst = [&](double const &center, double const &freq,
+			double const &amplitude, double const &width) {
+		double const lo = (center - 4.0 * width) * fs;
+		double const hi = (center + 4.0 * width) * fs;
+		for (size_t i = lo > 0.0 ? lo : 0; i < n && i < hi; i++) {
+			double const t = i / fs - center;
+			x[i] += amplitude * exp(-(t / width) * (t / width))
+					* sin(2.0 * M_PI * freq * t);
+		}
+	};
+
+	double const rr = 0.8 + 0.1 * uniform(rng);
+	for (double beat = 0.5; beat < record.duration - 0.5;
+			beat += rr + 0.02 * noise(rng) / 30.0) {
+		burst(beat, 60.0 + 10.0 * uniform(rng), 3000.0, 0.02);
+		burst(beat + 0.3, 90.0 + 10.0 * uniform(rng), 2000.0, 0.015);
+		if (record.murmur) {
+			burst(beat + 0.55, 300.0, 800.0, 0.05);
+		}
+	}
+
+	pcm->resize(n);
+	for (size_t i = 0; i < n; i++) {
+		(*pcm)[i] = x[i] > 32000.0 ? 32000 : x[i] < -32000.0 ? -32000 : x[i];
+	}
+}
+
+/**
+ * Classify a record and trace its markers
+ *
+ * @param Record name, or NULL for the PCM
+ * @param PCM of a synthetic record
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @param Pointer to output markers
+ * @return Classifier result
+ */
+static Classifier::result_e trace_record(char const *name,
+		std::vector<int16_t> const &pcm, Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees,
+		Classifier::marker_trace *markers) {
+	Signal::PhysionetChallenge2016 *dat =
+			name ? new Signal::PhysionetChallenge2016(name) :
+					new Signal::PhysionetChallenge2016(&pcm[0], pcm.size());
+	std::vector<data_raw_t *> signals(dat->get_channels());
+	for (size_t c = 0; c < signals.size(); ++c) {
+		signals[c] = dat->get_signal(c);
+	}
+
+	struct classify_trace trace;
+	Classifier::result_e result;
+	try {
+		Utils::log_scope quiet(0, 0);
+		result = classify_signal(&signals[0], signals.size(), dat->size(),
+				kernel, trees, 0, &trace);
+	} catch (int e) {
+		delete dat;
+		throw;
+	}
+	delete dat;
+	markers->swap(trace.markers);
+	return (result);
+}
+
+/**
+ * Compare the markers of a record, filtered by spans and whole
+ *
+ * @param Record name, for the messages
+ * @param Record name, or NULL for the PCM
+ * @param PCM of a synthetic record
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @param Pointer to the number of markers compared
+ * @param Pointer to the largest relative difference
+ * @return Zero if the markers match
+ */
+static int compare_record(char const *label, char const *name,
+		std::vector<int16_t> const &pcm, Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees, size_t *compared, double *worst) {
+	Classifier::marker_trace sparse, whole;
+
+	Classifier::Markers::set_sparse_bands(true);
+	Classifier::result_e const sparse_result = trace_record(name, pcm, kernel,
+			trees, &sparse);
+	Classifier::Markers::set_sparse_bands(false);
+	Classifier::result_e const whole_result = trace_record(name, pcm, kernel,
+			trees, &whole);
+	Classifier::Markers::set_sparse_bands(true);
+
+	int failed = 0;
+	if (sparse_result != whole_result) {
+		printf("check: %s: verdict %i with the spans, %i whole\n", label,
+				answer(sparse_result), answer(whole_result));
+		failed = -1;
+	}
+	if (sparse.size() != whole.size()) {
+		printf("check: %s: %lu markers with the spans, %lu whole\n", label,
+				sparse.size(), whole.size());
+		return (-1);
+	}
+
+	double off = 0.0;
+	for (size_t i = 0; i < sparse.size(); i++) {
+		struct Classifier::marker_value const &s = sparse[i];
+		struct Classifier::marker_value const &w = whole[i];
+		if (strcmp(s.marker_name, w.marker_name) || s.channel != w.channel) {
+			printf("check: %s: marker %s with the spans, %s whole\n", label,
+					s.marker_name, w.marker_name);
+			failed = -1;
+			continue;
+		}
+		double const scale = fmax(fabs(s.value), fabs(w.value));
+		double const d = scale > 0.0 ? fabs(s.value - w.value) / scale : 0.0;
+		if (!(d <= check_tolerance)) {
+			printf("check: %s: marker %s: %g with the spans, %g whole\n",
+					label, s.marker_name, s.value, w.value);
+			failed = -1;
+		}
+		if (off < d || d != d) {
+			off = d;
+		}
+	}
+	printf("check: %s: %lu markers, off by %g\n", label, sparse.size(), off);
+
+	*compared += sparse.size();
+	if (*worst < off || off != off) {
+		*worst = off;
+	}
+	return (failed);
+}
+
+static void put16(std::vector<uint8_t> *b, uint16_t const &v) {
+	b->push_back(v);
+	b->push_back(v >> 8);
+}
+
+static void put32(std::vector<uint8_t> *b, uint32_t const &v) {
+	put16(b, v);
+	put16(b, v >> 16);
+}
+
+static void put64(std::vector<uint8_t> *b, uint64_t const &v) {
+	put32(b, v);
+	put32(b, v >> 32);
+}
+
+/*
+ * A member of a ZIP fixture
+ */
+struct check_zip_member {
+	char const *name;
+	uint16_t method;
+	std::vector<uint8_t> data; // uncompressed
+	std::vector<uint8_t> compressed;
+	uint32_t crc;
+	size_t offset; // of the local header
+};
+
+/**
+ * Write a ZIP archive, the ZIP64 way with saturated sizes and offsets or the
+ * plain way
+ *
+ * @param Members, their data set
+ * @param True for ZIP64
+ * @return Archive image
+ */
+static std::vector<uint8_t> zip_fixture(
+		std::vector<struct check_zip_member> *members, bool const &zip64) {
+	std::vector<uint8_t> b;
+	for (size_t i = 0; i < members->size(); i++) {
+		struct check_zip_member &m = (*members)[i];
+		m.crc = crc32(crc32(0, Z_NULL, 0), &m.data[0], m.data.size());
+		if (m.method == Signal::ZIP_STORED) {
+			m.compressed = m.data;
+		} else {
+			z_stream z;
+			memset(&z, 0, sizeof(z));
+			deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+					Z_DEFAULT_STRATEGY);
+			m.compressed.resize(deflateBound(&z, m.data.size()));
+			z.next_in = &m.data[0];
+			z.avail_in = m.data.size();
+			z.next_out = &m.compressed[0];
+			z.avail_out = m.compressed.size();
+			deflate(&z, Z_FINISH);
+			m.compressed.resize(z.total_out);
+			deflateEnd(&z);
+		}
+
+		m.offset = b.size();
+		put32(&b, 0x04034b50);
+		put16(&b, zip64 ? 45 : 20);
+		put16(&b, 0);
+		put16(&b, m.method);
+		put32(&b, 0); // time and date
+		put32(&b, m.crc);
+		put32(&b, zip64 ? 0xffffffff : m.compressed.size());
+		put32(&b, zip64 ? 0xffffffff : m.data.size());
+		put16(&b, strlen(m.name));
+		put16(&b, zip64 ? 20 : 0);
+		b.insert(b.end(), m.name, m.name + strlen(m.name));
+		if (zip64) {
+			put16(&b, 0x0001);
+			put16(&b, 16);
+			put64(&b, m.data.size());
+			put64(&b, m.compressed.size());
+		}
+		b.insert(b.end(), m.compressed.begin(), m.compressed.end());
+	}
+
+	size_t const cd_offset = b.size();
+	for (size_t i = 0; i < members->size(); i++) {
+		struct check_zip_member const &m = (*members)[i];
+		put32(&b, 0x02014b50);
+		put16(&b, zip64 ? 45 : 20);
+		put16(&b, zip64 ? 45 : 20);
+		put16(&b, 0);
+		put16(&b, m.method);
+		put32(&b, 0);
+		put32(&b, m.crc);
+		put32(&b, zip64 ? 0xffffffff : m.compressed.size());
+		put32(&b, zip64 ? 0xffffffff : m.data.size());
+		put16(&b, strlen(m.name));
+		put16(&b, zip64 ? 28 : 0);
+		put16(&b, 0); // comment
+		put16(&b, 0); // disk
+		put16(&b, 0); // attributes
+		put32(&b, 0);
+		put32(&b, zip64 ? 0xffffffff : m.offset);
+		b.insert(b.end(), m.name, m.name + strlen(m.name));
+		if (zip64) {
+			put16(&b, 0x0001);
+			put16(&b, 24);
+			put64(&b, m.data.size());
+			put64(&b, m.compressed.size());
+			put64(&b, m.offset);
+		}
+	}
+	size_t const cd_len = b.size() - cd_offset;
+
+	if (zip64) {
+		size_t const eocd64 = b.size();
+		put32(&b, 0x06064b50);
+		put64(&b, 44);
+		put16(&b, 45);
+		put16(&b, 45);
+		put32(&b, 0);
+		put32(&b, 0);
+		put64(&b, members->size());
+		put64(&b, members->size());
+		put64(&b, cd_len);
+		put64(&b, cd_offset);
+
+		put32(&b, 0x07064b50);
+		put32(&b, 0);
+		put64(&b, eocd64);
+		put32(&b, 1);
+	}
+	put32(&b, 0x06054b50);
+	put32(&b, 0); // disks
+	put16(&b, zip64 ? 0xffff : members->size());
+	put16(&b, zip64 ? 0xffff : members->size());
+	put32(&b, zip64 ? 0xffffffff : cd_len);
+	put32(&b, zip64 ? 0xffffffff : cd_offset);
+	put16(&b, 0); // comment
+	return b;
+}
+
+/**
+ * Read all members of an archive image
+ *
+ * @param Archive image
+ * @param Pointer to output member data, in central directory order
+ * @return Zero, or the errno thrown
+ */
+static int read_zip(std::vector<uint8_t> const &image,
+		std::vector<std::vector<uint8_t> > *data) {
+	char filename[] = "/tmp/tftrig_check.XXXXXX";
+	int const fd = mkstemp(filename);
+	if (fd < 0) {
+		return errno;
+	}
+	bool const written = write(fd, &image[0], image.size())
+			== static_cast<ssize_t>(image.size());
+	close(fd);
+	if (!written) {
+		unlink(filename);
+		return EIO;
+	}
+
+	int e = 0;
+	data->clear();
+	try {
+		Signal::ZipArchive zip(filename);
+		std::vector<struct Signal::zip_member> const &members =
+				zip.get_members();
+		for (size_t i = 0; i < members.size(); i++) {
+			data->push_back(std::vector<uint8_t>(members[i].size));
+			if (members[i].method == Signal::ZIP_STORED) {
+				uint8_t const *p = static_cast<uint8_t const *>(zip.get_stored(
+						i));
+				std::copy(p, p + members[i].size, data->back().begin());
+			}
+			zip.inflate(i, data->back().empty() ? 0 : &data->back()[0]);
+		}
+	} catch (int _e) {
+		e = _e;
+	}
+	unlink(filename);
+	return e;
+}
+
+/**
+ * Read well formed ZIP and ZIP64 archives of stored and deflated members,
+ * and refuse corrupted and malformed ones
+ *
+ * @return Number of failed checks
+ */
+static size_t check_zip() {
+	std::vector<struct check_zip_member> members(2);
+	members[0].name = "training-a/a0001.wav";
+	members[0].method = Signal::ZIP_STORED;
+	members[1].name = "training-a/a0002.wav";
+	members[1].method = Signal::ZIP_DEFLATED;
+	std::mt19937 rng(5);
+	for (size_t i = 0; i < members.size(); i++) {
+		for (size_t j = 0; j < 200000; j++) {
+			members[i].data.push_back(rng() % 16); // compressible
+		}
+	}
+
+	size_t failed = 0;
+	auto expect = [&failed](char const *what, bool const &ok) {
+		printf("check: zip: %s: %s\n", what, ok ? "ok" : "FAILED");
+		failed += !ok;
+	};
+
+	std::vector<std::vector<uint8_t> > data;
+	for (int zip64 = 0; zip64 < 2; zip64++) {
+		std::vector<uint8_t> const image = zip_fixture(&members, zip64);
+		expect(zip64 ? "zip64 members read" : "members read",
+				read_zip(image, &data) == 0 && data.size() == members.size()
+						&& data[0] == members[0].data
+						&& data[1] == members[1].data);
+
+		for (size_t i = 0; i < members.size(); i++) {
+			std::vector<uint8_t> broken(image);
+			broken[members[i].offset + 30 + strlen(members[i].name)
+					+ (zip64 ? 20 : 0) + members[i].compressed.size() / 2] ^= 1;
+			expect(i == 0 ? "corrupted stored member refused" :
+							"corrupted deflated member refused",
+					read_zip(broken, &data) == EINVAL);
+		}
+	}
+
+	std::vector<uint8_t> const image = zip_fixture(&members, false);
+	std::vector<uint8_t> broken(image.begin(), image.end() - 30);
+	expect("truncated central directory refused",
+			read_zip(broken, &data) == EINVAL);
+
+	broken = image; // the stored size of the first member in the directory
+	size_t const cd = image.size() - 22 - 2 * (46 + strlen(members[0].name));
+	broken[cd + 24] ^= 0x10;
+	expect("stored size mismatch refused", read_zip(broken, &data) == EINVAL);
+
+	broken = image; // the local header offset of the second member
+	size_t const cd2 = cd + 46 + strlen(members[0].name);
+	broken[cd2 + 45] = 0x7f;
+	expect("member offset past the end refused",
+			read_zip(broken, &data) == EINVAL);
+
+	return failed;
+}
+
+/**
+ * Write the verdicts and the markers of the records
+ *
+ * @param Filename
+ * @param Verdicts
+ * @return Zero on success
+ */
+static int write_verdicts(char const *filename,
+		std::vector<struct check_verdict> const &verdicts) {
+	FILE *fp = fopen(filename, "w");
+	if (fp == 0) {
+		return (-1);
+	}
+	for (size_t i = 0; i < verdicts.size(); i++) {
+		struct check_verdict const &v = verdicts[i];
+		fprintf(fp, "record %s %i %lu\n", v.label.c_str(), v.answer,
+				v.markers.size());
+		for (size_t j = 0; j < v.markers.size(); j++) {
+			fprintf(fp, "marker %s %lu %.17g\n", v.markers[j].marker_name,
+					v.markers[j].channel, v.markers[j].value);
+		}
+	}
+	return (fclose(fp) ? -1 : 0);
+}
+
+/**
+ * Read the verdicts and the markers written by write_verdicts()
+ *
+ * @param Filename
+ * @param Pointer to output verdicts
+ * @return Zero on success
+ */
+static int read_verdicts(char const *filename,
+		std::vector<struct check_verdict> *verdicts) {
+	FILE *fp = fopen(filename, "r");
+	if (fp == 0) {
+		return (-1);
+	}
+	char label[4096];
+	int answer;
+	unsigned long n;
+	while (fscanf(fp, " record %4095s %i %lu", label, &answer, &n) == 3) {
+		struct check_verdict v;
+		v.label = label;
+		v.answer = answer;
+		v.markers.resize(n);
+		for (size_t j = 0; j < n; j++) {
+			struct Classifier::marker_value &m = v.markers[j];
+			char format[32];
+			snprintf(format, sizeof(format), " marker %%%lus %%lu %%lg",
+					sizeof(m.marker_name) - 1);
+			if (fscanf(fp, format, m.marker_name, &m.channel, &m.value) != 3) {
+				fclose(fp);
+				return (-1);
+			}
+		}
+		verdicts->push_back(v);
+	}
+	bool const end = feof(fp);
+	fclose(fp);
+	return (end ? 0 : -1);
+}
+
+/**
+ * Compare the verdicts and the markers of this build to the double build
+ *
+ * A marker is compared only while the decision paths agree.
+ *
+ * @param Verdicts of the double build
+ * @param Verdicts of this build
+ * @return Number of records that differ
+ */
+static size_t compare_verdicts(std::vector<struct check_verdict> const &ref,
+		std::vector<struct check_verdict> const &verdicts) {
+	if (ref.size() != verdicts.size()) {
+		printf("check: %s: %lu records, %lu in double\n", precision,
+				verdicts.size(), ref.size());
+		return (1);
+	}
+
+	size_t failed = 0;
+	double worst = 0.0;
+	for (size_t i = 0; i < ref.size(); i++) {
+		struct check_verdict const &r = ref[i], &v = verdicts[i];
+		char const *const label = v.label.c_str();
+		bool ok = r.label == v.label && r.answer == v.answer;
+		if (!ok) {
+			printf("check: %s: %s: verdict %i, %i in double\n", precision,
+					label, v.answer, r.answer);
+		}
+
+		double off = 0.0;
+		size_t j = 0;
+		for (; j < r.markers.size() && j < v.markers.size(); j++) {
+			struct Classifier::marker_value const &a = v.markers[j];
+			struct Classifier::marker_value const &b = r.markers[j];
+			if (strcmp(a.marker_name, b.marker_name) || a.channel != b.channel) {
+				break; // another path
+			}
+			double const scale = fmax(fabs(a.value), fabs(b.value));
+			double const d = scale > 0.0 ? fabs(a.value - b.value) / scale : 0.0;
+			if (!(d <= precision_tolerance)) {
+				printf("check: %s: %s: marker %s: %g, %g in double\n",
+						precision, label, a.marker_name, a.value, b.value);
+				ok = false;
+			}
+			if (off < d || d != d) {
+				off = d;
+			}
+		}
+		printf("check: %s: %s: verdict %i, %lu of %lu markers on the double"
+				" path, off by %g\n", precision, label, v.answer, j,
+				r.markers.size(), off);
+		if (worst < off || off != off) {
+			worst = off;
+		}
+		failed += !ok;
+	}
+	printf("check: %s: %lu records against double, off by %g at most,"
+			" tolerance %g: %s\n", precision, ref.size(), worst,
+			precision_tolerance, failed ? "FAILED" : "ok");
+	return (failed);
+}
+
+int main(int argc, char *argv[]) {
+	char const *write_to = 0, *compare_to = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "w:c:")) != -1) {
+		if (opt == 'w') {
+			write_to = optarg;
+		} else if (opt == 'c') {
+			compare_to = optarg;
+		} else {
+			argc = 0; // usage
+		}
+	}
+	if (argc - optind < 1) {
+		fprintf(stderr,
+				"[%s:%u] usage: %s [-w verdicts of this build | -c verdicts of the double build] <trigger convolution kernel.csv> [file base id, eg. a0123 ...]\n",
+				__FILE__, __LINE__, argv[0]);
+		exit (EXIT_FAILURE);
+	}
+	char const *const kernel_file = argv[optind];
+	int const first = optind + 1;
+
+	size_t records = 0, compared = 0, failed = 0;
+	double worst = 0.0;
+	std::vector<struct check_verdict> verdicts;
+	try {
+		Trigger::Csv2kernel kernel(kernel_file);
+		struct classifier_trees trees;
+		if (load_classifier_trees(&trees)) {
+			free_classifier_trees(&trees);
+			exit (EXIT_FAILURE);
+		}
+
+		std::vector<int16_t> pcm;
+		size_t const n = argc > first ? argc - first :
+				sizeof(check_records) / sizeof(check_records[0]);
+		for (size_t i = 0; i < n; i++, records++) {
+			char const *name = 0, *label = argv[first + i];
+			if (argc > first) {
+				name = label;
+			} else {
+				synthesize(check_records[i], &pcm);
+				label = check_records[i].name;
+			}
+			if (write_to || compare_to) {
+				struct check_verdict v;
+				v.label = label;
+				v.answer = answer(trace_record(name, pcm, kernel, trees,
+						&v.markers));
+				verdicts.push_back(v);
+			} else {
+				failed += compare_record(label, name, pcm, kernel, trees,
+						&compared, &worst) != 0;
+			}
+		}
+		free_classifier_trees(&trees);
+	} catch (int e) {
+		exit (EXIT_FAILURE);
+	}
+
+	if (write_to) {
+		if (write_verdicts(write_to, verdicts)) {
+			fprintf(stderr, "[%s:%u] %s: %s\n", __FILE__, __LINE__, write_to,
+					strerror(errno));
+			exit (EXIT_FAILURE);
+		}
+		printf("check: %s: %lu verdicts written to %s\n", precision, records,
+				write_to);
+		return (EXIT_SUCCESS);
+	}
+	if (compare_to) {
+		std::vector<struct check_verdict> ref;
+		if (read_verdicts(compare_to, &ref)) {
+			fprintf(stderr, "[%s:%u] %s: cannot read the verdicts\n", __FILE__,
+					__LINE__, compare_to);
+			exit (EXIT_FAILURE);
+		}
+		return (compare_verdicts(ref, verdicts) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	failed += check_zip();
+
+	printf("check: %lu records, %lu markers, off by %g at most, tolerance %g:"
+			" %s\n", records, compared, worst, check_tolerance,
+			failed ? "FAILED" : "ok");
+	return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,430 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrig_classify.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <time.h>
+
+#include "macro.h"
+
+#include "Trigger/Trigger.h"
+#include "Simplified/Retrigger.h"
+#include "Simplified/PhysionetChallenge2016.h"
+#include "Simplified/WavFile.h"
+#include "utils/log.h"
+
+#include "tftrig_classify.h"
+
+/**
+ * Load a classification tree and compile it for the records
+ *
+ * @param Tree filename
+ * @param Pointer to output
+ * @return Zero on success
+ */
+static int load_classifier_tree(char const *filename,
+		struct Classifier::marker_plan *plan) {
+	double const sample_freq = Simplified::Retrigger::sample_freq;
+	struct Classifier::string_tree tree = { };
+	if (Classifier::load_txt_string_tree(filename, &tree)) {
+		return (-1);
+	}
+	int const err = Classifier::compile_tree(&tree, sample_freq, plan);
+	Classifier::free_string_tree(&tree);
+	return (err);
+}
+
+/**
+ * Load the classification trees of the S1/S2, EV and rest marker sets
+ *
+ * @param Pointer to output
+ * @param Directory of s1s2.txt, ev.txt and rest.txt
+ * @return Zero on success
+ */
+int load_classifier_trees(struct classifier_trees *trees,
+		char const *params_dir) {
+	memset(trees, 0, sizeof(*trees));
+
+	char s1s2[FILENAME_MAX], ev[FILENAME_MAX], rest[FILENAME_MAX];
+	snprintf(s1s2, sizeof(s1s2), "%s/s1s2.txt", params_dir);
+	snprintf(ev, sizeof(ev), "%s/ev.txt", params_dir);
+	snprintf(rest, sizeof(rest), "%s/rest.txt", params_dir);
+	if (load_classifier_tree(s1s2, &trees->s1s2)
+			|| load_classifier_tree(ev, &trees->ev)
+			|| load_classifier_tree(rest, &trees->rest)) {
+		return (-1);
+	}
+	return (0);
+}
+
+void free_classifier_trees(struct classifier_trees *trees) {
+	Classifier::free_marker_plan(&trees->s1s2);
+	Classifier::free_marker_plan(&trees->ev);
+	Classifier::free_marker_plan(&trees->rest);
+}
+
+/**
+ * Monotonic wall clock
+ *
+ * @return Milliseconds from an arbitrary origin
+ */
+double stage_clock() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+/**
+ * Classify all the channels of a loaded record
+ */
+static Classifier::result_e classify_loaded(
+		Signal::PhysionetChallenge2016 const &dat,
+		Trigger::Csv2kernel const &kernel, struct classifier_trees const &trees,
+		struct stage_times *times) {
+	std::vector<data_raw_t *> signals(dat.get_channels());
+	for (size_t c = 0; c < signals.size(); ++c) {
+		signals[c] = dat.get_signal(c);
+	}
+	return classify_signal(&signals[0], signals.size(), dat.size(), kernel,
+			trees, times);
+}
+
+/**
+ * Classify a single record
+ *
+ * A record inside a ZIP archive is named by the archive and the member, eg.
+ * training-a.zip/training-a/a0001, see Signal::ZipArchive, and likewise a
+ * record of a packed corpus, eg. train.tfc/a0001, see Signal::Corpus.
+ *
+ * @param Record name, eg. a0123 for a0123.wav
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @param Optional pointer to the per stage wall clock times
+ * @return Classifier result; normal, abnormal or unknown
+ */
+Classifier::result_e classify_record(char const *data_filename,
+		Trigger::Csv2kernel const &kernel, struct classifier_trees const &trees,
+		struct stage_times *times) {
+	std::string archive, member;
+	if (Signal::Corpus::split(data_filename, &archive, &member)) {
+		Signal::Corpus corpus(archive.c_str());
+		size_t const r = corpus.find(member.c_str());
+		if (r == Signal::Corpus::npos) {
+			errno = ENOENT;
+			PERROR(data_filename);
+		}
+		return classify_record(corpus, r, kernel, trees, times);
+	}
+	if (Signal::ZipArchive::split(data_filename, &archive, &member)) {
+		Signal::ZipArchive zip(archive.c_str());
+		size_t const m = zip.find(member.c_str());
+		if (m == Signal::ZipArchive::npos) {
+			errno = ENOENT;
+			PERROR(data_filename);
+		}
+		return classify_record(zip, m, kernel, trees, times);
+	}
+
+	double const t0 = stage_clock();
+	Signal::PhysionetChallenge2016 dat(data_filename);
+	Utils::log_printf("data: %s\n", data_filename);
+	if (times) {
+		times->load = stage_clock() - t0;
+	}
+	return classify_loaded(dat, kernel, trees, times);
+}
+
+/**
+ * Classify a Wav file already read into memory, see Signal::Prefetch
+ *
+ * @param Record name, for the log
+ * @param Wav file contents
+ * @param Length of the contents in bytes
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @param Optional pointer to the per stage wall clock times
+ * @return Classifier result; normal, abnormal or unknown
+ */
+Classifier::result_e classify_record(char const *name, void const *image,
+		size_t const &len, Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees, struct stage_times *times) {
+	double const t0 = stage_clock();
+	Signal::WavFile const wav(image, len);
+	Signal::PhysionetChallenge2016 dat(wav);
+	Utils::log_printf("data: %s\n", name);
+	if (times) {
+		times->load = stage_clock() - t0;
+	}
+	return classify_loaded(dat, kernel, trees, times);
+}
+
+/**
+ * Classify a record in a ZIP archive without extracting it
+ *
+ * @param Archive
+ * @param Index of the member, see Signal::ZipArchive::find()
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @param Optional pointer to the per stage wall clock times
+ * @return Classifier result; normal, abnormal or unknown
+ */
+Classifier::result_e classify_record(Signal::ZipArchive const &zip,
+		size_t const &member, Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees, struct stage_times *times) {
+	double const t0 = stage_clock();
+	Signal::PhysionetChallenge2016 dat(zip, member);
+	Utils::log_printf("data: %s\n", zip.get_members()[member].name.c_str());
+	if (times) {
+		times->load = stage_clock() - t0;
+	}
+	return classify_loaded(dat, kernel, trees, times);
+}
+
+/**
+ * Classify a record of a packed corpus in place
+ *
+ * @param Corpus
+ * @param Index of the record, see Signal::Corpus::find()
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @param Optional pointer to the per stage wall clock times
+ * @return Classifier result; normal, abnormal or unknown
+ */
+Classifier::result_e classify_record(Signal::Corpus const &corpus,
+		size_t const &record, Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees, struct stage_times *times) {
+	double const t0 = stage_clock();
+	Signal::PhysionetChallenge2016 dat(corpus, record);
+	Utils::log_printf("data: %s\n", corpus.get_name(record));
+	if (times) {
+		times->load = stage_clock() - t0;
+	}
+	return classify_loaded(dat, kernel, trees, times);
+}
+
+/**
+ * Classify a baseline and scale corrected signal
+ *
+ * @param Signal, see Signal::PhysionetChallenge2016
+ * @param Number of samples
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @param Optional pointer to the per stage wall clock times
+ * @param Optional pointer to the intermediate results
+ * @return Classifier result; normal, abnormal or unknown
+ */
+Classifier::result_e classify_signal(data_raw_t *signal, size_t const &len,
+		Trigger::Csv2kernel const &kernel, struct classifier_trees const &trees,
+		struct stage_times *times, struct classify_trace *trace) {
+	return classify_signal(&signal, 1, len, kernel, trees, times, trace);
+}
+
+/**
+ * Joint verdict of the channels of a multi-site recording
+ *
+ * A murmur may be heard at one auscultation site only, so any abnormal channel
+ * makes the recording abnormal. Otherwise any normal channel makes it normal.
+ *
+ * @param Verdicts of the channels
+ * @return Classifier result; normal, abnormal or unknown
+ */
+static Classifier::result_e joint_verdict(
+		std::vector<Classifier::result_e> const &verdicts) {
+	Classifier::result_e result = Classifier::unknown;
+	for (size_t c = 0; c < verdicts.size(); ++c) {
+		if (verdicts[c] == Classifier::abnormal) {
+			return Classifier::abnormal;
+		}
+		if (verdicts[c] == Classifier::normal) {
+			result = Classifier::normal;
+		}
+	}
+	return result;
+}
+
+/**
+ * Classify the baseline and scale corrected channels of a recording
+ *
+ * The channels are recorded simultaneously, eg. at different auscultation
+ * sites. They share one energy signal, trigger and S1/S2 clustering, see
+ * Simplified::Retrigger::set_data(), and each channel is classified with its
+ * own markers on the shared events.
+ *
+ * @param Signals, one per channel
+ * @param Number of channels
+ * @param Number of samples per channel
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @param Optional pointer to the per stage wall clock times
+ * @param Optional pointer to the intermediate results
+ * @return Joint classifier result; normal, abnormal or unknown
+ */
+Classifier::result_e classify_signal(data_raw_t *const *signals,
+		size_t const &channels, size_t const &len,
+		Trigger::Csv2kernel const &kernel, struct classifier_trees const &trees,
+		struct stage_times *times, struct classify_trace *trace) {
+	double t = stage_clock();
+	auto lap = [&t, times](double stage_times::*stage) {
+		double const now = stage_clock();
+		if (times) {
+			times->*stage = now - t;
+		}
+		t = now;
+	};
+
+	std::vector<Classifier::result_e> verdicts(channels, Classifier::unknown);
+	if (trace) {
+		trace->channels = verdicts;
+		trace->reference_channel = 0;
+	}
+	if (len <= kernel.size()) { // the convolution needs a full kernel of samples
+		Utils::log_printf(
+				"Oops, the record is shorter than the convolution kernel\n");
+		return (Classifier::unknown);
+	}
+	if (len < Accbpm::Trigger::min_len(2000.0)) { // no trigger threshold
+		Utils::log_printf("Oops, the record is shorter than %.1f s\n",
+				Accbpm::Trigger::min_len(2000.0) / 2000.0);
+		return (Classifier::unknown);
+	}
+	Simplified::Retrigger retrig(0.25);
+	Classifier::marker_trace *markers = trace ? &trace->markers : 0;
+
+	// A bit inconsistent naming convention.. these are required to get the energy signal
+	retrig.set_convolution_kernel(kernel.get_data(), kernel.size());
+
+	retrig.set_data(signals, channels, len);
+	cl_float const *energy = retrig.get_energy();
+	lap(&stage_times::energy);
+	if (channels > 1) {
+		Utils::log_printf("%lu channels, correlated on channel %lu\n", channels,
+				retrig.get_reference_channel());
+	}
+	if (trace) {
+		trace->energy.assign(energy, energy + len);
+		trace->reference_channel = retrig.get_reference_channel();
+	}
+
+	// A simple minmaxminmax trigger, will fire both on S1 and S2
+	Accbpm::Trigger trig(energy, len, 2000.0);
+	{
+		ref_ev const &ev = trig.get_events();
+		Utils::log_printf("trigged %lu events\n", ev.size());
+		lap(&stage_times::trigger);
+		if (trace) {
+			trace->trigger = ev;
+		}
+
+		retrig.set_ref_ev(ev);
+		retrig.set_correlation_window(0.25, 0.125);
+		retrig.set_lookaround_window(0.05, 0.025);
+
+		// auto correlate, jut for fun!
+		retrig.calc_correlations(0.8);
+		lap(&stage_times::correlate);
+		if (trace) {
+			trace->events = retrig.get_events();
+		}
+	}
+
+	{
+		struct data data = { };
+		data.sample_freq = 2000.0;
+		data.number_of_channels = channels;
+		data.samples_per_channel = len;
+
+		struct data_channel data_ch[data.number_of_channels];
+		memset(&data_ch, 0, sizeof(data_ch));
+		for (size_t c = 0; c < channels; ++c) {
+			data_ch[c].raw = signals[c];
+		}
+		data.ch = data_ch;
+
+		// the events are shared, the markers are taken from each channel
+		Simplified::retrig_ev const *ev1 = 0, *ev2 = 0;
+		struct Classifier::marker_plan const *tree;
+		try {
+			ev1 = &retrig.get_s1_events();
+			ev2 = &retrig.get_s2_events();
+			Utils::log_printf(
+					"got %lu S1 events and %lu S2 events after auto correlation\n",
+					ev1->size(), ev2->size());
+			if (trace) {
+				trace->s1 = *ev1;
+				trace->s2 = *ev2;
+			}
+			tree = &trees.s1s2;
+		} catch (int e) {
+			Simplified::retrig_ev const &ev = retrig.get_events();
+			Utils::log_printf(
+					"got %lu events after auto correlation\n", ev.size());
+
+			ev1 = ev2 = 0;
+			if (ev.size()) {
+				ev1 = &ev;
+				tree = &trees.ev;
+			} else {
+				tree = &trees.rest;
+			}
+		}
+
+		struct Classifier::Markers::marker_context context;
+		Classifier::Markers::init_marker_context(&context, &data, ev1, ev2);
+		for (size_t c = 0; c < channels; ++c) {
+			verdicts[c] = Classifier::classify_this(&data, ev1, ev2, tree,
+					markers, c, &context);
+			if (channels > 1) {
+				Utils::log_printf("channel %lu verdict: %i\n", c, verdicts[c]);
+			}
+		}
+		if (times) {
+			times->memo = context.stats;
+		}
+	}
+
+	lap(&stage_times::classify);
+	if (trace) {
+		trace->channels = verdicts;
+	}
+
+	return joint_verdict(verdicts);
+}
+
+/**
+ * Answer code of a classifier result
+ *
+ * @param Classifier result
+ * @return 1 for abnormal, -1 for normal and 0 if unsure
+ */
+int answer(Classifier::result_e const &result) {
+	switch (result) {
+	case Classifier::abnormal:
+		return 1;
+	case Classifier::normal:
+		return -1;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,80 @@
+/**
+ * tftrig_classify.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_TFTRIG_CLASSIFY_H_
+#define SRC_TFTRIG_CLASSIFY_H_
+
+#include <cstdio>
+#include <vector>
+
+#include "Trigger/Csv2kernel.h"
+#include "Classifier/classifier.h"
+#include "Simplified/ZipArchive.h"
+#include "Simplified/Corpus.h"
+
+/*
+ * The classification trees, compiled, see Classifier::compile_tree()
+ */
+struct classifier_trees {
+	struct Classifier::marker_plan s1s2;
+	struct Classifier::marker_plan ev;
+	struct Classifier::marker_plan rest;
+};
+
+/*
+ * Wall clock time of the classification stages in milliseconds
+ */
+struct stage_times {
+	double load;
+	double energy;
+	double trigger;
+	double correlate;
+	double classify;
+	struct Classifier::Markers::marker_memo_stats memo; // of the classify stage
+};
+
+/*
+ * Intermediate results of a classification
+ */
+struct classify_trace {
+	std::vector<cl_float> energy;
+	ref_ev trigger; // trigger events
+	Simplified::retrig_ev events; // correlated events
+	Simplified::retrig_ev s1; // S1 cluster, if found
+	Simplified::retrig_ev s2; // S2 cluster, if found
+	Classifier::marker_trace markers; // markers on the decision paths, channel by channel
+	std::vector<Classifier::result_e> channels; // verdict of each channel
+	size_t reference_channel; // channel the events were correlated on
+};
+
+int load_classifier_trees(struct classifier_trees *trees,
+		char const *params_dir = "params");
+void free_classifier_trees(struct classifier_trees *trees);
+
+double stage_clock();
+Classifier::result_e classify_record(char const *data_filename,
+		Trigger::Csv2kernel const &kernel, struct classifier_trees const &trees,
+		struct stage_times *times = 0);
+Classifier::result_e classify_record(char const *name, void const *image,
+		size_t const &len, Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees, struct stage_times *times = 0);
+Classifier::result_e classify_record(Signal::ZipArchive const &zip,
+		size_t const &member, Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees, struct stage_times *times = 0);
+Classifier::result_e classify_record(Signal::Corpus const &corpus,
+		size_t const &record, Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees, struct stage_times *times = 0);
+Classifier::result_e classify_signal(data_raw_t *signal, size_t const &len,
+		Trigger::Csv2kernel const &kernel, struct classifier_trees const &trees,
+		struct stage_times *times = 0, struct classify_trace *trace = 0);
+Classifier::result_e classify_signal(data_raw_t *const *signals,
+		size_t const &channels, size_t const &len,
+		Trigger::Csv2kernel const &kernel, struct classifier_trees const &trees,
+		struct stage_times *times = 0, struct classify_trace *trace = 0);
+int answer(Classifier::result_e const &result);
+
+#endif /* SRC_TFTRIG_CLASSIFY_H_ */
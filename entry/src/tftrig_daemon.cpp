@@ -0,0 +1,520 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrig_daemon.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "macro.h"
+
+#include "Trigger/Csv2kernel.h"
+#include "Simplified/PhysionetChallenge2016.h"
+#include "Classifier/classifier.h"
+
+#include "tftrig_batch.h"
+#include "tftrig_daemon.h"
+
+static volatile sig_atomic_t daemon_stop = 0;
+static int daemon_wakeup = -1; // write end of the pipe the event loop polls
+
+static void daemon_signal(int) {
+	int const e = errno;
+	daemon_stop = 1;
+	if (daemon_wakeup >= 0) {
+		ssize_t const n = write(daemon_wakeup, "", 1);
+		(void) n;
+	}
+	errno = e;
+}
+
+/*
+ * A request of a client, classified by a worker of the pool
+ */
+struct daemon_request {
+	int fd; // of the client
+	std::string record; // RECORD
+	std::vector<int16_t> pcm; // PCM
+	double t0; // when the request was received
+};
+
+/*
+ * A connection, see serve()
+ */
+struct daemon_client {
+	std::string in; // received, not yet a whole request
+	std::string out; // replies not yet sent
+	bool busy; // a request in the pool
+	bool eof; // the client is done sending
+	bool closing; // the stream is lost, close after the replies
+};
+
+static char const *verdict_name(Classifier::result_e const &result) {
+	switch (result) {
+	case Classifier::abnormal:
+		return "abnormal";
+	case Classifier::normal:
+		return "normal";
+	default:
+		return "unknown";
+	}
+}
+
+/**
+ * Classify a request
+ *
+ * @param Request
+ * @param Trigger convolution kernel
+ * @param Classification trees
+ * @return Reply line
+ */
+static std::string run_request(struct daemon_request const &request,
+		Trigger::Csv2kernel const &kernel,
+		struct classifier_trees const &trees) {
+	char buf[FILENAME_MAX + 256];
+	struct stage_times times = { };
+	Classifier::result_e result = Classifier::unknown;
+	try {
+		if (request.pcm.empty()) {
+			result = classify_record(request.record.c_str(), kernel, trees,
+					&times);
+		} else {
+			double const t1 = stage_clock();
+			Signal::PhysionetChallenge2016 dat(&request.pcm[0],
+					request.pcm.size());
+			times.load = stage_clock() - t1;
+
+			result = classify_signal(dat.get_signal(), dat.size(), kernel,
+					trees, &times);
+		}
+	} catch (int e) {
+		snprintf(buf, sizeof(buf), "ERR %s\n", strerror(e));
+		return (buf);
+	} catch (std::bad_alloc const &) {
+		snprintf(buf, sizeof(buf), "ERR %s\n", strerror(ENOMEM));
+		return (buf);
+	} catch (std::exception const &e) {
+		snprintf(buf, sizeof(buf), "ERR %s\n", e.what());
+		return (buf);
+	} catch (...) {
+		return ("ERR internal error\n");
+	}
+
+	double const total = stage_clock() - request.t0;
+	snprintf(buf, sizeof(buf),
+			"OK %i %s load=%.3f energy=%.3f trigger=%.3f correlate=%.3f classify=%.3f total=%.3f\n",
+			answer(result), verdict_name(result), times.load, times.energy,
+			times.trigger, times.correlate, times.classify, total);
+	return (buf);
+}
+
+/**
+ * Take the next whole request of a client from its input
+ *
+ * Each request is a line:
+ *   RECORD <file base id, eg. /data/a0123>
+ *   PCM <number of samples>, followed by the little-endian 16 bit PCM at 2000 Hz
+ * and is answered by a line:
+ *   OK <answer> <verdict> load=<ms> energy=<ms> trigger=<ms> correlate=<ms> classify=<ms> total=<ms>
+ *   ERR <reason>
+ *
+ * An unknown request is answered here. A malformed PCM request closes the
+ * connection after the replies, as the stream can not be resynchronized.
+ *
+ * @param Socket of the client
+ * @param Pointer to the client
+ * @param Trigger convolution kernel
+ * @param Pointer to output request
+ * @return True if a request was taken
+ */
+static bool next_request(int const &fd, struct daemon_client *c,
+		Trigger::Csv2kernel const &kernel, struct daemon_request *request) {
+	while (!c->closing) {
+		size_t const nl = c->in.find('\n');
+		if (nl == std::string::npos) {
+			if (c->in.size() > FILENAME_MAX + 16) {
+				c->out += "ERR request too long\n";
+				c->closing = true;
+			}
+			return (false);
+		}
+
+		std::string line(c->in, 0, nl);
+		while (line.size() && line[line.size() - 1] == '\r') {
+			line.erase(line.size() - 1);
+		}
+		if (line.empty()) {
+			c->in.erase(0, nl + 1);
+			continue;
+		}
+
+		if (line.compare(0, 7, "RECORD ") == 0) {
+			c->in.erase(0, nl + 1);
+			request->fd = fd;
+			request->record = line.substr(7);
+			request->pcm.clear();
+			request->t0 = stage_clock();
+			return (true);
+		}
+		if (line.compare(0, 4, "PCM ") == 0) {
+			char *end;
+			size_t const len = strtoul(line.c_str() + 4, &end, 10);
+			if (*end || len < kernel.size()
+					|| len > daemon_max_pcm_length * 2000.0) {
+				c->out += "ERR invalid PCM length\n";
+				c->closing = true;
+				return (false);
+			}
+			if (c->in.size() < nl + 1 + len * sizeof(int16_t)) {
+				return (false); // the samples are still coming
+			}
+			request->fd = fd;
+			request->record.clear();
+			request->pcm.resize(len);
+			memcpy(&request->pcm[0], c->in.data() + nl + 1,
+					len * sizeof(int16_t));
+			c->in.erase(0, nl + 1 + len * sizeof(int16_t));
+			request->t0 = stage_clock();
+			return (true);
+		}
+
+		c->in.erase(0, nl + 1);
+		c->out += "ERR unknown request\n";
+	}
+	return (false);
+}
+
+/**
+ * Read what a client sent
+ *
+ * @param Socket of the client
+ * @param Pointer to the client
+ * @return Zero unless the connection failed
+ */
+static int receive(int const &fd, struct daemon_client *c) {
+	char buf[64 * 1024];
+	for (;;) {
+		ssize_t const n = recv(fd, buf, sizeof(buf), 0);
+		if (n > 0) {
+			c->in.append(buf, n);
+			if (c->busy) { // the next request is read after the reply
+				return (0);
+			}
+			continue;
+		}
+		if (n == 0) {
+			c->eof = true;
+			return (0);
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		return (errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1);
+	}
+}
+
+/**
+ * Send the replies to a client, as much as the socket takes
+ *
+ * @param Socket of the client
+ * @param Pointer to the client
+ * @return Zero unless the connection failed, the client may have gone already
+ */
+static int send_replies(int const &fd, struct daemon_client *c) {
+	while (c->out.size()) {
+		ssize_t const n = send(fd, c->out.data(), c->out.size(),
+				MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return (errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1);
+		}
+		c->out.erase(0, n);
+	}
+	return (0);
+}
+
+/**
+ * Classification daemon on a Unix domain stream socket
+ *
+ * The kernel and the classification trees are loaded once, the filter and
+ * window caches are memoized by the first request. The accepting thread
+ * polls all the connections and hands each whole request to the pool, so
+ * the workers are busy only while classifying and any number of idle
+ * connections cost no thread. A connection has one request in the pool at a
+ * time and its replies come in request order, see next_request(); concurrent
+ * requests need a connection each. SIGINT and SIGTERM stop accepting, wait for
+ * the requests being classified, hang up the clients and remove the socket.
+ *
+ * @param Convolution kernel filename
+ * @param Socket path
+ * @param Number of worker threads, zero for the number of cores
+ * @return Zero on clean shutdown
+ */
+int serve(char const *convolution_kernel, char const *socket_path,
+		size_t const &_threads) {
+	size_t threads = _threads ? _threads : std::thread::hardware_concurrency();
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	Trigger::Csv2kernel kernel(convolution_kernel);
+	struct classifier_trees trees;
+	if (load_classifier_trees(&trees)) {
+		free_classifier_trees(&trees);
+		return (EXIT_FAILURE);
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		PERROR("socket path");
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	int const sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+			0);
+	if (sock < 0) {
+		PERROR("socket");
+	}
+
+	// replace a stale socket, but nothing else
+	{
+		struct stat sb;
+		if (stat(socket_path, &sb) == 0 && S_ISSOCK(sb.st_mode)) {
+			unlink(socket_path);
+		}
+	}
+
+	if (bind(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))) {
+		PERROR("bind");
+	}
+	if (listen(sock, daemon_listen_backlog)) {
+		PERROR("listen");
+	}
+
+	// woken by the workers with replies and by the signals
+	int wakeup[2];
+	if (pipe2(wakeup, O_CLOEXEC | O_NONBLOCK)) {
+		PERROR("pipe2");
+	}
+	daemon_wakeup = wakeup[1];
+
+	{
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = daemon_signal;
+		sigaction(SIGINT, &sa, 0);
+		sigaction(SIGTERM, &sa, 0);
+	}
+
+	std::mutex mutex; // guards requests, replies and stopping
+	std::condition_variable request_ready;
+	std::deque<struct daemon_request> requests;
+	std::deque<std::pair<int, std::string> > replies; // to the clients
+	bool stopping = false;
+
+	auto worker = [&]() {
+		for (;;) {
+			struct daemon_request request;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				request_ready.wait(lock, [&] {
+					return stopping || requests.size();
+				});
+				if (stopping) {
+					return;
+				}
+				request = std::move(requests.front());
+				requests.pop_front();
+			}
+
+			std::string line = run_request(request, kernel, trees);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				replies.push_back(std::make_pair(request.fd, std::move(line)));
+			}
+			ssize_t const n = write(wakeup[1], "", 1);
+			(void) n;
+		}
+	};
+
+	// the signals go to the polling thread only
+	std::vector<std::thread> pool;
+	{
+		sigset_t set, old;
+		sigemptyset(&set);
+		sigaddset(&set, SIGINT);
+		sigaddset(&set, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &set, &old);
+		for (size_t i = 0; i < threads; ++i) {
+			pool.push_back(std::thread(worker));
+		}
+		pthread_sigmask(SIG_SETMASK, &old, 0);
+	}
+
+	printf("daemon: listening on %s, %lu threads\n", socket_path, threads);
+	fflush(stdout);
+
+	std::map<int, struct daemon_client> clients;
+	std::vector<struct pollfd> fds;
+	while (!daemon_stop) {
+		fds.clear();
+		struct pollfd const listening = { sock, POLLIN, 0 };
+		struct pollfd const woken = { wakeup[0], POLLIN, 0 };
+		fds.push_back(listening);
+		fds.push_back(woken);
+		for (std::map<int, struct daemon_client>::iterator it =
+				clients.begin(); it != clients.end(); ++it) {
+			struct daemon_client const &c = it->second;
+			struct pollfd const p = { it->first, static_cast<short>(
+					(c.busy || c.eof || c.closing ? 0 : POLLIN)
+							| (c.out.size() ? POLLOUT : 0)), 0 };
+			fds.push_back(p);
+		}
+
+		if (poll(&fds[0], fds.size(), -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "[%s:%u] %s: %s\n", __FILE__, __LINE__, "poll",
+					strerror(errno));
+			break;
+		}
+
+		if (fds[1].revents) {
+			char buf[256];
+			while (read(wakeup[0], buf, sizeof(buf)) > 0)
+				;
+			std::lock_guard<std::mutex> lock(mutex);
+			for (; replies.size(); replies.pop_front()) {
+				struct daemon_client &c = clients[replies.front().first];
+				c.busy = false;
+				c.out += replies.front().second;
+			}
+		}
+
+		for (size_t i = 2; i < fds.size(); ++i) {
+			int const fd = fds[i].fd;
+			struct daemon_client &c = clients[fd];
+			if ((fds[i].revents & POLLIN) && receive(fd, &c)) {
+				c.closing = true;
+				c.out.clear();
+			} else if ((fds[i].revents & (POLLHUP | POLLERR))
+					&& !(fds[i].revents & POLLIN)) {
+				c.eof = true;
+			}
+		}
+
+		if (fds[0].revents & POLLIN) {
+			for (;;) {
+				int const fd = accept4(sock, 0, 0,
+						SOCK_CLOEXEC | SOCK_NONBLOCK);
+				if (fd < 0) {
+					if (errno == EINTR || errno == ECONNABORTED) {
+						continue;
+					}
+					if (errno != EAGAIN && errno != EWOULDBLOCK) {
+						fprintf(stderr, "[%s:%u] %s: %s\n", __FILE__, __LINE__,
+								"accept", strerror(errno));
+					}
+					break;
+				}
+				clients[fd] = daemon_client();
+			}
+		}
+
+		// hand the whole requests to the pool, send the replies, hang up
+		for (std::map<int, struct daemon_client>::iterator it =
+				clients.begin(); it != clients.end();) {
+			int const fd = it->first;
+			struct daemon_client &c = it->second;
+			if (!c.busy) {
+				struct daemon_request request;
+				if (next_request(fd, &c, kernel, &request)) {
+					std::lock_guard<std::mutex> lock(mutex);
+					requests.push_back(std::move(request));
+					request_ready.notify_one();
+					c.busy = true;
+				}
+			}
+			if (send_replies(fd, &c)) {
+				c.closing = true;
+				c.out.clear();
+			}
+			if (!c.busy && c.out.empty() && (c.closing || c.eof)) {
+				close(fd);
+				clients.erase(it++);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	close(sock);
+	unlink(socket_path);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		requests.clear();
+		request_ready.notify_all();
+	}
+	for (size_t i = 0; i < pool.size(); ++i) {
+		pool[i].join();
+	}
+	for (std::map<int, struct daemon_client>::iterator it = clients.begin();
+			it != clients.end(); ++it) {
+		close(it->first);
+	}
+	daemon_wakeup = -1;
+	close(wakeup[0]);
+	close(wakeup[1]);
+
+	free_classifier_trees(&trees);
+
+	printf("daemon: stopped\n");
+	return (0);
+}
@@ -0,0 +1,19 @@
+/**
+ * tftrig_daemon.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_TFTRIG_DAEMON_H_
+#define SRC_TFTRIG_DAEMON_H_
+
+#include <cstdio>
+
+static double constexpr daemon_max_pcm_length = 3600.0; // seconds
+static int constexpr daemon_listen_backlog = 64;
+
+int serve(char const *convolution_kernel, char const *socket_path,
+		size_t const &threads);
+
+#endif /* SRC_TFTRIG_DAEMON_H_ */
@@ -0,0 +1,204 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * tftrig_embed.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ * Build time generator of the assets compiled into the binaries, see
+ * Utils::embedded_assets and make ASSETS=embedded
+ *
+ * The assets are built by the very code that builds them at run time, so
+ * the embedded kernel, trees, Blackman window and Chebyshev coefficients
+ * are bit for bit the ones a file based build would use.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unistd.h>
+
+#include "macro.h"
+
+#include "utils/memory_manager.h"
+#include "myDSP/Iir.h"
+#include "Simplified/Retrigger.h"
+#include "utils/AssetCache.h"
+#include "tftrig_classify.h"
+
+/*
+ * An asset of the memo, see Utils::for_each_asset()
+ */
+struct embed_asset {
+	std::string kind;
+	uint32_t kind_version;
+	std::string key;
+	std::string payload;
+
+	bool operator<(struct embed_asset const &a) const {
+		return kind != a.kind ? kind < a.kind :
+				kind_version != a.kind_version ?
+						kind_version < a.kind_version : key < a.key;
+	}
+};
+
+/**
+ * Get the Chebyshev coefficients of a bandpass filter by running it once
+ *
+ * @param Low cut-off frequency
+ * @param High cut-off frequency
+ * @param Sampling frequency
+ */
+static void embed_bandpass(float const low_freq, float const high_freq,
+		float const sample_freq) {
+	float const in[1] = { 0 };
+	float *out = 0;
+	DSP::Iir iir;
+	iir.bandpass(&out, in, 1, low_freq, high_freq, 0.5, 4, sample_freq);
+	mm_free(out);
+}
+
+/**
+ * Write a blob as a constexpr array, reusing the array of an equal blob
+ *
+ * @param Output
+ * @param Blob
+ * @param Names of the arrays written so far, by contents
+ * @return Name of the array
+ */
+static std::string const &embed_blob(FILE *f, std::string const &blob,
+		std::map<std::string, std::string> *names) {
+	std::map<std::string, std::string>::const_iterator it = names->find(blob);
+	if (it != names->end()) {
+		return it->second;
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "blob_%lu", names->size());
+
+	// aligned like a payload of Utils::get_asset()
+	fprintf(f, "alignas(64) static unsigned char constexpr %s[] = {", name);
+	for (size_t i = 0; i < blob.size(); ++i) {
+		fprintf(f, "%s0x%02x,", i % 16 ? " " : "\n\t",
+				static_cast<unsigned char>(blob[i]));
+	}
+	fprintf(f, "%s};\n\n", blob.size() ? "\n" : " 0 ");
+	return (*names)[blob] = name;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 4) {
+		fprintf(stderr,
+				"[%s:%u] usage: %s <output.cpp> <kernel.csv> <params directory>\n",
+				__FILE__, __LINE__, argv[0]);
+		exit (EXIT_FAILURE);
+	}
+	char const *kernel_name = argv[2], *params_dir = argv[3];
+
+	std::vector<std::string> source_names, sources;
+	std::vector<struct embed_asset> assets;
+	try {
+		// the sources, under the names the binaries will read them by
+		source_names.push_back(kernel_name);
+		char const *trees[] = { "s1s2.txt", "ev.txt", "rest.txt" };
+		for (size_t i = 0; i < sizeof(trees) / sizeof(*trees); ++i) {
+			source_names.push_back(std::string(params_dir) + "/" + trees[i]);
+		}
+		sources.resize(source_names.size());
+		for (size_t i = 0; i < sources.size(); ++i) {
+			Utils::read_source(source_names[i].c_str(), &sources[i]);
+		}
+
+		// build every asset a classification gets, the trees compile with
+		// the filters of their markers
+		Trigger::Csv2kernel const kernel(kernel_name);
+		struct classifier_trees classifier;
+		if (load_classifier_trees(&classifier, params_dir)) {
+			exit (EXIT_FAILURE);
+		}
+		Simplified::Retrigger const retrig(0.25); // of classify_signal()
+		embed_bandpass(10.0, 500.0, Simplified::Retrigger::sample_freq);
+		free_classifier_trees(&classifier);
+
+		Utils::for_each_asset(
+				[&assets](char const *kind, uint32_t const &kind_version,
+						std::string const &key, struct Utils::asset const &a) {
+					struct embed_asset e;
+					e.kind = kind;
+					e.kind_version = kind_version;
+					e.key = key;
+					e.payload.assign(static_cast<char const *>(a.data), a.len);
+					assets.push_back(e);
+				});
+	} catch (int e) {
+		exit (EXIT_FAILURE);
+	}
+	std::sort(assets.begin(), assets.end());
+
+	std::string const tmp = std::string(argv[1]) + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "w");
+	if (f == 0) {
+		fprintf(stderr, "[%s:%u] %s: %s\n", __FILE__, __LINE__, tmp.c_str(),
+				strerror(errno));
+		exit (EXIT_FAILURE);
+	}
+	fprintf(f, "/*\n * %s\n *\n * Generated by tftrig_embed from %s and %s, do not edit\n */\n\n",
+			argv[1], kernel_name, params_dir);
+	fprintf(f, "#include \"utils/AssetCache.h\"\n\nnamespace Utils {\n\n");
+
+	std::map<std::string, std::string> names;
+	std::vector<std::string> source_blobs, key_blobs, payload_blobs;
+	for (size_t i = 0; i < sources.size(); ++i) {
+		source_blobs.push_back(embed_blob(f, sources[i], &names));
+	}
+	for (size_t i = 0; i < assets.size(); ++i) {
+		key_blobs.push_back(embed_blob(f, assets[i].key, &names));
+		payload_blobs.push_back(embed_blob(f, assets[i].payload, &names));
+	}
+
+	fprintf(f, "extern struct embedded_source const embedded_sources[] = {\n");
+	for (size_t i = 0; i < sources.size(); ++i) {
+		fprintf(f, "\t{ \"%s\", %s, %lu },\n", source_names[i].c_str(),
+				source_blobs[i].c_str(), sources[i].size());
+	}
+	fprintf(f, "\t{ 0, 0, 0 } };\n\n");
+
+	fprintf(f, "extern struct embedded_asset const embedded_assets[] = {\n");
+	for (size_t i = 0; i < assets.size(); ++i) {
+		fprintf(f, "\t{ \"%s\", %u, %s, %lu, %s, %lu },\n",
+				assets[i].kind.c_str(), assets[i].kind_version,
+				key_blobs[i].c_str(), assets[i].key.size(),
+				payload_blobs[i].c_str(), assets[i].payload.size());
+	}
+	fprintf(f, "\t{ 0, 0, 0, 0, 0, 0 } };\n\n} /* namespace Utils */\n");
+
+	if (fclose(f) || rename(tmp.c_str(), argv[1])) {
+		fprintf(stderr, "[%s:%u] %s: %s\n", __FILE__, __LINE__, argv[1],
+				strerror(errno));
+		unlink(tmp.c_str());
+		exit (EXIT_FAILURE);
+	}
+	fprintf(stderr, "embed: %lu sources, %lu assets\n", sources.size(),
+			assets.size());
+	return 0;
+}
@@ -0,0 +1,142 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrig_feed.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ *
+ * A reference producer for the shared memory ingest ring, see tftrig_final -r
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "macro.h"
+
+#include "Simplified/PhysionetChallenge2016.h"
+#include "Simplified/ShmRing.h"
+#include "Simplified/WavFile.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Copy a 16 bit 2000 Hz record from its mapped file to its ring slot
+ *
+ * @param Record name, eg. a0123 for a0123.wav
+ * @param Pointer to the slot
+ * @param Slot capacity in samples
+ * @return Number of samples copied
+ */
+static size_t read_record(char const *basename, int16_t *slot,
+		size_t const &slot_samples) {
+	char filename[FILENAME_MAX];
+	snprintf(filename, sizeof(filename), "%s.wav", basename);
+
+	Signal::WavFile wav(filename);
+	struct Signal::wav_format const &format = wav.get_format();
+	if (format.format_tag != Signal::WAV_FORMAT_PCM || format.channels != 1
+			|| format.bits_per_sample != 16
+			|| format.sample_rate != Signal::PhysionetChallenge2016::sample_freq) {
+		errno = EINVAL;
+		PERROR(filename);
+	}
+
+	size_t const len = wav.size() < slot_samples ? wav.size() : slot_samples;
+	memcpy(slot, wav.get_data(), len * sizeof(int16_t));
+	return len;
+}
+
+static void print_answer(Signal::ShmRing const &ring,
+		std::vector<std::string> const &names, uint32_t const &seq) {
+	printf("%s,%i\n", names[seq % names.size()].c_str(), ring.get_answer(seq));
+}
+
+int main(int argc, char *argv[]) {
+	size_t repeat = 1;
+
+	for (int c; (c = getopt(argc, argv, "n:")) != -1;) {
+		switch (c) {
+		case 'n':
+			repeat = atoi(optarg);
+			break;
+		default:
+			exit (EXIT_FAILURE);
+		}
+	}
+
+	if (argc - optind < 2) {
+		fprintf(stderr,
+				"[%s:%u] usage: %s [-n repeat] <ring name, eg. /tftrig> <file base id, eg. a0123>...\n",
+				__FILE__, __LINE__, argv[0]);
+		exit (EXIT_FAILURE);
+	}
+
+	try {
+		Signal::ShmRing ring(argv[optind]);
+		std::vector<std::string> names(ring.get_slots());
+
+		double const t0 = now();
+		size_t samples = 0;
+		uint32_t seq = 0;
+		for (size_t n = 0; n < repeat; ++n) {
+			for (int i = optind + 1; i < argc; ++i, ++seq) {
+				while (!ring.wait_free(seq, 1.0)) {
+				}
+
+				// the previous record of the slot has been answered
+				if (seq >= ring.get_slots()) {
+					print_answer(ring, names, seq - ring.get_slots());
+				}
+
+				size_t const len = read_record(argv[i], ring.get_slot(seq),
+						ring.get_slot_samples());
+				names[seq % names.size()] = argv[i];
+				ring.publish(seq, len, argv[i]);
+				samples += len;
+			}
+		}
+		ring.close();
+
+		while (ring.get_tail() != seq) {
+			ring.wait_free(seq + ring.get_slots() - 1, 1.0);
+		}
+		for (uint32_t i = seq > ring.get_slots() ? seq - ring.get_slots() : 0;
+				i < seq; ++i) {
+			print_answer(ring, names, i);
+		}
+
+		double const t = now() - t0;
+		fprintf(stderr, "feed: %u records, %.1f s of signal in %.3f s\n", seq,
+				samples / 2000.0, t);
+	} catch (int e) {
+		exit (EXIT_FAILURE);
+	}
+	return 0;
+}
@@ -23,96 +23,172 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <climits>
 #include <unistd.h>
 #include <sys/types.h>
 #include <pwd.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <thread>
 
 #include "macro.h"
 
 #include "Trigger/Csv2kernel.h"
-#include "Trigger/Trigger.h"
-#include "Simplified/Retrigger.h"
-#include "Simplified/PhysionetChallenge2016.h"
-#include "myDSP/Iir.h"
 #include "Classifier/classifier.h"
+#include "tftrig_live.h"
+#include "tftrig_batch.h"
+#include "tftrig_daemon.h"
+#include "tftrig_ingest.h"
+
+static void usage(char const *name) {
+	fprintf(stderr,
+			"[%s:%u] usage: %s <trigger convolution kernel.csv> <file base id, eg. a0123>\n"
+			"       %s <trigger convolution kernel.csv> <- or FIFO> [verdict interval in seconds]\n"
+			"       %s <trigger convolution kernel.csv> -b <record list, directory, .zip or .tfc> [-j threads] [-m memory budget in MB] [-p records to read ahead]\n"
+			"       %s <trigger convolution kernel.csv> -d <socket path> [-j threads]\n"
+			"       %s <trigger convolution kernel.csv> -r <shared memory ring, eg. /tftrig> [-j threads]\n",
+			__FILE__, __LINE__, name, name, name, name, name);
+	exit (EXIT_FAILURE);
+}
 
-int main(int argc, char *argv[]) {
-	if (argc < 3) {
-		fprintf(stderr,
-				"[%s:%u] usage: %s <trigger convolution kernel.csv> <file base id, eg. a0123>\n",
-				__FILE__, __LINE__, argv[0]);
-		exit (EXIT_FAILURE);
+/**
+ * Parse a decimal count option
+ *
+ * @param Option argument
+ * @param Largest accepted value
+ * @param Pointer to output value
+ * @return Zero if the argument is a number from 0 to max, nothing else
+ */
+static int parse_count(char const *arg, unsigned long const &max,
+		size_t *value) {
+	if (!isdigit(static_cast<unsigned char>(*arg))) { // no sign, no blanks
+		return (-1);
 	}
+	char *end;
+	errno = 0;
+	unsigned long const n = strtoul(arg, &end, 10);
+	if (errno || *end || n > max) {
+		return (-1);
+	}
+	*value = n;
+	return (0);
+}
 
-	char const *convolution_kernel = argv[1];
-	char const *data_filename = argv[2];
-
-	clock_t ref = clock();
-
-	Signal::PhysionetChallenge2016 dat(data_filename);
-	printf("data: %s\n", data_filename);
-
-	Classifier::result_e result = Classifier::unknown;
-	Simplified::Retrigger retrig(0.25);
-
-	// A bit inconsistent naming convention.. these are required to get the energy signal
-	Trigger::Csv2kernel kernel(convolution_kernel);
-	retrig.set_convolution_kernel(kernel.get_data(), kernel.size());
-
-	retrig.set_data(dat.get_signal(), dat.size());
-	cl_float const *energy = retrig.get_energy();
+int main(int argc, char *argv[]) {
+	char const *list = 0;
+	char const *socket_path = 0;
+	char const *ring_name = 0;
+	size_t threads = 0;
+	size_t memory_budget = 1024;
+	long prefetch = -1; // Wav files read ahead, two per thread by default
+
+	for (int c; (c = getopt(argc, argv, "b:d:j:m:p:r:")) != -1;) {
+		switch (c) {
+		case 'b':
+			list = optarg;
+			break;
+		case 'd':
+			socket_path = optarg;
+			break;
+		case 'j':
+			if (parse_count(optarg, 4096, &threads)) {
+				fprintf(stderr, "-j: threads must be from 0 to 4096\n");
+				usage(argv[0]);
+			}
+			break;
+		case 'r':
+			ring_name = optarg;
+			break;
+		case 'm':
+			if (parse_count(optarg, SIZE_MAX >> 20, &memory_budget)) {
+				fprintf(stderr, "-m: memory budget must be from 0 to %lu MB\n",
+						static_cast<unsigned long>(SIZE_MAX >> 20));
+				usage(argv[0]);
+			}
+			break;
+		case 'p': {
+			size_t n;
+			if (parse_count(optarg, 65536, &n)) {
+				fprintf(stderr, "-p: records to read ahead must be from 0 to 65536\n");
+				usage(argv[0]);
+			}
+			prefetch = n;
+			break;
+		}
+		default:
+			usage(argv[0]);
+		}
+	}
 
-	// A simple minmaxminmax trigger, will fire both on S1 and S2
-	Accbpm::Trigger trig(energy, dat.size(), 2000.0);
-	try {
-		ref_ev const &ev = trig.get_events();
-		printf("trigged %lu events\n", ev.size());
+	if (argc - optind < (list || socket_path || ring_name ? 1 : 2)) {
+		usage(argv[0]);
+	}
 
-		retrig.set_ref_ev(ev);
-		retrig.set_correlation_window(0.25, 0.125);
-		retrig.set_lookaround_window(0.05, 0.025);
+	char const *convolution_kernel = argv[optind];
 
-		// auto correlate, jut for fun!
-		retrig.calc_correlations(0.8);
-	} catch (int e) {
-		exit (EXIT_FAILURE);
+	// batch mode; records from a list file or a directory
+	if (list) {
+		try {
+			size_t const cores =
+					threads ? threads : std::thread::hardware_concurrency();
+			return batch(convolution_kernel, list, threads,
+					memory_budget << 20,
+					prefetch < 0 ? 2 * (cores ? cores : 1) : prefetch);
+		} catch (int e) {
+			exit (EXIT_FAILURE);
+		}
 	}
 
-	{
-		struct data data = { };
-		data.sample_freq = 2000.0;
-		data.number_of_channels = 1;
-		data.samples_per_channel = dat.size();
-
-		struct data_channel data_ch[data.number_of_channels];
-		memset(&data_ch, 0, sizeof(data_ch));
-		data_ch[0].raw = dat.get_signal();
+	// daemon mode; requests over a Unix domain socket
+	if (socket_path) {
+		try {
+			return serve(convolution_kernel, socket_path, threads);
+		} catch (int e) {
+			exit (EXIT_FAILURE);
+		}
+	}
 
-		data.ch = data_ch;
+	// shared memory ingest; records from a co-located capture process
+	if (ring_name) {
 		try {
-			Simplified::retrig_ev const &ev1 = retrig.get_s1_events();
-			Simplified::retrig_ev const &ev2 = retrig.get_s2_events();
-			printf(
-					"got %lu S1 events and %lu S2 events after auto correlation\n",
-					ev1.size(), ev2.size());
-
-			result = Classifier::classify_this(&data, &ev1, &ev2,
-					"params/s1s2.txt");
+			return ingest(convolution_kernel, ring_name, threads);
 		} catch (int e) {
-			Simplified::retrig_ev const &ev = retrig.get_events();
-			printf("got %lu events after auto correlation\n", ev.size());
-
-			if (ev.size()) {
-				result = Classifier::classify_this(&data, &ev, 0,
-						"params/ev.txt");
-			} else {
-				result = Classifier::classify_this(&data, 0, 0,
-						"params/rest.txt");
+			exit (EXIT_FAILURE);
+		}
+	}
+
+	char const *data_filename = argv[optind + 1];
+
+	// live mode; raw PCM from stdin or a FIFO
+	{
+		struct stat sb;
+		if (strcmp(data_filename, "-") == 0
+				|| (stat(data_filename, &sb) == 0 && S_ISFIFO(sb.st_mode))) {
+			try {
+				return live(convolution_kernel, data_filename,
+						argc - optind > 2 ? atof(argv[optind + 2]) : 5.0);
+			} catch (int e) {
+				exit (EXIT_FAILURE);
 			}
+		}
+	}
+
+	clock_t ref = clock();
 
+	Classifier::result_e result = Classifier::unknown;
+	try {
+		Trigger::Csv2kernel kernel(convolution_kernel);
+		struct classifier_trees trees;
+		if (load_classifier_trees(&trees)) {
+			exit (EXIT_FAILURE);
 		}
+
+		result = classify_record(data_filename, kernel, trees);
+		free_classifier_trees(&trees);
+	} catch (int e) {
+		exit (EXIT_FAILURE);
 	}
 
 	{
@@ -139,17 +215,7 @@ int main(int argc, char *argv[]) {
 			return errno;
 		}
 
-		int r = 0;
-		switch (result) {
-		case Classifier::abnormal:
-			r = 1;
-			break;
-		case Classifier::normal:
-			r = -1;
-			break;
-		}
-
-		fprintf(f, "%s,%i\n", data_filename, r);
+		fprintf(f, "%s,%i\n", data_filename, answer(result));
 
 		fclose(f);
 	}
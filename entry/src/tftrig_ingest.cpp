@@ -0,0 +1,202 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrig_ingest.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "macro.h"
+
+#include "Trigger/Csv2kernel.h"
+#include "Simplified/PhysionetChallenge2016.h"
+#include "Simplified/ShmRing.h"
+#include "Classifier/classifier.h"
+
+#include "tftrig_batch.h"
+#include "tftrig_ingest.h"
+
+static volatile sig_atomic_t ingest_stop = 0;
+
+static void ingest_signal(int) {
+	ingest_stop = 1;
+}
+
+struct ingest_result {
+	bool done;
+	bool ok;
+	int answer;
+};
+
+/**
+ * Classify the records of a capture process from a shared memory ring
+ *
+ * The ring is created here, see Signal::ShmRing. The workers claim the
+ * records in sequence and convert the PCM straight from the shared slots.
+ * The slots are released in sequence, so the answers are appended to
+ * answers.txt in the order the records were published. Runs until the
+ * producer closes the ring, or SIGINT or SIGTERM.
+ *
+ * @param Convolution kernel filename
+ * @param Shared memory object name, eg. /tftrig
+ * @param Number of worker threads, zero for the number of cores
+ * @return Zero if all records were classified
+ */
+int ingest(char const *convolution_kernel, char const *ring_name,
+		size_t const &_threads) {
+	size_t threads = _threads ? _threads : std::thread::hardware_concurrency();
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	Trigger::Csv2kernel kernel(convolution_kernel);
+	struct classifier_trees trees;
+	if (load_classifier_trees(&trees)) {
+		free_classifier_trees(&trees);
+		return (EXIT_FAILURE);
+	}
+
+	FILE *f = fopen("answers.txt", "a");
+	if (f == 0) {
+		PERROR("fopen");
+	}
+
+	Signal::ShmRing ring(ring_name, ingest_slots,
+			ingest_slot_length * 2000.0);
+
+	{
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = ingest_signal;
+		sigaction(SIGINT, &sa, 0);
+		sigaction(SIGTERM, &sa, 0);
+	}
+
+	std::mutex mutex; // guards next, tail, results and the answers
+	std::vector<struct ingest_result> results(ring.get_slots());
+	uint32_t next = 0, tail = 0;
+	size_t records = 0, failed = 0;
+
+	auto worker = [&]() {
+		for (;;) {
+			uint32_t seq;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				seq = next++;
+			}
+
+			bool ready;
+			while (!(ready = ring.wait_published(seq, 0.1)) && !ingest_stop
+					&& !ring.is_closed()) {
+			}
+			if (!ready || ingest_stop) {
+				return;
+			}
+
+			char name[sizeof(Signal::shm_ring_slot::name)];
+			ring.get_name(seq, name, sizeof(name));
+			double const t0 = stage_clock();
+			struct stage_times times = { };
+			Classifier::result_e result = Classifier::unknown;
+			bool ok = true;
+			try {
+				size_t const len = ring.get_len(seq);
+				if (len < kernel.size() || len > ring.get_slot_samples()) {
+					errno = EINVAL;
+					throw errno;
+				}
+
+				// no copy; converted from the shared pages to the pipeline input
+				Signal::PhysionetChallenge2016 dat(ring.get_pcm(seq), len);
+				times.load = stage_clock() - t0;
+
+				result = classify_signal(dat.get_signal(), dat.size(), kernel,
+						trees, &times);
+			} catch (int e) {
+				fprintf(stderr, "[%s:%u] %s: failed (%s)\n", __FILE__, __LINE__,
+						name, strerror(e));
+				ok = false;
+			}
+
+			printf(
+					"ingest: %s %i load=%.3f energy=%.3f trigger=%.3f correlate=%.3f classify=%.3f total=%.3f\n",
+					name, answer(result), times.load, times.energy,
+					times.trigger, times.correlate, times.classify,
+					stage_clock() - t0);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			struct ingest_result &r = results[seq % results.size()];
+			r.done = true;
+			r.ok = ok;
+			r.answer = answer(result);
+
+			// release in sequence, the producer reuses the slots
+			for (; tail != next && results[tail % results.size()].done; ++tail) {
+				struct ingest_result &t = results[tail % results.size()];
+				if (t.ok) {
+					fprintf(f, "%s,%i\n",
+							ring.get_name(tail, name, sizeof(name)), t.answer);
+				} else {
+					++failed;
+				}
+				++records;
+				t.done = false;
+				ring.release(tail, t.answer);
+			}
+			fflush(f);
+		}
+	};
+
+	printf("ingest: ring %s, %lu slots of %lu samples, %lu threads\n",
+			ring_name, ring.get_slots(), ring.get_slot_samples(), threads);
+	fflush(stdout);
+
+	// the signals go to the main thread only
+	std::vector<std::thread> pool;
+	{
+		sigset_t set, old;
+		sigemptyset(&set);
+		sigaddset(&set, SIGINT);
+		sigaddset(&set, SIGTERM);
+		pthread_sigmask(SIG_BLOCK, &set, &old);
+		for (size_t i = 0; i < threads; ++i) {
+			pool.push_back(std::thread(worker));
+		}
+		pthread_sigmask(SIG_SETMASK, &old, 0);
+	}
+	for (size_t i = 0; i < pool.size(); ++i) {
+		pool[i].join();
+	}
+
+	fclose(f);
+	free_classifier_trees(&trees);
+
+	printf("ingest: %lu records, %lu failed\n", records, failed);
+	return failed ? EXIT_FAILURE : 0;
+}
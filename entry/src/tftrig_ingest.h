@@ -0,0 +1,19 @@
+/**
+ * tftrig_ingest.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_TFTRIG_INGEST_H_
+#define SRC_TFTRIG_INGEST_H_
+
+#include <cstdio>
+
+static size_t constexpr ingest_slots = 8;
+static double constexpr ingest_slot_length = 600.0; // seconds
+
+int ingest(char const *convolution_kernel, char const *ring_name,
+		size_t const &threads);
+
+#endif /* SRC_TFTRIG_INGEST_H_ */
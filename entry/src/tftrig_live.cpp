@@ -0,0 +1,263 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrig_live.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "macro.h"
+
+#include "Trigger/Csv2kernel.h"
+#include "Trigger/StreamTrigger.h"
+#include "Simplified/EnergyStream.h"
+#include "Simplified/Clusters.h"
+#include "Simplified/PcmStream.h"
+#include "Classifier/classifier.h"
+#include "utils/memory_manager.h"
+
+#include "tftrig_live.h"
+
+static double now(clockid_t const clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Copy the events within a window
+ *
+ * @param Events
+ * @param Window offset in samples
+ * @param Window length in samples
+ * @return Events relative to the window
+ */
+static Simplified::retrig_ev window_events(Simplified::retrig_ev const &ev,
+		size_t const &origin, size_t const &len) {
+	Simplified::retrig_ev _ev;
+	for (Simplified::retrig_ev_it it = ev.begin(); it != ev.end(); ++it) {
+		if (it->offset >= origin && it->offset < origin + len) {
+			struct retrig_event e = *it;
+			e.offset -= origin;
+			_ev.push_back(e);
+		}
+	}
+	return _ev;
+}
+
+/**
+ * Classify the signal window with the current clusters
+ *
+ * @param Pointer to the signal window
+ * @param Window offset in samples
+ * @param Window length in samples
+ * @param Current clusters
+ * @param Pointers to output event counts of S1, S2 and EV clusters
+ * @return Classifier result; normal, abnormal or unknown
+ */
+static Classifier::result_e classify_window(data_raw_t *raw,
+		size_t const &origin, size_t const &len,
+		Simplified::Clusters const &clusters, size_t n[3]) {
+	struct data data = { };
+	data.sample_freq = 2000.0;
+	data.number_of_channels = 1;
+	data.samples_per_channel = len;
+
+	struct data_channel data_ch[data.number_of_channels];
+	memset(&data_ch, 0, sizeof(data_ch));
+	data_ch[0].raw = raw;
+	data.ch = data_ch;
+
+	Simplified::retrig_ev ev1, ev2, ev;
+	try {
+		ev1 = window_events(clusters.get_s1_events(), origin, len);
+		ev2 = window_events(clusters.get_s2_events(), origin, len);
+	} catch (int e) {
+		ev = window_events(clusters.get_events(), origin, len);
+	}
+
+	n[0] = ev1.size();
+	n[1] = ev2.size();
+	n[2] = ev.size();
+
+	if (ev1.size() && ev2.size()) {
+		return Classifier::classify_this(&data, &ev1, &ev2, "params/s1s2.txt");
+	}
+	if (ev1.size()) {
+		ev.swap(ev1);
+	}
+	if (ev.size()) {
+		return Classifier::classify_this(&data, &ev, 0, "params/ev.txt");
+	}
+	return Classifier::classify_this(&data, 0, 0, "params/rest.txt");
+}
+
+/**
+ * Live classification of raw PCM from stdin or a FIFO
+ *
+ * The energy, trigger and clustering stages run on every block. A verdict of
+ * the last live_window_length seconds is printed every interval seconds.
+ * CPU time is budgeted per block: unused budget accumulates up to one interval
+ * and the optional work, the verdicts and the full reclusterings, is deferred
+ * while the budget is overdrawn. Each verdict is stamped with its latency from
+ * the arrival of the newest block in wall clock time.
+ *
+ * @param Convolution kernel filename
+ * @param Source filename, - for stdin
+ * @param Verdict interval in seconds
+ * @return Zero on success
+ */
+int live(char const *convolution_kernel, char const *source,
+		double const &interval) {
+	double const sample_freq = 2000.0;
+	size_t const block_len = live_block_length * sample_freq;
+	size_t const window_len = live_window_length * sample_freq;
+	size_t const interval_len =
+			interval * sample_freq > 1 ? interval * sample_freq : 1;
+
+	int fd = STDIN_FILENO;
+	if (strcmp(source, "-")) {
+		fd = open(source, O_RDONLY);
+		if (fd < 0) {
+			PERROR("open");
+		}
+	}
+
+	setvbuf(stdout, 0, _IOLBF, 0);
+
+	Trigger::Csv2kernel kernel(convolution_kernel);
+
+	Simplified::EnergyStream energy(0.25, live_block_length);
+	energy.set_convolution_kernel(kernel.get_data(), kernel.size());
+
+	Accbpm::StreamTrigger trig(sample_freq);
+
+	size_t const window_size = window_len + Signal::PcmStream::calibration_len
+			+ block_len;
+
+	// the clusters keep the events of the signal window
+	Simplified::Clusters clusters(0.25, 0.8, 20.0, window_size / sample_freq);
+	clusters.set_convolution_kernel(kernel.get_data(), kernel.size());
+	clusters.set_correlation_window(0.25, 0.125);
+	clusters.set_lookaround_window(0.05, 0.025);
+
+	Signal::PcmStream pcm(fd, block_len);
+
+	// the last window_len samples; window[0] is the sample at origin
+	data_raw_t *window = static_cast<data_raw_t *>(mm_malloc(
+			window_size * sizeof(data_raw_t)));
+	size_t origin = 0, window_n = 0;
+
+	printf("live: %s, verdict every %.1f s, pipeline lag %.2f s\n", source,
+			interval,
+			(energy.get_latency() + trig.get_latency()) / sample_freq);
+
+	double const budget_per_sample = live_cpu_budget / sample_freq;
+	double const max_credit = budget_per_sample * interval_len;
+	double credit = 0.0, cpu_ref = now(CLOCK_PROCESS_CPUTIME_ID);
+	size_t next_verdict = interval_len, verdict_ref = 0;
+	Classifier::result_e result = Classifier::unknown;
+
+	for (bool end = false; !end;) {
+		size_t n = pcm.read();
+		double const arrival = now(CLOCK_MONOTONIC);
+		double const cpu = now(CLOCK_PROCESS_CPUTIME_ID);
+		end = n == 0;
+
+		credit += budget_per_sample * n;
+		clusters.set_reclustering(credit > 0.0 || end);
+
+		if (n) {
+			if (window_n + n > window_size) {
+				size_t const drop = window_n + n - window_len;
+				memmove(window, window + drop,
+						(window_n - drop) * sizeof(data_raw_t));
+				origin += drop;
+				window_n -= drop;
+			}
+			memcpy(window + window_n, pcm.get_block(), n * sizeof(data_raw_t));
+			window_n += n;
+
+			clusters.push(pcm.get_block(), n);
+		}
+
+		size_t const m = end ? energy.flush() : energy.push(pcm.get_block(), n);
+		clusters.push_energy(energy.get_block(), m);
+
+		trig.push(energy.get_block(), m);
+		clusters.add(trig.get_events());
+
+		if ((pcm.size() >= next_verdict && credit > 0.0) || end) {
+			size_t c[3];
+			result = classify_window(window, origin, window_n, clusters, c);
+
+			double const t = now(CLOCK_PROCESS_CPUTIME_ID);
+			// no samples since the previous verdict, eg. the final one right
+			// after a periodic one, leave no interval to load
+			char load[32] = "";
+			if (pcm.size() > verdict_ref) {
+				snprintf(load, sizeof(load), ", cpu %.0f %%",
+						100.0 * (t - cpu_ref) * sample_freq
+								/ (pcm.size() - verdict_ref));
+			}
+			printf("live verdict at %.1f s: %i (%s), %lu S1 / %lu S2 / %lu EV events, "
+					"latency %.3f s%s%s\n",
+					pcm.size() / sample_freq, result,
+					result == Classifier::normal ? "normal" :
+					result == Classifier::abnormal ? "abnormal" : "unknown",
+					c[0], c[1], c[2], now(CLOCK_MONOTONIC) - arrival, load,
+					end ? ", final" :
+					pcm.size() > next_verdict + block_len ? ", late" : "");
+
+			cpu_ref = t;
+			verdict_ref = pcm.size();
+			while (next_verdict <= pcm.size()) {
+				next_verdict += interval_len;
+			}
+		}
+
+		credit -= now(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+		if (credit > max_credit) {
+			credit = max_credit;
+		}
+	}
+
+	{
+#define RESULT_CASE(_a) case _a: printf(" (" #_a ")\n"); break;
+		printf("verdict: %i", result);
+		switch (result) {
+		RESULT_CASE(Classifier::unknown)
+		RESULT_CASE(Classifier::normal)
+		RESULT_CASE(Classifier::abnormal)
+		}
+#undef RESULT_CASE
+	}
+
+	mm_free(window);
+	if (fd != STDIN_FILENO) {
+		close(fd);
+	}
+	return 0;
+}
@@ -0,0 +1,18 @@
+/**
+ * tftrig_live.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_TFTRIG_LIVE_H_
+#define SRC_TFTRIG_LIVE_H_
+
+static double constexpr live_block_length = 0.5; // seconds
+static double constexpr live_cpu_budget = 0.5; // fraction of block length
+static double constexpr live_window_length = 30.0; // seconds
+
+int live(char const *convolution_kernel, char const *source,
+		double const &interval);
+
+#endif /* SRC_TFTRIG_LIVE_H_ */
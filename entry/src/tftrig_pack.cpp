@@ -0,0 +1,166 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * tftrig_pack.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ *
+ * Pack records into a corpus file for batch runs, see Signal::Corpus and
+ * tftrig_final -b
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+
+#include "macro.h"
+
+#include "Simplified/PhysionetChallenge2016.h"
+#include "Simplified/ZipArchive.h"
+#include "Simplified/Corpus.h"
+#include "Simplified/WavFile.h"
+#include "Simplified/Prefetch.h"
+#include "tftrig_batch.h"
+
+static size_t constexpr pack_prefetch = 8; // Wav files read ahead
+static size_t constexpr no_prefetch = static_cast<size_t>(-1);
+
+/**
+ * Load a record of the list
+ *
+ * @param Job, see read_record_list()
+ * @param Archive or corpus of the records, if any
+ * @param Read ahead of the Wav files, if any
+ * @param Index of the Wav file of the job in the read ahead, or no_prefetch
+ * @return Record, delete after use
+ */
+static Signal::PhysionetChallenge2016 *load_job(struct batch_job const &job,
+		struct record_source const &source, Signal::Prefetch *prefetch,
+		size_t const &file) {
+	if (source.corpus) {
+		return new Signal::PhysionetChallenge2016(*source.corpus, job.member);
+	}
+	if (source.zip) {
+		return new Signal::PhysionetChallenge2016(*source.zip, job.member);
+	}
+	if (prefetch && file != no_prefetch) {
+		void const *image;
+		size_t len;
+		if (prefetch->acquire(file, &image, &len) == 0) {
+			Signal::PhysionetChallenge2016 *dat;
+			try {
+				Signal::WavFile const wav(image, len);
+				dat = new Signal::PhysionetChallenge2016(wav);
+			} catch (int e) {
+				prefetch->release(file);
+				throw;
+			}
+			prefetch->release(file);
+			return dat;
+		}
+		prefetch->release(file); // fails again below, with the usual error
+	}
+	return new Signal::PhysionetChallenge2016(job.name.c_str());
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		fprintf(stderr,
+				"[%s:%u] usage: %s <corpus.tfc> <record list, directory, .zip or .tfc>\n",
+				__FILE__, __LINE__, argv[0]);
+		exit (EXIT_FAILURE);
+	}
+	char const *list = argv[2];
+
+	size_t failed = 0, samples = 0;
+	std::vector<batch_job> jobs;
+	struct record_source source;
+	Signal::Prefetch *prefetch = 0;
+	double const t0 = stage_clock();
+	try {
+		read_record_list(list, &jobs, &source);
+		Signal::CorpusWriter corpus(argv[1]);
+
+		// read the Wav files ahead while the records are converted and written
+		std::vector<size_t> prefetch_file(jobs.size(), no_prefetch);
+		if (source.zip == 0 && source.corpus == 0) {
+			std::vector<std::string> files;
+			for (size_t i = 0; i < jobs.size(); ++i) {
+				std::string const filename = jobs[i].name + ".wav";
+				if (access(filename.c_str(), R_OK) == 0) {
+					prefetch_file[i] = files.size();
+					files.push_back(filename);
+				}
+			}
+			if (files.size()) {
+				prefetch = new Signal::Prefetch(files, pack_prefetch);
+			}
+		}
+
+		// the records of a directory, an archive or a corpus are named relative to it
+		std::string const prefix = std::string(list) + "/";
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			std::string name = jobs[i].name;
+			if (name.compare(0, prefix.size(), prefix) == 0) {
+				name.erase(0, prefix.size());
+			}
+
+			Signal::PhysionetChallenge2016 *dat;
+			try {
+				dat = load_job(jobs[i], source, prefetch, prefetch_file[i]);
+			} catch (int e) {
+				fprintf(stderr, "[%s:%u] %s: skipped (%s)\n", __FILE__, __LINE__,
+						jobs[i].name.c_str(), strerror(e));
+				++failed;
+				continue;
+			}
+
+			std::vector<data_raw_t const *> signals(dat->get_channels());
+			for (size_t c = 0; c < signals.size(); ++c) {
+				signals[c] = dat->get_signal(c);
+			}
+			try {
+				corpus.append(name.c_str(), &signals[0], signals.size(),
+						dat->size());
+			} catch (int e) {
+				delete dat;
+				throw;
+			}
+			samples += dat->size() * signals.size();
+			delete dat;
+		}
+		corpus.finish();
+	} catch (int e) {
+		delete prefetch;
+		free_record_source(&source);
+		exit (EXIT_FAILURE);
+	}
+	delete prefetch;
+	free_record_source(&source);
+
+	fprintf(stderr, "pack: %lu records, %lu skipped, %.1f s of signal in %.3f s\n",
+			jobs.size() - failed, failed,
+			samples / static_cast<double>(Signal::PhysionetChallenge2016::sample_freq),
+			(stage_clock() - t0) * 1e-3);
+	return failed ? EXIT_FAILURE : 0;
+}
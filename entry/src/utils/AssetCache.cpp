@@ -0,0 +1,366 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * AssetCache.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include <zlib.h>
+
+#include "macro.h"
+
+#include "AssetCache.h"
+
+namespace Utils {
+
+static char const asset_magic[8] = "TFTRIGA";
+static uint32_t constexpr asset_version = 1;
+static uint32_t constexpr asset_byte_order = 0x01020304;
+static size_t constexpr asset_align = 64; // bytes, a cache line
+
+/*
+ * An asset of the in-process memo; lives until the process exits
+ */
+struct asset_entry {
+	struct asset pub;
+	void *map; // the cache file, or
+	void *buf; // the payload built in this process
+};
+
+typedef std::unordered_map<std::string, struct asset_entry *> asset_map;
+
+static std::mutex asset_mutex; // guards the memo and the cache directory
+// never destroyed, the assets outlive the static destructors of their users
+static asset_map &asset_memo = *new asset_map();
+
+/**
+ * 64 bit FNV-1a
+ */
+static uint64_t fnv1a(uint64_t h, void const *buf, size_t len) {
+	uint8_t const *p = static_cast<uint8_t const *>(buf);
+	for (size_t i = 0; i < len; ++i) {
+		h = (h ^ p[i]) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+/**
+ * CRC-32 of a buffer of any length, zlib counts in uInt
+ */
+static uint32_t crc(uint32_t crc, void const *buf, size_t len) {
+	Bytef const *p = static_cast<Bytef const *>(buf);
+	for (size_t const chunk = 1u << 30; len;) {
+		size_t const n = len < chunk ? len : chunk;
+		crc = crc32(crc, p, n);
+		p += n;
+		len -= n;
+	}
+	return crc;
+}
+
+/**
+ * Directory of the asset files
+ *
+ * $TFTRIG_CACHE_DIR, or /tmp/tftrig-<uid> created on first use. An empty
+ * $TFTRIG_CACHE_DIR, or a directory not owned by the user, keeps the assets
+ * in memory only, as does a build with embedded assets.
+ *
+ * @return Directory, empty if there is none
+ */
+std::string const &asset_cache_dir() {
+	static std::string dir;
+	static bool done = false;
+	std::lock_guard<std::mutex> lock(asset_mutex);
+	if (done) {
+		return dir;
+	}
+	done = true;
+#ifdef TFTRIG_EMBEDDED
+	// the binary touches no files besides its input
+	return dir;
+#endif
+
+	char const *env = getenv("TFTRIG_CACHE_DIR");
+	if (env) {
+		dir = env;
+		return dir;
+	}
+
+	char path[FILENAME_MAX];
+	snprintf(path, sizeof(path), "/tmp/tftrig-%lu",
+			static_cast<unsigned long>(getuid()));
+	mkdir(path, 0700);
+	// others may not plant or swap assets in a shared /tmp
+	struct stat sb;
+	if (lstat(path, &sb) == 0 && S_ISDIR(sb.st_mode) && sb.st_uid == getuid()
+			&& (sb.st_mode & 022) == 0) {
+		dir = path;
+	}
+	return dir;
+}
+
+/**
+ * Map an asset file and check it against the key
+ *
+ * @param Filename
+ * @param Version of the producer
+ * @param Key of the asset
+ * @param Pointer to the memo entry to fill
+ * @return True if the file holds the asset
+ */
+static bool map_asset(std::string const &filename, uint32_t const &kind_version,
+		std::string const &key, struct asset_entry *e) {
+	int const fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) || static_cast<size_t>(sb.st_size) < sizeof(asset_header)) {
+		close(fd);
+		return false;
+	}
+	size_t const len = sb.st_size;
+	void *map = mmap(0, len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+
+	uint8_t const *buf = static_cast<uint8_t const *>(map);
+	struct asset_header const *h =
+			reinterpret_cast<struct asset_header const *>(buf);
+	if (memcmp(h->magic, asset_magic, sizeof(asset_magic))
+			|| h->version != asset_version || h->byte_order != asset_byte_order
+			|| h->header_crc
+					!= crc(0, h, offsetof(struct asset_header, header_crc))
+			|| h->kind_version != kind_version || h->key_len != key.size()
+			|| h->key_len > len - sizeof(asset_header)
+			|| memcmp(buf + sizeof(asset_header), key.data(), key.size())
+			|| h->payload_offset % asset_align || h->payload_offset > len
+			|| h->payload_len > len - h->payload_offset
+			|| h->payload_crc != crc(0, buf + h->payload_offset, h->payload_len)) {
+		munmap(map, len);
+		return false;
+	}
+
+	e->map = map;
+	e->pub.data = buf + h->payload_offset;
+	e->pub.len = h->payload_len;
+	return true;
+}
+
+/**
+ * Write an asset file; the file is written privately and renamed in place,
+ * so a reader never sees a partial asset. A failure only costs the cache.
+ *
+ * @param Filename
+ * @param Version of the producer
+ * @param Key of the asset
+ * @param Payload
+ */
+static void store_asset(std::string const &filename,
+		uint32_t const &kind_version, std::string const &key,
+		struct asset const &a) {
+	struct asset_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, asset_magic, sizeof(asset_magic));
+	h.version = asset_version;
+	h.byte_order = asset_byte_order;
+	h.kind_version = kind_version;
+	h.key_len = key.size();
+	h.payload_offset = (sizeof(h) + key.size() + asset_align - 1) / asset_align
+			* asset_align;
+	h.payload_len = a.len;
+	h.payload_crc = crc(0, a.data, a.len);
+	h.header_crc = crc(0, &h, offsetof(struct asset_header, header_crc));
+
+	char tmpfile[FILENAME_MAX];
+	snprintf(tmpfile, sizeof(tmpfile), "%s.%d.%lu", filename.c_str(), getpid(),
+			static_cast<unsigned long>(pthread_self()));
+	FILE *f = fopen(tmpfile, "w");
+	if (f == 0) {
+		return;
+	}
+	static uint8_t const zeros[asset_align] = { };
+	size_t const pad = h.payload_offset - sizeof(h) - key.size();
+	bool const ok = fwrite(&h, sizeof(h), 1, f) == 1
+			&& fwrite(key.data(), 1, key.size(), f) == key.size()
+			&& fwrite(zeros, 1, pad, f) == pad
+			&& fwrite(a.data, 1, a.len, f) == a.len;
+	if (fclose(f) || !ok || rename(tmpfile, filename.c_str())) {
+		unlink(tmpfile);
+	}
+}
+
+/**
+ * Get a derived asset, eg. a parsed kernel or filter coefficients
+ *
+ * An asset is named by its kind and the hash of its key, the exact inputs it
+ * is built from: the contents of the source files and the parameters. The
+ * key is stored in the file and compared, so a changed source can never meet
+ * a stale asset. The asset is built once per process: it comes from the
+ * in-process memo, else the assets compiled into the binary, else the mapped
+ * cache file, else the builder, whose result is then stored for the other
+ * processes. The builder runs under the lock of the memo, so it may not get
+ * other assets.
+ *
+ * @param Kind of the asset, eg. "Csv2kernel"
+ * @param Version of the producer, bump it when the payload changes
+ * @param Key of the asset
+ * @param Builder of the payload
+ * @return Asset, valid until the process exits, or NULL if the builder failed
+ */
+struct asset const *get_asset(char const *kind, uint32_t const &kind_version,
+		std::string const &key, asset_builder const &build) {
+	std::string const &dir = asset_cache_dir();
+
+	std::string memo_key(kind);
+	memo_key.push_back(0);
+	memo_key.append(reinterpret_cast<char const *>(&kind_version),
+			sizeof(kind_version));
+	memo_key.append(key);
+
+	std::lock_guard<std::mutex> lock(asset_mutex);
+	asset_map::const_iterator it = asset_memo.find(memo_key);
+	if (it != asset_memo.end()) {
+		return &it->second->pub;
+	}
+
+	std::string filename;
+	if (dir.size()) {
+		char name[FILENAME_MAX];
+		snprintf(name, sizeof(name), "/%s.v%u.%016llx.dat", kind, kind_version,
+				static_cast<unsigned long long>(fnv1a(0xcbf29ce484222325ull,
+						memo_key.data(), memo_key.size())));
+		filename = dir + name;
+	}
+
+	struct asset_entry *entry = new asset_entry();
+#ifdef TFTRIG_EMBEDDED
+	for (struct embedded_asset const *e = embedded_assets; e->kind; ++e) {
+		if (e->kind_version == kind_version && e->key_len == key.size()
+				&& !strcmp(e->kind, kind)
+				&& !memcmp(e->key, key.data(), key.size())) {
+			entry->pub.data = e->payload;
+			entry->pub.len = e->payload_len;
+			asset_memo[memo_key] = entry;
+			return &entry->pub;
+		}
+	}
+#endif
+	if (filename.empty() || !map_asset(filename, kind_version, key, entry)) {
+		std::string payload;
+		int err;
+		try {
+			err = build(&payload);
+		} catch (int e) {
+			delete entry;
+			throw;
+		}
+		if (err || posix_memalign(&entry->buf, asset_align,
+				payload.size() ? payload.size() : 1)) {
+			delete entry;
+			return 0;
+		}
+		memcpy(entry->buf, payload.data(), payload.size());
+		entry->pub.data = entry->buf;
+		entry->pub.len = payload.size();
+		if (filename.size()) {
+			store_asset(filename, kind_version, key, entry->pub);
+		}
+	}
+
+	asset_memo[memo_key] = entry;
+	return &entry->pub;
+}
+
+/**
+ * Visit the assets of the in-process memo, eg. to embed them
+ *
+ * The visitor runs under the lock of the memo, so it may not get assets.
+ *
+ * @param Visitor
+ */
+void for_each_asset(asset_visitor const &visit) {
+	std::lock_guard<std::mutex> lock(asset_mutex);
+	for (asset_map::const_iterator it = asset_memo.begin();
+			it != asset_memo.end(); ++it) {
+		// kind, NUL, kind_version, key; see get_asset()
+		char const *kind = it->first.c_str();
+		size_t const kind_len = strlen(kind) + 1;
+		uint32_t kind_version;
+		memcpy(&kind_version, it->first.data() + kind_len,
+				sizeof(kind_version));
+		visit(kind, kind_version,
+				it->first.substr(kind_len + sizeof(kind_version)),
+				it->second->pub);
+	}
+}
+
+/**
+ * Read a whole source file, eg. to key an asset by its contents
+ *
+ * A build with embedded assets gives the compiled in copy of a source of
+ * the same name, as given at build time, without touching the file.
+ *
+ * @param Filename
+ * @param Pointer to output the contents
+ */
+void read_source(char const *filename, std::string *content) {
+#ifdef TFTRIG_EMBEDDED
+	for (struct embedded_source const *s = embedded_sources; s->name; ++s) {
+		if (!strcmp(s->name, filename)) {
+			content->assign(reinterpret_cast<char const *>(s->data), s->len);
+			return;
+		}
+	}
+#endif
+	FILE *f = fopen(filename, "r");
+	if (f == 0) {
+		PERROR("fopen");
+	}
+	content->clear();
+	char buf[65536];
+	for (size_t n; (n = fread(buf, 1, sizeof(buf), f));) {
+		content->append(buf, n);
+	}
+	bool const failed = ferror(f);
+	fclose(f);
+	if (failed) {
+		errno = EIO;
+		PERROR("fread");
+	}
+}
+
+} /* namespace Utils */
@@ -0,0 +1,92 @@
+/**
+ * AssetCache.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_UTILS_ASSETCACHE_H_
+#define SRC_UTILS_ASSETCACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <functional>
+
+namespace Utils {
+
+/*
+ * Asset file, see get_asset()
+ *
+ *   header
+ *   key, the inputs the asset was built from
+ *   payload, aligned to asset_align bytes
+ *
+ * All the fields are in host byte order, see byte_order.
+ */
+struct asset_header {
+	char magic[8]; // "TFTRIGA\0"
+	uint32_t version; // of the file format
+	uint32_t byte_order; // 0x01020304 as written
+	uint32_t kind_version; // of the producer
+	uint32_t payload_crc;
+	uint64_t key_len;
+	uint64_t payload_offset;
+	uint64_t payload_len;
+	uint32_t reserved;
+	uint32_t header_crc; // of the header up to this field
+};
+
+struct asset {
+	void const *data; // payload, read only
+	size_t len;
+};
+
+/*
+ * Builds the payload of an asset, returns zero on success
+ */
+typedef std::function<int(std::string *payload)> asset_builder;
+
+/*
+ * Visits an asset of the memo, see for_each_asset()
+ */
+typedef std::function<
+		void(char const *kind, uint32_t const &kind_version,
+				std::string const &key, struct asset const &a)> asset_visitor;
+
+/*
+ * Source file compiled into the binary, see tftrig_embed
+ */
+struct embedded_source {
+	char const *name; // as given to read_source()
+	unsigned char const *data;
+	size_t len;
+};
+
+/*
+ * Asset compiled into the binary, see tftrig_embed
+ */
+struct embedded_asset {
+	char const *kind;
+	uint32_t kind_version;
+	unsigned char const *key;
+	size_t key_len;
+	unsigned char const *payload; // aligned like a built payload
+	size_t payload_len;
+};
+
+#ifdef TFTRIG_EMBEDDED
+// both terminated by an entry with a NULL name or kind
+extern struct embedded_source const embedded_sources[];
+extern struct embedded_asset const embedded_assets[];
+#endif
+
+struct asset const *get_asset(char const *kind, uint32_t const &kind_version,
+		std::string const &key, asset_builder const &build);
+void for_each_asset(asset_visitor const &visit);
+void read_source(char const *filename, std::string *content);
+std::string const &asset_cache_dir();
+
+} /* namespace Utils */
+
+#endif /* SRC_UTILS_ASSETCACHE_H_ */
@@ -0,0 +1,123 @@
+/**
+ *  tftrig_final - a heart sound classifier
+ *  Copyright (C) 2016 Jarno Mäkelä and Heikki Väänänen, RemoteA Ltd
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of  MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * log.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#include <cstdio>
+#include <cstdarg>
+#include <vector>
+
+#include "log.h"
+
+namespace Utils {
+
+#ifndef TFTRIG_BUILD
+static void log_stdout(void *, char const *message) {
+	fputs(message, stdout);
+}
+#endif
+
+static thread_local struct {
+	log_fn fn;
+	void *arg;
+} sink = {
+#ifdef TFTRIG_BUILD
+		0, 0 // the library is quiet unless asked
+#else
+		log_stdout, 0
+#endif
+		};
+
+/**
+ * Format a message to a log function
+ *
+ * @param Log function
+ * @param Its argument
+ * @param Format
+ * @param Format arguments
+ */
+static void log_vprintf(log_fn fn, void *arg, char const *format, va_list ap) {
+	char buf[256];
+	va_list ap2;
+	va_copy(ap2, ap);
+	int const n = vsnprintf(buf, sizeof(buf), format, ap2);
+	va_end(ap2);
+	if (n < 0) {
+		return;
+	}
+	if (static_cast<size_t>(n) < sizeof(buf)) {
+		fn(arg, buf);
+		return;
+	}
+
+	std::vector<char> long_buf(n + 1);
+	vsnprintf(&long_buf[0], long_buf.size(), format, ap);
+	fn(arg, &long_buf[0]);
+}
+
+/**
+ * Format a message like printf() and pass it to the log function of the thread
+ *
+ * @param Format
+ */
+void log_printf(char const *format, ...) {
+	if (sink.fn == 0) {
+		return;
+	}
+
+	va_list ap;
+	va_start(ap, format);
+	log_vprintf(sink.fn, sink.arg, format, ap);
+	va_end(ap);
+}
+
+/**
+ * Format an error like printf() to stderr, or in the library to the log
+ * function of the thread
+ *
+ * @param Format
+ */
+void log_error(char const *format, ...) {
+	va_list ap;
+	va_start(ap, format);
+#ifdef TFTRIG_BUILD
+	if (sink.fn) {
+		log_vprintf(sink.fn, sink.arg, format, ap);
+	}
+#else
+	vfprintf(stderr, format, ap);
+#endif
+	va_end(ap);
+}
+
+log_scope::log_scope(log_fn fn, void *arg) :
+		fn(sink.fn), arg(sink.arg) {
+	sink.fn = fn;
+	sink.arg = arg;
+}
+
+log_scope::~log_scope() {
+	sink.fn = fn;
+	sink.arg = arg;
+}
+
+} /* namespace Utils */
@@ -0,0 +1,49 @@
+/**
+ * log.h
+ *
+ * Progress output of the pipeline. The binaries print it to stdout, the
+ * library passes it to the log function of the caller, if any.
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#ifndef SRC_UTILS_LOG_H_
+#define SRC_UTILS_LOG_H_
+
+namespace Utils {
+
+/*
+ * Receives one formatted message, newline included
+ */
+typedef void (*log_fn)(void *arg, char const *message);
+
+void log_printf(char const *format, ...)
+		__attribute__((format(printf, 1, 2)));
+
+/*
+ * Errors; the binaries print them to stderr, the library passes them to the
+ * log function of the caller like log_printf()
+ */
+void log_error(char const *format, ...)
+		__attribute__((format(printf, 1, 2)));
+
+/*
+ * Routes the log_printf() of this thread to fn while in scope, NULL to drop
+ */
+class log_scope {
+public:
+	log_scope(log_fn fn, void *arg);
+	~log_scope();
+
+private:
+	log_fn fn;
+	void *arg;
+
+	log_scope(log_scope const &);
+	log_scope &operator=(log_scope const &);
+};
+
+} /* namespace Utils */
+
+#endif /* SRC_UTILS_LOG_H_ */